@@ -0,0 +1,385 @@
+#ifndef LIBACQUIRE_ACQUIRE_AF_ALG_H
+#define LIBACQUIRE_ACQUIRE_AF_ALG_H
+
+/*
+ * SHA256 and SHA512 through the Linux kernel crypto API (AF_ALG).
+ *
+ * The file is spliced through a pipe into an AF_ALG hash socket, so its
+ * pages go from the page cache to the kernel's hash driver without ever
+ * being copied into user space. The hashing itself still runs on the CPU,
+ * as system time of the polling thread, unless the kernel has an offload
+ * engine for the algorithm. Files that cannot be spliced are read and sent
+ * instead.
+ *
+ * Never chosen automatically: ask for it with
+ * `acquire_handle_set_checksum_backend(handle,
+ * ACQUIRE_BACKEND_CHECKSUM_AF_ALG)`. Where the kernel or a sandbox refuses
+ * AF_ALG sockets, verification goes through the usual backends.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "acquire_common_defs.h"
+#include "acquire_status_codes.h"
+#include "libacquire_export.h"
+
+struct acquire_handle; /* Forward declaration */
+
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+
+/**
+ * @brief Check whether the kernel hashes `algorithm` over AF_ALG here.
+ *
+ * Containers and seccomp profiles often refuse AF_ALG sockets outright.
+ *
+ * @return `1` if it does, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int acquire_af_alg_supported(enum Checksum algorithm);
+
+int _af_alg_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash);
+enum acquire_status _af_alg_verify_async_poll(struct acquire_handle *handle);
+void _af_alg_verify_async_cancel(struct acquire_handle *handle);
+
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+
+#if defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_AF_ALG) &&    \
+    LIBACQUIRE_USE_AF_ALG
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_alg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif /* !AF_ALG */
+
+struct af_alg_backend {
+  int file_fd;
+  /* Hash socket accepted for this file */
+  int op_fd;
+  /* Splice pipe; both `-1` once data goes through `buffer` instead */
+  int pipe_fd[2];
+  unsigned char *buffer;
+  size_t block_size;
+  enum Checksum algorithm;
+  char expected_hash[129];
+};
+
+static const char *af_alg_name(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_SHA256:
+    return "sha256";
+  case LIBACQUIRE_SHA512:
+    return "sha512";
+  default:
+    return NULL;
+  }
+}
+
+static void af_alg_cloexec(int fd) {
+  const int flags = fcntl(fd, F_GETFD);
+  if (flags >= 0)
+    fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+}
+
+/* A fresh hash socket for `algorithm`, or `-1` with `errno` set */
+static int af_alg_open(enum Checksum algorithm) {
+  struct sockaddr_alg sa;
+  const char *name = af_alg_name(algorithm);
+  int tfm, op, saved;
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.salg_family = AF_ALG;
+  strcpy((char *)sa.salg_type, "hash");
+  strcpy((char *)sa.salg_name, name);
+  tfm = socket(AF_ALG, SOCK_SEQPACKET, 0);
+  if (tfm < 0)
+    return -1;
+  if (bind(tfm, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+    saved = errno;
+    close(tfm);
+    errno = saved;
+    return -1;
+  }
+  /* Each accepted socket hashes on its own; the bound one is done with */
+  op = accept(tfm, NULL, 0);
+  saved = errno;
+  close(tfm);
+  if (op >= 0)
+    af_alg_cloexec(op);
+  errno = saved;
+  return op;
+}
+
+int acquire_af_alg_supported(enum Checksum algorithm) {
+  const int op = af_alg_open(algorithm);
+  if (op < 0)
+    return 0;
+  close(op);
+  return 1;
+}
+
+static void af_alg_close_pipe(struct af_alg_backend *be) {
+  if (be->pipe_fd[0] >= 0)
+    close(be->pipe_fd[0]);
+  if (be->pipe_fd[1] >= 0)
+    close(be->pipe_fd[1]);
+  be->pipe_fd[0] = be->pipe_fd[1] = -1;
+}
+
+static void cleanup_af_alg_backend(struct acquire_handle *handle) {
+  struct af_alg_backend *be;
+  if (!handle || !handle->backend_handle)
+    return;
+  be = (struct af_alg_backend *)handle->backend_handle;
+  af_alg_close_pipe(be);
+  if (be->op_fd >= 0)
+    close(be->op_fd);
+  if (be->file_fd >= 0)
+    close(be->file_fd);
+  free(be->buffer);
+  free(be);
+  handle->backend_handle = NULL;
+}
+
+/* Send all `len` bytes to the hash socket; `-1` with `errno` set */
+static int af_alg_send(struct af_alg_backend *be, const unsigned char *data,
+                       size_t len) {
+  while (len > 0) {
+    const ssize_t sent = send(be->op_fd, data, len, MSG_MORE);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    data += sent;
+    len -= (size_t)sent;
+  }
+  return 0;
+}
+
+/* Stop splicing, sending what is still in the pipe from `buffer` */
+static int af_alg_unsplice(struct af_alg_backend *be, size_t in_pipe) {
+  int rc = 0;
+  be->buffer = (unsigned char *)malloc(be->block_size);
+  if (be->buffer == NULL) {
+    errno = ENOMEM;
+    rc = -1;
+  }
+  while (rc == 0 && in_pipe > 0) {
+    const ssize_t got = read(be->pipe_fd[0], be->buffer,
+                             in_pipe < be->block_size ? in_pipe
+                                                      : be->block_size);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0 || af_alg_send(be, be->buffer, (size_t)got) != 0) {
+      rc = -1;
+      break;
+    }
+    in_pipe -= (size_t)got;
+  }
+  af_alg_close_pipe(be);
+  return rc;
+}
+
+/* Hash the next block: bytes hashed, `0` at end of file, `-1` on error */
+static ssize_t af_alg_feed(struct af_alg_backend *be) {
+  ssize_t got;
+  size_t left;
+  if (be->pipe_fd[0] >= 0) {
+    do {
+      got = splice(be->file_fd, NULL, be->pipe_fd[1], NULL, be->block_size,
+                   SPLICE_F_MOVE | SPLICE_F_MORE);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0 && errno == EINVAL) {
+      /* The file system cannot splice: read it instead */
+      if (af_alg_unsplice(be, 0) != 0)
+        return -1;
+    } else if (got <= 0) {
+      return got;
+    } else {
+      for (left = (size_t)got; left > 0;) {
+        const ssize_t sent =
+            splice(be->pipe_fd[0], NULL, be->op_fd, NULL, left,
+                   SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (sent < 0 && errno == EINTR)
+          continue;
+        if (sent < 0 && errno == EINVAL)
+          return af_alg_unsplice(be, left) == 0 ? got : -1;
+        if (sent <= 0)
+          return -1;
+        left -= (size_t)sent;
+      }
+      return got;
+    }
+  }
+  do {
+    got = read(be->file_fd, be->buffer, be->block_size);
+  } while (got < 0 && errno == EINTR);
+  if (got > 0 && af_alg_send(be, be->buffer, (size_t)got) != 0)
+    return -1;
+  return got;
+}
+
+int _af_alg_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash) {
+  struct af_alg_backend *be;
+  size_t hex_len;
+  int op;
+  if (af_alg_name(algorithm) == NULL)
+    return -1;
+  if (!handle || !filepath || !expected_hash) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  hex_len = algorithm == LIBACQUIRE_SHA512 ? 128 : 64;
+  if (strlen(expected_hash) != hex_len) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                             "Invalid hash length for %s",
+                             algorithm == LIBACQUIRE_SHA512 ? "SHA512"
+                                                            : "SHA256");
+    return -1;
+  }
+  /* Refused sockets leave the file to the other backends */
+  op = af_alg_open(algorithm);
+  if (op < 0)
+    return -1;
+  be = (struct af_alg_backend *)calloc(1, sizeof(struct af_alg_backend));
+  if (!be) {
+    close(op);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Out of memory");
+    return -1;
+  }
+  be->op_fd = op;
+  be->pipe_fd[0] = be->pipe_fd[1] = -1;
+#ifdef O_CLOEXEC
+  be->file_fd = open(filepath, O_RDONLY | O_CLOEXEC);
+#else
+  be->file_fd = open(filepath, O_RDONLY);
+#endif
+  if (be->file_fd < 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Cannot open file: %s", strerror(errno));
+    handle->backend_handle = be;
+    cleanup_af_alg_backend(handle);
+    return -1;
+  }
+  be->block_size = handle->read_buffer_size ? handle->read_buffer_size
+                                            : ACQUIRE_DEFAULT_READ_BUFFER_SIZE;
+  if (pipe(be->pipe_fd) == 0) {
+    af_alg_cloexec(be->pipe_fd[0]);
+    af_alg_cloexec(be->pipe_fd[1]);
+#ifdef F_SETPIPE_SZ
+    /* A pipe as big as a block saves splice calls; it may be capped lower */
+    fcntl(be->pipe_fd[1], F_SETPIPE_SZ, (int)be->block_size);
+#endif /* F_SETPIPE_SZ */
+  } else {
+    be->pipe_fd[0] = be->pipe_fd[1] = -1;
+    be->buffer = (unsigned char *)malloc(be->block_size);
+    if (be->buffer == NULL) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                               "Out of memory");
+      handle->backend_handle = be;
+      cleanup_af_alg_backend(handle);
+      return -1;
+    }
+  }
+  be->algorithm = algorithm;
+  memcpy(be->expected_hash, expected_hash, hex_len);
+  be->expected_hash[hex_len] = '\0';
+  handle->backend_handle = be;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  return 0;
+}
+
+enum acquire_status _af_alg_verify_async_poll(struct acquire_handle *handle) {
+  struct af_alg_backend *be;
+  size_t bytes_done = 0;
+  ssize_t got;
+  double started;
+  if (!handle || !handle->backend_handle)
+    return ACQUIRE_ERROR;
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    return handle->status;
+  be = (struct af_alg_backend *)handle->backend_handle;
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Operation cancelled");
+      cleanup_af_alg_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = af_alg_feed(be);
+    if (got <= 0)
+      break;
+    acquire_handle_add_progress(handle, (off_t)got);
+    bytes_done += (size_t)got;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "File read error: %s", strerror(errno));
+  } else {
+    unsigned char digest[64];
+    char computed_hex[129];
+    const size_t out_len = be->algorithm == LIBACQUIRE_SHA512 ? 64 : 32;
+    size_t i;
+    /* Reading the digest finishes the hash */
+    if (read(be->op_fd, digest, out_len) != (ssize_t)out_len) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "AF_ALG digest read failed: %s",
+                               strerror(errno));
+      cleanup_af_alg_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    for (i = 0; i < out_len; i++)
+      snprintf(computed_hex + 2 * i, 3, "%02x", digest[i]);
+    if (strncasecmp(computed_hex, be->expected_hash, 2 * out_len) == 0) {
+      handle->status = ACQUIRE_COMPLETE;
+    } else {
+      acquire_handle_set_error(
+          handle, ACQUIRE_ERROR_UNKNOWN, "%s mismatch: expected %s, got %s",
+          be->algorithm == LIBACQUIRE_SHA512 ? "SHA512" : "SHA256",
+          be->expected_hash, computed_hex);
+    }
+  }
+  cleanup_af_alg_backend(handle);
+  return handle->status;
+}
+
+void _af_alg_verify_async_cancel(struct acquire_handle *handle) {
+  if (handle)
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+}
+
+#endif /* defined(LIBACQUIRE_IMPLEMENTATION) &&                               \
+          defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_AF_ALG_H */
@@ -0,0 +1,618 @@
+#ifndef LIBACQUIRE_ACQUIRE_BATCH_READER_H
+#define LIBACQUIRE_ACQUIRE_BATCH_READER_H
+
+/*
+ * Reads many files at once, keeping several reads in flight across all of
+ * them so an NVMe drive sees more than one request at a time.
+ *
+ * Files are queued with `acquire_batch_reader_add` and their blocks come
+ * back from `acquire_batch_reader_next` as they complete: in order within
+ * each file, interleaved between files. On Linux the reads go through
+ * io_uring (raw system calls, no liburing), with one fixed buffer per
+ * in-flight read. Where io_uring is not built in, or the kernel refuses it
+ * (too old, `io_uring_disabled`, seccomp), the same interface falls back to
+ * one blocking `pread` at a time.
+ *
+ * Only regular files are accepted. POSIX only: elsewhere
+ * `acquire_batch_reader_create` returns `NULL`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "libacquire_export.h"
+
+#ifndef ACQUIRE_DEFAULT_IO_QUEUE_DEPTH
+#define ACQUIRE_DEFAULT_IO_QUEUE_DEPTH 64
+#endif /* !ACQUIRE_DEFAULT_IO_QUEUE_DEPTH */
+
+struct acquire_batch_reader;
+
+/* One completed read, handed out by `acquire_batch_reader_next` */
+struct acquire_batch_block {
+  /* As passed to `acquire_batch_reader_add` */
+  void *user;
+  /* Bytes at `offset`; valid until the next call on the reader */
+  const unsigned char *data;
+  size_t len;
+  off_t offset;
+  /* Set on the file's final block (which may be empty) */
+  int last;
+  /* `errno` value if the read failed; the block is then also the last */
+  int error;
+};
+
+/**
+ * @brief Create a reader keeping up to `queue_depth` reads of `block_size`
+ * bytes in flight, over at most `queue_depth` open files.
+ *
+ * @param queue_depth `0` for `ACQUIRE_DEFAULT_IO_QUEUE_DEPTH`.
+ * @param block_size `0` for `ACQUIRE_DEFAULT_READ_BUFFER_SIZE`.
+ *
+ * @return The reader, or `NULL` if out of memory or not supported here.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_batch_reader *
+acquire_batch_reader_create(unsigned int queue_depth, size_t block_size);
+
+/**
+ * @brief Wait for outstanding reads, close every file and free the reader.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_batch_reader_free(struct acquire_batch_reader *reader);
+
+/**
+ * @brief `1` if reads go through io_uring, `0` if through `pread`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_batch_reader_uses_io_uring(const struct acquire_batch_reader *reader);
+
+/**
+ * @brief `1` if `acquire_batch_reader_add` has no room for another file
+ * until `acquire_batch_reader_next` has finished one.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_batch_reader_full(const struct acquire_batch_reader *reader);
+
+/**
+ * @brief Open `path` and queue all of it for reading.
+ *
+ * @return `0` on success, or an `errno` value: `EBUSY` when full,
+ * `EINVAL` if it is not a regular file, otherwise why `open` failed.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_batch_reader_add(struct acquire_batch_reader *reader,
+                         const char *path, void *user);
+
+/**
+ * @brief Wait for the next block of any queued file.
+ *
+ * @return `1` with `*block` filled in, `0` once every queued file has been
+ * handed out in full, `-1` if the ring itself failed.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_batch_reader_next(struct acquire_batch_reader *reader,
+                          struct acquire_batch_block *block);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_BATCH_READER_IMPL_
+#define ACQUIRE_BATCH_READER_IMPL_
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+
+struct acquire_batch_reader {
+  int unused;
+};
+
+struct acquire_batch_reader *acquire_batch_reader_create(unsigned int depth,
+                                                         size_t block_size) {
+  (void)depth;
+  (void)block_size;
+  return NULL;
+}
+void acquire_batch_reader_free(struct acquire_batch_reader *reader) {
+  (void)reader;
+}
+int acquire_batch_reader_uses_io_uring(
+    const struct acquire_batch_reader *reader) {
+  (void)reader;
+  return 0;
+}
+int acquire_batch_reader_full(const struct acquire_batch_reader *reader) {
+  (void)reader;
+  return 1;
+}
+int acquire_batch_reader_add(struct acquire_batch_reader *reader,
+                             const char *path, void *user) {
+  (void)reader;
+  (void)path;
+  (void)user;
+  return ENOSYS;
+}
+int acquire_batch_reader_next(struct acquire_batch_reader *reader,
+                              struct acquire_batch_block *block) {
+  (void)reader;
+  (void)block;
+  return -1;
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "acquire_file_reader.h"
+
+#if defined(LIBACQUIRE_USE_IO_URING) && LIBACQUIRE_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define BATCH_IO_URING 1
+#endif
+
+enum batch_slot_state {
+  BATCH_SLOT_FREE,
+  BATCH_SLOT_READING,
+  BATCH_SLOT_READY,
+  BATCH_SLOT_HANDED_OUT
+};
+
+/* One buffer, and the read currently using it */
+struct batch_slot {
+  unsigned char *buffer;
+  struct iovec iov;
+  enum batch_slot_state state;
+  size_t file;
+  off_t offset;
+  size_t len;
+  int error;
+};
+
+struct batch_file {
+  int fd;
+  void *user;
+  /* Bytes to read: the size at open, less if a read came back short */
+  off_t size;
+  /* Next offset to read, and next offset to hand out */
+  off_t submit_offset, deliver_offset;
+  /* Slots reading or holding this file's blocks */
+  unsigned int in_flight;
+  /* Open and queued; cleared once its last block has been handed out */
+  int active;
+  /* Its last block (or error) is handed out: drop any blocks left over */
+  int finished;
+};
+
+struct acquire_batch_reader {
+  unsigned int depth;
+  size_t block_size;
+  struct batch_slot *slots;
+  struct batch_file *files;
+  unsigned char *buffers;
+  size_t buffers_size;
+  /* Slot handed out by the last `acquire_batch_reader_next`, or `depth` */
+  unsigned int out;
+  /* Round-robin position for choosing which file to read next */
+  unsigned int cursor;
+  unsigned int n_files;
+  unsigned int reading;
+#ifdef BATCH_IO_URING
+  int ring_fd;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  /* SQEs written but not yet passed to `io_uring_enter` */
+  unsigned int unsubmitted;
+#endif /* BATCH_IO_URING */
+};
+
+#ifdef BATCH_IO_URING
+static void batch_ring_close(struct acquire_batch_reader *r) {
+  if (r->sqes)
+    munmap(r->sqes, r->sqes_size);
+  if (r->cq_ring && r->cq_ring != r->sq_ring)
+    munmap(r->cq_ring, r->cq_ring_size);
+  if (r->sq_ring)
+    munmap(r->sq_ring, r->sq_ring_size);
+  if (r->ring_fd >= 0)
+    close(r->ring_fd);
+  r->ring_fd = -1;
+  r->sq_ring = r->cq_ring = NULL;
+  r->sqes = NULL;
+}
+
+/* Map a ring of `entries`; on any failure leave `ring_fd` at `-1` */
+static void batch_ring_open(struct acquire_batch_reader *r, unsigned entries) {
+  struct io_uring_params p;
+  unsigned char *sq, *cq;
+  memset(&p, 0, sizeof(p));
+  r->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (r->ring_fd < 0) {
+    r->ring_fd = -1;
+    return;
+  }
+  r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_ring_size > r->sq_ring_size)
+      r->sq_ring_size = r->cq_ring_size;
+    r->cq_ring_size = r->sq_ring_size;
+  }
+  r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQ_RING);
+  if (r->sq_ring == MAP_FAILED) {
+    r->sq_ring = NULL;
+    batch_ring_close(r);
+    return;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_ring = r->sq_ring;
+  } else {
+    r->cq_ring =
+        mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_CQ_RING);
+    if (r->cq_ring == MAP_FAILED) {
+      r->cq_ring = NULL;
+      batch_ring_close(r);
+      return;
+    }
+  }
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe *)mmap(NULL, r->sqes_size,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, r->ring_fd,
+                                        IORING_OFF_SQES);
+  if ((void *)r->sqes == MAP_FAILED) {
+    r->sqes = NULL;
+    batch_ring_close(r);
+    return;
+  }
+  sq = (unsigned char *)r->sq_ring;
+  cq = (unsigned char *)r->cq_ring;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+}
+
+/* Pass queued SQEs to the kernel, waiting for `wait` completions */
+static int batch_ring_enter(struct acquire_batch_reader *r, unsigned wait) {
+  for (;;) {
+    const int n = (int)syscall(__NR_io_uring_enter, r->ring_fd, r->unsubmitted,
+                               wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL,
+                               0);
+    if (n >= 0) {
+      r->unsubmitted -= (unsigned)n < r->unsubmitted ? (unsigned)n
+                                                     : r->unsubmitted;
+      return 0;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      return -1;
+  }
+}
+
+/* Move every posted completion into its slot */
+static void batch_ring_reap(struct acquire_batch_reader *r) {
+  unsigned head = *r->cq_head;
+  const unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    struct batch_slot *slot = &r->slots[cqe->user_data];
+    if (cqe->res < 0) {
+      slot->error = -cqe->res;
+      slot->len = 0;
+    } else {
+      slot->len = (size_t)cqe->res;
+    }
+    slot->state = BATCH_SLOT_READY;
+    r->reading--;
+  }
+  __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif /* BATCH_IO_URING */
+
+static void batch_file_close(struct acquire_batch_reader *r,
+                             struct batch_file *f) {
+  if (f->fd >= 0)
+    close(f->fd);
+  f->fd = -1;
+  f->active = 0;
+  r->n_files--;
+}
+
+/* Read the slot's block: queued on the ring, or right now with `pread` */
+static void batch_submit(struct acquire_batch_reader *r, unsigned int index) {
+  struct batch_slot *slot = &r->slots[index];
+  struct batch_file *f = &r->files[slot->file];
+  slot->iov.iov_base = slot->buffer;
+  slot->iov.iov_len = (size_t)(f->size - slot->offset) < r->block_size
+                          ? (size_t)(f->size - slot->offset)
+                          : r->block_size;
+  slot->error = 0;
+  slot->len = 0;
+  f->in_flight++;
+#ifdef BATCH_IO_URING
+  if (r->ring_fd >= 0) {
+    const unsigned tail = *r->sq_tail;
+    const unsigned at = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[at];
+    /* `READV` rather than `READ`: it goes back to the first io_uring */
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = f->fd;
+    sqe->off = (unsigned long long)slot->offset;
+    sqe->addr = (unsigned long long)(size_t)&slot->iov;
+    sqe->len = 1;
+    sqe->user_data = index;
+    r->sq_array[at] = at;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->unsubmitted++;
+    r->reading++;
+    slot->state = BATCH_SLOT_READING;
+    return;
+  }
+#endif /* BATCH_IO_URING */
+  for (;;) {
+    const ssize_t n =
+        pread(f->fd, slot->buffer, slot->iov.iov_len, slot->offset);
+    if (n >= 0) {
+      slot->len = (size_t)n;
+      break;
+    }
+    if (errno != EINTR) {
+      slot->error = errno;
+      break;
+    }
+  }
+  slot->state = BATCH_SLOT_READY;
+}
+
+/* Start reads into free slots, taking a block from each file in turn */
+static void batch_fill(struct acquire_batch_reader *r) {
+  unsigned int s, tried;
+  for (s = 0; s < r->depth; s++) {
+    if (r->slots[s].state != BATCH_SLOT_FREE)
+      continue;
+    for (tried = 0; tried < r->depth; tried++) {
+      struct batch_file *f = &r->files[r->cursor];
+      r->cursor = (r->cursor + 1) % r->depth;
+      if (f->active && !f->finished && f->submit_offset < f->size) {
+        r->slots[s].file = (size_t)(f - r->files);
+        r->slots[s].offset = f->submit_offset;
+        f->submit_offset += (off_t)r->block_size;
+        batch_submit(r, s);
+        break;
+      }
+    }
+    if (tried == r->depth)
+      return;
+#ifdef BATCH_IO_URING
+    /* Without a ring, read only as far ahead as is handed out */
+    if (r->ring_fd < 0)
+#endif /* BATCH_IO_URING */
+      return;
+  }
+}
+
+/* The slot is done with: free it, and the file once nothing refers to it */
+static void batch_slot_release(struct acquire_batch_reader *r,
+                               struct batch_slot *slot) {
+  struct batch_file *f = &r->files[slot->file];
+  slot->state = BATCH_SLOT_FREE;
+  if (--f->in_flight == 0 && f->finished && f->active)
+    batch_file_close(r, f);
+}
+
+struct acquire_batch_reader *acquire_batch_reader_create(unsigned int depth,
+                                                         size_t block_size) {
+  struct acquire_batch_reader *r;
+  unsigned int i;
+  if (depth == 0)
+    depth = ACQUIRE_DEFAULT_IO_QUEUE_DEPTH;
+  if (block_size == 0)
+    block_size = ACQUIRE_DEFAULT_READ_BUFFER_SIZE;
+  r = (struct acquire_batch_reader *)calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+  r->depth = depth;
+  r->block_size = block_size;
+  r->out = depth;
+#ifdef BATCH_IO_URING
+  r->ring_fd = -1;
+#endif /* BATCH_IO_URING */
+  r->slots = (struct batch_slot *)calloc(depth, sizeof(*r->slots));
+  r->files = (struct batch_file *)calloc(depth, sizeof(*r->files));
+  /* Page-aligned, and given back to the system as soon as it is freed */
+  r->buffers_size = (size_t)depth * block_size;
+  r->buffers = (unsigned char *)mmap(NULL, r->buffers_size,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (r->buffers == (unsigned char *)MAP_FAILED)
+    r->buffers = NULL;
+  if (r->slots == NULL || r->files == NULL || r->buffers == NULL) {
+    acquire_batch_reader_free(r);
+    return NULL;
+  }
+  for (i = 0; i < depth; i++) {
+    r->slots[i].buffer = r->buffers + (size_t)i * block_size;
+    r->files[i].fd = -1;
+  }
+#ifdef BATCH_IO_URING
+  batch_ring_open(r, depth);
+#endif /* BATCH_IO_URING */
+  return r;
+}
+
+void acquire_batch_reader_free(struct acquire_batch_reader *r) {
+  unsigned int i;
+  if (r == NULL)
+    return;
+#ifdef BATCH_IO_URING
+  /* The kernel may still be writing into the buffers: let it finish */
+  while (r->ring_fd >= 0 && r->reading > 0) {
+    if (batch_ring_enter(r, 1) != 0)
+      break;
+    batch_ring_reap(r);
+  }
+  batch_ring_close(r);
+#endif /* BATCH_IO_URING */
+  if (r->files)
+    for (i = 0; i < r->depth; i++)
+      if (r->files[i].active)
+        close(r->files[i].fd);
+  if (r->buffers)
+    munmap(r->buffers, r->buffers_size);
+  free(r->slots);
+  free(r->files);
+  free(r);
+}
+
+int acquire_batch_reader_uses_io_uring(const struct acquire_batch_reader *r) {
+#ifdef BATCH_IO_URING
+  return r != NULL && r->ring_fd >= 0;
+#else
+  (void)r;
+  return 0;
+#endif /* BATCH_IO_URING */
+}
+
+int acquire_batch_reader_full(const struct acquire_batch_reader *r) {
+  return r == NULL || r->n_files >= r->depth;
+}
+
+int acquire_batch_reader_add(struct acquire_batch_reader *r, const char *path,
+                             void *user) {
+  struct batch_file *f = NULL;
+  struct stat st;
+  unsigned int i;
+  int fd;
+  if (r == NULL || path == NULL)
+    return EINVAL;
+  for (i = 0; i < r->depth && f == NULL; i++)
+    if (!r->files[i].active && r->files[i].in_flight == 0)
+      f = &r->files[i];
+  if (f == NULL)
+    return EBUSY;
+#ifdef O_CLOEXEC
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+#else
+  fd = open(path, O_RDONLY);
+#endif
+  if (fd < 0)
+    return errno;
+  if (fstat(fd, &st) != 0) {
+    const int e = errno;
+    close(fd);
+    return e;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    close(fd);
+    return EINVAL;
+  }
+  memset(f, 0, sizeof(*f));
+  f->fd = fd;
+  f->user = user;
+  f->size = st.st_size;
+  f->active = 1;
+  r->n_files++;
+  return 0;
+}
+
+int acquire_batch_reader_next(struct acquire_batch_reader *r,
+                              struct acquire_batch_block *block) {
+  unsigned int i;
+  if (r == NULL || block == NULL)
+    return -1;
+  if (r->out < r->depth) {
+    batch_slot_release(r, &r->slots[r->out]);
+    r->out = r->depth;
+  }
+  for (;;) {
+    int pending = 0;
+    /* Empty files have no blocks to read, only a last one to hand out */
+    for (i = 0; i < r->depth; i++) {
+      struct batch_file *f = &r->files[i];
+      if (f->active && !f->finished && f->size == 0) {
+        memset(block, 0, sizeof(*block));
+        block->user = f->user;
+        block->last = 1;
+        f->finished = 1;
+        batch_file_close(r, f);
+        return 1;
+      }
+    }
+    for (i = 0; i < r->depth; i++) {
+      struct batch_slot *slot = &r->slots[i];
+      struct batch_file *f;
+      if (slot->state != BATCH_SLOT_READY)
+        continue;
+      f = &r->files[slot->file];
+      /* Past the end of a file that was truncated, or already failed */
+      if (f->finished || slot->offset >= f->size) {
+        batch_slot_release(r, slot);
+        continue;
+      }
+      if (slot->offset != f->deliver_offset) {
+        pending = 1;
+        continue;
+      }
+      if (!slot->error && slot->len < slot->iov.iov_len)
+        f->size = slot->offset + (off_t)slot->len; /* shrank while read */
+      block->user = f->user;
+      block->data = slot->buffer;
+      block->len = slot->len;
+      block->offset = slot->offset;
+      block->error = slot->error;
+      block->last = slot->error || slot->offset + (off_t)slot->len >= f->size;
+      f->deliver_offset += (off_t)slot->len;
+      if (block->last)
+        f->finished = 1;
+      slot->state = BATCH_SLOT_HANDED_OUT;
+      r->out = i;
+      return 1;
+    }
+    batch_fill(r);
+#ifdef BATCH_IO_URING
+    if (r->ring_fd >= 0 && (r->reading > 0 || r->unsubmitted > 0)) {
+      if (batch_ring_enter(r, r->reading > 0 ? 1 : 0) != 0)
+        return -1;
+      batch_ring_reap(r);
+      continue;
+    }
+#endif /* BATCH_IO_URING */
+    for (i = 0; i < r->depth; i++)
+      if (r->slots[i].state == BATCH_SLOT_READY)
+        pending = 1;
+    if (!pending)
+      return 0;
+  }
+}
+
+#endif /* defined(WIN32) || defined(_WIN32) || defined(__WIN32__) ||        \
+          defined(__NT__) */
+
+#endif /* !ACQUIRE_BATCH_READER_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_BATCH_READER_H */
@@ -0,0 +1,1315 @@
+#ifndef LIBACQUIRE_ACQUIRE_BLAKE3_H
+#define LIBACQUIRE_ACQUIRE_BLAKE3_H
+
+/*
+ * Bundled BLAKE3 (https://github.com/BLAKE3-team/BLAKE3-specs): a portable
+ * compression function plus NEON (4-way), AVX2 (8-way) and AVX-512 (16-way)
+ * kernels that hash whole 1 KiB chunks side by side, and a verification
+ * backend that can split large files into subtrees hashed on worker threads.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acquire_common_defs.h"
+#include "libacquire_export.h"
+
+struct acquire_handle; /* Forward declaration */
+
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+
+#define ACQUIRE_BLAKE3_OUT_LEN 32
+#define ACQUIRE_BLAKE3_BLOCK_LEN 64
+#define ACQUIRE_BLAKE3_CHUNK_LEN 1024
+#define ACQUIRE_BLAKE3_MAX_DEPTH 54
+
+#ifndef ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE
+/* Smallest share of a file worth handing to its own worker thread */
+#define ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE (4 * 1048576)
+#endif /* !ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE */
+
+/* Implementations of the many-chunks-at-once step, selected at runtime */
+enum acquire_blake3_kernel {
+  ACQUIRE_BLAKE3_KERNEL_PORTABLE, /* one chunk at a time, runs anywhere */
+  ACQUIRE_BLAKE3_KERNEL_NEON,     /* 4 chunks per pass on AArch64 */
+  ACQUIRE_BLAKE3_KERNEL_AVX2,     /* 8 chunks per pass on x86-64 */
+  ACQUIRE_BLAKE3_KERNEL_AVX512    /* 16 chunks per pass on x86-64 */
+};
+
+struct acquire_blake3_chunk_state {
+  uint32_t cv[8];
+  uint64_t chunk_counter;
+  uint8_t buf[ACQUIRE_BLAKE3_BLOCK_LEN];
+  uint8_t buf_len;
+  uint8_t blocks_compressed;
+  uint8_t flags;
+};
+
+/* Incremental hasher; treat as opaque and only use through the functions */
+struct acquire_blake3_hasher {
+  uint32_t key[8];
+  struct acquire_blake3_chunk_state chunk;
+  uint64_t base_counter; /* first chunk of the (sub)tree being hashed */
+  uint8_t cv_stack_len;
+  uint32_t cv_stack[ACQUIRE_BLAKE3_MAX_DEPTH + 1][8];
+  enum acquire_blake3_kernel kernel;
+};
+
+/**
+ * @brief Start a new BLAKE3 hash using the fastest kernel this CPU supports.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_blake3_init(struct acquire_blake3_hasher *self);
+
+/**
+ * @brief Like `acquire_blake3_init`, but force a specific kernel.
+ *
+ * Mainly useful to test and benchmark the kernels against each other. An
+ * unsupported `kernel` falls back to the portable one.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_blake3_init_with_kernel(struct acquire_blake3_hasher *self,
+                                enum acquire_blake3_kernel kernel);
+
+/**
+ * @brief Add `len` bytes of `input` to the hash.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_blake3_update(struct acquire_blake3_hasher *self, const void *input,
+                      size_t len);
+
+/**
+ * @brief Write the 32 byte digest of everything added so far to `out`.
+ *
+ * Does not modify the hasher, so more input may be added afterwards.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_blake3_final(const struct acquire_blake3_hasher *self,
+                     uint8_t out[ACQUIRE_BLAKE3_OUT_LEN]);
+
+/**
+ * @brief Report which kernel `acquire_blake3_init` selects on this machine.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_blake3_kernel
+acquire_blake3_active_kernel(void);
+
+/**
+ * @brief Check whether `kernel` was compiled in and this CPU can run it.
+ *
+ * @return `1` if the kernel can be used, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_blake3_kernel_supported(enum acquire_blake3_kernel kernel);
+
+int _blake3_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash);
+enum acquire_status _blake3_verify_async_poll(struct acquire_handle *handle);
+void _blake3_verify_async_cancel(struct acquire_handle *handle);
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+
+#if defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_BLAKE3) &&    \
+    LIBACQUIRE_USE_BLAKE3
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+#define BLAKE3_CHUNK_START 1
+#define BLAKE3_CHUNK_END 2
+#define BLAKE3_PARENT 4
+#define BLAKE3_ROOT 8
+
+/* Most chunks handed to a kernel per `acquire_blake3_update` step */
+#define BLAKE3_MAX_BATCH 64
+
+static const uint32_t BLAKE3_IV[8] = {0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U,
+                                      0xA54FF53AU, 0x510E527FU, 0x9B05688CU,
+                                      0x1F83D9ABU, 0x5BE0CD19U};
+
+/* Message word order for each of the 7 rounds */
+static const uint8_t BLAKE3_MSG_SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+/*
+ * One round of `G` over the state `v` with message words `m`. Every kernel
+ * spells out all 7 rounds so that, with a constant round number, the
+ * schedule lookups fold away and `v`/`m` can live entirely in registers.
+ */
+#define BLAKE3_ROUND(G, v, m, r)                                               \
+  do {                                                                         \
+    G(v, 0, 4, 8, 12, m[BLAKE3_MSG_SCHEDULE[r][0]],                            \
+      m[BLAKE3_MSG_SCHEDULE[r][1]]);                                           \
+    G(v, 1, 5, 9, 13, m[BLAKE3_MSG_SCHEDULE[r][2]],                            \
+      m[BLAKE3_MSG_SCHEDULE[r][3]]);                                           \
+    G(v, 2, 6, 10, 14, m[BLAKE3_MSG_SCHEDULE[r][4]],                           \
+      m[BLAKE3_MSG_SCHEDULE[r][5]]);                                           \
+    G(v, 3, 7, 11, 15, m[BLAKE3_MSG_SCHEDULE[r][6]],                           \
+      m[BLAKE3_MSG_SCHEDULE[r][7]]);                                           \
+    G(v, 0, 5, 10, 15, m[BLAKE3_MSG_SCHEDULE[r][8]],                           \
+      m[BLAKE3_MSG_SCHEDULE[r][9]]);                                           \
+    G(v, 1, 6, 11, 12, m[BLAKE3_MSG_SCHEDULE[r][10]],                          \
+      m[BLAKE3_MSG_SCHEDULE[r][11]]);                                          \
+    G(v, 2, 7, 8, 13, m[BLAKE3_MSG_SCHEDULE[r][12]],                           \
+      m[BLAKE3_MSG_SCHEDULE[r][13]]);                                          \
+    G(v, 3, 4, 9, 14, m[BLAKE3_MSG_SCHEDULE[r][14]],                           \
+      m[BLAKE3_MSG_SCHEDULE[r][15]]);                                          \
+  } while (0)
+
+#define BLAKE3_ROUNDS(G, v, m)                                                 \
+  do {                                                                         \
+    BLAKE3_ROUND(G, v, m, 0);                                                  \
+    BLAKE3_ROUND(G, v, m, 1);                                                  \
+    BLAKE3_ROUND(G, v, m, 2);                                                  \
+    BLAKE3_ROUND(G, v, m, 3);                                                  \
+    BLAKE3_ROUND(G, v, m, 4);                                                  \
+    BLAKE3_ROUND(G, v, m, 5);                                                  \
+    BLAKE3_ROUND(G, v, m, 6);                                                  \
+  } while (0)
+
+static uint32_t blake3_load32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static void blake3_store32(uint8_t *p, uint32_t w) {
+  p[0] = (uint8_t)w;
+  p[1] = (uint8_t)(w >> 8);
+  p[2] = (uint8_t)(w >> 16);
+  p[3] = (uint8_t)(w >> 24);
+}
+
+static uint32_t blake3_rotr32(uint32_t w, unsigned int c) {
+  return (w >> c) | (w << (32 - c));
+}
+
+/******************************
+ * Portable compression       *
+ ******************************/
+
+#define BLAKE3_G(s, a, b, c, d, x, y)                                          \
+  do {                                                                         \
+    s[a] = s[a] + s[b] + (x);                                                  \
+    s[d] = blake3_rotr32(s[d] ^ s[a], 16);                                     \
+    s[c] = s[c] + s[d];                                                        \
+    s[b] = blake3_rotr32(s[b] ^ s[c], 12);                                     \
+    s[a] = s[a] + s[b] + (y);                                                  \
+    s[d] = blake3_rotr32(s[d] ^ s[a], 8);                                      \
+    s[c] = s[c] + s[d];                                                        \
+    s[b] = blake3_rotr32(s[b] ^ s[c], 7);                                      \
+  } while (0)
+
+static void blake3_compress_pre(uint32_t state[16], const uint32_t cv[8],
+                                const uint8_t block[ACQUIRE_BLAKE3_BLOCK_LEN],
+                                uint8_t block_len, uint64_t counter,
+                                uint8_t flags) {
+  /* Work on locals so the compiler can keep the state in registers */
+  uint32_t m[16], v[16];
+  size_t i;
+  for (i = 0; i < 16; i++)
+    m[i] = blake3_load32(block + 4 * i);
+  for (i = 0; i < 8; i++)
+    v[i] = cv[i];
+  v[8] = BLAKE3_IV[0];
+  v[9] = BLAKE3_IV[1];
+  v[10] = BLAKE3_IV[2];
+  v[11] = BLAKE3_IV[3];
+  v[12] = (uint32_t)counter;
+  v[13] = (uint32_t)(counter >> 32);
+  v[14] = (uint32_t)block_len;
+  v[15] = (uint32_t)flags;
+  BLAKE3_ROUNDS(BLAKE3_G, v, m);
+  memcpy(state, v, sizeof(v));
+}
+
+static void blake3_compress_in_place(uint32_t cv[8],
+                                     const uint8_t block[ACQUIRE_BLAKE3_BLOCK_LEN],
+                                     uint8_t block_len, uint64_t counter,
+                                     uint8_t flags) {
+  uint32_t state[16];
+  size_t i;
+  blake3_compress_pre(state, cv, block, block_len, counter, flags);
+  for (i = 0; i < 8; i++)
+    cv[i] = state[i] ^ state[i + 8];
+}
+
+/*
+ * A batch of equal-sized inputs for the many-at-once kernels: either whole
+ * chunks (16 blocks, consecutive counters) or parent nodes (1 block holding
+ * two child CVs, counter 0). Input `i` starts at `input + i * stride`.
+ */
+struct blake3_job {
+  const uint8_t *input;
+  size_t stride;
+  size_t blocks;
+  const uint32_t *key;
+  uint64_t counter;
+  int increment_counter;
+  uint8_t flags, flags_start, flags_end;
+};
+
+static uint8_t blake3_job_block_flags(const struct blake3_job *job, size_t b) {
+  uint8_t block_flags = job->flags;
+  if (b == 0)
+    block_flags |= job->flags_start;
+  if (b + 1 == job->blocks)
+    block_flags |= job->flags_end;
+  return block_flags;
+}
+
+/* Hash input `i` of `job`, writing its 32 byte CV to `out` */
+static void blake3_hash_one_portable(const struct blake3_job *job, size_t i,
+                                     uint8_t *out) {
+  const uint8_t *input = job->input + i * job->stride;
+  const uint64_t counter = job->increment_counter ? job->counter + i : 0;
+  uint32_t cv[8];
+  size_t b;
+  memcpy(cv, job->key, sizeof(cv));
+  for (b = 0; b < job->blocks; b++)
+    blake3_compress_in_place(cv, input + b * ACQUIRE_BLAKE3_BLOCK_LEN,
+                             ACQUIRE_BLAKE3_BLOCK_LEN, counter,
+                             blake3_job_block_flags(job, b));
+  for (b = 0; b < 8; b++)
+    blake3_store32(out + 4 * b, cv[b]);
+}
+
+/*
+ * The SIMD kernels below all follow the same shape: lane `l` of every vector
+ * belongs to input `first + l` of the job, so one pass of the round function
+ * advances several independent chunks or parents. Each 64 byte block is
+ * loaded per input and transposed so that vector `w` holds message word `w`
+ * of every input.
+ */
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define LIBACQUIRE_BLAKE3_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LIBACQUIRE_BLAKE3_TARGET_AVX2
+#define LIBACQUIRE_BLAKE3_TARGET_AVX512
+#else
+#define LIBACQUIRE_BLAKE3_TARGET_AVX2 __attribute__((target("avx2")))
+#define LIBACQUIRE_BLAKE3_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+#endif /* x86-64 */
+
+#if defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN) &&                      \
+    (defined(__GNUC__) || defined(__clang__))
+#define LIBACQUIRE_BLAKE3_HAVE_NEON 1
+#include <arm_neon.h>
+#endif /* AArch64 */
+
+#ifdef LIBACQUIRE_BLAKE3_HAVE_X86
+
+/******************************
+ * AVX2: 8 chunks per pass    *
+ ******************************/
+
+#define BLAKE3_AVX2_ROTR(x, c)                                                 \
+  _mm256_or_si256(_mm256_srli_epi32((x), (c)), _mm256_slli_epi32((x), 32 - (c)))
+
+#define BLAKE3_AVX2_G(v, a, b, c, d, x, y)                                     \
+  do {                                                                         \
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), (x));                \
+    v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot16);           \
+    v[c] = _mm256_add_epi32(v[c], v[d]);                                       \
+    v[b] = _mm256_xor_si256(v[b], v[c]);                                       \
+    v[b] = BLAKE3_AVX2_ROTR(v[b], 12);                                         \
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), (y));                \
+    v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot8);            \
+    v[c] = _mm256_add_epi32(v[c], v[d]);                                       \
+    v[b] = _mm256_xor_si256(v[b], v[c]);                                       \
+    v[b] = BLAKE3_AVX2_ROTR(v[b], 7);                                          \
+  } while (0)
+
+/* `vecs[l]` holds 8 words of chunk `l`; afterwards `vecs[w]` holds word `w` */
+LIBACQUIRE_BLAKE3_TARGET_AVX2
+static void blake3_avx2_transpose(__m256i vecs[8]) {
+  __m256i t[8], q[8];
+  size_t j;
+  t[0] = _mm256_unpacklo_epi32(vecs[0], vecs[1]);
+  t[1] = _mm256_unpackhi_epi32(vecs[0], vecs[1]);
+  t[2] = _mm256_unpacklo_epi32(vecs[2], vecs[3]);
+  t[3] = _mm256_unpackhi_epi32(vecs[2], vecs[3]);
+  t[4] = _mm256_unpacklo_epi32(vecs[4], vecs[5]);
+  t[5] = _mm256_unpackhi_epi32(vecs[4], vecs[5]);
+  t[6] = _mm256_unpacklo_epi32(vecs[6], vecs[7]);
+  t[7] = _mm256_unpackhi_epi32(vecs[6], vecs[7]);
+  /* q[4g + j]: 128-bit half `k` is word `4k + j` of chunks 4g..4g+3 */
+  for (j = 0; j < 2; j++) {
+    q[4 * j + 0] = _mm256_unpacklo_epi64(t[4 * j + 0], t[4 * j + 2]);
+    q[4 * j + 1] = _mm256_unpackhi_epi64(t[4 * j + 0], t[4 * j + 2]);
+    q[4 * j + 2] = _mm256_unpacklo_epi64(t[4 * j + 1], t[4 * j + 3]);
+    q[4 * j + 3] = _mm256_unpackhi_epi64(t[4 * j + 1], t[4 * j + 3]);
+  }
+  for (j = 0; j < 4; j++) {
+    vecs[j] = _mm256_permute2x128_si256(q[j], q[4 + j], 0x20);
+    vecs[4 + j] = _mm256_permute2x128_si256(q[j], q[4 + j], 0x31);
+  }
+}
+
+LIBACQUIRE_BLAKE3_TARGET_AVX2
+static void blake3_hash8_avx2(const struct blake3_job *job, size_t first,
+                              uint8_t *out) {
+  const __m256i rot16 = _mm256_set_epi8(
+      13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 13, 12, 15, 14, 9,
+      8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+  const __m256i rot8 = _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6,
+                                       5, 0, 3, 2, 1, 12, 15, 14, 13, 8, 11,
+                                       10, 9, 4, 7, 6, 5, 0, 3, 2, 1);
+  const uint8_t *input = job->input + first * job->stride;
+  __m256i h[8], v[16], m[16], ctr_lo, ctr_hi;
+  uint32_t lo[8], hi[8], words[8][8];
+  size_t i, b;
+
+  for (i = 0; i < 8; i++) {
+    const uint64_t counter =
+        job->increment_counter ? job->counter + first + i : 0;
+    lo[i] = (uint32_t)counter;
+    hi[i] = (uint32_t)(counter >> 32);
+    h[i] = _mm256_set1_epi32((int)job->key[i]);
+  }
+  ctr_lo = _mm256_loadu_si256((const __m256i *)lo);
+  ctr_hi = _mm256_loadu_si256((const __m256i *)hi);
+
+  for (b = 0; b < job->blocks; b++) {
+    for (i = 0; i < 8; i++) {
+      const uint8_t *p = input + i * job->stride + b * 64;
+      m[i] = _mm256_loadu_si256((const __m256i *)p);
+      m[8 + i] = _mm256_loadu_si256((const __m256i *)(p + 32));
+    }
+    blake3_avx2_transpose(m);
+    blake3_avx2_transpose(m + 8);
+
+    for (i = 0; i < 8; i++)
+      v[i] = h[i];
+    v[8] = _mm256_set1_epi32((int)BLAKE3_IV[0]);
+    v[9] = _mm256_set1_epi32((int)BLAKE3_IV[1]);
+    v[10] = _mm256_set1_epi32((int)BLAKE3_IV[2]);
+    v[11] = _mm256_set1_epi32((int)BLAKE3_IV[3]);
+    v[12] = ctr_lo;
+    v[13] = ctr_hi;
+    v[14] = _mm256_set1_epi32(ACQUIRE_BLAKE3_BLOCK_LEN);
+    v[15] = _mm256_set1_epi32(blake3_job_block_flags(job, b));
+    BLAKE3_ROUNDS(BLAKE3_AVX2_G, v, m);
+    for (i = 0; i < 8; i++)
+      h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+  }
+
+  /* Transposing back turns word-per-vector into one CV per input */
+  blake3_avx2_transpose(h);
+  for (i = 0; i < 8; i++)
+    _mm256_storeu_si256((__m256i *)words[i], h[i]);
+  for (i = 0; i < 8; i++)
+    for (b = 0; b < 8; b++)
+      blake3_store32(out + 32 * i + 4 * b, words[i][b]);
+}
+
+/******************************
+ * AVX-512: 16 chunks per pass *
+ ******************************/
+
+#define BLAKE3_AVX512_G(v, a, b, c, d, x, y)                                   \
+  do {                                                                         \
+    v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), (x));                \
+    v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 16);                 \
+    v[c] = _mm512_add_epi32(v[c], v[d]);                                       \
+    v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 12);                 \
+    v[a] = _mm512_add_epi32(_mm512_add_epi32(v[a], v[b]), (y));                \
+    v[d] = _mm512_ror_epi32(_mm512_xor_si512(v[d], v[a]), 8);                  \
+    v[c] = _mm512_add_epi32(v[c], v[d]);                                       \
+    v[b] = _mm512_ror_epi32(_mm512_xor_si512(v[b], v[c]), 7);                  \
+  } while (0)
+
+/* `vecs[l]` holds the 16 words of chunk `l`; afterwards `vecs[w]` word `w` */
+LIBACQUIRE_BLAKE3_TARGET_AVX512
+static void blake3_avx512_transpose(__m512i vecs[16]) {
+  __m512i t[16], q[16], p[16];
+  size_t g, j;
+  for (g = 0; g < 8; g++) {
+    t[2 * g] = _mm512_unpacklo_epi32(vecs[2 * g], vecs[2 * g + 1]);
+    t[2 * g + 1] = _mm512_unpackhi_epi32(vecs[2 * g], vecs[2 * g + 1]);
+  }
+  /* q[4g + j]: 128-bit lane `k` is word `4k + j` of chunks 4g..4g+3 */
+  for (g = 0; g < 4; g++) {
+    q[4 * g + 0] = _mm512_unpacklo_epi64(t[4 * g + 0], t[4 * g + 2]);
+    q[4 * g + 1] = _mm512_unpackhi_epi64(t[4 * g + 0], t[4 * g + 2]);
+    q[4 * g + 2] = _mm512_unpacklo_epi64(t[4 * g + 1], t[4 * g + 3]);
+    q[4 * g + 3] = _mm512_unpackhi_epi64(t[4 * g + 1], t[4 * g + 3]);
+  }
+  /* Transpose the 4x4 grid of 128-bit lanes for each `j` */
+  for (j = 0; j < 4; j++) {
+    p[4 * j + 0] = _mm512_shuffle_i32x4(q[j], q[4 + j], 0x88);
+    p[4 * j + 1] = _mm512_shuffle_i32x4(q[j], q[4 + j], 0xDD);
+    p[4 * j + 2] = _mm512_shuffle_i32x4(q[8 + j], q[12 + j], 0x88);
+    p[4 * j + 3] = _mm512_shuffle_i32x4(q[8 + j], q[12 + j], 0xDD);
+  }
+  for (j = 0; j < 4; j++) {
+    vecs[j] = _mm512_shuffle_i32x4(p[4 * j + 0], p[4 * j + 2], 0x88);
+    vecs[4 + j] = _mm512_shuffle_i32x4(p[4 * j + 1], p[4 * j + 3], 0x88);
+    vecs[8 + j] = _mm512_shuffle_i32x4(p[4 * j + 0], p[4 * j + 2], 0xDD);
+    vecs[12 + j] = _mm512_shuffle_i32x4(p[4 * j + 1], p[4 * j + 3], 0xDD);
+  }
+}
+
+LIBACQUIRE_BLAKE3_TARGET_AVX512
+static void blake3_hash16_avx512(const struct blake3_job *job, size_t first,
+                                 uint8_t *out) {
+  const uint8_t *input = job->input + first * job->stride;
+  __m512i h[16], v[16], m[16], ctr_lo, ctr_hi;
+  uint32_t lo[16], hi[16], words[16][16];
+  size_t i, b;
+
+  for (i = 0; i < 16; i++) {
+    const uint64_t counter =
+        job->increment_counter ? job->counter + first + i : 0;
+    lo[i] = (uint32_t)counter;
+    hi[i] = (uint32_t)(counter >> 32);
+  }
+  for (i = 0; i < 8; i++)
+    h[i] = _mm512_set1_epi32((int)job->key[i]);
+  ctr_lo = _mm512_loadu_si512((const void *)lo);
+  ctr_hi = _mm512_loadu_si512((const void *)hi);
+
+  for (b = 0; b < job->blocks; b++) {
+    for (i = 0; i < 16; i++)
+      m[i] = _mm512_loadu_si512((const void *)(input + i * job->stride + b * 64));
+    blake3_avx512_transpose(m);
+
+    for (i = 0; i < 8; i++)
+      v[i] = h[i];
+    v[8] = _mm512_set1_epi32((int)BLAKE3_IV[0]);
+    v[9] = _mm512_set1_epi32((int)BLAKE3_IV[1]);
+    v[10] = _mm512_set1_epi32((int)BLAKE3_IV[2]);
+    v[11] = _mm512_set1_epi32((int)BLAKE3_IV[3]);
+    v[12] = ctr_lo;
+    v[13] = ctr_hi;
+    v[14] = _mm512_set1_epi32(ACQUIRE_BLAKE3_BLOCK_LEN);
+    v[15] = _mm512_set1_epi32(blake3_job_block_flags(job, b));
+    BLAKE3_ROUNDS(BLAKE3_AVX512_G, v, m);
+    for (i = 0; i < 8; i++)
+      h[i] = _mm512_xor_si512(v[i], v[i + 8]);
+  }
+
+  /* Pad to a square so the transpose yields one CV per input (low half) */
+  for (i = 8; i < 16; i++)
+    h[i] = _mm512_setzero_si512();
+  blake3_avx512_transpose(h);
+  for (i = 0; i < 16; i++)
+    _mm512_storeu_si512((void *)words[i], h[i]);
+  for (i = 0; i < 16; i++)
+    for (b = 0; b < 8; b++)
+      blake3_store32(out + 32 * i + 4 * b, words[i][b]);
+}
+
+static int blake3_cpu_has(enum acquire_blake3_kernel kernel) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  unsigned __int64 xcr0;
+  __cpuid(info, 1);
+  if (!((info[2] >> 27) & 1)) /* OSXSAVE: the OS manages extended state */
+    return 0;
+  xcr0 = _xgetbv(0);
+  __cpuidex(info, 7, 0);
+  if (kernel == ACQUIRE_BLAKE3_KERNEL_AVX2)
+    return (xcr0 & 0x6) == 0x6 && ((info[1] >> 5) & 1);
+  return (xcr0 & 0xE6) == 0xE6 && ((info[1] >> 16) & 1);
+#else
+  __builtin_cpu_init();
+  if (kernel == ACQUIRE_BLAKE3_KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2") != 0;
+  return __builtin_cpu_supports("avx512f") != 0;
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+}
+#endif /* LIBACQUIRE_BLAKE3_HAVE_X86 */
+
+#ifdef LIBACQUIRE_BLAKE3_HAVE_NEON
+
+/******************************
+ * NEON: 4 chunks per pass    *
+ ******************************/
+
+#define BLAKE3_NEON_G(v, a, b, c, d, x, y)                                     \
+  do {                                                                         \
+    v[a] = vaddq_u32(vaddq_u32(v[a], v[b]), (x));                              \
+    v[d] = veorq_u32(v[d], v[a]);                                              \
+    v[d] = vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(v[d])));    \
+    v[c] = vaddq_u32(v[c], v[d]);                                              \
+    v[b] = veorq_u32(v[b], v[c]);                                              \
+    v[b] = vsriq_n_u32(vshlq_n_u32(v[b], 20), v[b], 12);                       \
+    v[a] = vaddq_u32(vaddq_u32(v[a], v[b]), (y));                              \
+    v[d] = veorq_u32(v[d], v[a]);                                              \
+    v[d] = vsriq_n_u32(vshlq_n_u32(v[d], 24), v[d], 8);                        \
+    v[c] = vaddq_u32(v[c], v[d]);                                              \
+    v[b] = veorq_u32(v[b], v[c]);                                              \
+    v[b] = vsriq_n_u32(vshlq_n_u32(v[b], 25), v[b], 7);                        \
+  } while (0)
+
+static void blake3_hash4_neon(const struct blake3_job *job, size_t first,
+                              uint8_t *out) {
+  const uint8_t *input = job->input + first * job->stride;
+  uint32x4_t h[8], v[16], m[16], rows[4], ctr_lo, ctr_hi;
+  uint32x4x2_t t01, t23;
+  uint32_t lo[4], hi[4], words[8][4];
+  size_t i, b, q;
+
+  for (i = 0; i < 4; i++) {
+    const uint64_t counter =
+        job->increment_counter ? job->counter + first + i : 0;
+    lo[i] = (uint32_t)counter;
+    hi[i] = (uint32_t)(counter >> 32);
+  }
+  for (i = 0; i < 8; i++)
+    h[i] = vdupq_n_u32(job->key[i]);
+  ctr_lo = vld1q_u32(lo);
+  ctr_hi = vld1q_u32(hi);
+
+  for (b = 0; b < job->blocks; b++) {
+    for (q = 0; q < 4; q++) {
+      for (i = 0; i < 4; i++)
+        rows[i] = vreinterpretq_u32_u8(
+            vld1q_u8(input + i * job->stride + b * 64 + q * 16));
+      t01 = vtrnq_u32(rows[0], rows[1]);
+      t23 = vtrnq_u32(rows[2], rows[3]);
+      m[4 * q + 0] =
+          vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+      m[4 * q + 1] =
+          vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+      m[4 * q + 2] =
+          vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+      m[4 * q + 3] =
+          vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+    }
+
+    for (i = 0; i < 8; i++)
+      v[i] = h[i];
+    v[8] = vdupq_n_u32(BLAKE3_IV[0]);
+    v[9] = vdupq_n_u32(BLAKE3_IV[1]);
+    v[10] = vdupq_n_u32(BLAKE3_IV[2]);
+    v[11] = vdupq_n_u32(BLAKE3_IV[3]);
+    v[12] = ctr_lo;
+    v[13] = ctr_hi;
+    v[14] = vdupq_n_u32(ACQUIRE_BLAKE3_BLOCK_LEN);
+    v[15] = vdupq_n_u32(blake3_job_block_flags(job, b));
+    BLAKE3_ROUNDS(BLAKE3_NEON_G, v, m);
+    for (i = 0; i < 8; i++)
+      h[i] = veorq_u32(v[i], v[i + 8]);
+  }
+
+  for (i = 0; i < 8; i++)
+    vst1q_u32(words[i], h[i]);
+  for (i = 0; i < 4; i++)
+    for (b = 0; b < 8; b++)
+      blake3_store32(out + 32 * i + 4 * b, words[b][i]);
+}
+#endif /* LIBACQUIRE_BLAKE3_HAVE_NEON */
+
+/******************************
+ * Kernel dispatch            *
+ ******************************/
+
+int acquire_blake3_kernel_supported(enum acquire_blake3_kernel kernel) {
+  switch (kernel) {
+  case ACQUIRE_BLAKE3_KERNEL_PORTABLE:
+    return 1;
+#ifdef LIBACQUIRE_BLAKE3_HAVE_NEON
+  case ACQUIRE_BLAKE3_KERNEL_NEON:
+    return 1; /* NEON is mandatory on AArch64 */
+#endif /* LIBACQUIRE_BLAKE3_HAVE_NEON */
+#ifdef LIBACQUIRE_BLAKE3_HAVE_X86
+  case ACQUIRE_BLAKE3_KERNEL_AVX2:
+  case ACQUIRE_BLAKE3_KERNEL_AVX512:
+    return blake3_cpu_has(kernel);
+#endif /* LIBACQUIRE_BLAKE3_HAVE_X86 */
+  default:
+    return 0;
+  }
+}
+
+/* The widest kernel this CPU runs, picked by `blake3_resolve` */
+static enum acquire_blake3_kernel blake3_active_id =
+    ACQUIRE_BLAKE3_KERNEL_PORTABLE;
+static acquire_once_t blake3_active_once = ACQUIRE_ONCE_INIT;
+
+static void blake3_resolve(void) {
+  enum acquire_blake3_kernel kernel = ACQUIRE_BLAKE3_KERNEL_PORTABLE;
+  if (acquire_blake3_kernel_supported(ACQUIRE_BLAKE3_KERNEL_AVX512))
+    kernel = ACQUIRE_BLAKE3_KERNEL_AVX512;
+  else if (acquire_blake3_kernel_supported(ACQUIRE_BLAKE3_KERNEL_AVX2))
+    kernel = ACQUIRE_BLAKE3_KERNEL_AVX2;
+  else if (acquire_blake3_kernel_supported(ACQUIRE_BLAKE3_KERNEL_NEON))
+    kernel = ACQUIRE_BLAKE3_KERNEL_NEON;
+  blake3_active_id = kernel;
+}
+
+enum acquire_blake3_kernel acquire_blake3_active_kernel(void) {
+  acquire_once(&blake3_active_once, blake3_resolve);
+  return blake3_active_id;
+}
+
+/* Run inputs `0..n-1` of `job`, writing one 32 byte CV each to `out` */
+static void blake3_hash_many(enum acquire_blake3_kernel kernel,
+                             const struct blake3_job *job, size_t n,
+                             uint8_t *out) {
+  size_t i = 0;
+#ifdef LIBACQUIRE_BLAKE3_HAVE_X86
+  if (kernel == ACQUIRE_BLAKE3_KERNEL_AVX512)
+    for (; i + 16 <= n; i += 16)
+      blake3_hash16_avx512(job, i, out + 32 * i);
+  /* Every AVX-512 CPU also has AVX2, so use it for the remainder */
+  if (kernel == ACQUIRE_BLAKE3_KERNEL_AVX512 ||
+      kernel == ACQUIRE_BLAKE3_KERNEL_AVX2)
+    for (; i + 8 <= n; i += 8)
+      blake3_hash8_avx2(job, i, out + 32 * i);
+#endif /* LIBACQUIRE_BLAKE3_HAVE_X86 */
+#ifdef LIBACQUIRE_BLAKE3_HAVE_NEON
+  if (kernel == ACQUIRE_BLAKE3_KERNEL_NEON)
+    for (; i + 4 <= n; i += 4)
+      blake3_hash4_neon(job, i, out + 32 * i);
+#endif /* LIBACQUIRE_BLAKE3_HAVE_NEON */
+  (void)kernel;
+  for (; i < n; i++)
+    blake3_hash_one_portable(job, i, out + 32 * i);
+}
+
+/*
+ * CV of the `n` (a power of two) whole chunks at `input`, the first being
+ * chunk `counter`. Chunks and then each level of parents are hashed in
+ * batches, so the SIMD kernels do almost all of the work.
+ */
+static void blake3_compress_subtree(const struct acquire_blake3_hasher *self,
+                                    const uint8_t *input, size_t n,
+                                    uint64_t counter, uint32_t cv[8]) {
+  uint8_t cvs[2][BLAKE3_MAX_BATCH * ACQUIRE_BLAKE3_OUT_LEN];
+  struct blake3_job job;
+  size_t level = 0, i;
+
+  job.input = input;
+  job.stride = ACQUIRE_BLAKE3_CHUNK_LEN;
+  job.blocks = ACQUIRE_BLAKE3_CHUNK_LEN / ACQUIRE_BLAKE3_BLOCK_LEN;
+  job.key = self->key;
+  job.counter = counter;
+  job.increment_counter = 1;
+  job.flags = self->chunk.flags;
+  job.flags_start = BLAKE3_CHUNK_START;
+  job.flags_end = BLAKE3_CHUNK_END;
+  blake3_hash_many(self->kernel, &job, n, cvs[0]);
+
+  /* Adjacent CVs already form each parent's 64 byte block */
+  job.stride = ACQUIRE_BLAKE3_BLOCK_LEN;
+  job.blocks = 1;
+  job.counter = 0;
+  job.increment_counter = 0;
+  job.flags = (uint8_t)(self->chunk.flags | BLAKE3_PARENT);
+  job.flags_start = 0;
+  job.flags_end = 0;
+  for (; n > 1; n /= 2, level ^= 1) {
+    job.input = cvs[level];
+    blake3_hash_many(self->kernel, &job, n / 2, cvs[level ^ 1]);
+  }
+  for (i = 0; i < 8; i++)
+    cv[i] = blake3_load32(cvs[level] + 4 * i);
+}
+
+/******************************
+ * Chunk state and tree       *
+ ******************************/
+
+struct blake3_output {
+  uint32_t cv[8];
+  uint8_t block[ACQUIRE_BLAKE3_BLOCK_LEN];
+  uint8_t block_len;
+  uint64_t counter;
+  uint8_t flags;
+};
+
+static void blake3_chunk_init(struct acquire_blake3_chunk_state *cs,
+                              const uint32_t key[8], uint64_t counter,
+                              uint8_t flags) {
+  memcpy(cs->cv, key, sizeof(cs->cv));
+  cs->chunk_counter = counter;
+  memset(cs->buf, 0, sizeof(cs->buf));
+  cs->buf_len = 0;
+  cs->blocks_compressed = 0;
+  cs->flags = flags;
+}
+
+static size_t blake3_chunk_len(const struct acquire_blake3_chunk_state *cs) {
+  return (size_t)ACQUIRE_BLAKE3_BLOCK_LEN * cs->blocks_compressed +
+         cs->buf_len;
+}
+
+static uint8_t
+blake3_chunk_start_flag(const struct acquire_blake3_chunk_state *cs) {
+  return cs->blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0;
+}
+
+static void blake3_chunk_update(struct acquire_blake3_chunk_state *cs,
+                                const uint8_t *input, size_t len) {
+  while (len > 0) {
+    size_t take;
+    if (cs->buf_len == ACQUIRE_BLAKE3_BLOCK_LEN) {
+      blake3_compress_in_place(cs->cv, cs->buf, ACQUIRE_BLAKE3_BLOCK_LEN,
+                               cs->chunk_counter,
+                               cs->flags | blake3_chunk_start_flag(cs));
+      cs->blocks_compressed++;
+      cs->buf_len = 0;
+      memset(cs->buf, 0, sizeof(cs->buf));
+    }
+    take = ACQUIRE_BLAKE3_BLOCK_LEN - cs->buf_len;
+    if (take > len)
+      take = len;
+    memcpy(cs->buf + cs->buf_len, input, take);
+    cs->buf_len = (uint8_t)(cs->buf_len + take);
+    input += take;
+    len -= take;
+  }
+}
+
+static void blake3_chunk_output(const struct acquire_blake3_chunk_state *cs,
+                                struct blake3_output *o) {
+  memcpy(o->cv, cs->cv, sizeof(o->cv));
+  memcpy(o->block, cs->buf, sizeof(o->block));
+  o->block_len = cs->buf_len;
+  o->counter = cs->chunk_counter;
+  o->flags =
+      (uint8_t)(cs->flags | blake3_chunk_start_flag(cs) | BLAKE3_CHUNK_END);
+}
+
+static void blake3_parent_output(const uint32_t left[8],
+                                 const uint32_t right[8],
+                                 const uint32_t key[8], uint8_t flags,
+                                 struct blake3_output *o) {
+  size_t i;
+  memcpy(o->cv, key, sizeof(o->cv));
+  for (i = 0; i < 8; i++) {
+    blake3_store32(o->block + 4 * i, left[i]);
+    blake3_store32(o->block + 32 + 4 * i, right[i]);
+  }
+  o->block_len = ACQUIRE_BLAKE3_BLOCK_LEN;
+  o->counter = 0;
+  o->flags = (uint8_t)(flags | BLAKE3_PARENT);
+}
+
+static void blake3_output_cv(const struct blake3_output *o, uint32_t cv[8]) {
+  memcpy(cv, o->cv, 8 * sizeof(uint32_t));
+  blake3_compress_in_place(cv, o->block, o->block_len, o->counter, o->flags);
+}
+
+static void blake3_output_root(const struct blake3_output *o,
+                               uint8_t out[ACQUIRE_BLAKE3_OUT_LEN]) {
+  uint32_t state[16];
+  size_t i;
+  blake3_compress_pre(state, o->cv, o->block, o->block_len, 0,
+                      (uint8_t)(o->flags | BLAKE3_ROOT));
+  for (i = 0; i < 8; i++)
+    blake3_store32(out + 4 * i, state[i] ^ state[i + 8]);
+}
+
+static unsigned int blake3_popcount64(uint64_t x) {
+  unsigned int n = 0;
+  for (; x; x &= x - 1)
+    n++;
+  return n;
+}
+
+/*
+ * After `n` chunks of the (sub)tree the stack holds one entry per set bit of
+ * `n`, so merge completed siblings until it does. This runs lazily, just
+ * before more input arrives, so the newest CV stays unmerged and is still
+ * available if it turns out to be the root.
+ */
+static void blake3_merge_cv_stack(struct acquire_blake3_hasher *self,
+                                  uint64_t chunk_counter) {
+  const unsigned int post_merge =
+      blake3_popcount64(chunk_counter - self->base_counter);
+  struct blake3_output o;
+  while (self->cv_stack_len > post_merge) {
+    uint32_t *left = self->cv_stack[self->cv_stack_len - 2];
+    blake3_parent_output(left, self->cv_stack[self->cv_stack_len - 1],
+                         self->key, self->chunk.flags, &o);
+    blake3_output_cv(&o, left);
+    self->cv_stack_len--;
+  }
+}
+
+/* Add the CV of the subtree starting at chunk `chunk_counter` */
+static void blake3_push_cv(struct acquire_blake3_hasher *self,
+                           const uint32_t cv[8], uint64_t chunk_counter) {
+  blake3_merge_cv_stack(self, chunk_counter);
+  memcpy(self->cv_stack[self->cv_stack_len], cv, 8 * sizeof(uint32_t));
+  self->cv_stack_len++;
+}
+
+/* Start hashing the subtree whose first chunk is `base_counter` */
+static void blake3_init_subtree(struct acquire_blake3_hasher *self,
+                                enum acquire_blake3_kernel kernel,
+                                uint64_t base_counter) {
+  memcpy(self->key, BLAKE3_IV, sizeof(self->key));
+  blake3_chunk_init(&self->chunk, self->key, base_counter, 0);
+  self->base_counter = base_counter;
+  self->cv_stack_len = 0;
+  self->kernel =
+      acquire_blake3_kernel_supported(kernel) ? kernel
+                                              : ACQUIRE_BLAKE3_KERNEL_PORTABLE;
+}
+
+void acquire_blake3_init_with_kernel(struct acquire_blake3_hasher *self,
+                                     enum acquire_blake3_kernel kernel) {
+  if (self)
+    blake3_init_subtree(self, kernel, 0);
+}
+
+void acquire_blake3_init(struct acquire_blake3_hasher *self) {
+  acquire_blake3_init_with_kernel(self, acquire_blake3_active_kernel());
+}
+
+/*
+ * At least one byte is always left in the chunk state, so the last chunk is
+ * never pushed: finalisation can then treat it as the right edge of the tree.
+ */
+void acquire_blake3_update(struct acquire_blake3_hasher *self,
+                           const void *input, size_t len) {
+  const uint8_t *in = (const uint8_t *)input;
+  uint32_t cv[8];
+  if (!self || !in)
+    return;
+  while (len > 0) {
+    size_t take;
+    if (blake3_chunk_len(&self->chunk) == ACQUIRE_BLAKE3_CHUNK_LEN) {
+      struct blake3_output o;
+      const uint64_t counter = self->chunk.chunk_counter;
+      blake3_chunk_output(&self->chunk, &o);
+      blake3_output_cv(&o, cv);
+      blake3_push_cv(self, cv, counter);
+      blake3_chunk_init(&self->chunk, self->key, counter + 1,
+                        self->chunk.flags);
+    }
+    if (blake3_chunk_len(&self->chunk) == 0 &&
+        len > ACQUIRE_BLAKE3_CHUNK_LEN) {
+      /*
+       * Largest power-of-two run of whole chunks that starts on a multiple
+       * of its own size, so it is exactly one complete subtree.
+       */
+      const uint64_t counter = self->chunk.chunk_counter;
+      const uint64_t offset = counter - self->base_counter;
+      size_t n = 1;
+      while (2 * n <= BLAKE3_MAX_BATCH &&
+             2 * n * ACQUIRE_BLAKE3_CHUNK_LEN < len && offset % (2 * n) == 0)
+        n *= 2;
+      blake3_compress_subtree(self, in, n, counter, cv);
+      blake3_push_cv(self, cv, counter);
+      blake3_chunk_init(&self->chunk, self->key, counter + n,
+                        self->chunk.flags);
+      in += n * ACQUIRE_BLAKE3_CHUNK_LEN;
+      len -= n * ACQUIRE_BLAKE3_CHUNK_LEN;
+      continue;
+    }
+    take = ACQUIRE_BLAKE3_CHUNK_LEN - blake3_chunk_len(&self->chunk);
+    if (take > len)
+      take = len;
+    blake3_merge_cv_stack(self, self->chunk.chunk_counter);
+    blake3_chunk_update(&self->chunk, in, take);
+    in += take;
+    len -= take;
+  }
+}
+
+/* Fold the right edge of the tree into a single output node */
+static void blake3_fold(const struct acquire_blake3_hasher *self,
+                        struct blake3_output *o) {
+  size_t i = self->cv_stack_len;
+  uint32_t cv[8];
+  blake3_chunk_output(&self->chunk, o);
+  while (i > 0) {
+    i--;
+    blake3_output_cv(o, cv);
+    blake3_parent_output(self->cv_stack[i], cv, self->key, self->chunk.flags,
+                         o);
+  }
+}
+
+void acquire_blake3_final(const struct acquire_blake3_hasher *self,
+                          uint8_t out[ACQUIRE_BLAKE3_OUT_LEN]) {
+  struct blake3_output o;
+  if (!self || !out)
+    return;
+  blake3_fold(self, &o);
+  blake3_output_root(&o, out);
+}
+
+/* CV of a complete subtree hashed with `blake3_init_subtree` (never root) */
+static void blake3_subtree_cv(const struct acquire_blake3_hasher *self,
+                              uint32_t cv[8]) {
+  struct blake3_output o;
+  blake3_fold(self, &o);
+  blake3_output_cv(&o, cv);
+}
+
+/******************************
+ * Verification backend       *
+ ******************************/
+
+struct blake3_subtree_worker;
+
+struct blake3_backend {
+  struct acquire_file_reader reader;
+  struct acquire_blake3_hasher hasher;
+  char expected_hash[2 * ACQUIRE_BLAKE3_OUT_LEN + 1];
+  /*
+   * Parallel mode only: the first `n_subtrees` equal, power-of-two sized
+   * subtrees are hashed by workers, then pushed into `hasher` in order and
+   * the remaining tail is hashed sequentially by the regular poll loop.
+   */
+  struct acquire_handle *handle;
+  struct blake3_subtree_worker *workers;
+  unsigned int n_workers;
+  uint32_t (*subtree_cvs)[8];
+  uint64_t n_subtrees, subtree_chunks;
+  volatile int stop;
+};
+
+struct blake3_subtree_worker {
+  struct blake3_backend *be;
+  acquire_thread_t thread;
+  int started, joined;
+  uint64_t first; /* subtrees `first`, `first + n_workers`, ... */
+  volatile off_t bytes_done;
+  volatile int finished;
+  int error; /* `errno` of a failed read, or `EIO` if the file shrank */
+};
+
+static void blake3_subtree_worker_run(void *arg) {
+  struct blake3_subtree_worker *w = (struct blake3_subtree_worker *)arg;
+  struct blake3_backend *be = w->be;
+  const off_t subtree_len =
+      (off_t)(be->subtree_chunks * ACQUIRE_BLAKE3_CHUNK_LEN);
+  const size_t block = be->reader.block_size;
+  struct acquire_blake3_hasher hasher;
+  /* Only unmapped files need somewhere to read into */
+  unsigned char *scratch = NULL;
+  uint64_t s;
+  off_t done = 0;
+
+  if (be->reader.map == NULL) {
+    scratch = (unsigned char *)malloc(block);
+    if (!scratch) {
+      w->error = ENOMEM;
+      acquire_atomic_store_int(&w->finished, 1);
+      return;
+    }
+  }
+  for (s = w->first; s < be->n_subtrees && !w->error; s += be->n_workers) {
+    off_t pos = (off_t)s * subtree_len;
+    const off_t end = pos + subtree_len;
+    blake3_init_subtree(&hasher, be->hasher.kernel, s * be->subtree_chunks);
+    while (pos < end) {
+      const unsigned char *data;
+      size_t got = 0;
+      const size_t want =
+          end - pos < (off_t)block ? (size_t)(end - pos) : block;
+      if (acquire_atomic_load_int(&be->stop) ||
+          acquire_atomic_load_int(&be->handle->cancel_flag)) {
+        free(scratch);
+        acquire_atomic_store_int(&w->finished, 1);
+        return;
+      }
+      w->error = acquire_file_reader_read_at(&be->reader, pos, want, scratch,
+                                             &data, &got);
+      if (!w->error && got == 0)
+        w->error = EIO;
+      if (w->error)
+        break;
+      acquire_blake3_update(&hasher, data, got);
+      pos += (off_t)got;
+      done += (off_t)got;
+      acquire_atomic_store_off(&w->bytes_done, done);
+    }
+    if (!w->error)
+      blake3_subtree_cv(&hasher, be->subtree_cvs[s]);
+  }
+  free(scratch);
+  acquire_atomic_store_int(&w->finished, 1);
+}
+
+static void blake3_join_workers(struct blake3_backend *be) {
+  unsigned int i;
+  for (i = 0; i < be->n_workers; i++)
+    if (be->workers[i].started && !be->workers[i].joined) {
+      acquire_thread_join(be->workers[i].thread);
+      be->workers[i].joined = 1;
+    }
+}
+
+static void blake3_free_workers(struct blake3_backend *be) {
+  if (be->workers) {
+    acquire_atomic_store_int(&be->stop, 1);
+    blake3_join_workers(be);
+    free(be->workers);
+    be->workers = NULL;
+  }
+  free(be->subtree_cvs);
+  be->subtree_cvs = NULL;
+  be->n_workers = 0;
+}
+
+static void cleanup_blake3_backend(struct acquire_handle *handle) {
+  struct blake3_backend *be;
+  if (!handle || !handle->backend_handle)
+    return;
+  be = (struct blake3_backend *)handle->backend_handle;
+  blake3_free_workers(be);
+  acquire_file_reader_close(&be->reader);
+  free(be);
+  handle->backend_handle = NULL;
+}
+
+/*
+ * Pick the largest power-of-two subtree such that there are at least four
+ * per thread, which keeps the sequential tail small and the workers evenly
+ * loaded. Returns 0 when workers are running, or -1 to hash sequentially.
+ */
+static int blake3_start_parallel(struct blake3_backend *be,
+                                 unsigned int threads) {
+  const off_t size = be->reader.size;
+  uint64_t chunks, subtree_chunks = 1;
+  unsigned int i;
+
+  if (size < 2 * (off_t)ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE)
+    return -1;
+  if ((off_t)threads > size / ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE)
+    threads = (unsigned int)(size / ACQUIRE_BLAKE3_PARALLEL_MIN_RANGE);
+
+  /* Leave at least one byte for the sequential tail (see update) */
+  chunks = (uint64_t)(size - 1) / ACQUIRE_BLAKE3_CHUNK_LEN;
+  while (subtree_chunks * 2 * 4 * threads <= chunks)
+    subtree_chunks *= 2;
+  be->subtree_chunks = subtree_chunks;
+  be->n_subtrees = chunks / subtree_chunks;
+
+  be->workers = (struct blake3_subtree_worker *)calloc(
+      threads, sizeof(struct blake3_subtree_worker));
+  be->subtree_cvs =
+      (uint32_t(*)[8])malloc((size_t)be->n_subtrees * sizeof(uint32_t[8]));
+  if (!be->workers || !be->subtree_cvs) {
+    blake3_free_workers(be);
+    return -1;
+  }
+  be->n_workers = threads;
+
+  for (i = 0; i < threads; i++) {
+    be->workers[i].be = be;
+    be->workers[i].first = i;
+  }
+  for (i = 0; i < threads; i++) {
+    if (acquire_thread_create(&be->workers[i].thread,
+                              blake3_subtree_worker_run,
+                              &be->workers[i]) != 0) {
+      blake3_free_workers(be);
+      be->stop = 0;
+      return -1;
+    }
+    be->workers[i].started = 1;
+  }
+  return 0;
+}
+
+/*
+ * Workers run on their own; a poll only collects progress. With no poll
+ * budget (the sync API) it blocks in join instead of spinning. Once every
+ * subtree is done their CVs join the main tree and the tail is read on.
+ */
+static enum acquire_status
+blake3_parallel_poll(struct acquire_handle *handle,
+                     struct blake3_backend *be) {
+  unsigned int i, finished = 0;
+  off_t bytes = 0, resume_at;
+  uint64_t s;
+
+  if (handle->poll_budget_bytes == 0 && handle->poll_budget_usec == 0)
+    blake3_join_workers(be);
+  for (i = 0; i < be->n_workers; i++) {
+    /* `finished` first: a worker sets it after its last progress, so a
+     * finished worker's count is then whole */
+    finished += acquire_atomic_load_int(&be->workers[i].finished) ? 1 : 0;
+    bytes += acquire_atomic_load_off(&be->workers[i].bytes_done);
+  }
+  acquire_handle_set_progress(handle, bytes);
+
+  if (acquire_atomic_load_int(&handle->cancel_flag)) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Operation cancelled");
+    cleanup_blake3_backend(handle);
+    return ACQUIRE_ERROR;
+  }
+  if (finished < be->n_workers)
+    return ACQUIRE_IN_PROGRESS;
+
+  /* Joining also makes each worker's CVs and `error` visible here */
+  blake3_join_workers(be);
+  for (i = 0; i < be->n_workers; i++)
+    if (be->workers[i].error) {
+#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
+    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
+      char error_code[256];
+      strerror_s(error_code, sizeof(error_code), be->workers[i].error);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File read error: %s", error_code);
+#else
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File read error: %s",
+                               strerror(be->workers[i].error));
+#endif
+      cleanup_blake3_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+
+  for (s = 0; s < be->n_subtrees; s++)
+    blake3_push_cv(&be->hasher, be->subtree_cvs[s], s * be->subtree_chunks);
+  blake3_chunk_init(&be->hasher.chunk, be->hasher.key,
+                    be->n_subtrees * be->subtree_chunks, 0);
+  resume_at =
+      (off_t)(be->n_subtrees * be->subtree_chunks * ACQUIRE_BLAKE3_CHUNK_LEN);
+  blake3_free_workers(be);
+  if (acquire_file_reader_seek(&be->reader, resume_at) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "File seek error");
+    cleanup_blake3_backend(handle);
+    return ACQUIRE_ERROR;
+  }
+  acquire_handle_set_progress(handle, resume_at);
+  return ACQUIRE_IN_PROGRESS;
+}
+
+int _blake3_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash) {
+  struct blake3_backend *be;
+  unsigned int threads;
+  if (algorithm != LIBACQUIRE_BLAKE3)
+    return -1;
+  if (!handle || !filepath || !expected_hash) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  if (strlen(expected_hash) != 2 * ACQUIRE_BLAKE3_OUT_LEN) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                             "Invalid hash length for BLAKE3");
+    return -1;
+  }
+  be = (struct blake3_backend *)calloc(1, sizeof(struct blake3_backend));
+  if (!be) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Out of memory");
+    return -1;
+  }
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+    free(be);
+    return -1;
+  }
+  acquire_blake3_init(&be->hasher);
+  be->handle = handle;
+  memcpy(be->expected_hash, expected_hash, 2 * ACQUIRE_BLAKE3_OUT_LEN);
+  be->expected_hash[2 * ACQUIRE_BLAKE3_OUT_LEN] = '\0';
+  handle->backend_handle = be;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  threads = handle->verify_threads == 0 ? acquire_cpu_count()
+                                        : handle->verify_threads;
+  if (threads > 1)
+    blake3_start_parallel(be, threads);
+  return 0;
+}
+
+enum acquire_status _blake3_verify_async_poll(struct acquire_handle *handle) {
+  struct blake3_backend *be;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
+  if (!handle || !handle->backend_handle)
+    return ACQUIRE_ERROR;
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    return handle->status;
+  be = (struct blake3_backend *)handle->backend_handle;
+  if (be->workers)
+    return blake3_parallel_poll(handle, be);
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Operation cancelled");
+      cleanup_blake3_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
+    acquire_blake3_update(&be->hasher, buffer, bytes_read);
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+  } else {
+    uint8_t digest[ACQUIRE_BLAKE3_OUT_LEN];
+    char computed_hex[2 * ACQUIRE_BLAKE3_OUT_LEN + 1];
+    size_t i;
+    acquire_blake3_final(&be->hasher, digest);
+    for (i = 0; i < ACQUIRE_BLAKE3_OUT_LEN; i++)
+      snprintf(computed_hex + 2 * i, 3, "%02x", digest[i]);
+    if (strncasecmp(computed_hex, be->expected_hash,
+                    2 * ACQUIRE_BLAKE3_OUT_LEN) == 0) {
+      handle->status = ACQUIRE_COMPLETE;
+    } else {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "BLAKE3 mismatch: expected %s, got %s",
+                               be->expected_hash, computed_hex);
+    }
+  }
+  cleanup_blake3_backend(handle);
+  return handle->status;
+}
+
+void _blake3_verify_async_cancel(struct acquire_handle *handle) {
+  if (handle)
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+}
+
+#endif /* defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_BLAKE3) \
+          && LIBACQUIRE_USE_BLAKE3 */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_BLAKE3_H */
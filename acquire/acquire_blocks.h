@@ -0,0 +1,997 @@
+#ifndef LIBACQUIRE_ACQUIRE_BLOCKS_H
+#define LIBACQUIRE_ACQUIRE_BLOCKS_H
+
+/*
+ * Block manifests: a digest for every fixed-size block of a file, tied
+ * together by a Merkle root.
+ *
+ * A single digest over a large file only says that something is wrong. With
+ * a digest per block, `acquire_verify_blocks` says which blocks are wrong,
+ * and `acquire_download_repair_blocks` fetches just those byte ranges again
+ * instead of the whole file.
+ *
+ * The root lets a manifest fetched from an untrusted mirror be checked
+ * against one short digest from a trusted source. Leaves are the block
+ * digests; each parent is the digest of a `0x01` byte followed by its two
+ * children's raw digests, and a node left without a partner moves up a level
+ * unchanged. The root of a file with no blocks is the digest of no data. A
+ * root is only as strong as its algorithm: a CRC32C or XXH3 tree catches
+ * damage, not tampering.
+ *
+ * On disk a manifest is text:
+ *
+ *   acquire-blocks 1
+ *   algorithm sha256
+ *   block-size 4194304
+ *   size 10485760
+ *   root <hex>
+ *   <hex digest of block 0>
+ *   <hex digest of block 1>
+ *   ...
+ *
+ * Blank lines and `#` comments are skipped.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "acquire_common_defs.h"
+#include "acquire_handle.h"
+#include "libacquire_export.h"
+
+/* Room for the longest hex digest (SHA512) and its terminator */
+#define ACQUIRE_BLOCK_HASH_SIZE 129
+
+struct acquire_block_manifest {
+  enum Checksum algorithm;
+  size_t block_size;
+  /* File size; the last block holds whatever is left over */
+  off_t size;
+  size_t count;
+  char root[ACQUIRE_BLOCK_HASH_SIZE];
+  /* `count` lowercase hex digests, `ACQUIRE_BLOCK_HASH_SIZE` bytes apart */
+  char *hashes;
+};
+
+/**
+ * @brief Hash every `block_size` bytes of `filepath` into `manifest`.
+ *
+ * Blocks are shared between `acquire_handle_set_verify_threads` threads, and
+ * hashed with the handle's checksum backend.
+ *
+ * @return `0` on success, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_block_manifest_create(struct acquire_handle *handle,
+                              struct acquire_block_manifest *manifest,
+                              const char *filepath, enum Checksum algorithm,
+                              size_t block_size);
+
+/**
+ * @brief Parse manifest `text` of `length` bytes into `manifest`.
+ *
+ * The root is recomputed from the block digests and must match the one
+ * listed, and `expected_root` too unless it is `NULL`.
+ *
+ * @return `0` on success, `-1` on error (details on the handle);
+ * `ACQUIRE_ERROR_CHECKSUM_MISMATCH` if a root does not match.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_block_manifest_parse(struct acquire_handle *handle,
+                             struct acquire_block_manifest *manifest,
+                             const char *text, size_t length,
+                             const char *expected_root);
+
+/**
+ * @brief Read and parse the manifest at `path`; see
+ * `acquire_block_manifest_parse`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_block_manifest_load(struct acquire_handle *handle,
+                            struct acquire_block_manifest *manifest,
+                            const char *path, const char *expected_root);
+
+/**
+ * @brief Write `manifest` to `path`.
+ *
+ * @return `0` on success, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_block_manifest_save(struct acquire_handle *handle,
+                            const struct acquire_block_manifest *manifest,
+                            const char *path);
+
+/**
+ * @brief Hex digest of block `index`, or `NULL` if there is no such block.
+ */
+extern LIBACQUIRE_EXPORT const char *
+acquire_block_manifest_hash(const struct acquire_block_manifest *manifest,
+                            size_t index);
+
+extern LIBACQUIRE_EXPORT void
+acquire_block_manifest_free(struct acquire_block_manifest *manifest);
+
+/**
+ * @brief Check every block of `filepath` against `manifest`.
+ *
+ * Blocks are shared between threads as by `acquire_block_manifest_create`.
+ * Blocks missing from a short file are bad, and so is the last block of a
+ * file longer than the manifest says. The first `bad_size` bad block
+ * numbers are written to `bad` in ascending order; `bad` may be `NULL` if
+ * `bad_size` is `0`.
+ *
+ * @return The number of bad blocks, which may exceed `bad_size`, or `-1` on
+ * error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_blocks(struct acquire_handle *handle, const char *filepath,
+                      const struct acquire_block_manifest *manifest,
+                      size_t *bad, size_t bad_size);
+
+/**
+ * @brief Like `acquire_verify_blocks`, but only for the `count` blocks
+ * listed in `blocks`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_block_list(struct acquire_handle *handle, const char *filepath,
+                          const struct acquire_block_manifest *manifest,
+                          const size_t *blocks, size_t count, size_t *bad,
+                          size_t bad_size);
+
+/**
+ * @brief Byte range of the next run of consecutive blocks in `blocks`,
+ * which must be in ascending order, starting at `blocks[*pos]`.
+ *
+ * `*first` and `*last` are inclusive, as in an HTTP `Range` header, and
+ * `*pos` moves past the run, so a loop visits each run once.
+ *
+ * @return `1` with a range, `0` once `*pos` reaches `count`, `-1` if a
+ * block number is out of range or out of order.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_block_range(const struct acquire_block_manifest *manifest,
+                    const size_t *blocks, size_t count, size_t *pos,
+                    off_t *first, off_t *last);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_BLOCKS_IMPL_
+#define ACQUIRE_BLOCKS_IMPL_
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_checksums.h"
+#include "acquire_file_reader.h"
+#include "acquire_multi_digest.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+/* Hex digits in a digest of `algorithm`, or `0` if it is not a digest */
+static size_t blocks_hex_length(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return 8;
+  case LIBACQUIRE_XXH3_64:
+    return 16;
+  case LIBACQUIRE_XXH128:
+    return 32;
+  case LIBACQUIRE_SHA256:
+  case LIBACQUIRE_BLAKE3:
+    return 64;
+  case LIBACQUIRE_SHA512:
+    return 128;
+  default:
+    return 0;
+  }
+}
+
+/* As `string2checksum` reads it back */
+static const char *blocks_algorithm_name(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return "crc32c";
+  case LIBACQUIRE_SHA256:
+    return "sha256";
+  case LIBACQUIRE_SHA512:
+    return "sha512";
+  case LIBACQUIRE_BLAKE3:
+    return "blake3";
+  case LIBACQUIRE_XXH3_64:
+    return "xxh3";
+  case LIBACQUIRE_XXH128:
+    return "xxh128";
+  default:
+    return "unknown";
+  }
+}
+
+static int blocks_hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = (char)tolower((unsigned char)c);
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+/* Check `hex_len` hex digits of `s` and copy them, lowercased, to `out` */
+static int blocks_copy_hex(char *out, const char *s, size_t hex_len) {
+  size_t i;
+  if (strlen(s) != hex_len)
+    return -1;
+  for (i = 0; i < hex_len; i++) {
+    if (blocks_hex_value(s[i]) < 0)
+      return -1;
+    out[i] = (char)tolower((unsigned char)s[i]);
+  }
+  out[hex_len] = '\0';
+  return 0;
+}
+
+static void blocks_unhex(unsigned char *out, const char *hex, size_t bytes) {
+  size_t i;
+  for (i = 0; i < bytes; i++)
+    out[i] = (unsigned char)(blocks_hex_value(hex[2 * i]) << 4 |
+                             blocks_hex_value(hex[2 * i + 1]));
+}
+
+/*
+ * Decimal without `long long` printf support; at most 18 digits where the
+ * type is 64 bits, 9 where it is 32, so the value never overflows.
+ */
+static int blocks_parse_off(const char *s, off_t *out) {
+  const size_t max_digits = sizeof(off_t) >= 8 ? 18 : 9;
+  size_t n = 0;
+  off_t v = 0;
+  for (; isdigit((unsigned char)s[n]); n++)
+    v = v * 10 + (s[n] - '0');
+  if (n == 0 || n > max_digits || s[n] != '\0')
+    return -1;
+  *out = v;
+  return 0;
+}
+
+static int blocks_parse_size(const char *s, size_t *out) {
+  const size_t max_digits = sizeof(size_t) >= 8 ? 18 : 9;
+  size_t n = 0, v = 0;
+  for (; isdigit((unsigned char)s[n]); n++)
+    v = v * 10 + (size_t)(s[n] - '0');
+  if (n == 0 || n > max_digits || s[n] != '\0')
+    return -1;
+  *out = v;
+  return 0;
+}
+
+static void blocks_format_off(char *buf, off_t v) {
+  char digits[24];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + (int)(v % 10));
+    v /= 10;
+  } while (v > 0);
+  while (n > 0)
+    *buf++ = digits[--n];
+  *buf = '\0';
+}
+
+static size_t blocks_count_for(off_t size, size_t block_size) {
+  return (size_t)((size + (off_t)block_size - 1) / (off_t)block_size);
+}
+
+/* Bytes in block `index` of `manifest` */
+static off_t blocks_length(const struct acquire_block_manifest *manifest,
+                           size_t index) {
+  const off_t first = (off_t)index * (off_t)manifest->block_size;
+  const off_t left = manifest->size - first;
+  return left < (off_t)manifest->block_size ? left
+                                            : (off_t)manifest->block_size;
+}
+
+/*
+ * Digest `len` bytes of `data` into `hex` with a stream on `scratch`,
+ * whose error says why if this fails.
+ */
+static int blocks_digest(struct acquire_handle *scratch,
+                         enum Checksum algorithm, const void *data, size_t len,
+                         char *hex) {
+  char placeholder[ACQUIRE_BLOCK_HASH_SIZE];
+  struct acquire_digest_spec spec;
+  struct acquire_digest_stream *stream;
+  const size_t hex_len = blocks_hex_length(algorithm);
+  memset(placeholder, '0', hex_len);
+  placeholder[hex_len] = '\0';
+  spec.algorithm = algorithm;
+  spec.expected_hash = placeholder;
+  stream = acquire_digest_stream_new(scratch, &spec, 1);
+  if (!stream)
+    return -1;
+  if (acquire_digest_stream_update(stream, data, len) != 0) {
+    acquire_digest_stream_free(stream);
+    acquire_handle_set_error(scratch, ACQUIRE_ERROR_UNKNOWN,
+                             "Hashing failed");
+    return -1;
+  }
+  acquire_digest_stream_finish(stream, scratch);
+  acquire_digest_stream_free(stream);
+  memcpy(hex, scratch->digests[0].computed_hash, hex_len + 1);
+  return 0;
+}
+
+/* Fold the block digests of `manifest` up to the Merkle root, in `root` */
+static int blocks_root(struct acquire_handle *handle,
+                       const struct acquire_block_manifest *manifest,
+                       char *root) {
+  const size_t hex_len = blocks_hex_length(manifest->algorithm);
+  const size_t bytes = hex_len / 2;
+  struct acquire_handle *scratch;
+  unsigned char *level, pair[1 + 2 * (ACQUIRE_BLOCK_HASH_SIZE / 2)];
+  char hex[ACQUIRE_BLOCK_HASH_SIZE];
+  size_t n = manifest->count, i;
+  int rc = 0;
+  scratch = acquire_handle_init();
+  level = (unsigned char *)malloc(n ? n * bytes : 1);
+  if (!scratch || !level) { /* LCOV_EXCL_START */
+    acquire_handle_free(scratch);
+    free(level);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Block manifest allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  acquire_handle_set_checksum_backend(scratch, handle->checksum_backend);
+  if (n == 0)
+    rc = blocks_digest(scratch, manifest->algorithm, "", 0, root);
+  for (i = 0; i < n; i++)
+    blocks_unhex(level + i * bytes,
+                 manifest->hashes + i * ACQUIRE_BLOCK_HASH_SIZE, bytes);
+  pair[0] = 0x01;
+  while (rc == 0 && n > 1) {
+    for (i = 0; rc == 0 && i + 1 < n; i += 2) {
+      memcpy(pair + 1, level + i * bytes, 2 * bytes);
+      rc = blocks_digest(scratch, manifest->algorithm, pair, 1 + 2 * bytes,
+                         hex);
+      blocks_unhex(level + (i / 2) * bytes, hex, bytes);
+    }
+    if (n % 2)
+      memmove(level + (n / 2) * bytes, level + (n - 1) * bytes, bytes);
+    n = (n + 1) / 2;
+  }
+  if (rc == 0 && manifest->count > 0) {
+    for (i = 0; i < bytes; i++)
+      sprintf(root + 2 * i, "%02x", level[i]);
+    root[hex_len] = '\0';
+  }
+  if (rc != 0)
+    acquire_handle_set_error(handle, acquire_handle_get_error_code(scratch),
+                             "%s", acquire_handle_get_error_string(scratch));
+  free(level);
+  acquire_handle_free(scratch);
+  return rc;
+}
+
+/*
+ * Hashing blocks: workers take the next block from a shared counter,
+ * since blocks are all the same size and there is nothing to balance. Each
+ * has its own handle for digest streams, and reads through the one
+ * `acquire_file_reader`, which is safe to share.
+ */
+struct blocks_run {
+  struct acquire_block_manifest *manifest;
+  /* Write the digests into `manifest` rather than check against them */
+  int creating;
+  struct acquire_handle *owner;
+  struct acquire_file_reader reader;
+  /* Blocks to hash, or `NULL` for all `count` of them */
+  const size_t *blocks;
+  size_t count;
+  /* Per entry of `blocks`: nonzero if that block is bad */
+  unsigned char *bad;
+  acquire_mutex_t lock;
+  size_t next;
+  int failed;
+  enum acquire_error_code error;
+  char message[256];
+};
+
+struct blocks_worker {
+  struct blocks_run *run;
+  acquire_thread_t thread;
+  int started;
+  struct acquire_handle *handle;
+  /* Only unmapped files need somewhere to read into */
+  unsigned char *scratch;
+  size_t chunk;
+};
+
+static int blocks_take(struct blocks_run *run, size_t *i) {
+  int more;
+  acquire_mutex_lock(&run->lock);
+  more = !run->failed && run->next < run->count;
+  if (more)
+    *i = run->next++;
+  acquire_mutex_unlock(&run->lock);
+  return more && !acquire_atomic_load_int(&run->owner->cancel_flag);
+}
+
+/* Keep the first worker failure, for the owner's handle */
+static void blocks_fail(struct blocks_run *run, struct acquire_handle *from) {
+  acquire_mutex_lock(&run->lock);
+  if (!run->failed) {
+    run->failed = 1;
+    run->error = acquire_handle_get_error_code(from);
+    sprintf(run->message, "%.255s", acquire_handle_get_error_string(from));
+  }
+  acquire_mutex_unlock(&run->lock);
+}
+
+/* Hash block `index`; `*bad` says whether it matched, when checking */
+static int blocks_hash(struct blocks_worker *w, size_t index, int *bad) {
+  struct blocks_run *run = w->run;
+  struct acquire_block_manifest *m = run->manifest;
+  char *slot = m->hashes + index * ACQUIRE_BLOCK_HASH_SIZE;
+  char placeholder[ACQUIRE_BLOCK_HASH_SIZE];
+  struct acquire_digest_spec spec;
+  struct acquire_digest_stream *stream;
+  const size_t hex_len = blocks_hex_length(m->algorithm);
+  off_t pos = (off_t)index * (off_t)m->block_size;
+  const off_t end = pos + blocks_length(m, index);
+  int matched;
+  memset(placeholder, '0', hex_len);
+  placeholder[hex_len] = '\0';
+  spec.algorithm = m->algorithm;
+  spec.expected_hash = run->creating ? placeholder : slot;
+  stream = acquire_digest_stream_new(w->handle, &spec, 1);
+  if (!stream)
+    return -1;
+  while (pos < end) {
+    const unsigned char *data;
+    size_t got;
+    const size_t want =
+        end - pos < (off_t)w->chunk ? (size_t)(end - pos) : w->chunk;
+    const int err = acquire_file_reader_read_at(&run->reader, pos, want,
+                                                w->scratch, &data, &got);
+    if (err != 0) {
+      acquire_digest_stream_free(stream);
+      acquire_handle_set_error(w->handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "Read failed: %s", strerror(err));
+      return -1;
+    }
+    if (got == 0)
+      break;
+    if (acquire_digest_stream_update(stream, data, got) != 0) {
+      acquire_digest_stream_free(stream);
+      acquire_handle_set_error(w->handle, ACQUIRE_ERROR_UNKNOWN,
+                               "Hashing failed");
+      return -1;
+    }
+    pos += (off_t)got;
+    acquire_handle_add_progress(run->owner, (off_t)got);
+  }
+  matched = acquire_digest_stream_finish(stream, w->handle) == 0;
+  acquire_digest_stream_free(stream);
+  if (run->creating) {
+    if (pos < end) {
+      acquire_handle_set_error(w->handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File shrank while being hashed");
+      return -1;
+    }
+    memcpy(slot, w->handle->digests[0].computed_hash, hex_len + 1);
+    return 0;
+  }
+  *bad = pos < end || !matched ||
+         (index + 1 == m->count && run->reader.size > m->size);
+  return 0;
+}
+
+static void blocks_worker_run(void *arg) {
+  struct blocks_worker *w = (struct blocks_worker *)arg;
+  struct blocks_run *run = w->run;
+  size_t i;
+  while (blocks_take(run, &i)) {
+    int bad = 0;
+    if (blocks_hash(w, run->blocks ? run->blocks[i] : i, &bad) != 0) {
+      blocks_fail(run, w->handle);
+      break;
+    }
+    run->bad[i] = (unsigned char)bad;
+  }
+}
+
+/*
+ * Hash the blocks of `run`, whose reader is open, on the threads `handle`
+ * allows; the calling thread is one of them.
+ */
+static int blocks_run_all(struct acquire_handle *handle,
+                          struct blocks_run *run) {
+  struct blocks_worker *workers;
+  unsigned int threads = handle->verify_threads, n;
+  size_t chunk = handle->read_buffer_size ? handle->read_buffer_size
+                                          : ACQUIRE_DEFAULT_READ_BUFFER_SIZE;
+  int rc = 0;
+  if (chunk > run->manifest->block_size)
+    chunk = run->manifest->block_size;
+  if (threads == 0)
+    threads = acquire_cpu_count();
+  if ((size_t)threads > run->count)
+    threads = run->count ? (unsigned int)run->count : 1;
+  run->owner = handle;
+  run->bad = (unsigned char *)calloc(run->count ? run->count : 1, 1);
+  workers =
+      (struct blocks_worker *)calloc(threads, sizeof(struct blocks_worker));
+  if (!run->bad || !workers || acquire_mutex_init(&run->lock) != 0) {
+    /* LCOV_EXCL_START */
+    free(workers);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Block worker allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  for (n = 0; n < threads; n++) {
+    struct blocks_worker *w = &workers[n];
+    w->run = run;
+    w->chunk = chunk;
+    w->handle = acquire_handle_init();
+    if (w->handle)
+      acquire_handle_set_checksum_backend(w->handle,
+                                          handle->checksum_backend);
+    if (w->handle && run->reader.map == NULL)
+      w->scratch = (unsigned char *)malloc(chunk);
+    if (!w->handle || (run->reader.map == NULL && !w->scratch)) {
+      acquire_handle_free(w->handle);
+      break;
+    }
+  }
+  if (n < threads) { /* LCOV_EXCL_START */
+    threads = n;
+    rc = -1;
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Block worker allocation failed");
+  } /* LCOV_EXCL_STOP */
+  if (rc == 0) {
+    /* Workers that fail to start leave their blocks to the others */
+    for (n = 1; n < threads; n++)
+      workers[n].started = acquire_thread_create(&workers[n].thread,
+                                                 blocks_worker_run,
+                                                 &workers[n]) == 0;
+    blocks_worker_run(&workers[0]);
+  }
+  for (n = 0; n < threads; n++) {
+    if (workers[n].started)
+      acquire_thread_join(workers[n].thread);
+    free(workers[n].scratch);
+    acquire_handle_free(workers[n].handle);
+  }
+  free(workers);
+  acquire_mutex_destroy(&run->lock);
+  if (rc != 0)
+    return -1;
+  if (run->failed) {
+    acquire_handle_set_error(handle, run->error, "%s", run->message);
+    return -1;
+  }
+  if (acquire_atomic_load_int(&handle->cancel_flag)) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Block hashing cancelled");
+    return -1;
+  }
+  return 0;
+}
+
+/* Ready `handle` for a new operation, as `acquire_manifest_verify` does */
+static void blocks_begin(struct acquire_handle *handle) {
+  handle->status = ACQUIRE_IN_PROGRESS;
+  handle->error.code = ACQUIRE_OK;
+  handle->error.message[0] = '\0';
+  handle->cancel_flag = 0;
+  acquire_handle_set_progress(handle, 0);
+}
+
+static int blocks_open(struct acquire_handle *handle,
+                       struct acquire_file_reader *reader,
+                       const char *filepath) {
+  char reason[128];
+  if (acquire_file_reader_open(reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) == 0 &&
+      reader->size >= 0)
+    return 0;
+  acquire_handle_set_error(
+      handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open %s: %s", filepath,
+      reader->opened ? "not a regular file"
+                     : acquire_file_reader_strerror(reader, reason,
+                                                    sizeof(reason)));
+  acquire_file_reader_close(reader);
+  return -1;
+}
+
+int acquire_block_manifest_create(struct acquire_handle *handle,
+                                  struct acquire_block_manifest *manifest,
+                                  const char *filepath,
+                                  enum Checksum algorithm,
+                                  size_t block_size) {
+  struct blocks_run run;
+  int rc;
+  if (!handle || !manifest || !filepath || block_size == 0 ||
+      blocks_hex_length(algorithm) == 0) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "manifest");
+    return -1;
+  }
+  memset(manifest, 0, sizeof(*manifest));
+  memset(&run, 0, sizeof(run));
+  blocks_begin(handle);
+  if (blocks_open(handle, &run.reader, filepath) != 0)
+    return -1;
+  manifest->algorithm = algorithm;
+  manifest->block_size = block_size;
+  manifest->size = run.reader.size;
+  manifest->count = blocks_count_for(manifest->size, block_size);
+  manifest->hashes = (char *)calloc(
+      manifest->count ? manifest->count : 1, ACQUIRE_BLOCK_HASH_SIZE);
+  if (!manifest->hashes) { /* LCOV_EXCL_START */
+    acquire_file_reader_close(&run.reader);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Block manifest allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  run.manifest = manifest;
+  run.creating = 1;
+  run.count = manifest->count;
+  rc = blocks_run_all(handle, &run);
+  acquire_file_reader_close(&run.reader);
+  free(run.bad);
+  if (rc == 0)
+    rc = blocks_root(handle, manifest, manifest->root);
+  if (rc != 0) {
+    acquire_block_manifest_free(manifest);
+    return -1;
+  }
+  handle->status = ACQUIRE_COMPLETE;
+  return 0;
+}
+
+/* The `key value` header lines; `-1` if `line` is none of them */
+static int blocks_parse_header(struct acquire_block_manifest *manifest,
+                               char *line, unsigned int *seen) {
+  char *value = strchr(line, ' ');
+  if (value == NULL)
+    return -1;
+  *value++ = '\0';
+  if (strcmp(line, "algorithm") == 0) {
+    manifest->algorithm = string2checksum(value);
+    *seen |= 1;
+    return blocks_hex_length(manifest->algorithm) ? 0 : -1;
+  }
+  if (strcmp(line, "block-size") == 0) {
+    *seen |= 2;
+    return blocks_parse_size(value, &manifest->block_size) == 0 &&
+                   manifest->block_size > 0
+               ? 0
+               : -1;
+  }
+  if (strcmp(line, "size") == 0) {
+    *seen |= 4;
+    return blocks_parse_off(value, &manifest->size);
+  }
+  if (strcmp(line, "root") == 0 && (*seen & 1)) {
+    *seen |= 8;
+    return blocks_copy_hex(manifest->root, value,
+                           blocks_hex_length(manifest->algorithm));
+  }
+  return -1;
+}
+
+int acquire_block_manifest_parse(struct acquire_handle *handle,
+                                 struct acquire_block_manifest *manifest,
+                                 const char *text, size_t length,
+                                 const char *expected_root) {
+  char *copy, *line, *end;
+  char root[ACQUIRE_BLOCK_HASH_SIZE];
+  unsigned int seen = 0;
+  unsigned long line_no = 0;
+  size_t digests = 0, hex_len = 0;
+  int signature = 0, malformed = 1;
+  if (!handle || !manifest || (!text && length)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "manifest");
+    return -1;
+  }
+  memset(manifest, 0, sizeof(*manifest));
+  copy = (char *)malloc(length + 1);
+  if (!copy) { /* LCOV_EXCL_START */
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Block manifest allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  if (length)
+    memcpy(copy, text, length);
+  copy[length] = '\0';
+
+  for (line = copy; line < copy + length; line = end + 1) {
+    end = (char *)memchr(line, '\n', (size_t)(copy + length - line));
+    if (end == NULL)
+      end = copy + length;
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    line_no++;
+    if (*line == '\0' || *line == '#')
+      continue;
+    if (!signature) {
+      if (strcmp(line, "acquire-blocks 1") != 0)
+        break;
+      signature = 1;
+    } else if (seen != 15) {
+      if (blocks_parse_header(manifest, line, &seen) != 0)
+        break;
+      if (seen == 15) {
+        hex_len = blocks_hex_length(manifest->algorithm);
+        manifest->count =
+            blocks_count_for(manifest->size, manifest->block_size);
+        manifest->hashes = (char *)calloc(
+            manifest->count ? manifest->count : 1, ACQUIRE_BLOCK_HASH_SIZE);
+        if (!manifest->hashes) { /* LCOV_EXCL_START */
+          free(copy);
+          acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                                   "Block manifest allocation failed");
+          return -1;
+        } /* LCOV_EXCL_STOP */
+      }
+    } else if (digests == manifest->count ||
+               blocks_copy_hex(manifest->hashes +
+                                   digests++ * ACQUIRE_BLOCK_HASH_SIZE,
+                               line, hex_len) != 0) {
+      break;
+    }
+  }
+  if (line >= copy + length)
+    malformed = 0;
+  free(copy);
+  if (malformed || !signature || seen != 15 || digests != manifest->count) {
+    acquire_block_manifest_free(manifest);
+    if (malformed)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Malformed block manifest line %lu", line_no);
+    else
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Block manifest is incomplete");
+    return -1;
+  }
+
+  if (blocks_root(handle, manifest, root) != 0) {
+    acquire_block_manifest_free(manifest);
+    return -1;
+  }
+  if (strcmp(root, manifest->root) != 0 ||
+      (expected_root && strcasecmp(expected_root, manifest->root) != 0)) {
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+        "Block manifest root %s does not match %s", manifest->root,
+        strcmp(root, manifest->root) != 0 ? "its blocks" : expected_root);
+    acquire_block_manifest_free(manifest);
+    return -1;
+  }
+  return 0;
+}
+
+int acquire_block_manifest_load(struct acquire_handle *handle,
+                                struct acquire_block_manifest *manifest,
+                                const char *path, const char *expected_root) {
+  FILE *f;
+  char *text = NULL, *grown;
+  size_t length = 0, capacity = 0, got;
+  int rc;
+  if (!handle || !manifest || !path) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "manifest");
+    return -1;
+  }
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Cannot open block manifest %s: %s", path,
+                             strerror(errno));
+    return -1;
+  }
+  do {
+    if (length == capacity) {
+      capacity = capacity ? capacity * 2 : 65536;
+      grown = (char *)realloc(text, capacity);
+      if (grown == NULL) { /* LCOV_EXCL_START */
+        free(text);
+        fclose(f);
+        acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                                 "Block manifest allocation failed");
+        return -1;
+      } /* LCOV_EXCL_STOP */
+      text = grown;
+    }
+    got = fread(text + length, 1, capacity - length, f);
+    length += got;
+  } while (got > 0);
+  if (ferror(f)) {
+    fclose(f);
+    free(text);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "Cannot read block manifest %s", path);
+    return -1;
+  }
+  fclose(f);
+  rc = acquire_block_manifest_parse(handle, manifest, text, length,
+                                    expected_root);
+  free(text);
+  return rc;
+}
+
+int acquire_block_manifest_save(struct acquire_handle *handle,
+                                const struct acquire_block_manifest *manifest,
+                                const char *path) {
+  char size[24];
+  FILE *f;
+  size_t i;
+  int failed;
+  if (!handle || !manifest || !path ||
+      (manifest->count && !manifest->hashes)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "manifest");
+    return -1;
+  }
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Cannot create block manifest %s: %s", path,
+                             strerror(errno));
+    return -1;
+  }
+  blocks_format_off(size, manifest->size);
+  fprintf(f, "acquire-blocks 1\nalgorithm %s\nblock-size %lu\nsize %s\n",
+          blocks_algorithm_name(manifest->algorithm),
+          (unsigned long)manifest->block_size, size);
+  fprintf(f, "root %s\n", manifest->root);
+  for (i = 0; i < manifest->count; i++)
+    fprintf(f, "%s\n", manifest->hashes + i * ACQUIRE_BLOCK_HASH_SIZE);
+  failed = ferror(f);
+  if (fclose(f) != 0 || failed) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot write block manifest %s", path);
+    return -1;
+  }
+  return 0;
+}
+
+const char *
+acquire_block_manifest_hash(const struct acquire_block_manifest *manifest,
+                            size_t index) {
+  if (manifest == NULL || manifest->hashes == NULL ||
+      index >= manifest->count)
+    return NULL;
+  return manifest->hashes + index * ACQUIRE_BLOCK_HASH_SIZE;
+}
+
+void acquire_block_manifest_free(struct acquire_block_manifest *manifest) {
+  if (manifest == NULL)
+    return;
+  free(manifest->hashes);
+  manifest->hashes = NULL;
+  manifest->count = 0;
+}
+
+/* Check `count` blocks: those listed in `blocks`, or all if it is `NULL` */
+static int blocks_verify(struct acquire_handle *handle, const char *filepath,
+                         const struct acquire_block_manifest *manifest,
+                         const size_t *blocks, size_t count, size_t *bad,
+                         size_t bad_size) {
+  struct blocks_run run;
+  size_t i, found = 0;
+  if (!handle || !filepath || !manifest || (bad_size && !bad) ||
+      (manifest->count && !manifest->hashes) ||
+      blocks_hex_length(manifest->algorithm) == 0) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "verification");
+    return -1;
+  }
+  for (i = 0; blocks && i < count; i++)
+    if (blocks[i] >= manifest->count) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "No block %lu in a manifest of %lu",
+                               (unsigned long)blocks[i],
+                               (unsigned long)manifest->count);
+      return -1;
+    }
+  memset(&run, 0, sizeof(run));
+  blocks_begin(handle);
+  if (blocks_open(handle, &run.reader, filepath) != 0)
+    return -1;
+  if (manifest->count == 0 && run.reader.size > 0) {
+    acquire_file_reader_close(&run.reader);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+                             "%s should be empty", filepath);
+    return -1;
+  }
+  /* Only read, as `blocks_hash` only writes digests when creating */
+  run.manifest = (struct acquire_block_manifest *)manifest;
+  run.blocks = blocks;
+  run.count = count;
+  if (blocks_run_all(handle, &run) != 0) {
+    acquire_file_reader_close(&run.reader);
+    free(run.bad);
+    return -1;
+  }
+  acquire_file_reader_close(&run.reader);
+  for (i = 0; i < count; i++)
+    if (run.bad[i]) {
+      if (found < bad_size)
+        bad[found] = blocks ? blocks[i] : i;
+      found++;
+    }
+  free(run.bad);
+  handle->status = ACQUIRE_COMPLETE;
+  return (int)found;
+}
+
+int acquire_verify_blocks(struct acquire_handle *handle, const char *filepath,
+                          const struct acquire_block_manifest *manifest,
+                          size_t *bad, size_t bad_size) {
+  return blocks_verify(handle, filepath, manifest, NULL,
+                       manifest ? manifest->count : 0, bad, bad_size);
+}
+
+int acquire_verify_block_list(struct acquire_handle *handle,
+                              const char *filepath,
+                              const struct acquire_block_manifest *manifest,
+                              const size_t *blocks, size_t count, size_t *bad,
+                              size_t bad_size) {
+  if (count && !blocks) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for block "
+                               "verification");
+    return -1;
+  }
+  return blocks_verify(handle, filepath, manifest, blocks, count, bad,
+                       bad_size);
+}
+
+int acquire_block_range(const struct acquire_block_manifest *manifest,
+                        const size_t *blocks, size_t count, size_t *pos,
+                        off_t *first, off_t *last) {
+  size_t start, end;
+  if (!manifest || !pos || !first || !last || (count && !blocks))
+    return -1;
+  if (*pos >= count)
+    return 0;
+  start = end = blocks[*pos];
+  if (start >= manifest->count)
+    return -1;
+  for ((*pos)++; *pos < count && blocks[*pos] == end + 1; (*pos)++)
+    end++;
+  if (*pos < count && blocks[*pos] <= end)
+    return -1;
+  *first = (off_t)start * (off_t)manifest->block_size;
+  *last = (off_t)end * (off_t)manifest->block_size +
+          blocks_length(manifest, end) - 1;
+  return 1;
+}
+
+#endif /* !ACQUIRE_BLOCKS_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_BLOCKS_H */
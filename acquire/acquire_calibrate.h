@@ -0,0 +1,481 @@
+#ifndef LIBACQUIRE_ACQUIRE_CALIBRATE_H
+#define LIBACQUIRE_ACQUIRE_CALIBRATE_H
+
+/*
+ * Picks the fastest checksum backend on this machine for handles set to
+ * `ACQUIRE_BACKEND_CHECKSUM_AUTO`.
+ *
+ * The first such verification of an algorithm times every backend built in
+ * for it, and later ones go straight to the fastest. Each backend verifies
+ * the same scratch file of zeros in the temporary directory, so the timing
+ * covers the whole path it takes on a real file (open, read, map or splice,
+ * and hash) with the data already in the page cache. Results are kept for
+ * the life of the process; `acquire_calibration_save` and
+ * `acquire_calibration_load` keep them across runs.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "acquire_common_defs.h"
+#include "acquire_handle.h"
+#include "libacquire_export.h"
+
+/* Bytes of the scratch file each backend verifies */
+#ifndef ACQUIRE_CALIBRATION_FILE_SIZE
+#define ACQUIRE_CALIBRATION_FILE_SIZE 4194304
+#endif /* !ACQUIRE_CALIBRATION_FILE_SIZE */
+
+/* Verifications per backend; the fastest counts */
+#ifndef ACQUIRE_CALIBRATION_RUNS
+#define ACQUIRE_CALIBRATION_RUNS 3
+#endif /* !ACQUIRE_CALIBRATION_RUNS */
+
+struct acquire_calibration {
+  enum Checksum algorithm;
+  /* Fastest backend, `ACQUIRE_BACKEND_NONE` if none could verify */
+  enum acquire_backend_type backend;
+  /* What it managed, in gigabytes (10^9 bytes) per second */
+  double gbps;
+};
+
+/**
+ * @brief Time every backend built in for `algorithm` now, replacing any
+ * earlier result.
+ *
+ * @return `0` if some backend verified the scratch file, `-1` if none did
+ * or it could not be written.
+ */
+extern LIBACQUIRE_EXPORT int acquire_calibration_run(enum Checksum algorithm);
+
+/**
+ * @brief The backend `ACQUIRE_BACKEND_CHECKSUM_AUTO` uses for `algorithm`.
+ *
+ * Never times anything itself.
+ *
+ * @return `0` with `out` filled in, or `-1` if `algorithm` has not been
+ * timed or loaded yet.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_calibration_get(enum Checksum algorithm,
+                        struct acquire_calibration *out);
+
+/**
+ * @brief Load results saved by `acquire_calibration_save`.
+ *
+ * Lines naming a backend this build cannot use for that algorithm are
+ * skipped, so a profile from another build is safe to load.
+ *
+ * @return Results loaded, or `-1` if `path` cannot be read.
+ */
+extern LIBACQUIRE_EXPORT int acquire_calibration_load(const char *path);
+
+/**
+ * @brief Write every result known so far to `path`, one line each.
+ *
+ * @return `0` on success, `-1` if `path` cannot be written.
+ */
+extern LIBACQUIRE_EXPORT int acquire_calibration_save(const char *path);
+
+/* Forget every result, so the next use times the backends again */
+extern LIBACQUIRE_EXPORT void acquire_calibration_reset(void);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_checksums.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#define calibration_getpid _getpid
+#define calibration_create(path)                                               \
+  _open((path), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,                    \
+        _S_IREAD | _S_IWRITE)
+#define calibration_write(fd, buf, n) _write((fd), (buf), (unsigned)(n))
+#define calibration_close _close
+#else
+#include <unistd.h>
+#define calibration_getpid getpid
+#define calibration_create(path) open((path), O_WRONLY | O_CREAT | O_EXCL, 0600)
+#define calibration_write write
+#define calibration_close close
+#endif
+
+/* Names the scratch file may take before calibration gives up */
+#define CALIBRATION_NAME_TRIES 100
+
+#define CALIBRATION_MAGIC "# acquire-calibration 1\n"
+
+/* Slots are indexed by `enum Checksum` */
+#define CALIBRATION_SLOTS ((size_t)LIBACQUIRE_INVALID_CHECKSUM_ALGO)
+
+struct calibration_slot {
+  int known;
+  /* Set while some thread times the backends for this slot */
+  int measuring;
+  enum acquire_backend_type backend;
+  double gbps;
+};
+
+static struct calibration_slot calibration_slots[CALIBRATION_SLOTS];
+static acquire_mutex_t calibration_lock;
+static acquire_once_t calibration_once = ACQUIRE_ONCE_INIT;
+
+static void calibration_init(void) { acquire_mutex_init(&calibration_lock); }
+
+static const struct {
+  enum acquire_backend_type backend;
+  const char *name;
+} calibration_backends[] = {{ACQUIRE_BACKEND_CHECKSUM_AF_ALG, "af_alg"},
+                            {ACQUIRE_BACKEND_CHECKSUM_LIBRHASH, "librhash"},
+                            {ACQUIRE_BACKEND_CHECKSUM_OPENSSL, "openssl"},
+                            {ACQUIRE_BACKEND_CHECKSUM_WINCRYPT, "wincrypt"},
+                            {ACQUIRE_BACKEND_CHECKSUM_SHA2, "sha2"},
+                            {ACQUIRE_BACKEND_CHECKSUM_CRC32C, "crc32c"},
+                            {ACQUIRE_BACKEND_CHECKSUM_BLAKE3, "blake3"},
+                            {ACQUIRE_BACKEND_CHECKSUM_XXHASH, "xxhash"},
+                            {ACQUIRE_BACKEND_NONE, "none"}};
+
+static const char *const calibration_algorithms[] = {
+    "crc32c", "sha256", "sha512", "blake3", "xxh3", "xxh128"};
+
+#define CALIBRATION_BACKENDS                                                   \
+  (sizeof(calibration_backends) / sizeof(calibration_backends[0]))
+
+static const char *calibration_backend_name(enum acquire_backend_type b) {
+  size_t i;
+  for (i = 0; i < CALIBRATION_BACKENDS - 1; i++)
+    if (calibration_backends[i].backend == b)
+      break;
+  return calibration_backends[i].name;
+}
+
+/* Index into `calibration_backends`, or `CALIBRATION_BACKENDS` */
+static size_t calibration_backend_named(const char *name) {
+  size_t i;
+  for (i = 0; i < CALIBRATION_BACKENDS; i++)
+    if (strcmp(name, calibration_backends[i].name) == 0)
+      break;
+  return i;
+}
+
+/* Digests of `ACQUIRE_CALIBRATION_FILE_SIZE` zero bytes, by algorithm */
+static const char *calibration_digest(enum Checksum algorithm) {
+#if ACQUIRE_CALIBRATION_FILE_SIZE == 4194304
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return "bc29e3a2";
+  case LIBACQUIRE_SHA256:
+    return "bb9f8df61474d25e71fa00722318cd387396ca1736605e1248821cc0de3d3af8";
+  case LIBACQUIRE_SHA512:
+    return "bd273bf4e10ed6e305ecb7b781cb065545fce9be9f1e2968df22c3a98f82d719"
+           "855aafe5ff303d14ea623a5c55e51e924e10033a92a7a6b07725d7e9692b74f5";
+  case LIBACQUIRE_BLAKE3:
+    return "04e52cd2da6a0e1f338b0078369130d96585c1de65057da5dd1283b12fb853e1";
+  case LIBACQUIRE_XXH3_64:
+    return "165f453a5f35c459";
+  case LIBACQUIRE_XXH128:
+    return "34001ae2f947e773165f453a5f35c459";
+  default:
+    return NULL;
+  }
+#else
+#error "Digests of the calibration file are only known for 4 MiB"
+#endif /* ACQUIRE_CALIBRATION_FILE_SIZE == 4194304 */
+}
+
+/* Whether this build has `backend`, and it can hash `algorithm` */
+static int calibration_candidate(enum acquire_backend_type backend,
+                                 enum Checksum algorithm) {
+  const int sha = algorithm == LIBACQUIRE_SHA256 ||
+                  algorithm == LIBACQUIRE_SHA512;
+  (void)sha;
+  switch (backend) {
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+  case ACQUIRE_BACKEND_CHECKSUM_AF_ALG:
+    return sha;
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+#if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
+  case ACQUIRE_BACKEND_CHECKSUM_LIBRHASH:
+    return sha || algorithm == LIBACQUIRE_CRC32C;
+#endif /* defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH */
+#if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO ||   \
+    defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL ||               \
+    defined(LIBACQUIRE_USE_LIBRESSL) && LIBACQUIRE_USE_LIBRESSL
+  case ACQUIRE_BACKEND_CHECKSUM_OPENSSL:
+    return sha;
+#endif
+#if defined(LIBACQUIRE_USE_WINCRYPT) && LIBACQUIRE_USE_WINCRYPT
+  case ACQUIRE_BACKEND_CHECKSUM_WINCRYPT:
+    return sha;
+#endif /* defined(LIBACQUIRE_USE_WINCRYPT) && LIBACQUIRE_USE_WINCRYPT */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case ACQUIRE_BACKEND_CHECKSUM_SHA2:
+    return sha;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case ACQUIRE_BACKEND_CHECKSUM_CRC32C:
+    return algorithm == LIBACQUIRE_CRC32C;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case ACQUIRE_BACKEND_CHECKSUM_BLAKE3:
+    return algorithm == LIBACQUIRE_BLAKE3;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case ACQUIRE_BACKEND_CHECKSUM_XXHASH:
+    return algorithm == LIBACQUIRE_XXH3_64 || algorithm == LIBACQUIRE_XXH128;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+  default:
+    return 0;
+  }
+}
+
+static const char *calibration_tmpdir(void) {
+  static const char *const vars[] = {"TMPDIR", "TEMP", "TMP"};
+  size_t i;
+  for (i = 0; i < sizeof(vars) / sizeof(vars[0]); i++) {
+    const char *dir = getenv(vars[i]);
+    if (dir != NULL && *dir != '\0')
+      return dir;
+  }
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return ".";
+#else
+  return "/tmp";
+#endif
+}
+
+/*
+ * Create the scratch file under a fresh name in `path`, which only this
+ * process can open, so nothing already in the shared temporary directory is
+ * followed or overwritten.
+ */
+static int calibration_write_file(char *path, size_t size) {
+  static const unsigned char zeros[65536];
+  unsigned long left = ACQUIRE_CALIBRATION_FILE_SIZE;
+  int fd = -1, attempt;
+  for (attempt = 0; fd < 0 && attempt < CALIBRATION_NAME_TRIES; attempt++) {
+    if (size < 1024)
+      return -1;
+    sprintf(path, "%.960s%sacquire_calibration_%lu_%d.bin",
+            calibration_tmpdir(), PATH_SEP,
+            (unsigned long)calibration_getpid(), attempt);
+    fd = calibration_create(path);
+    if (fd < 0 && errno != EEXIST)
+      return -1;
+  }
+  if (fd < 0)
+    return -1;
+  while (left > 0) {
+    const size_t n = left < sizeof(zeros) ? (size_t)left : sizeof(zeros);
+    const long written = (long)calibration_write(fd, zeros, n);
+    if (written <= 0) {
+      calibration_close(fd);
+      remove(path);
+      return -1;
+    }
+    left -= (unsigned long)written;
+  }
+  if (calibration_close(fd) != 0) {
+    remove(path);
+    return -1;
+  }
+  return 0;
+}
+
+/* Best GB/s of `backend` verifying `path`, or `0` if it did not */
+static double calibration_time(enum acquire_backend_type backend,
+                               enum Checksum algorithm, const char *path) {
+  struct acquire_handle *handle = acquire_handle_init();
+  double best = 0.0;
+  int run;
+  if (handle == NULL)
+    return 0.0;
+  acquire_handle_set_checksum_backend(handle, backend);
+  /* Compare one thread against one thread */
+  acquire_handle_set_verify_threads(handle, 1);
+  for (run = 0; run < ACQUIRE_CALIBRATION_RUNS; run++) {
+    const double started = acquire_clock_seconds();
+    double elapsed;
+    /* A backend that fell back, or got the digest wrong, is not a result */
+    if (acquire_verify_sync(handle, path, algorithm,
+                            calibration_digest(algorithm)) != 0 ||
+        handle->active_backend != backend) {
+      best = 0.0;
+      break;
+    }
+    elapsed = acquire_clock_seconds() - started;
+    if (elapsed > 0.0 &&
+        (double)ACQUIRE_CALIBRATION_FILE_SIZE / elapsed / 1e9 > best)
+      best = (double)ACQUIRE_CALIBRATION_FILE_SIZE / elapsed / 1e9;
+  }
+  acquire_handle_free(handle);
+  return best;
+}
+
+/*
+ * Time the candidates for `algorithm` into `slot`. This takes seconds, so
+ * it runs without the lock; `calibration_publish` stores the result.
+ */
+static int calibration_measure(enum Checksum algorithm,
+                               struct calibration_slot *slot) {
+  char path[1024];
+  size_t i;
+  slot->known = 1;
+  slot->measuring = 0;
+  slot->backend = ACQUIRE_BACKEND_NONE;
+  slot->gbps = 0.0;
+  if (calibration_write_file(path, sizeof(path)) != 0)
+    return -1;
+  for (i = 0; i < CALIBRATION_BACKENDS; i++) {
+    double gbps;
+    if (!calibration_candidate(calibration_backends[i].backend, algorithm))
+      continue;
+    gbps = calibration_time(calibration_backends[i].backend, algorithm, path);
+    if (gbps > slot->gbps) {
+      slot->backend = calibration_backends[i].backend;
+      slot->gbps = gbps;
+    }
+  }
+  remove(path);
+  return slot->backend == ACQUIRE_BACKEND_NONE ? -1 : 0;
+}
+
+static void calibration_publish(enum Checksum algorithm,
+                                const struct calibration_slot *slot) {
+  acquire_mutex_lock(&calibration_lock);
+  calibration_slots[algorithm] = *slot;
+  acquire_mutex_unlock(&calibration_lock);
+}
+
+int acquire_calibration_run(enum Checksum algorithm) {
+  struct calibration_slot slot;
+  int rc;
+  if ((size_t)algorithm >= CALIBRATION_SLOTS)
+    return -1;
+  acquire_once(&calibration_once, calibration_init);
+  rc = calibration_measure(algorithm, &slot);
+  calibration_publish(algorithm, &slot);
+  return rc;
+}
+
+int acquire_calibration_get(enum Checksum algorithm,
+                            struct acquire_calibration *out) {
+  int rc = -1;
+  if ((size_t)algorithm >= CALIBRATION_SLOTS || out == NULL)
+    return -1;
+  acquire_once(&calibration_once, calibration_init);
+  acquire_mutex_lock(&calibration_lock);
+  if (calibration_slots[algorithm].known) {
+    out->algorithm = algorithm;
+    out->backend = calibration_slots[algorithm].backend;
+    out->gbps = calibration_slots[algorithm].gbps;
+    rc = 0;
+  }
+  acquire_mutex_unlock(&calibration_lock);
+  return rc;
+}
+
+enum acquire_backend_type _acquire_calibrated_backend(enum Checksum algorithm) {
+  enum acquire_backend_type backend = ACQUIRE_BACKEND_NONE;
+  struct calibration_slot slot;
+  int measure = 0;
+  if ((size_t)algorithm >= CALIBRATION_SLOTS)
+    return ACQUIRE_BACKEND_NONE;
+  acquire_once(&calibration_once, calibration_init);
+  acquire_mutex_lock(&calibration_lock);
+  /* Failures are remembered too, so they are not timed on every start */
+  if (calibration_slots[algorithm].known)
+    backend = calibration_slots[algorithm].backend;
+  else if (!calibration_slots[algorithm].measuring)
+    measure = calibration_slots[algorithm].measuring = 1;
+  /* Otherwise another thread is timing; use the default order meanwhile */
+  acquire_mutex_unlock(&calibration_lock);
+  if (measure) {
+    calibration_measure(algorithm, &slot);
+    calibration_publish(algorithm, &slot);
+    backend = slot.backend;
+  }
+  return backend;
+}
+
+int acquire_calibration_load(const char *path) {
+  char line[128], algorithm_name[16], backend_name[16];
+  int loaded = 0;
+  FILE *fh;
+  if (path == NULL || (fh = fopen(path, "r")) == NULL)
+    return -1;
+  acquire_once(&calibration_once, calibration_init);
+  acquire_mutex_lock(&calibration_lock);
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    enum Checksum algorithm;
+    double gbps;
+    size_t i;
+    if (line[0] == '#' ||
+        sscanf(line, "%15s %15s %lf", algorithm_name, backend_name, &gbps) != 3)
+      continue;
+    algorithm = string2checksum(algorithm_name);
+    i = calibration_backend_named(backend_name);
+    if ((size_t)algorithm >= CALIBRATION_SLOTS || i == CALIBRATION_BACKENDS ||
+        !(calibration_backends[i].backend == ACQUIRE_BACKEND_NONE ||
+          calibration_candidate(calibration_backends[i].backend, algorithm)))
+      continue;
+    calibration_slots[algorithm].known = 1;
+    calibration_slots[algorithm].measuring = 0;
+    calibration_slots[algorithm].backend = calibration_backends[i].backend;
+    calibration_slots[algorithm].gbps = gbps;
+    loaded++;
+  }
+  acquire_mutex_unlock(&calibration_lock);
+  fclose(fh);
+  return loaded;
+}
+
+int acquire_calibration_save(const char *path) {
+  FILE *fh;
+  size_t i;
+  int rc = 0;
+  if (path == NULL || (fh = fopen(path, "w")) == NULL)
+    return -1;
+  acquire_once(&calibration_once, calibration_init);
+  acquire_mutex_lock(&calibration_lock);
+  if (fputs(CALIBRATION_MAGIC, fh) == EOF)
+    rc = -1;
+  for (i = 0; rc == 0 && i < CALIBRATION_SLOTS; i++) {
+    if (!calibration_slots[i].known)
+      continue;
+    if (fprintf(fh, "%s %s %.3f\n", calibration_algorithms[i],
+                calibration_backend_name(calibration_slots[i].backend),
+                calibration_slots[i].gbps) < 0)
+      rc = -1;
+  }
+  acquire_mutex_unlock(&calibration_lock);
+  if (fclose(fh) != 0)
+    rc = -1;
+  return rc;
+}
+
+void acquire_calibration_reset(void) {
+  acquire_once(&calibration_once, calibration_init);
+  acquire_mutex_lock(&calibration_lock);
+  memset(calibration_slots, 0, sizeof(calibration_slots));
+  acquire_mutex_unlock(&calibration_lock);
+}
+
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_CALIBRATE_H */
@@ -5,6 +5,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include "acquire_executor.h"
 #include "acquire_handle.h"
 #include "libacquire_export.h"
 
@@ -12,6 +13,22 @@ extern "C" {
 #include "acquire_crc32c.h"
 #endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
 
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+#include "acquire_blake3.h"
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+#include "acquire_xxhash.h"
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+#include "acquire_sha2.h"
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+#include "acquire_af_alg.h"
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+
 #if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
 #include "acquire_librhash.h"
 #endif
@@ -26,6 +43,8 @@ extern "C" {
 #include "acquire_wincrypt.h"
 #endif
 
+#include "acquire_multi_digest.h"
+
 extern LIBACQUIRE_EXPORT enum Checksum string2checksum(const char *s);
 extern LIBACQUIRE_EXPORT int
 acquire_verify_async_start(struct acquire_handle *handle, const char *filepath,
@@ -39,17 +58,24 @@ extern LIBACQUIRE_EXPORT int acquire_verify_sync(struct acquire_handle *handle,
                                                  enum Checksum algorithm,
                                                  const char *expected_hash);
 
+/* After the declarations above, which its implementation uses */
+#include "acquire_calibrate.h"
+
 #ifdef LIBACQUIRE_IMPLEMENTATION
 
 #include <string.h>
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-#include <synchapi.h> /* For Sleep() */
-#else
-#include <unistd.h> /* For usleep() */
-#endif
+#include "acquire_threads.h"
 #include <acquire_string_extras.h>
 
+/*
+ * Internal, in `acquire_calibrate.h`: the backend
+ * `ACQUIRE_BACKEND_CHECKSUM_AUTO` means for `algorithm`, timing them first
+ * if that has not been done.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_backend_type
+_acquire_calibrated_backend(enum Checksum algorithm);
+
 enum Checksum string2checksum(const char *const s) {
   if (s == NULL)
     return LIBACQUIRE_UNSUPPORTED_CHECKSUM;
@@ -59,12 +85,90 @@ enum Checksum string2checksum(const char *const s) {
     return LIBACQUIRE_SHA256;
   if (strcasecmp(s, "sha512") == 0)
     return LIBACQUIRE_SHA512;
+  if (strcasecmp(s, "blake3") == 0)
+    return LIBACQUIRE_BLAKE3;
+  if (strcasecmp(s, "xxh3") == 0 || strcasecmp(s, "xxh3_64") == 0)
+    return LIBACQUIRE_XXH3_64;
+  if (strcasecmp(s, "xxh128") == 0)
+    return LIBACQUIRE_XXH128;
   return LIBACQUIRE_UNSUPPORTED_CHECKSUM;
 }
 
-int acquire_verify_async_start(struct acquire_handle *handle,
-                               const char *filepath, enum Checksum algorithm,
-                               const char *expected_hash) {
+typedef int (*verify_start_fn)(struct acquire_handle *, const char *,
+                               enum Checksum, const char *);
+
+/*
+ * Start the backend `acquire_handle_set_checksum_backend` asked for. `-1`
+ * with no error set means it is not built in or cannot take this file, and
+ * the usual order applies.
+ */
+static int verify_start_preferred(struct acquire_handle *handle,
+                                  const char *filepath,
+                                  enum Checksum algorithm,
+                                  const char *expected_hash) {
+  enum acquire_backend_type backend = handle->checksum_backend;
+  verify_start_fn start = NULL;
+  if (backend == ACQUIRE_BACKEND_CHECKSUM_AUTO) {
+    /* Calibration times one thread; split CRC32C across several instead */
+    if (algorithm == LIBACQUIRE_CRC32C && handle->verify_threads != 1)
+      return -1;
+    backend = _acquire_calibrated_backend(algorithm);
+  }
+  switch (backend) {
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+  case ACQUIRE_BACKEND_CHECKSUM_AF_ALG:
+    start = _af_alg_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+#if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
+  case ACQUIRE_BACKEND_CHECKSUM_LIBRHASH:
+    start = _librhash_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH */
+#if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO ||   \
+    defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL ||               \
+    defined(LIBACQUIRE_USE_LIBRESSL) && LIBACQUIRE_USE_LIBRESSL
+  case ACQUIRE_BACKEND_CHECKSUM_OPENSSL:
+    start = _openssl_verify_async_start;
+    break;
+#endif
+#if defined(LIBACQUIRE_USE_WINCRYPT) && LIBACQUIRE_USE_WINCRYPT
+  case ACQUIRE_BACKEND_CHECKSUM_WINCRYPT:
+    start = _wincrypt_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_WINCRYPT) && LIBACQUIRE_USE_WINCRYPT */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case ACQUIRE_BACKEND_CHECKSUM_SHA2:
+    start = _sha2_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case ACQUIRE_BACKEND_CHECKSUM_CRC32C:
+    start = _crc32c_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case ACQUIRE_BACKEND_CHECKSUM_BLAKE3:
+    start = _blake3_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case ACQUIRE_BACKEND_CHECKSUM_XXHASH:
+    start = _xxhash_verify_async_start;
+    break;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+  default:
+    break;
+  }
+  if (start == NULL || start(handle, filepath, algorithm, expected_hash) != 0)
+    return -1;
+  handle->active_backend = backend;
+  return 0;
+}
+
+static int verify_start_backend(struct acquire_handle *handle,
+                                const char *filepath, enum Checksum algorithm,
+                                const char *expected_hash) {
   if (!handle || !filepath || !expected_hash) {
     if (handle)
       acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
@@ -73,8 +177,46 @@ int acquire_verify_async_start(struct acquire_handle *handle,
   }
   handle->active_backend = ACQUIRE_BACKEND_NONE;
   handle->status = ACQUIRE_IDLE;
+  /* A cancelled executor job may have left this set */
+  acquire_atomic_store_int(&handle->cancel_flag, 0);
   handle->error.code = ACQUIRE_OK;
   handle->error.message[0] = '\0';
+  if (verify_start_preferred(handle, filepath, algorithm, expected_hash) == 0)
+    return 0;
+  if (handle->error.code != ACQUIRE_OK)
+    return -1;
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  /* Only the built-in CRC32C can split one file across threads */
+  if (algorithm == LIBACQUIRE_CRC32C && handle->verify_threads != 1) {
+    if (_crc32c_verify_async_start(handle, filepath, algorithm,
+                                   expected_hash) == 0) {
+      handle->active_backend = ACQUIRE_BACKEND_CHECKSUM_CRC32C;
+      return 0;
+    }
+    return -1;
+  }
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  /* Bundled, and faster than any of the external libraries */
+  if (algorithm == LIBACQUIRE_BLAKE3) {
+    if (_blake3_verify_async_start(handle, filepath, algorithm,
+                                   expected_hash) == 0) {
+      handle->active_backend = ACQUIRE_BACKEND_CHECKSUM_BLAKE3;
+      return 0;
+    }
+    return -1;
+  }
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  if (algorithm == LIBACQUIRE_XXH3_64 || algorithm == LIBACQUIRE_XXH128) {
+    if (_xxhash_verify_async_start(handle, filepath, algorithm,
+                                   expected_hash) == 0) {
+      handle->active_backend = ACQUIRE_BACKEND_CHECKSUM_XXHASH;
+      return 0;
+    }
+    return -1;
+  }
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
 #if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
   if (_librhash_verify_async_start(handle, filepath, algorithm,
                                    expected_hash) == 0) {
@@ -104,6 +246,16 @@ int acquire_verify_async_start(struct acquire_handle *handle,
   if (handle->error.code != ACQUIRE_OK)
     return -1;
 #endif /* defined(LIBACQUIRE_USE_WINCRYPT) && LIBACQUIRE_USE_WINCRYPT */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  /* After the crypto libraries, so that builds without one still verify */
+  if (_sha2_verify_async_start(handle, filepath, algorithm, expected_hash) ==
+      0) {
+    handle->active_backend = ACQUIRE_BACKEND_CHECKSUM_SHA2;
+    return 0;
+  }
+  if (handle->error.code != ACQUIRE_OK)
+    return -1;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
 #if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
   if (_crc32c_verify_async_start(handle, filepath, algorithm, expected_hash) ==
       0) {
@@ -119,7 +271,7 @@ int acquire_verify_async_start(struct acquire_handle *handle,
   return -1;
 }
 
-enum acquire_status acquire_verify_async_poll(struct acquire_handle *handle) {
+static enum acquire_status verify_poll_backend(struct acquire_handle *handle) {
   if (!handle)
     return ACQUIRE_ERROR;
   switch (handle->active_backend) {
@@ -141,6 +293,24 @@ enum acquire_status acquire_verify_async_poll(struct acquire_handle *handle) {
   case ACQUIRE_BACKEND_CHECKSUM_CRC32C:
     return _crc32c_verify_async_poll(handle);
 #endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case ACQUIRE_BACKEND_CHECKSUM_BLAKE3:
+    return _blake3_verify_async_poll(handle);
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case ACQUIRE_BACKEND_CHECKSUM_XXHASH:
+    return _xxhash_verify_async_poll(handle);
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case ACQUIRE_BACKEND_CHECKSUM_SHA2:
+    return _sha2_verify_async_poll(handle);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+  case ACQUIRE_BACKEND_CHECKSUM_AF_ALG:
+    return _af_alg_verify_async_poll(handle);
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+  case ACQUIRE_BACKEND_CHECKSUM_MULTI:
+    return _multi_verify_async_poll(handle);
   default:
     if (handle->status != ACQUIRE_IN_PROGRESS)
       return handle->status;
@@ -150,25 +320,50 @@ enum acquire_status acquire_verify_async_poll(struct acquire_handle *handle) {
   }
 }
 
+int acquire_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash) {
+  if (_acquire_executor_busy(handle))
+    return -1;
+  if (verify_start_backend(handle, filepath, algorithm, expected_hash) != 0)
+    return -1;
+  if (handle->executor)
+    return _acquire_executor_submit(handle, verify_poll_backend);
+  return 0;
+}
+
+enum acquire_status acquire_verify_async_poll(struct acquire_handle *handle) {
+  if (!handle)
+    return ACQUIRE_ERROR;
+  if (handle->job)
+    return _acquire_executor_collect(handle) ? ACQUIRE_IN_PROGRESS
+                                             : handle->status;
+  return verify_poll_backend(handle);
+}
+
 void acquire_verify_async_cancel(struct acquire_handle *handle) {
   if (handle)
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
 }
 
 int acquire_verify_sync(struct acquire_handle *handle, const char *filepath,
                         enum Checksum algorithm, const char *expected_hash) {
   enum acquire_status status;
+  size_t budget_bytes;
+  unsigned long budget_usec;
   if (acquire_verify_async_start(handle, filepath, algorithm, expected_hash) !=
       0)
     return -1;
+  if (handle->job)
+    return acquire_executor_wait(handle) == ACQUIRE_COMPLETE ? 0 : -1;
+  /* Nothing else runs on this thread, so let the backend hash flat out */
+  budget_bytes = handle->poll_budget_bytes;
+  budget_usec = handle->poll_budget_usec;
+  acquire_handle_set_poll_budget(handle, 0, 0);
   do {
     status = acquire_verify_async_poll(handle);
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-    Sleep(10); /* 10ms poll interval */
-#else
-    usleep(10000); /* 10ms poll interval */
-#endif
   } while (status == ACQUIRE_IN_PROGRESS);
+  acquire_handle_set_poll_budget(handle, budget_bytes, budget_usec);
   return (status == ACQUIRE_COMPLETE) ? 0 : -1;
 }
 
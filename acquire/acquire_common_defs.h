@@ -11,6 +11,9 @@ enum Checksum {
   LIBACQUIRE_CRC32C,
   LIBACQUIRE_SHA256,
   LIBACQUIRE_SHA512,
+  LIBACQUIRE_BLAKE3,
+  LIBACQUIRE_XXH3_64,
+  LIBACQUIRE_XXH128,
   LIBACQUIRE_INVALID_CHECKSUM_ALGO,
   LIBACQUIRE_UNSUPPORTED_CHECKSUM
 };
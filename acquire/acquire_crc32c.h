@@ -5,11 +5,82 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "acquire_common_defs.h"
+#include "libacquire_export.h"
 
 struct acquire_handle; /* Forward declaration */
 
 #if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+/* Implementations of CRC32C that may be selected at runtime */
+enum acquire_crc32c_kernel {
+  ACQUIRE_CRC32C_KERNEL_PORTABLE, /* slicing-by-16 tables, runs anywhere */
+  ACQUIRE_CRC32C_KERNEL_SSE42,    /* x86-64 `crc32` instruction */
+  ACQUIRE_CRC32C_KERNEL_ARMV8     /* AArch64 `crc32c[bwxd]` instructions */
+};
+
+#ifndef ACQUIRE_CRC32C_PARALLEL_MIN_RANGE
+/* Smallest file range worth handing to its own worker thread */
+#define ACQUIRE_CRC32C_PARALLEL_MIN_RANGE (4 * 1048576)
+#endif /* !ACQUIRE_CRC32C_PARALLEL_MIN_RANGE */
+
+/**
+ * @brief Compute or continue a CRC32C (Castagnoli) checksum.
+ *
+ * Follows the zlib `crc32` convention: pass `0` to start, then feed each
+ * result back in to continue over further data. The fastest kernel this CPU
+ * supports is picked on first use.
+ *
+ * @param crc The CRC of the data seen so far (`0` for none).
+ * @param data The bytes to add.
+ * @param len Number of bytes in `data`.
+ * @return The CRC32C of all the data seen so far.
+ */
+extern LIBACQUIRE_EXPORT uint32_t acquire_crc32c(uint32_t crc, const void *data,
+                                                 size_t len);
+
+/**
+ * @brief Report which kernel `acquire_crc32c` dispatches to on this machine.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_crc32c_kernel
+acquire_crc32c_active_kernel(void);
+
+/**
+ * @brief Check whether `kernel` was compiled in and this CPU can run it.
+ *
+ * @return `1` if the kernel can be used, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_crc32c_kernel_supported(enum acquire_crc32c_kernel kernel);
+
+/**
+ * @brief Like `acquire_crc32c`, but force a specific kernel.
+ *
+ * Mainly useful to test and benchmark the kernels against each other. An
+ * unsupported `kernel` falls back to the portable one.
+ */
+extern LIBACQUIRE_EXPORT uint32_t
+acquire_crc32c_with_kernel(enum acquire_crc32c_kernel kernel, uint32_t crc,
+                           const void *data, size_t len);
+
+/**
+ * @brief Combine the CRC32Cs of two adjacent blocks into the CRC32C of both.
+ *
+ * Given `crc1 = acquire_crc32c(0, A, len(A))` and
+ * `crc2 = acquire_crc32c(0, B, len2)`, returns the CRC32C of `A` followed by
+ * `B` without touching the data again. Costs `O(log(len2))`.
+ *
+ * @param crc1 CRC32C of the first block.
+ * @param crc2 CRC32C of the second block.
+ * @param len2 Length in bytes of the second block.
+ * @return CRC32C of the concatenation.
+ */
+extern LIBACQUIRE_EXPORT uint32_t acquire_crc32c_combine(uint32_t crc1,
+                                                         uint32_t crc2,
+                                                         uint64_t len2);
+
 int _crc32c_verify_async_start(struct acquire_handle *handle,
                                const char *filepath, enum Checksum algorithm,
                                const char *expected_hash);
@@ -25,119 +96,715 @@ void _crc32c_verify_async_cancel(struct acquire_handle *handle);
 #include <stdlib.h>
 #include <string.h>
 
+#include "acquire_file_reader.h"
 #include "acquire_handle.h"
 #include "acquire_string_extras.h"
+#include "acquire_threads.h"
 
-#ifndef CHUNK_SIZE
-#define CHUNK_SIZE 4096
-#endif /* !CHUNK_SIZE */
+struct crc32c_range_worker;
 
 struct checksum_backend {
-  FILE *file;
+  struct acquire_file_reader reader;
   uint32_t crc;
   char expected_hash[9];
+  /* Parallel mode only: one worker per file range, merged on completion */
+  struct acquire_handle *handle;
+  struct crc32c_range_worker *workers;
+  unsigned int n_workers;
+  volatile int stop;
 };
 
-static const uint32_t crc32c_table[256] = {
-    0x00000000U, 0xF26B8303U, 0xE13B70F7U, 0x1350F3F4U, 0xC79A971FU,
-    0x35F1141CU, 0x26A1E7E8U, 0xD4CA64EBU, 0x8AD958CFU, 0x78B2DBCCU,
-    0x6BE22838U, 0x9989AB3BU, 0x4D43CFD0U, 0xBF284CD3U, 0xAC78BF27U,
-    0x5E133C24U, 0x105EC76FU, 0xE235446CU, 0xF165B798U, 0x030E349BU,
-    0xD7C45070U, 0x25AFD373U, 0x36FF2087U, 0xC494A384U, 0x9A879FA0U,
-    0x68EC1CA3U, 0x7BBCEF57U, 0x89D76C54U, 0x5D1D08BFU, 0xAF768BBCU,
-    0xBC267848U, 0x4E4DFB4BU, 0x20BD8EDEU, 0xD2D60DDDU, 0xC186FE29U,
-    0x33ED7D2AU, 0xE72719C1U, 0x154C9AC2U, 0x061C6936U, 0xF477EA35U,
-    0xAA64D611U, 0x580F5512U, 0x4B5FA6E6U, 0xB93425E5U, 0x6DFE410EU,
-    0x9F95C20DU, 0x8CC531F9U, 0x7EAEB2FAU, 0x30E349B1U, 0xC288CAB2U,
-    0xD1D83946U, 0x23B3BA45U, 0xF779DEAEU, 0x05125DADU, 0x1642AE59U,
-    0xE4292D5AU, 0xBA3A117EU, 0x4851927DU, 0x5B016189U, 0xA96AE28AU,
-    0x7DA08661U, 0x8FCB0562U, 0x9C9BF696U, 0x6EF07595U, 0x417B1DBCU,
-    0xB3109EBFU, 0xA0406D4BU, 0x522BEE48U, 0x86E18AA3U, 0x748A09A0U,
-    0x67DAFA54U, 0x95B17957U, 0xCBA24573U, 0x39C9C670U, 0x2A993584U,
-    0xD8F2B687U, 0x0C38D26CU, 0xFE53516FU, 0xED03A29BU, 0x1F682198U,
-    0x5125DAD3U, 0xA34E59D0U, 0xB01EAA24U, 0x42752927U, 0x96BF4DCCU,
-    0x64D4CECFU, 0x77843D3BU, 0x85EFBE38U, 0xDBFC821CU, 0x2997011FU,
-    0x3AC7F2EBU, 0xC8AC71E8U, 0x1C71F743U, 0xEE1A7440U, 0xFF4A87B4U,
-    0x0D2104B7U, 0x79EB605CU, 0x8B80E35FU, 0x98D010ABU, 0x6ABBD3A8U,
-    0x3E71B743U, 0xCC1A3440U, 0xDF4A67B4U, 0x2D21E4B7U, 0x59EBA05CU,
-    0xAB80235FU, 0xB8D0D0ABU, 0x4ABE53A8U, 0x64DAB3E0U, 0x96B130E3U,
-    0x85E16317U, 0x778AE014U, 0xF4F10ACFU, 0x069A89CCU, 0x15CA7A38U,
-    0xE7A1F93BU, 0xB3E8D5D0U, 0x418356D3U, 0x52D3A527U, 0xA0B82624U,
-    0x747242CFU, 0x8619C1CCU, 0x95493238U, 0x6722B13BU, 0xD4158D1FU,
-    0x267E0E1CU, 0x352EFDE8U, 0xC7457EEBU, 0x138F1A00U, 0xE1E49903U,
-    0xF2B46AF7U, 0x00DFEDF4U, 0x84427D3FU, 0x7629F43CU, 0x657907C8U,
-    0x971284CBU, 0x43D8E020U, 0xB1B36323U, 0xA2E390D7U, 0x508813D4U,
-    0xDB23E5AU,  0xEF496C59U, 0xFC199FAFU, 0x0E721CA8U, 0x8021308CU,
-    0x724AB38FU, 0x611A407BU, 0x9371C378U, 0x47BBE793U, 0xB5D06490U,
-    0xA6809764U, 0x54EA1467U, 0x2087CF2CU, 0xD2E84C2FU, 0xC1B8BFDBU,
-    0x33D33CD8U, 0xF94F00B3U, 0x0B2483B0U, 0x18747044U, 0xEA1FF347U};
+/* The kernels below operate on the raw (pre- and post-inverted) CRC state */
+typedef uint32_t (*crc32c_kernel_fn)(uint32_t crc, const unsigned char *data,
+                                     size_t len);
+
+/*
+ * Slicing-by-16 tables, generated from the reflected Castagnoli polynomial on
+ * first use: `crc32c_slice_table[0]` is the classic byte-at-a-time table and
+ * `crc32c_slice_table[k][n]` is the CRC of byte `n` followed by `k` zeros, so
+ * 16 input bytes can be folded with 16 independent lookups.
+ */
+#define CRC32C_POLY 0x82F63B78U
+
+static uint32_t crc32c_slice_table[16][256];
+static acquire_once_t crc32c_slice_table_once = ACQUIRE_ONCE_INIT;
+
+static void crc32c_build_slice_table(void) {
+  uint32_t n, crc;
+  int k;
+  for (n = 0; n < 256; n++) {
+    crc = n;
+    for (k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1U)));
+    crc32c_slice_table[0][n] = crc;
+  }
+  for (n = 0; n < 256; n++) {
+    crc = crc32c_slice_table[0][n];
+    for (k = 1; k < 16; k++) {
+      crc = crc32c_slice_table[0][crc & 0xFF] ^ (crc >> 8);
+      crc32c_slice_table[k][n] = crc;
+    }
+  }
+}
+
+static void crc32c_init_slice_table(void) {
+  acquire_once(&crc32c_slice_table_once, crc32c_build_slice_table);
+}
+
+/* Endian independent; compilers fold this to a single load on LE targets */
+static uint32_t crc32c_load_le32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *data,
+                                size_t len) {
+  uint32_t(*const t)[256] = crc32c_slice_table;
+  uint32_t a, b, c, d;
+
+  while (len >= 16) {
+    a = crc ^ crc32c_load_le32(data);
+    b = crc32c_load_le32(data + 4);
+    c = crc32c_load_le32(data + 8);
+    d = crc32c_load_le32(data + 12);
+    crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^
+          t[12][a >> 24] ^ t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^
+          t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^ t[7][c & 0xFF] ^
+          t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+          t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^
+          t[0][d >> 24];
+    data += 16;
+    len -= 16;
+  }
+
+  if (len >= 8) {
+    a = crc ^ crc32c_load_le32(data);
+    b = crc32c_load_le32(data + 4);
+    crc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^
+          t[4][a >> 24] ^ t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^
+          t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+    data += 8;
+    len -= 8;
+  }
+
+  while (len--)
+    crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+static uint32_t crc32c_gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1)
+      sum ^= *mat;
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void crc32c_gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  int n;
+  for (n = 0; n < 32; n++)
+    square[n] = crc32c_gf2_matrix_times(mat, mat[n]);
+}
+
+/*
+ * zlib-style combine: square the "one zero bit" operator up to whole bytes
+ * and apply it for every set bit of `len2`, shifting `crc1` past block 2.
+ */
+uint32_t acquire_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  int n;
+  uint32_t row = 1;
+  uint32_t even[32], odd[32];
+
+  if (len2 == 0)
+    return crc1;
+
+  odd[0] = CRC32C_POLY;
+  for (n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  crc32c_gf2_matrix_square(even, odd);
+  crc32c_gf2_matrix_square(odd, even);
+
+  do {
+    crc32c_gf2_matrix_square(even, odd);
+    if (len2 & 1)
+      crc1 = crc32c_gf2_matrix_times(even, crc1);
+    len2 >>= 1;
+    if (len2 == 0)
+      break;
+    crc32c_gf2_matrix_square(odd, even);
+    if (len2 & 1)
+      crc1 = crc32c_gf2_matrix_times(odd, crc1);
+    len2 >>= 1;
+  } while (len2);
+
+  return crc1 ^ crc2;
+}
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define LIBACQUIRE_CRC32C_HAVE_SSE42 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LIBACQUIRE_CRC32C_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define LIBACQUIRE_CRC32C_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+#endif /* x86-64 */
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) &&       \
+    (defined(__linux__) || defined(__APPLE__))
+#define LIBACQUIRE_CRC32C_HAVE_ARMV8 1
+#include <arm_acle.h>
+#ifdef __clang__
+#define LIBACQUIRE_CRC32C_TARGET_ARMV8 __attribute__((target("crc")))
+#else
+#define LIBACQUIRE_CRC32C_TARGET_ARMV8 __attribute__((target("+crc")))
+#endif /* __clang__ */
+#ifdef __linux__
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif /* !HWCAP_CRC32 */
+#endif /* __linux__ */
+#endif /* AArch64 */
+
+#if defined(LIBACQUIRE_CRC32C_HAVE_SSE42) || defined(LIBACQUIRE_CRC32C_HAVE_ARMV8)
+/*
+ * The hardware kernels run three independent CRC streams over adjacent
+ * blocks, so the instruction's 3-cycle latency is hidden behind its
+ * 1-per-cycle throughput. Streams are then merged by shifting the earlier
+ * CRC over the length of the later block, which is a linear operator on
+ * the CRC state and so can be precomputed as four byte-indexed tables.
+ */
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static uint32_t crc32c_long_shift[4][256];
+static uint32_t crc32c_short_shift[4][256];
+static acquire_once_t crc32c_shift_tables_once = ACQUIRE_ONCE_INIT;
+
+/* Build the operator that appends `len` zero bytes; `len` is a power of 2 */
+static void crc32c_zeros_op(uint32_t *even, size_t len) {
+  int n;
+  uint32_t row = 1;
+  uint32_t odd[32];
+
+  odd[0] = CRC32C_POLY; /* one zero bit */
+  for (n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  crc32c_gf2_matrix_square(even, odd); /* two zero bits */
+  crc32c_gf2_matrix_square(odd, even); /* four zero bits */
+
+  /* Each square doubles the count, the first one reaching a whole byte */
+  do {
+    crc32c_gf2_matrix_square(even, odd);
+    len >>= 1;
+    if (len == 0)
+      return;
+    crc32c_gf2_matrix_square(odd, even);
+    len >>= 1;
+  } while (len);
+
+  for (n = 0; n < 32; n++)
+    even[n] = odd[n];
+}
+
+static void crc32c_zeros(uint32_t zeros[][256], size_t len) {
+  uint32_t n;
+  uint32_t op[32];
+
+  crc32c_zeros_op(op, len);
+  for (n = 0; n < 256; n++) {
+    zeros[0][n] = crc32c_gf2_matrix_times(op, n);
+    zeros[1][n] = crc32c_gf2_matrix_times(op, n << 8);
+    zeros[2][n] = crc32c_gf2_matrix_times(op, n << 16);
+    zeros[3][n] = crc32c_gf2_matrix_times(op, n << 24);
+  }
+}
+
+static uint32_t crc32c_shift(uint32_t zeros[][256], uint32_t crc) {
+  return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^
+         zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+static void crc32c_build_shift_tables(void) {
+  crc32c_zeros(crc32c_long_shift, CRC32C_LONG);
+  crc32c_zeros(crc32c_short_shift, CRC32C_SHORT);
+}
+
+static void crc32c_init_shift_tables(void) {
+  acquire_once(&crc32c_shift_tables_once, crc32c_build_shift_tables);
+}
+#endif /* defined(LIBACQUIRE_CRC32C_HAVE_SSE42) ||                            \
+          defined(LIBACQUIRE_CRC32C_HAVE_ARMV8) */
+
+#ifdef LIBACQUIRE_CRC32C_HAVE_SSE42
+static int crc32c_cpu_has_sse42(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] >> 20) & 1;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (ecx & bit_SSE4_2) != 0;
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+}
+
+LIBACQUIRE_CRC32C_TARGET_SSE42
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *next,
+                             size_t len) {
+  const unsigned char *end;
+  uint64_t crc0 = crc, crc1, crc2;
+
+  /* Align to 8 bytes so the wide loads below never straddle a boundary */
+  while (len && ((uintptr_t)next & 7) != 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+    len--;
+  }
+
+  while (len >= CRC32C_LONG * 3) {
+    crc1 = 0;
+    crc2 = 0;
+    end = next + CRC32C_LONG;
+    do {
+      crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)next);
+      crc1 = _mm_crc32_u64(crc1, *(const uint64_t *)(next + CRC32C_LONG));
+      crc2 = _mm_crc32_u64(crc2, *(const uint64_t *)(next + CRC32C_LONG * 2));
+      next += 8;
+    } while (next < end);
+    crc0 = crc32c_shift(crc32c_long_shift, (uint32_t)crc0) ^ crc1;
+    crc0 = crc32c_shift(crc32c_long_shift, (uint32_t)crc0) ^ crc2;
+    next += CRC32C_LONG * 2;
+    len -= CRC32C_LONG * 3;
+  }
+
+  while (len >= CRC32C_SHORT * 3) {
+    crc1 = 0;
+    crc2 = 0;
+    end = next + CRC32C_SHORT;
+    do {
+      crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)next);
+      crc1 = _mm_crc32_u64(crc1, *(const uint64_t *)(next + CRC32C_SHORT));
+      crc2 = _mm_crc32_u64(crc2, *(const uint64_t *)(next + CRC32C_SHORT * 2));
+      next += 8;
+    } while (next < end);
+    crc0 = crc32c_shift(crc32c_short_shift, (uint32_t)crc0) ^ crc1;
+    crc0 = crc32c_shift(crc32c_short_shift, (uint32_t)crc0) ^ crc2;
+    next += CRC32C_SHORT * 2;
+    len -= CRC32C_SHORT * 3;
+  }
+
+  end = next + (len - (len & 7));
+  while (next < end) {
+    crc0 = _mm_crc32_u64(crc0, *(const uint64_t *)next);
+    next += 8;
+  }
+  len &= 7;
+
+  while (len) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+    len--;
+  }
+  return (uint32_t)crc0;
+}
+#endif /* LIBACQUIRE_CRC32C_HAVE_SSE42 */
+
+#ifdef LIBACQUIRE_CRC32C_HAVE_ARMV8
+static int crc32c_cpu_has_armv8(void) {
+#ifdef __linux__
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+  return 1; /* every Apple arm64 CPU implements the CRC32 extension */
+#endif /* __linux__ */
+}
+
+LIBACQUIRE_CRC32C_TARGET_ARMV8
+static uint32_t crc32c_armv8(uint32_t crc, const unsigned char *next,
+                             size_t len) {
+  const unsigned char *end;
+  uint32_t crc0 = crc, crc1, crc2;
+
+  while (len && ((uintptr_t)next & 7) != 0) {
+    crc0 = __crc32cb(crc0, *next++);
+    len--;
+  }
+
+  while (len >= CRC32C_LONG * 3) {
+    crc1 = 0;
+    crc2 = 0;
+    end = next + CRC32C_LONG;
+    do {
+      crc0 = __crc32cd(crc0, *(const uint64_t *)next);
+      crc1 = __crc32cd(crc1, *(const uint64_t *)(next + CRC32C_LONG));
+      crc2 = __crc32cd(crc2, *(const uint64_t *)(next + CRC32C_LONG * 2));
+      next += 8;
+    } while (next < end);
+    crc0 = crc32c_shift(crc32c_long_shift, crc0) ^ crc1;
+    crc0 = crc32c_shift(crc32c_long_shift, crc0) ^ crc2;
+    next += CRC32C_LONG * 2;
+    len -= CRC32C_LONG * 3;
+  }
+
+  while (len >= CRC32C_SHORT * 3) {
+    crc1 = 0;
+    crc2 = 0;
+    end = next + CRC32C_SHORT;
+    do {
+      crc0 = __crc32cd(crc0, *(const uint64_t *)next);
+      crc1 = __crc32cd(crc1, *(const uint64_t *)(next + CRC32C_SHORT));
+      crc2 = __crc32cd(crc2, *(const uint64_t *)(next + CRC32C_SHORT * 2));
+      next += 8;
+    } while (next < end);
+    crc0 = crc32c_shift(crc32c_short_shift, crc0) ^ crc1;
+    crc0 = crc32c_shift(crc32c_short_shift, crc0) ^ crc2;
+    next += CRC32C_SHORT * 2;
+    len -= CRC32C_SHORT * 3;
+  }
+
+  end = next + (len - (len & 7));
+  while (next < end) {
+    crc0 = __crc32cd(crc0, *(const uint64_t *)next);
+    next += 8;
+  }
+  len &= 7;
+
+  while (len) {
+    crc0 = __crc32cb(crc0, *next++);
+    len--;
+  }
+  return crc0;
+}
+#endif /* LIBACQUIRE_CRC32C_HAVE_ARMV8 */
+
+/* The fastest kernel this CPU runs, picked by `crc32c_resolve` */
+static crc32c_kernel_fn crc32c_active_fn = NULL;
+static enum acquire_crc32c_kernel crc32c_active_id =
+    ACQUIRE_CRC32C_KERNEL_PORTABLE;
+static acquire_once_t crc32c_active_once = ACQUIRE_ONCE_INIT;
+
+int acquire_crc32c_kernel_supported(enum acquire_crc32c_kernel kernel) {
+  switch (kernel) {
+  case ACQUIRE_CRC32C_KERNEL_PORTABLE:
+    return 1;
+#ifdef LIBACQUIRE_CRC32C_HAVE_SSE42
+  case ACQUIRE_CRC32C_KERNEL_SSE42:
+    return crc32c_cpu_has_sse42();
+#endif /* LIBACQUIRE_CRC32C_HAVE_SSE42 */
+#ifdef LIBACQUIRE_CRC32C_HAVE_ARMV8
+  case ACQUIRE_CRC32C_KERNEL_ARMV8:
+    return crc32c_cpu_has_armv8();
+#endif /* LIBACQUIRE_CRC32C_HAVE_ARMV8 */
+  default:
+    return 0;
+  }
+}
+
+static crc32c_kernel_fn crc32c_kernel_fn_for(enum acquire_crc32c_kernel kernel) {
+  if (!acquire_crc32c_kernel_supported(kernel)) {
+    crc32c_init_slice_table();
+    return crc32c_portable;
+  }
+  switch (kernel) {
+#ifdef LIBACQUIRE_CRC32C_HAVE_SSE42
+  case ACQUIRE_CRC32C_KERNEL_SSE42:
+    crc32c_init_shift_tables();
+    return crc32c_sse42;
+#endif /* LIBACQUIRE_CRC32C_HAVE_SSE42 */
+#ifdef LIBACQUIRE_CRC32C_HAVE_ARMV8
+  case ACQUIRE_CRC32C_KERNEL_ARMV8:
+    crc32c_init_shift_tables();
+    return crc32c_armv8;
+#endif /* LIBACQUIRE_CRC32C_HAVE_ARMV8 */
+  case ACQUIRE_CRC32C_KERNEL_PORTABLE:
+  default:
+    crc32c_init_slice_table();
+    return crc32c_portable;
+  }
+}
+
+static void crc32c_resolve(void) {
+  enum acquire_crc32c_kernel kernel = ACQUIRE_CRC32C_KERNEL_PORTABLE;
+  if (acquire_crc32c_kernel_supported(ACQUIRE_CRC32C_KERNEL_SSE42))
+    kernel = ACQUIRE_CRC32C_KERNEL_SSE42;
+  else if (acquire_crc32c_kernel_supported(ACQUIRE_CRC32C_KERNEL_ARMV8))
+    kernel = ACQUIRE_CRC32C_KERNEL_ARMV8;
+  crc32c_active_id = kernel;
+  crc32c_active_fn = crc32c_kernel_fn_for(kernel);
+}
+
+static crc32c_kernel_fn crc32c_dispatch(void) {
+  acquire_once(&crc32c_active_once, crc32c_resolve);
+  return crc32c_active_fn;
+}
+
+enum acquire_crc32c_kernel acquire_crc32c_active_kernel(void) {
+  crc32c_dispatch();
+  return crc32c_active_id;
+}
+
+uint32_t acquire_crc32c(uint32_t crc, const void *data, size_t len) {
+  if (data == NULL || len == 0)
+    return crc;
+  return crc32c_dispatch()(crc ^ 0xFFFFFFFFU, (const unsigned char *)data,
+                           len) ^
+         0xFFFFFFFFU;
+}
+
+uint32_t acquire_crc32c_with_kernel(enum acquire_crc32c_kernel kernel,
+                                    uint32_t crc, const void *data,
+                                    size_t len) {
+  if (data == NULL || len == 0)
+    return crc;
+  return crc32c_kernel_fn_for(kernel)(crc ^ 0xFFFFFFFFU,
+                                      (const unsigned char *)data, len) ^
+         0xFFFFFFFFU;
+}
 
 static uint32_t crc32c_init(void) { return 0xFFFFFFFFU; }
 static uint32_t crc32c_update(uint32_t crc, const unsigned char *data,
                               size_t len) {
-  size_t i;
-  for (i = 0; i < len; ++i) {
-    uint8_t idx = (uint8_t)((crc ^ data[i]) & 0xFFU);
-    crc = crc32c_table[idx] ^ (crc >> 8);
-  }
-  return crc;
+  return crc32c_dispatch()(crc, data, len);
 }
 static uint32_t crc32c_finalize(uint32_t crc) { return crc ^ 0xFFFFFFFFU; }
 
+struct crc32c_range_worker {
+  struct checksum_backend *be;
+  acquire_thread_t thread;
+  int started, joined;
+  off_t offset, length;
+  volatile off_t bytes_done;
+  volatile int finished;
+  int error; /* `errno` of a failed read, or `EIO` if the file shrank */
+  uint32_t crc;
+};
+
+static void crc32c_range_worker_run(void *arg) {
+  struct crc32c_range_worker *w = (struct crc32c_range_worker *)arg;
+  const struct acquire_file_reader *reader = &w->be->reader;
+  const size_t block = reader->block_size;
+  const off_t end = w->offset + w->length;
+  off_t pos = w->offset;
+  uint32_t crc = 0;
+  /* Only unmapped files need somewhere to read into */
+  unsigned char *scratch = NULL;
+  if (reader->map == NULL) {
+    scratch = (unsigned char *)malloc(block);
+    if (!scratch) {
+      w->error = ENOMEM;
+      pos = end;
+    }
+  }
+  while (pos < end && !acquire_atomic_load_int(&w->be->stop) &&
+         !acquire_atomic_load_int(&w->be->handle->cancel_flag)) {
+    const unsigned char *data;
+    size_t got;
+    const size_t want =
+        end - pos < (off_t)block ? (size_t)(end - pos) : block;
+    const int err =
+        acquire_file_reader_read_at(reader, pos, want, scratch, &data, &got);
+    if (err != 0) {
+      w->error = err;
+      break;
+    }
+    if (got == 0) {
+      w->error = EIO;
+      break;
+    }
+    crc = acquire_crc32c(crc, data, got);
+    pos += (off_t)got;
+    acquire_atomic_store_off(&w->bytes_done, pos - w->offset);
+  }
+  free(scratch);
+  w->crc = crc;
+  acquire_atomic_store_int(&w->finished, 1);
+}
+
+static void crc32c_join_workers(struct checksum_backend *be) {
+  unsigned int i;
+  for (i = 0; i < be->n_workers; i++)
+    if (be->workers[i].started && !be->workers[i].joined) {
+      acquire_thread_join(be->workers[i].thread);
+      be->workers[i].joined = 1;
+    }
+}
+
 static void cleanup_crc32c_backend(struct acquire_handle *handle) {
   struct checksum_backend *be;
   if (!handle || !handle->backend_handle)
     return;
   be = (struct checksum_backend *)handle->backend_handle;
-  if (be->file)
-    fclose(be->file);
+  if (be->workers) {
+    acquire_atomic_store_int(&be->stop, 1);
+    crc32c_join_workers(be);
+    free(be->workers);
+  }
+  acquire_file_reader_close(&be->reader);
   free(be);
   handle->backend_handle = NULL;
 }
 
+/*
+ * Split the file into one contiguous range per thread. Returns 0 when the
+ * workers are running, or -1 to fall back to sequential hashing (too small
+ * a file, or threads could not be started).
+ */
+static int crc32c_start_parallel(struct checksum_backend *be,
+                                 unsigned int threads) {
+  const off_t size = be->reader.size;
+  off_t range, offset = 0;
+  unsigned int i;
+
+  if (size < 2 * (off_t)ACQUIRE_CRC32C_PARALLEL_MIN_RANGE)
+    return -1;
+  if ((off_t)threads > size / ACQUIRE_CRC32C_PARALLEL_MIN_RANGE)
+    threads = (unsigned int)(size / ACQUIRE_CRC32C_PARALLEL_MIN_RANGE);
+
+  be->workers = (struct crc32c_range_worker *)calloc(
+      threads, sizeof(struct crc32c_range_worker));
+  if (!be->workers)
+    return -1;
+  be->n_workers = threads;
+
+  range = size / threads;
+  for (i = 0; i < threads; i++) {
+    struct crc32c_range_worker *w = &be->workers[i];
+    w->be = be;
+    w->offset = offset;
+    w->length = i + 1 == threads ? size - offset : range;
+    offset += w->length;
+  }
+  for (i = 0; i < threads; i++) {
+    if (acquire_thread_create(&be->workers[i].thread, crc32c_range_worker_run,
+                              &be->workers[i]) != 0) {
+      acquire_atomic_store_int(&be->stop, 1);
+      crc32c_join_workers(be);
+      free(be->workers);
+      be->workers = NULL;
+      be->n_workers = 0;
+      be->stop = 0;
+      return -1;
+    }
+    be->workers[i].started = 1;
+  }
+  return 0;
+}
+
+static void crc32c_check_result(struct acquire_handle *handle,
+                                const struct checksum_backend *be,
+                                uint32_t final_crc) {
+  char computed_hex[9];
+  snprintf(computed_hex, sizeof(computed_hex), "%08x", final_crc);
+  if (strncasecmp(computed_hex, be->expected_hash, 8) == 0) {
+    handle->status = ACQUIRE_COMPLETE;
+  } else {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                             "CRC32C mismatch: expected %s, got %s",
+                             be->expected_hash, computed_hex);
+  }
+}
+
+/*
+ * Workers run on their own; a poll only collects progress. With no poll
+ * budget (the sync API) it blocks in join instead of spinning.
+ */
+static enum acquire_status
+crc32c_parallel_poll(struct acquire_handle *handle,
+                     struct checksum_backend *be) {
+  unsigned int i, finished = 0;
+  off_t bytes = 0;
+  uint32_t crc;
+
+  if (handle->poll_budget_bytes == 0 && handle->poll_budget_usec == 0)
+    crc32c_join_workers(be);
+  for (i = 0; i < be->n_workers; i++) {
+    /* `finished` first: a worker sets it after its last progress, so a
+     * finished worker's count is then whole */
+    finished += acquire_atomic_load_int(&be->workers[i].finished) ? 1 : 0;
+    bytes += acquire_atomic_load_off(&be->workers[i].bytes_done);
+  }
+  acquire_handle_set_progress(handle, bytes);
+
+  if (acquire_atomic_load_int(&handle->cancel_flag)) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Operation cancelled");
+    cleanup_crc32c_backend(handle);
+    return ACQUIRE_ERROR;
+  }
+  if (finished < be->n_workers)
+    return ACQUIRE_IN_PROGRESS;
+
+  /* Joining also makes each worker's `crc` and `error` visible here */
+  crc32c_join_workers(be);
+  crc = 0;
+  for (i = 0; i < be->n_workers; i++) {
+    const struct crc32c_range_worker *w = &be->workers[i];
+    if (w->error) {
+#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
+    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
+      char error_code[256];
+      strerror_s(error_code, sizeof(error_code), w->error);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File read error: %s", error_code);
+#else
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File read error: %s", strerror(w->error));
+#endif
+      cleanup_crc32c_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    crc = acquire_crc32c_combine(crc, w->crc, (uint64_t)w->length);
+  }
+  crc32c_check_result(handle, be, crc);
+  cleanup_crc32c_backend(handle);
+  return handle->status;
+}
+
 int _crc32c_verify_async_start(struct acquire_handle *handle,
                                const char *filepath, enum Checksum algorithm,
                                const char *expected_hash) {
   struct checksum_backend *be;
+  unsigned int threads;
   if (algorithm != LIBACQUIRE_CRC32C)
     return -1;
-  if (strlen(expected_hash) != 8) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
-                             "Invalid hash length for CRC32C");
-    return -1;
-  }
   if (!handle || !filepath || !expected_hash) {
     if (handle)
       acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
                                "Invalid arguments");
     return -1;
   }
+  if (strlen(expected_hash) != 8) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                             "Invalid hash length for CRC32C");
+    return -1;
+  }
   be = (struct checksum_backend *)calloc(1, sizeof(struct checksum_backend));
   if (!be) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
                              "Out of memory");
     return -1;
   }
-#if defined(_MSC_VER) || defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-  {
-    const errno_t err = fopen_s(&be->file, filepath, "rb");
-    if (err != 0 || be->file == NULL) {
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                               "Cannot open file: %s", filepath);
-      free(be);
-      return -1;
-    }
-  }
-#else
-  be->file = fopen(filepath, "rb");
-  if (!be->file) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                             "Cannot open file: %s", strerror(errno));
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
     free(be);
     return -1;
   }
-#endif
   be->crc = crc32c_init();
+  be->handle = handle;
 #if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
     defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
   strncpy_s(be->expected_hash, sizeof be->expected_hash, expected_hash, 8);
@@ -147,52 +814,50 @@ int _crc32c_verify_async_start(struct acquire_handle *handle,
   be->expected_hash[8] = '\0';
   handle->backend_handle = be;
   handle->status = ACQUIRE_IN_PROGRESS;
+  threads = handle->verify_threads == 0 ? acquire_cpu_count()
+                                        : handle->verify_threads;
+  if (threads > 1)
+    crc32c_start_parallel(be, threads);
   return 0;
 }
 
 enum acquire_status _crc32c_verify_async_poll(struct acquire_handle *handle) {
   struct checksum_backend *be;
-  unsigned char buffer[CHUNK_SIZE];
-  size_t bytes_read;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
   if (!handle || !handle->backend_handle)
     return ACQUIRE_ERROR;
   if (handle->status != ACQUIRE_IN_PROGRESS)
     return handle->status;
-  if (handle->cancel_flag) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
-                             "Operation cancelled");
-    cleanup_crc32c_backend(handle);
-    return ACQUIRE_ERROR;
-  }
   be = (struct checksum_backend *)handle->backend_handle;
-  bytes_read = fread(buffer, 1, sizeof(buffer), be->file);
-  if (bytes_read > 0) {
+  if (be->workers)
+    return crc32c_parallel_poll(handle, be);
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Operation cancelled");
+      cleanup_crc32c_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
     be->crc = crc32c_update(be->crc, buffer, bytes_read);
-    handle->bytes_processed += (off_t)bytes_read;
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
     return ACQUIRE_IN_PROGRESS;
-  }
-  if (ferror(be->file)) {
-#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
-    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-    char error_code[256];
-    strerror_s(error_code, sizeof(error_code), errno);
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", error_code);
-#else
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", strerror(errno));
-#endif
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
   } else {
-    char computed_hex[9];
-    uint32_t final_crc = crc32c_finalize(be->crc);
-    snprintf(computed_hex, sizeof(computed_hex), "%08x", final_crc);
-    if (strncasecmp(computed_hex, be->expected_hash, 8) == 0) {
-      handle->status = ACQUIRE_COMPLETE;
-    } else {
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
-                               "CRC32C mismatch: expected %s, got %s",
-                               be->expected_hash, computed_hex);
-    }
+    crc32c_check_result(handle, be, crc32c_finalize(be->crc));
   }
   cleanup_crc32c_backend(handle);
   return handle->status;
@@ -200,7 +865,7 @@ enum acquire_status _crc32c_verify_async_poll(struct acquire_handle *handle) {
 
 void _crc32c_verify_async_cancel(struct acquire_handle *handle) {
   if (handle)
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
 }
 
 #endif /* defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_CRC32C) \
@@ -0,0 +1,657 @@
+#ifndef LIBACQUIRE_ACQUIRE_DIGEST_CACHE_H
+#define LIBACQUIRE_ACQUIRE_DIGEST_CACHE_H
+
+/*
+ * Remembers which files have already been verified, so checking an
+ * unchanged multi-gigabyte download again costs one `stat` instead of a
+ * full read.
+ *
+ * Entries are keyed by device, inode, size and mtime (to the nanosecond
+ * where the platform has it), and are only trusted while those and the
+ * ctime are exactly as they were when the file was hashed; any other
+ * write, rename-over or `touch` invalidates them, and the file is hashed
+ * again. A digest is not cached when the file's mtime is within
+ * `ACQUIRE_DIGEST_CACHE_RACY_SECONDS` of the verification, since a write
+ * in the same timestamp tick could go unnoticed.
+ *
+ * The index is an append-only text file, one line per stored digest,
+ * loaded once and compacted when it has gathered many superseded lines.
+ * Anyone who can write to it can vouch for any file, so keep it where only
+ * trusted users can. POSIX only: elsewhere every lookup misses.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "acquire_common_defs.h"
+#include "acquire_handle.h"
+#include "libacquire_export.h"
+
+#ifndef ACQUIRE_DIGEST_CACHE_RACY_SECONDS
+#define ACQUIRE_DIGEST_CACHE_RACY_SECONDS 2
+#endif /* !ACQUIRE_DIGEST_CACHE_RACY_SECONDS */
+
+struct acquire_digest_cache;
+
+struct acquire_digest_cache_stats {
+  /* Lookups answered without reading the file */
+  unsigned long hits;
+  /* Lookups that found nothing usable, stale entries included */
+  unsigned long misses;
+  /* Entries dropped because their file changed */
+  unsigned long stale;
+  /* Digests recorded after a successful verification */
+  unsigned long stores;
+};
+
+/**
+ * @brief Open the digest cache backed by `index_path`, loading any entries
+ * already there. The file is created on the first store.
+ *
+ * @param index_path Index file, or `NULL` for a cache that lives only as
+ * long as the process.
+ *
+ * @return The cache, or `NULL` if out of memory.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_digest_cache *
+acquire_digest_cache_open(const char *index_path);
+
+extern LIBACQUIRE_EXPORT void
+acquire_digest_cache_close(struct acquire_digest_cache *cache);
+
+/**
+ * @brief Let `is_downloaded` answer from `cache`, or stop it with `NULL`.
+ *
+ * There is none by default. `is_downloaded` only reads the cache: record
+ * files in it with `acquire_verify_cached` or `acquire_digest_cache_store`.
+ * Keep `cache` open for as long as it is set.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_digest_cache_set_default(struct acquire_digest_cache *cache);
+
+/* The cache `is_downloaded` answers from, or `NULL` */
+extern LIBACQUIRE_EXPORT struct acquire_digest_cache *
+acquire_digest_cache_default(void);
+
+/**
+ * @brief Look `filepath` up with a single `stat`.
+ *
+ * @return `1` if it is known to have digest `expected_hash`, `0` if it is
+ * known to have another, `-1` if it has to be hashed.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_digest_cache_lookup(struct acquire_digest_cache *cache,
+                            const char *filepath, enum Checksum algorithm,
+                            const char *expected_hash);
+
+/**
+ * @brief Record that `filepath`, as it is now, has digest `hash`.
+ *
+ * Call only once the digest has been verified.
+ *
+ * @return `0` if stored, `-1` if not (unreadable, racy or unsupported).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_digest_cache_store(struct acquire_digest_cache *cache,
+                           const char *filepath, enum Checksum algorithm,
+                           const char *hash);
+
+/**
+ * @brief `acquire_verify_sync`, answered from `cache` when it can be and
+ * recorded there when the file had to be hashed and matched.
+ *
+ * With a `NULL` cache this is just `acquire_verify_sync`.
+ *
+ * @return `0` if the file has digest `expected_hash`, `-1` otherwise
+ * (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_cached(struct acquire_digest_cache *cache,
+                      struct acquire_handle *handle, const char *filepath,
+                      enum Checksum algorithm, const char *expected_hash);
+
+extern LIBACQUIRE_EXPORT void
+acquire_digest_cache_get_stats(struct acquire_digest_cache *cache,
+                               struct acquire_digest_cache_stats *stats);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_DIGEST_CACHE_IMPL_
+#define ACQUIRE_DIGEST_CACHE_IMPL_
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "acquire_checksums.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ACQUIRE_DIGEST_CACHE_SUPPORTED 1
+#else
+#define ACQUIRE_DIGEST_CACHE_SUPPORTED 0
+#endif
+
+#define DIGEST_CACHE_MAGIC "acquire-digest-cache 1\n"
+
+/* What a file must still look like for its entry to be trusted */
+struct digest_cache_key {
+  uint64_t dev, ino, size;
+  int64_t mtime_ns, ctime_ns;
+};
+
+struct digest_cache_entry {
+  struct digest_cache_key key;
+  int algorithm; /* `enum Checksum`, or `-1` for an empty slot */
+  char hash[129]; /* Lowercase hex; empty once invalidated */
+};
+
+struct acquire_digest_cache {
+  acquire_mutex_t lock;
+  char *index_path;
+  /* Open addressing on (device, inode, algorithm) */
+  struct digest_cache_entry *slots;
+  size_t capacity, count;
+  struct acquire_digest_cache_stats stats;
+};
+
+static const char *digest_cache_algorithm_name(int algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return "crc32c";
+  case LIBACQUIRE_SHA256:
+    return "sha256";
+  case LIBACQUIRE_SHA512:
+    return "sha512";
+  case LIBACQUIRE_BLAKE3:
+    return "blake3";
+  case LIBACQUIRE_XXH3_64:
+    return "xxh3";
+  case LIBACQUIRE_XXH128:
+    return "xxh128";
+  default:
+    return NULL;
+  }
+}
+
+#if ACQUIRE_DIGEST_CACHE_SUPPORTED
+static int digest_cache_stat(const char *path, struct digest_cache_key *key) {
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+    return -1;
+  key->dev = (uint64_t)st.st_dev;
+  key->ino = (uint64_t)st.st_ino;
+  key->size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+  key->mtime_ns = (int64_t)st.st_mtimespec.tv_sec * 1000000000 +
+                  st.st_mtimespec.tv_nsec;
+  key->ctime_ns = (int64_t)st.st_ctimespec.tv_sec * 1000000000 +
+                  st.st_ctimespec.tv_nsec;
+#elif defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) ||    \
+    defined(__OpenBSD__) || defined(__DragonFly__)
+  key->mtime_ns =
+      (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  key->ctime_ns =
+      (int64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+#else
+  key->mtime_ns = (int64_t)st.st_mtime * 1000000000;
+  key->ctime_ns = (int64_t)st.st_ctime * 1000000000;
+#endif
+  return 0;
+}
+#endif /* ACQUIRE_DIGEST_CACHE_SUPPORTED */
+
+/* Whether a file that looks like `now` is still the one `entry` hashed */
+static int digest_cache_key_equal(const struct digest_cache_key *entry,
+                                  const struct digest_cache_key *now) {
+  return entry->dev == now->dev && entry->ino == now->ino &&
+         entry->size == now->size && entry->mtime_ns == now->mtime_ns &&
+         entry->ctime_ns == now->ctime_ns;
+}
+
+static size_t digest_cache_bucket(const struct digest_cache_key *key,
+                                  int algorithm, size_t capacity) {
+  uint64_t h = key->ino * UINT64_C(0x9E3779B97F4A7C15);
+  h ^= (key->dev + (uint64_t)algorithm) * UINT64_C(0xC2B2AE3D27D4EB4F);
+  h ^= h >> 29;
+  return (size_t)h & (capacity - 1);
+}
+
+/* The slot for the key's file and `algorithm`: its entry or an empty one */
+static struct digest_cache_entry *
+digest_cache_find(struct acquire_digest_cache *cache,
+                  const struct digest_cache_key *key, int algorithm) {
+  size_t i = digest_cache_bucket(key, algorithm, cache->capacity);
+  for (;; i = (i + 1) & (cache->capacity - 1)) {
+    struct digest_cache_entry *e = &cache->slots[i];
+    if (e->algorithm < 0 || (e->algorithm == algorithm &&
+                             e->key.dev == key->dev && e->key.ino == key->ino))
+      return e;
+  }
+}
+
+static int digest_cache_grow(struct acquire_digest_cache *cache) {
+  struct digest_cache_entry *old = cache->slots;
+  const size_t old_capacity = cache->capacity;
+  size_t i;
+  cache->capacity = old_capacity ? old_capacity * 2 : 64;
+  cache->slots = (struct digest_cache_entry *)malloc(
+      cache->capacity * sizeof(struct digest_cache_entry));
+  if (cache->slots == NULL) { /* LCOV_EXCL_START */
+    cache->slots = old;
+    cache->capacity = old_capacity;
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  for (i = 0; i < cache->capacity; i++)
+    cache->slots[i].algorithm = -1;
+  for (i = 0; i < old_capacity; i++)
+    if (old[i].algorithm >= 0)
+      *digest_cache_find(cache, &old[i].key, old[i].algorithm) = old[i];
+  free(old);
+  return 0;
+}
+
+/* Insert or replace; called with the lock held */
+static int digest_cache_put(struct acquire_digest_cache *cache,
+                            const struct digest_cache_key *key, int algorithm,
+                            const char *hash) {
+  struct digest_cache_entry *e;
+  size_t i;
+  if ((cache->count + 1) * 2 > cache->capacity &&
+      digest_cache_grow(cache) != 0)
+    return -1;
+  e = digest_cache_find(cache, key, algorithm);
+  if (e->algorithm < 0)
+    cache->count++;
+  e->key = *key;
+  e->algorithm = algorithm;
+  for (i = 0; hash[i] && i < sizeof(e->hash) - 1; i++)
+    e->hash[i] = (char)tolower((unsigned char)hash[i]);
+  e->hash[i] = '\0';
+  return 0;
+}
+
+static void digest_cache_format_u64(char *out, uint64_t v) {
+  static const char digits[] = "0123456789abcdef";
+  int i;
+  for (i = 15; i >= 0; i--, v >>= 4)
+    out[i] = digits[v & 15];
+}
+
+static int digest_cache_parse_u64(const char *in, uint64_t *v) {
+  int i;
+  *v = 0;
+  for (i = 0; i < 16; i++) {
+    const char c = in[i];
+    if (c >= '0' && c <= '9')
+      *v = (*v << 4) | (uint64_t)(c - '0');
+    else if (c >= 'a' && c <= 'f')
+      *v = (*v << 4) | (uint64_t)(c - 'a' + 10);
+    else
+      return -1;
+  }
+  return in[16] == ' ' ? 0 : -1;
+}
+
+/* `<dev> <ino> <size> <mtime_ns> <ctime_ns> <algorithm> <hash>` */
+static void digest_cache_format_line(char *line,
+                                     const struct digest_cache_entry *e) {
+  uint64_t f[5];
+  int i;
+  f[0] = e->key.dev;
+  f[1] = e->key.ino;
+  f[2] = e->key.size;
+  f[3] = (uint64_t)e->key.mtime_ns;
+  f[4] = (uint64_t)e->key.ctime_ns;
+  for (i = 0; i < 5; i++) {
+    digest_cache_format_u64(line + i * 17, f[i]);
+    line[i * 17 + 16] = ' ';
+  }
+  sprintf(line + 5 * 17, "%s %s\n", digest_cache_algorithm_name(e->algorithm),
+          e->hash);
+}
+
+static int digest_cache_parse_line(char *line, struct digest_cache_key *key,
+                                   int *algorithm, char **hash) {
+  uint64_t f[5];
+  char *name, *end;
+  int i;
+  for (i = 0; i < 5; i++)
+    if (digest_cache_parse_u64(line + i * 17, &f[i]) != 0)
+      return -1;
+  name = line + 5 * 17;
+  *hash = strchr(name, ' ');
+  if (*hash == NULL)
+    return -1;
+  *(*hash)++ = '\0';
+  end = *hash + strcspn(*hash, "\r\n");
+  *end = '\0';
+  *algorithm = (int)string2checksum(name);
+  if (digest_cache_algorithm_name(*algorithm) == NULL || **hash == '\0' ||
+      (size_t)(end - *hash) > 128)
+    return -1;
+  key->dev = f[0];
+  key->ino = f[1];
+  key->size = f[2];
+  key->mtime_ns = (int64_t)f[3];
+  key->ctime_ns = (int64_t)f[4];
+  return 0;
+}
+
+/* Replace the index with just the live entries */
+static void digest_cache_rewrite(struct acquire_digest_cache *cache) {
+  char line[5 * 17 + 16 + 130];
+  char *tmp_path;
+  FILE *f;
+  size_t i;
+  int ok;
+  tmp_path = (char *)malloc(strlen(cache->index_path) + 5);
+  if (tmp_path == NULL)
+    return;
+  sprintf(tmp_path, "%s.tmp", cache->index_path);
+  f = fopen(tmp_path, "wb");
+  if (f == NULL) {
+    free(tmp_path);
+    return;
+  }
+  ok = fputs(DIGEST_CACHE_MAGIC, f) >= 0;
+  for (i = 0; ok && i < cache->capacity; i++)
+    if (cache->slots[i].algorithm >= 0 && cache->slots[i].hash[0]) {
+      digest_cache_format_line(line, &cache->slots[i]);
+      ok = fputs(line, f) >= 0;
+    }
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path, cache->index_path) != 0)
+    remove(tmp_path);
+  free(tmp_path);
+}
+
+static void digest_cache_load(struct acquire_digest_cache *cache) {
+  char line[512];
+  size_t lines = 0;
+  FILE *f = fopen(cache->index_path, "rb");
+  if (f == NULL)
+    return;
+  if (fgets(line, sizeof(line), f) == NULL ||
+      strcmp(line, DIGEST_CACHE_MAGIC) != 0) {
+    /* Unknown layout: start over rather than misread it */
+    fclose(f);
+    remove(cache->index_path);
+    return;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    struct digest_cache_key key;
+    int algorithm;
+    char *hash;
+    lines++;
+    /* Later lines supersede earlier ones for the same file */
+    if (digest_cache_parse_line(line, &key, &algorithm, &hash) == 0)
+      digest_cache_put(cache, &key, algorithm, hash);
+  }
+  fclose(f);
+  if (lines > 2 * cache->count + 64)
+    digest_cache_rewrite(cache);
+}
+
+#if ACQUIRE_DIGEST_CACHE_SUPPORTED
+/* Write all of `s`; an `O_APPEND` descriptor places it at the end whole */
+static int digest_cache_write_all(int fd, const char *s) {
+  size_t left = strlen(s);
+  while (left > 0) {
+    const ssize_t n = write(fd, s, left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    s += n;
+    left -= (size_t)n;
+  }
+  return 0;
+}
+
+static void digest_cache_append(struct acquire_digest_cache *cache,
+                                const struct digest_cache_entry *e) {
+  char line[5 * 17 + 16 + 130];
+  struct stat st;
+  int fd;
+  if (cache->index_path == NULL)
+    return;
+  fd = open(cache->index_path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+  if (fd < 0)
+    return;
+  digest_cache_format_line(line, e);
+  /*
+   * A single `write` per line on an `O_APPEND` descriptor, so concurrent
+   * appenders do not interleave; a second magic line from a racing
+   * creator is skipped on load like any other unparseable line.
+   */
+  if ((fstat(fd, &st) != 0 || st.st_size > 0 ||
+       digest_cache_write_all(fd, DIGEST_CACHE_MAGIC) == 0))
+    digest_cache_write_all(fd, line);
+  close(fd);
+}
+#endif /* ACQUIRE_DIGEST_CACHE_SUPPORTED */
+
+struct acquire_digest_cache *acquire_digest_cache_open(const char *index_path) {
+  struct acquire_digest_cache *cache = (struct acquire_digest_cache *)calloc(
+      1, sizeof(struct acquire_digest_cache));
+  if (cache == NULL)
+    return NULL;
+  if (acquire_mutex_init(&cache->lock) != 0) { /* LCOV_EXCL_START */
+    free(cache);
+    return NULL;
+  } /* LCOV_EXCL_STOP */
+  if (index_path != NULL) {
+    cache->index_path = (char *)malloc(strlen(index_path) + 1);
+    if (cache->index_path == NULL) { /* LCOV_EXCL_START */
+      acquire_digest_cache_close(cache);
+      return NULL;
+    } /* LCOV_EXCL_STOP */
+    strcpy(cache->index_path, index_path);
+  }
+  if (digest_cache_grow(cache) != 0) { /* LCOV_EXCL_START */
+    acquire_digest_cache_close(cache);
+    return NULL;
+  } /* LCOV_EXCL_STOP */
+  if (cache->index_path != NULL && ACQUIRE_DIGEST_CACHE_SUPPORTED)
+    digest_cache_load(cache);
+  return cache;
+}
+
+void acquire_digest_cache_close(struct acquire_digest_cache *cache) {
+  if (cache == NULL)
+    return;
+  acquire_mutex_destroy(&cache->lock);
+  free(cache->index_path);
+  free(cache->slots);
+  free(cache);
+}
+
+static struct acquire_digest_cache *digest_cache_default_instance = NULL;
+/* Guards `digest_cache_default_instance` */
+static acquire_mutex_t digest_cache_default_lock;
+static acquire_once_t digest_cache_default_once = ACQUIRE_ONCE_INIT;
+
+static void digest_cache_default_init(void) {
+  acquire_mutex_init(&digest_cache_default_lock);
+}
+
+void acquire_digest_cache_set_default(struct acquire_digest_cache *cache) {
+  acquire_once(&digest_cache_default_once, digest_cache_default_init);
+  acquire_mutex_lock(&digest_cache_default_lock);
+  digest_cache_default_instance = cache;
+  acquire_mutex_unlock(&digest_cache_default_lock);
+}
+
+struct acquire_digest_cache *acquire_digest_cache_default(void) {
+  struct acquire_digest_cache *cache;
+  acquire_once(&digest_cache_default_once, digest_cache_default_init);
+  acquire_mutex_lock(&digest_cache_default_lock);
+  cache = digest_cache_default_instance;
+  acquire_mutex_unlock(&digest_cache_default_lock);
+  return cache;
+}
+
+/* As `acquire_digest_cache_lookup`, or `-2` if the file cannot be stat'ed */
+static int digest_cache_lookup_key(struct acquire_digest_cache *cache,
+                                   const char *filepath,
+                                   enum Checksum algorithm,
+                                   const char *expected_hash,
+                                   struct digest_cache_key *key) {
+#if ACQUIRE_DIGEST_CACHE_SUPPORTED
+  struct digest_cache_entry *e;
+  int result = -1;
+  if (digest_cache_stat(filepath, key) != 0)
+    return -2;
+  acquire_mutex_lock(&cache->lock);
+  e = digest_cache_find(cache, key, (int)algorithm);
+  if (e->algorithm >= 0 && e->hash[0]) {
+    if (!digest_cache_key_equal(&e->key, key)) {
+      e->hash[0] = '\0';
+      cache->stats.stale++;
+    } else {
+      result = strcasecmp(e->hash, expected_hash) == 0;
+    }
+  }
+  if (result < 0)
+    cache->stats.misses++;
+  else
+    cache->stats.hits++;
+  acquire_mutex_unlock(&cache->lock);
+  return result;
+#else
+  (void)filepath;
+  (void)algorithm;
+  (void)expected_hash;
+  (void)key;
+  acquire_mutex_lock(&cache->lock);
+  cache->stats.misses++;
+  acquire_mutex_unlock(&cache->lock);
+  return -1;
+#endif /* ACQUIRE_DIGEST_CACHE_SUPPORTED */
+}
+
+int acquire_digest_cache_lookup(struct acquire_digest_cache *cache,
+                                const char *filepath, enum Checksum algorithm,
+                                const char *expected_hash) {
+  struct digest_cache_key key;
+  int result;
+  if (cache == NULL || filepath == NULL || expected_hash == NULL)
+    return -1;
+  result = digest_cache_lookup_key(cache, filepath, algorithm, expected_hash,
+                                   &key);
+  return result < -1 ? -1 : result;
+}
+
+/* Store against `key` if the file still matches it and is not racy */
+static int digest_cache_store_key(struct acquire_digest_cache *cache,
+                                  const char *filepath,
+                                  const struct digest_cache_key *key,
+                                  enum Checksum algorithm, const char *hash,
+                                  time_t verified_at) {
+#if ACQUIRE_DIGEST_CACHE_SUPPORTED
+  struct digest_cache_key now;
+  struct digest_cache_entry *e;
+  int rc = -1;
+  if (digest_cache_algorithm_name((int)algorithm) == NULL ||
+      digest_cache_stat(filepath, &now) != 0 ||
+      !digest_cache_key_equal(key, &now) ||
+      key->mtime_ns / 1000000000 >=
+          (int64_t)verified_at - ACQUIRE_DIGEST_CACHE_RACY_SECONDS)
+    return -1;
+  acquire_mutex_lock(&cache->lock);
+  if (digest_cache_put(cache, key, (int)algorithm, hash) == 0) {
+    e = digest_cache_find(cache, key, (int)algorithm);
+    digest_cache_append(cache, e);
+    cache->stats.stores++;
+    rc = 0;
+  }
+  acquire_mutex_unlock(&cache->lock);
+  return rc;
+#else
+  (void)cache;
+  (void)filepath;
+  (void)key;
+  (void)algorithm;
+  (void)hash;
+  (void)verified_at;
+  return -1;
+#endif /* ACQUIRE_DIGEST_CACHE_SUPPORTED */
+}
+
+int acquire_digest_cache_store(struct acquire_digest_cache *cache,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *hash) {
+#if ACQUIRE_DIGEST_CACHE_SUPPORTED
+  struct digest_cache_key key;
+  if (cache == NULL || filepath == NULL || hash == NULL ||
+      digest_cache_stat(filepath, &key) != 0)
+    return -1;
+  return digest_cache_store_key(cache, filepath, &key, algorithm, hash,
+                                time(NULL));
+#else
+  (void)cache;
+  (void)filepath;
+  (void)algorithm;
+  (void)hash;
+  return -1;
+#endif /* ACQUIRE_DIGEST_CACHE_SUPPORTED */
+}
+
+int acquire_verify_cached(struct acquire_digest_cache *cache,
+                          struct acquire_handle *handle, const char *filepath,
+                          enum Checksum algorithm, const char *expected_hash) {
+  struct digest_cache_key key;
+  time_t started;
+  int cached;
+  if (cache == NULL || handle == NULL || filepath == NULL ||
+      expected_hash == NULL)
+    return acquire_verify_sync(handle, filepath, algorithm, expected_hash);
+  cached = digest_cache_lookup_key(cache, filepath, algorithm, expected_hash,
+                                   &key);
+  if (cached == 1) {
+    handle->error.code = ACQUIRE_OK;
+    handle->error.message[0] = '\0';
+    handle->status = ACQUIRE_COMPLETE;
+    return 0;
+  }
+  /* Only a match skips the read; a recorded mismatch is hashed again */
+  started = time(NULL);
+  if (acquire_verify_sync(handle, filepath, algorithm, expected_hash) != 0)
+    return -1;
+  if (cached >= -1)
+    digest_cache_store_key(cache, filepath, &key, algorithm, expected_hash,
+                           started);
+  return 0;
+}
+
+void acquire_digest_cache_get_stats(struct acquire_digest_cache *cache,
+                                    struct acquire_digest_cache_stats *stats) {
+  if (stats == NULL)
+    return;
+  if (cache == NULL) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+  acquire_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  acquire_mutex_unlock(&cache->lock);
+}
+
+#endif /* !ACQUIRE_DIGEST_CACHE_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_DIGEST_CACHE_H */
@@ -0,0 +1,325 @@
+#ifndef LIBACQUIRE_ACQUIRE_DIGEST_POOL_H
+#define LIBACQUIRE_ACQUIRE_DIGEST_POOL_H
+
+/*
+ * Per-thread pools of hashing contexts, so verifying thousands of small
+ * files does not pay for a context allocation and algorithm lookup on
+ * each one.
+ *
+ * With OpenSSL 3 `EVP_DigestInit_ex(ctx, EVP_sha256(), NULL)` fetches the
+ * provider implementation on every call, which for 1-10 KB files costs
+ * more than the hashing. Here each `EVP_MD` is fetched once per process
+ * and a released `EVP_MD_CTX` keeps its provider state, so the next
+ * `EVP_DigestInit_ex` only resets it. librhash contexts are reused
+ * through `rhash_reset` when the same algorithm mask is requested again.
+ *
+ * Contexts may be released on a different thread than the one that took
+ * them; they join the releasing thread's pool. Each pool holds at most
+ * `ACQUIRE_DIGEST_POOL_SIZE` contexts per algorithm and is freed when its
+ * thread exits. The main thread's is not, as the process exits rather than
+ * the thread; `acquire_digest_pool_cleanup` frees it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "acquire_common_defs.h"
+#include "libacquire_export.h"
+
+#if defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL ||               \
+    defined(LIBACQUIRE_USE_LIBRESSL) && LIBACQUIRE_USE_LIBRESSL
+#include <openssl/evp.h>
+#define ACQUIRE_DIGEST_POOL_EVP 1
+#endif
+#if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
+#include <rhash.h>
+#define ACQUIRE_DIGEST_POOL_RHASH 1
+#endif
+
+#ifndef ACQUIRE_DIGEST_POOL_SIZE
+#define ACQUIRE_DIGEST_POOL_SIZE 4
+#endif /* !ACQUIRE_DIGEST_POOL_SIZE */
+
+/**
+ * @brief Turn pooling on (the default) or off. When off, every context is
+ * created, initialised by name and freed as before; meant for measuring
+ * the difference.
+ */
+extern LIBACQUIRE_EXPORT void acquire_digest_pool_set_enabled(int enabled);
+
+/**
+ * @brief Free the calling thread's pool and the `EVP_MD`s fetched for all
+ * threads, e.g. before `main` returns so leak checkers see a clean exit.
+ *
+ * Call it while no other thread is hashing. Pooling carries on afterwards,
+ * starting again from empty.
+ */
+extern LIBACQUIRE_EXPORT void acquire_digest_pool_cleanup(void);
+
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+/**
+ * @brief The SHA256 or SHA512 implementation, fetched once per process.
+ *
+ * @return `NULL` for any other algorithm.
+ */
+extern LIBACQUIRE_EXPORT const EVP_MD *
+acquire_digest_pool_evp_md(enum Checksum algorithm);
+
+/**
+ * @brief A context for `algorithm`, initialised and ready for
+ * `EVP_DigestUpdate`.
+ *
+ * @return `NULL` if the algorithm is not SHA256/SHA512 or on failure.
+ */
+extern LIBACQUIRE_EXPORT EVP_MD_CTX *
+acquire_digest_pool_evp_take(enum Checksum algorithm);
+
+/**
+ * @brief Give back a context from `acquire_digest_pool_evp_take`, finished
+ * or not. `NULL` is ignored.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_digest_pool_evp_give(enum Checksum algorithm, EVP_MD_CTX *ctx);
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+
+#ifdef ACQUIRE_DIGEST_POOL_RHASH
+/**
+ * @brief A freshly reset librhash context computing `hash_ids` (a mask of
+ * `RHASH_*` ids). Also initialises librhash on first use.
+ *
+ * @return `NULL` on failure.
+ */
+extern LIBACQUIRE_EXPORT rhash
+acquire_digest_pool_rhash_take(unsigned int hash_ids);
+
+/**
+ * @brief Give back a context from `acquire_digest_pool_rhash_take` with the
+ * same `hash_ids`. `NULL` is ignored.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_digest_pool_rhash_give(unsigned int hash_ids, rhash ctx);
+#endif /* ACQUIRE_DIGEST_POOL_RHASH */
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_DIGEST_POOL_IMPL_
+#define ACQUIRE_DIGEST_POOL_IMPL_
+
+#include <stdlib.h>
+
+#include "acquire_threads.h"
+
+static int digest_pool_enabled = 1;
+
+void acquire_digest_pool_set_enabled(int enabled) {
+  acquire_atomic_store_int(&digest_pool_enabled, enabled != 0);
+}
+
+/* Without a library to pool contexts for, only the switch above remains */
+#if defined(ACQUIRE_DIGEST_POOL_EVP) || defined(ACQUIRE_DIGEST_POOL_RHASH)
+#define ACQUIRE_DIGEST_POOL_ANY 1
+struct digest_pool {
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+  /* Indexed by `digest_pool_evp_slot`: SHA256, then SHA512 */
+  EVP_MD_CTX *evp[2][ACQUIRE_DIGEST_POOL_SIZE];
+  size_t evp_count[2];
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+#ifdef ACQUIRE_DIGEST_POOL_RHASH
+  rhash rh[ACQUIRE_DIGEST_POOL_SIZE];
+  unsigned int rh_ids[ACQUIRE_DIGEST_POOL_SIZE];
+  size_t rh_count;
+#endif /* ACQUIRE_DIGEST_POOL_RHASH */
+  int unused;
+};
+
+static acquire_once_t digest_pool_once = ACQUIRE_ONCE_INIT;
+static acquire_tls_key_t digest_pool_key;
+static int digest_pool_key_ok = 0;
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+static const EVP_MD *digest_pool_md[2];
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+
+static void ACQUIRE_TLS_CALLBACK digest_pool_destroy(void *value) {
+  struct digest_pool *pool = (struct digest_pool *)value;
+  size_t i;
+  if (!pool)
+    return;
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+  for (i = 0; i < pool->evp_count[0]; i++)
+    EVP_MD_CTX_free(pool->evp[0][i]);
+  for (i = 0; i < pool->evp_count[1]; i++)
+    EVP_MD_CTX_free(pool->evp[1][i]);
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+#ifdef ACQUIRE_DIGEST_POOL_RHASH
+  for (i = 0; i < pool->rh_count; i++)
+    rhash_free(pool->rh[i]);
+#endif /* ACQUIRE_DIGEST_POOL_RHASH */
+  (void)i;
+  free(pool);
+}
+
+static void digest_pool_init(void) {
+  digest_pool_key_ok =
+      acquire_tls_create(&digest_pool_key, digest_pool_destroy) == 0;
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+  digest_pool_md[0] = EVP_MD_fetch(NULL, "SHA256", NULL);
+  digest_pool_md[1] = EVP_MD_fetch(NULL, "SHA512", NULL);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+  if (!digest_pool_md[0])
+    digest_pool_md[0] = EVP_sha256();
+  if (!digest_pool_md[1])
+    digest_pool_md[1] = EVP_sha512();
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+#ifdef ACQUIRE_DIGEST_POOL_RHASH
+  rhash_library_init();
+#endif /* ACQUIRE_DIGEST_POOL_RHASH */
+}
+
+/* This thread's pool, created on first use; `NULL` if disabled or OOM */
+static struct digest_pool *digest_pool_get(int create) {
+  struct digest_pool *pool;
+  if (!digest_pool_key_ok || !acquire_atomic_load_int(&digest_pool_enabled))
+    return NULL;
+  pool = (struct digest_pool *)acquire_tls_get(digest_pool_key);
+  if (!pool && create) {
+    pool = (struct digest_pool *)calloc(1, sizeof *pool);
+    if (pool && acquire_tls_set(digest_pool_key, pool) != 0) {
+      free(pool);
+      pool = NULL;
+    }
+  }
+  return pool;
+}
+#endif /* defined(ACQUIRE_DIGEST_POOL_EVP) ||                                \
+          defined(ACQUIRE_DIGEST_POOL_RHASH) */
+
+void acquire_digest_pool_cleanup(void) {
+#ifdef ACQUIRE_DIGEST_POOL_ANY
+  struct digest_pool *pool;
+  if (digest_pool_key_ok) {
+    pool = (struct digest_pool *)acquire_tls_get(digest_pool_key);
+    if (pool) {
+      acquire_tls_set(digest_pool_key, NULL);
+      digest_pool_destroy(pool);
+    }
+  }
+#endif /* ACQUIRE_DIGEST_POOL_ANY */
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+  /* Contexts elsewhere hold references of their own; built-ins are ignored */
+  EVP_MD_free((EVP_MD *)digest_pool_md[0]);
+  EVP_MD_free((EVP_MD *)digest_pool_md[1]);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x30000000L */
+  /* Later takes use the built-ins */
+  digest_pool_md[0] = EVP_sha256();
+  digest_pool_md[1] = EVP_sha512();
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+}
+
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+static int digest_pool_evp_slot(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_SHA256:
+    return 0;
+  case LIBACQUIRE_SHA512:
+    return 1;
+  default:
+    return -1;
+  }
+}
+
+const EVP_MD *acquire_digest_pool_evp_md(enum Checksum algorithm) {
+  const int slot = digest_pool_evp_slot(algorithm);
+  if (slot < 0)
+    return NULL;
+  acquire_once(&digest_pool_once, digest_pool_init);
+  return digest_pool_md[slot];
+}
+
+EVP_MD_CTX *acquire_digest_pool_evp_take(enum Checksum algorithm) {
+  const int slot = digest_pool_evp_slot(algorithm);
+  struct digest_pool *pool;
+  EVP_MD_CTX *ctx = NULL;
+  const EVP_MD *md;
+  if (slot < 0)
+    return NULL;
+  acquire_once(&digest_pool_once, digest_pool_init);
+  pool = digest_pool_get(1);
+  if (pool) {
+    md = digest_pool_md[slot];
+    if (pool->evp_count[slot] > 0)
+      ctx = pool->evp[slot][--pool->evp_count[slot]];
+  } else {
+    /* Unpooled: exactly the per-file work the backends used to do */
+    md = slot == 0 ? EVP_sha256() : EVP_sha512();
+  }
+  if (!ctx)
+    ctx = EVP_MD_CTX_new();
+  if (!ctx)
+    return NULL;
+  /* Same `md` as last time: OpenSSL 3 reinitialises the provider context
+   * in place rather than freeing and refetching it */
+  if (EVP_DigestInit_ex(ctx, md, NULL) != 1) {
+    EVP_MD_CTX_free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+void acquire_digest_pool_evp_give(enum Checksum algorithm, EVP_MD_CTX *ctx) {
+  const int slot = digest_pool_evp_slot(algorithm);
+  struct digest_pool *pool;
+  if (!ctx)
+    return;
+  pool = slot < 0 ? NULL : digest_pool_get(1);
+  if (pool && pool->evp_count[slot] < ACQUIRE_DIGEST_POOL_SIZE)
+    pool->evp[slot][pool->evp_count[slot]++] = ctx;
+  else
+    EVP_MD_CTX_free(ctx);
+}
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+
+#ifdef ACQUIRE_DIGEST_POOL_RHASH
+rhash acquire_digest_pool_rhash_take(unsigned int hash_ids) {
+  struct digest_pool *pool;
+  size_t i;
+  acquire_once(&digest_pool_once, digest_pool_init);
+  pool = digest_pool_get(1);
+  if (pool)
+    for (i = pool->rh_count; i-- > 0;)
+      if (pool->rh_ids[i] == hash_ids) {
+        rhash ctx = pool->rh[i];
+        /* Keep the rest packed: move the last one into the hole */
+        pool->rh_count--;
+        pool->rh[i] = pool->rh[pool->rh_count];
+        pool->rh_ids[i] = pool->rh_ids[pool->rh_count];
+        rhash_reset(ctx);
+        return ctx;
+      }
+  return rhash_init(hash_ids);
+}
+
+void acquire_digest_pool_rhash_give(unsigned int hash_ids, rhash ctx) {
+  struct digest_pool *pool;
+  if (!ctx)
+    return;
+  pool = digest_pool_get(1);
+  if (pool && pool->rh_count < ACQUIRE_DIGEST_POOL_SIZE) {
+    pool->rh[pool->rh_count] = ctx;
+    pool->rh_ids[pool->rh_count] = hash_ids;
+    pool->rh_count++;
+  } else {
+    rhash_free(ctx);
+  }
+}
+#endif /* ACQUIRE_DIGEST_POOL_RHASH */
+
+#endif /* !ACQUIRE_DIGEST_POOL_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_DIGEST_POOL_H */
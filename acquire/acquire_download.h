@@ -25,6 +25,263 @@ acquire_download_async_poll(struct acquire_handle *handle);
 extern LIBACQUIRE_EXPORT void
 acquire_download_async_cancel(struct acquire_handle *handle);
 
+/* --- Event-loop API --- */
+
+/* Passed to `acquire_download_socket_action` when the timeout is due */
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define ACQUIRE_SOCKET_TIMEOUT ((acquire_socket_t)~0)
+#else
+#define ACQUIRE_SOCKET_TIMEOUT (-1)
+#endif
+
+/* A socket an in-progress download wants watched */
+struct acquire_download_fd {
+  acquire_socket_t fd;
+  /* `ACQUIRE_EVENT_IN` and/or `ACQUIRE_EVENT_OUT` */
+  int events;
+};
+
+/**
+ * @brief The sockets an async download is waiting on and how long until it
+ * next needs to run, for callers that run their own event loop.
+ *
+ * Up to `max` sockets are copied into `fds`. Wait for any of them to become
+ * ready or for `*timeout_ms` to pass (`-1` means no timeout is due), then
+ * call `acquire_download_socket_action`. An idle download costs nothing
+ * between those calls. See also `acquire_handle_set_event_hooks`.
+ *
+ * @return How many sockets there are, which may exceed `max`, or `-1` on
+ * error. A download that is not in progress has none and no timeout.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_download_get_fds(struct acquire_handle *handle,
+                         struct acquire_download_fd *fds, size_t max,
+                         long *timeout_ms);
+
+/**
+ * @brief Run an async download after `fd` saw `events` (`ACQUIRE_EVENT_*`),
+ * or after its timeout passed if `fd` is `ACQUIRE_SOCKET_TIMEOUT`.
+ *
+ * Use this or `acquire_download_async_poll` to drive a download, not both.
+ * A cancelled download stops at the next call. Downloads on a shared
+ * engine are driven through the engine: for them this only returns the
+ * status, and `acquire_download_get_fds` reports nothing.
+ *
+ * @return The download's status, as from `acquire_download_async_poll`.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_status
+acquire_download_socket_action(struct acquire_handle *handle,
+                               acquire_socket_t fd, int events);
+
+/* --- Shared engine --- */
+
+/* HTTP/2 streams an engine runs at once over one connection by default */
+#ifndef ACQUIRE_ENGINE_MAX_STREAMS
+#define ACQUIRE_ENGINE_MAX_STREAMS 100
+#endif /* !ACQUIRE_ENGINE_MAX_STREAMS */
+
+/**
+ * @brief Create an engine: one multi stack that drives the downloads of
+ * every handle attached to it with `acquire_handle_set_engine`.
+ *
+ * However many downloads are attached, one `acquire_engine_poll` (or
+ * `acquire_engine_socket_action`) call moves all of them along, and a
+ * download's own handle says when it has finished.
+ *
+ * @return The engine, or `NULL` if it could not be created.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_engine *acquire_engine_create(void);
+
+/**
+ * @brief Free `engine`. Downloads still attached to it fail with
+ * `ACQUIRE_ERROR_CANCELLED`.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_engine_free(struct acquire_engine *engine);
+
+/**
+ * @brief Move every download on `engine` along, first waiting up to
+ * `max_wait_msec` milliseconds for the network if it is idle.
+ *
+ * Each download that finishes, fails or was cancelled is settled on its
+ * own handle, which can then be reused or freed.
+ *
+ * @return How many downloads are still in progress, or `-1` on error.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_engine_poll(struct acquire_engine *engine,
+                    unsigned long max_wait_msec);
+
+/**
+ * @brief The sockets and timeout of all the downloads on `engine`; as
+ * `acquire_download_get_fds` is for one.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_engine_get_fds(struct acquire_engine *engine,
+                       struct acquire_download_fd *fds, size_t max,
+                       long *timeout_ms);
+
+/**
+ * @brief Move the downloads on `engine` along after `fd` saw `events`, or
+ * after the timeout passed; as `acquire_download_socket_action` is for one.
+ *
+ * @return How many downloads are still in progress, or `-1` on error.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_engine_socket_action(struct acquire_engine *engine,
+                             acquire_socket_t fd, int events);
+
+/**
+ * @brief Tell an external event loop of `engine`'s socket and timeout
+ * changes; as `acquire_handle_set_event_hooks`, with a `NULL` handle. Set
+ * these before the first download starts.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_engine_set_event_hooks(struct acquire_engine *engine,
+                               acquire_socket_fn socket_fn,
+                               acquire_timer_fn timer_fn, void *user_data);
+
+/**
+ * @brief Limit what `engine` opens to any one origin (scheme, host and
+ * port): at most `max_connections` connections (`0` for no limit), each
+ * carrying up to `max_streams` HTTP/2 streams at once.
+ *
+ * Downloads over HTTPS speak HTTP/2 where the server does, and those to
+ * one origin wait for its connection and multiplex over it rather than
+ * each opening their own. Downloads beyond the limits queue until a
+ * stream frees up. The default is no connection limit and
+ * `ACQUIRE_ENGINE_MAX_STREAMS` streams.
+ *
+ * @return `0` on success, `-1` if a limit is out of range.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_engine_set_origin_limits(struct acquire_engine *engine,
+                                 long max_connections, long max_streams);
+
+/* --- Batches --- */
+
+/*
+ * Connections a batch without an engine opens to any one origin. Without
+ * a limit, each download queued behind a full HTTP/2 connection would
+ * open one of its own.
+ */
+#ifndef ACQUIRE_BATCH_MAX_CONNECTIONS
+#define ACQUIRE_BATCH_MAX_CONNECTIONS 6
+#endif /* !ACQUIRE_BATCH_MAX_CONNECTIONS */
+
+/* One download of a batch: `url` to `dest_path`, reported on `handle` */
+struct acquire_download_item {
+  struct acquire_handle *handle;
+  const char *url;
+  const char *dest_path;
+};
+
+/**
+ * @brief Download every item of `items[0..count)` at once on `engine`, or
+ * on an engine of their own limited to `ACQUIRE_BATCH_MAX_CONNECTIONS`
+ * connections per origin if it is `NULL`, and wait for them all.
+ *
+ * Each item needs a handle of its own, which is on `engine` only for the
+ * call. Downloads from one origin share its connections, so hundreds of
+ * files from one mirror cost one TLS handshake rather than hundreds. Other
+ * downloads on `engine` move along meanwhile. How each item went is on its
+ * handle.
+ *
+ * @return How many items failed, or `-1` on error.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_download_batch(struct acquire_engine *engine,
+                       const struct acquire_download_item *items,
+                       size_t count);
+
+/* --- Sessions --- */
+
+/**
+ * @brief Create a session: caches shared by the downloads of every handle
+ * attached to it with `acquire_handle_set_session`.
+ *
+ * Downloads in a session share resolved host names, open connections, TLS
+ * session tickets and HSTS entries, so a second download from the same
+ * server skips the lookup and handshakes. Transfer handles are also kept
+ * for the next download rather than rebuilt each time. Handles in one
+ * session may download on different threads.
+ *
+ * @return The session, or `NULL` if it could not be created.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_session *acquire_session_create(void);
+
+/**
+ * @brief Free `session`, once no download that uses it is in progress.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_session_free(struct acquire_session *session);
+
+/* --- Verified API --- */
+
+/**
+ * @brief Download `url` to `dest_path`, hashing the data as it is written
+ * rather than reading the file back afterwards.
+ *
+ * Drive it with `acquire_download_async_poll`. The download only completes
+ * if the data has digest `expected_hash`; otherwise it fails with
+ * `ACQUIRE_ERROR_CHECKSUM_MISMATCH` and the file is left as received. The
+ * computed digest is in the handle's `digests[0]` either way.
+ *
+ * @return `0` if started, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int acquire_download_verified_async_start(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    enum Checksum algorithm, const char *expected_hash);
+
+/**
+ * @brief Blocking form of `acquire_download_verified_async_start`.
+ *
+ * @return `0` if downloaded and matched, `-1` otherwise.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_download_verified_sync(struct acquire_handle *handle, const char *url,
+                               const char *dest_path, enum Checksum algorithm,
+                               const char *expected_hash);
+
+/**
+ * @brief Carry on a verified download from `checkpoint`, which
+ * `acquire_checkpoint` took while an earlier one was running.
+ *
+ * `dest_path` must still hold at least the bytes the checkpoint covers;
+ * whatever follows them is replaced. Only the rest of the file is
+ * requested, and hashing carries on from the saved state, so the part
+ * already on disk is neither downloaded nor read again. Servers that cannot
+ * send part of a file fail the download.
+ *
+ * @return `0` if started, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int acquire_download_verified_resume_async_start(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    enum Checksum algorithm, const char *expected_hash,
+    const void *checkpoint, size_t checkpoint_size);
+
+/* --- Block repair; see `acquire_blocks.h` --- */
+
+struct acquire_block_manifest;
+
+/**
+ * @brief Fetch blocks `blocks[0..count)` of `manifest`, in ascending order,
+ * from `url` again and write them into `dest_path` in place.
+ *
+ * Runs of adjacent blocks are requested as one byte range, so only the
+ * damaged parts of the file cross the network. The file is then cut to the
+ * manifest's size and the repaired blocks are checked against it. Servers
+ * that cannot send part of a file fail the repair.
+ *
+ * @return `0` if every listed block now matches, `-1` otherwise (details on
+ * the handle); `ACQUIRE_ERROR_CHECKSUM_MISMATCH` if the server sent the
+ * wrong data.
+ */
+extern LIBACQUIRE_EXPORT int acquire_download_repair_blocks(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    const struct acquire_block_manifest *manifest, const size_t *blocks,
+    size_t count);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
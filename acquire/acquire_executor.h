@@ -0,0 +1,446 @@
+#ifndef LIBACQUIRE_ACQUIRE_EXECUTOR_H
+#define LIBACQUIRE_ACQUIRE_EXECUTOR_H
+
+/*
+ * Worker threads that run checksum verifications off the caller's thread.
+ *
+ * Once a handle has an executor (`acquire_handle_set_executor`),
+ * `acquire_verify_async_start` and `acquire_verify_multi_async_start`
+ * validate their arguments and open the file as usual, then queue the
+ * hashing and return. From then on `acquire_verify_async_poll` only reads
+ * the job's state, `acquire_handle_get_progress` reports the bytes hashed,
+ * and the descriptor from `acquire_handle_get_completion_fd` becomes
+ * readable when the job is done, ready for `epoll`/`kqueue`/`poll`.
+ *
+ * While a job is queued or running the handle belongs to the executor: use
+ * only the poll, cancel, progress and wait functions on it. Starting another
+ * verification fails, and until the job is collected the handle's error
+ * code is then `ACQUIRE_ERROR_INVALID_ARGUMENT`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "acquire_common_defs.h"
+#include "acquire_handle.h"
+#include "libacquire_export.h"
+
+/**
+ * @brief Start a pool of `threads` verification workers.
+ *
+ * One executor can be shared by any number of handles; jobs run in the
+ * order they were started.
+ *
+ * @param threads Worker threads, or `0` for one per online CPU.
+ *
+ * @return The executor, or `NULL` if no thread could be started.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_executor *
+acquire_executor_create(unsigned int threads);
+
+/**
+ * @brief Stop the workers once running jobs finish, cancelling queued ones.
+ *
+ * Jobs cancelled this way finish with `ACQUIRE_ERROR_CANCELLED`; collect
+ * them with `acquire_verify_async_poll` as usual, even after this returns.
+ * The executor does not track the handles given it, so detach each one with
+ * `acquire_handle_set_executor(handle, NULL)` before starting another
+ * verification on it.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_executor_free(struct acquire_executor *executor);
+
+/**
+ * @brief Descriptor that becomes readable when the handle's job finishes.
+ *
+ * An `eventfd` on Linux and a pipe elsewhere, created on first use and
+ * owned by the handle. It stays readable until the job is collected by
+ * `acquire_verify_async_poll`, so it suits level- and edge-triggered
+ * loops alike. Do not read from or close it.
+ *
+ * @return The descriptor, or `-1` if unavailable (always so on Windows;
+ * use `acquire_executor_wait` there).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_handle_get_completion_fd(struct acquire_handle *handle);
+
+/**
+ * @brief Block until the handle's queued verification is done and collect
+ * it.
+ *
+ * @return The final status, or the current one if nothing was queued.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_status
+acquire_executor_wait(struct acquire_handle *handle);
+
+typedef enum acquire_status (*acquire_verify_poll_fn)(
+    struct acquire_handle *handle);
+
+/*
+ * Internal: queue the verification a backend has just started on `handle`
+ * and drive it with `poll` on a worker. If it cannot be queued the handle
+ * is left to be polled on the caller's thread. Returns `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+_acquire_executor_submit(struct acquire_handle *handle,
+                         acquire_verify_poll_fn poll);
+
+/*
+ * Internal: `1` while the handle's job is running, else `0` once it has
+ * been collected (or there was none) and the handle's status is final.
+ */
+extern LIBACQUIRE_EXPORT int
+_acquire_executor_collect(struct acquire_handle *handle);
+
+/*
+ * Internal: `1` if the handle still belongs to a job and so cannot start
+ * another, which `acquire_handle_get_error_code` then reports as
+ * `ACQUIRE_ERROR_INVALID_ARGUMENT` until the job is collected; else `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+_acquire_executor_busy(struct acquire_handle *handle);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_EXECUTOR_IMPL_
+#define ACQUIRE_EXECUTOR_IMPL_
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_threads.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <stdint.h>
+#include <sys/eventfd.h>
+#endif /* defined(__linux__) */
+#endif
+
+/*
+ * Completion is guarded by the job's own lock rather than the executor's,
+ * so a finished job can still be collected after `acquire_executor_free`.
+ */
+struct acquire_verify_job {
+  struct acquire_verify_job *next;
+  struct acquire_handle *handle;
+  acquire_verify_poll_fn poll;
+  /* The handle's poll budget, restored when the job is collected */
+  size_t budget_bytes;
+  unsigned long budget_usec;
+  /*
+   * Why a verification started meanwhile was refused; kept here, as the
+   * backend still reads the handle's own error
+   */
+  struct acquire_error_info rejected;
+  acquire_mutex_t lock;
+  acquire_cond_t finished;
+  volatile int done;
+};
+
+struct acquire_executor {
+  acquire_mutex_t lock;
+  acquire_cond_t work; /* a job was queued, or shutting down */
+  struct acquire_verify_job *head, *tail;
+  acquire_thread_t *threads;
+  unsigned int n_threads;
+  int shutdown;
+};
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+static int executor_open_notify(struct acquire_handle *handle) {
+#if defined(__linux__) && defined(EFD_CLOEXEC) && defined(EFD_NONBLOCK)
+  const int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fd < 0)
+    return -1;
+  handle->completion_fd[0] = handle->completion_fd[1] = fd;
+#else
+  int fds[2], i;
+  if (pipe(fds) != 0)
+    return -1;
+  for (i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  handle->completion_fd[0] = fds[0];
+  handle->completion_fd[1] = fds[1];
+#endif
+  return 0;
+}
+
+static void executor_notify(struct acquire_handle *handle) {
+  ssize_t n;
+  if (handle->completion_fd[1] < 0)
+    return;
+#if defined(__linux__) && defined(EFD_CLOEXEC) && defined(EFD_NONBLOCK)
+  {
+    const uint64_t one = 1;
+    n = write(handle->completion_fd[1], &one, sizeof(one));
+  }
+#else
+  {
+    const char one = 1;
+    n = write(handle->completion_fd[1], &one, 1);
+  }
+#endif
+  (void)n; /* Full means already readable */
+}
+
+static void executor_drain_notify(struct acquire_handle *handle) {
+  char buf[64];
+  if (handle->completion_fd[0] < 0)
+    return;
+  while (read(handle->completion_fd[0], buf, sizeof(buf)) > 0)
+    ;
+}
+#else
+#define executor_notify(handle) ((void)(handle))
+#define executor_drain_notify(handle) ((void)(handle))
+#endif
+
+static void executor_run_job(struct acquire_verify_job *job) {
+  enum acquire_status status;
+  do {
+    status = job->poll(job->handle);
+  } while (status == ACQUIRE_IN_PROGRESS);
+}
+
+static void executor_worker_run(void *arg) {
+  struct acquire_executor *ex = (struct acquire_executor *)arg;
+  acquire_mutex_lock(&ex->lock);
+  for (;;) {
+    struct acquire_verify_job *job;
+    while (ex->head == NULL && !ex->shutdown)
+      acquire_cond_wait(&ex->work, &ex->lock);
+    if (ex->head == NULL)
+      break;
+    job = ex->head;
+    ex->head = job->next;
+    if (ex->head == NULL)
+      ex->tail = NULL;
+    if (ex->shutdown)
+      acquire_atomic_store_int(&job->handle->cancel_flag, 1);
+    acquire_mutex_unlock(&ex->lock);
+
+    executor_run_job(job);
+
+    /*
+     * Under the job's lock so `_acquire_executor_collect` cannot drain the
+     * descriptor between `done` and the notification. The job may be
+     * freed as soon as it is unlocked.
+     */
+    acquire_mutex_lock(&job->lock);
+    acquire_atomic_store_int(&job->done, 1);
+    executor_notify(job->handle);
+    acquire_cond_broadcast(&job->finished);
+    acquire_mutex_unlock(&job->lock);
+
+    acquire_mutex_lock(&ex->lock);
+  }
+  acquire_mutex_unlock(&ex->lock);
+}
+
+struct acquire_executor *acquire_executor_create(unsigned int threads) {
+  struct acquire_executor *ex;
+  unsigned int i;
+  if (threads == 0)
+    threads = acquire_cpu_count();
+  ex = (struct acquire_executor *)calloc(1, sizeof(struct acquire_executor));
+  if (!ex)
+    return NULL;
+  ex->threads = (acquire_thread_t *)calloc(threads, sizeof(acquire_thread_t));
+  if (!ex->threads) {
+    free(ex);
+    return NULL;
+  }
+  if (acquire_mutex_init(&ex->lock) != 0) {
+    free(ex->threads);
+    free(ex);
+    return NULL;
+  }
+  if (acquire_cond_init(&ex->work) != 0) {
+    acquire_mutex_destroy(&ex->lock);
+    free(ex->threads);
+    free(ex);
+    return NULL;
+  }
+  /* Settle for fewer workers if the system runs out of threads */
+  for (i = 0; i < threads; i++) {
+    if (acquire_thread_create(&ex->threads[i], executor_worker_run, ex) != 0)
+      break;
+    ex->n_threads++;
+  }
+  if (ex->n_threads == 0) {
+    acquire_executor_free(ex);
+    return NULL;
+  }
+  return ex;
+}
+
+void acquire_executor_free(struct acquire_executor *ex) {
+  unsigned int i;
+  if (!ex)
+    return;
+  acquire_mutex_lock(&ex->lock);
+  ex->shutdown = 1;
+  acquire_cond_broadcast(&ex->work);
+  acquire_mutex_unlock(&ex->lock);
+  for (i = 0; i < ex->n_threads; i++)
+    acquire_thread_join(ex->threads[i]);
+  acquire_cond_destroy(&ex->work);
+  acquire_mutex_destroy(&ex->lock);
+  free(ex->threads);
+  free(ex);
+}
+
+int acquire_handle_get_completion_fd(struct acquire_handle *handle) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  (void)handle;
+  return -1;
+#else
+  struct acquire_verify_job *job;
+  if (!handle)
+    return -1;
+  if (handle->completion_fd[0] >= 0)
+    return handle->completion_fd[0];
+  /* A worker may be about to notify this handle */
+  job = handle->job;
+  if (job)
+    acquire_mutex_lock(&job->lock);
+  if (executor_open_notify(handle) == 0 && job &&
+      acquire_atomic_load_int(&job->done))
+    executor_notify(handle);
+  if (job)
+    acquire_mutex_unlock(&job->lock);
+  return handle->completion_fd[0];
+#endif
+}
+
+int _acquire_executor_submit(struct acquire_handle *handle,
+                             acquire_verify_poll_fn poll) {
+  struct acquire_executor *ex;
+  struct acquire_verify_job *job;
+  if (!handle || !poll || !handle->executor || handle->job)
+    return 0;
+  ex = handle->executor;
+  job = (struct acquire_verify_job *)calloc(1, sizeof(*job));
+  if (!job)
+    return 0;
+  if (acquire_mutex_init(&job->lock) != 0) {
+    free(job);
+    return 0;
+  }
+  if (acquire_cond_init(&job->finished) != 0) {
+    acquire_mutex_destroy(&job->lock);
+    free(job);
+    return 0;
+  }
+  job->handle = handle;
+  job->poll = poll;
+  /* Nothing else shares the worker, so hash flat out as the sync API does */
+  job->budget_bytes = handle->poll_budget_bytes;
+  job->budget_usec = handle->poll_budget_usec;
+  acquire_handle_set_poll_budget(handle, 0, 0);
+
+  acquire_mutex_lock(&ex->lock);
+  if (ex->shutdown) {
+    acquire_mutex_unlock(&ex->lock);
+    acquire_handle_set_poll_budget(handle, job->budget_bytes,
+                                   job->budget_usec);
+    acquire_cond_destroy(&job->finished);
+    acquire_mutex_destroy(&job->lock);
+    free(job);
+    return 0;
+  }
+  handle->job = job;
+  if (ex->tail)
+    ex->tail->next = job;
+  else
+    ex->head = job;
+  ex->tail = job;
+  acquire_cond_broadcast(&ex->work);
+  acquire_mutex_unlock(&ex->lock);
+  return 0;
+}
+
+int _acquire_executor_collect(struct acquire_handle *handle) {
+  struct acquire_verify_job *job;
+  if (!handle || !handle->job)
+    return 0;
+  job = handle->job;
+  if (!acquire_atomic_load_int(&job->done))
+    return 1;
+  /* Wait out the worker's notification before draining it */
+  acquire_mutex_lock(&job->lock);
+  executor_drain_notify(handle);
+  acquire_mutex_unlock(&job->lock);
+  handle->job = NULL;
+  acquire_handle_set_poll_budget(handle, job->budget_bytes, job->budget_usec);
+  acquire_cond_destroy(&job->finished);
+  acquire_mutex_destroy(&job->lock);
+  free(job);
+  return 0;
+}
+
+int _acquire_executor_busy(struct acquire_handle *handle) {
+  static const char busy[] = "Handle is busy with an executor job";
+  if (!handle || !handle->job)
+    return 0;
+  handle->job->rejected.code = ACQUIRE_ERROR_INVALID_ARGUMENT;
+  memcpy(handle->job->rejected.message, busy, sizeof(busy));
+  return 1;
+}
+
+const struct acquire_error_info *
+_acquire_executor_rejection(const struct acquire_handle *handle) {
+  if (!handle || !handle->job || handle->job->rejected.code == ACQUIRE_OK)
+    return NULL;
+  return &handle->job->rejected;
+}
+
+enum acquire_status acquire_executor_wait(struct acquire_handle *handle) {
+  struct acquire_verify_job *job;
+  if (!handle)
+    return ACQUIRE_ERROR;
+  job = handle->job;
+  if (job) {
+    acquire_mutex_lock(&job->lock);
+    while (!acquire_atomic_load_int(&job->done))
+      acquire_cond_wait(&job->finished, &job->lock);
+    acquire_mutex_unlock(&job->lock);
+    _acquire_executor_collect(handle);
+  }
+  return handle->status;
+}
+
+void _acquire_executor_release(struct acquire_handle *handle) {
+  if (!handle)
+    return;
+  if (handle->job) {
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+    acquire_executor_wait(handle);
+  }
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+  if (handle->completion_fd[0] >= 0)
+    close(handle->completion_fd[0]);
+  if (handle->completion_fd[1] >= 0 &&
+      handle->completion_fd[1] != handle->completion_fd[0])
+    close(handle->completion_fd[1]);
+#endif
+  handle->completion_fd[0] = handle->completion_fd[1] = -1;
+}
+
+#endif /* !ACQUIRE_EXECUTOR_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_EXECUTOR_H */
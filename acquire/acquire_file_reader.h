@@ -0,0 +1,437 @@
+#ifndef LIBACQUIRE_ACQUIRE_FILE_READER_H
+#define LIBACQUIRE_ACQUIRE_FILE_READER_H
+
+/*
+ * Block reader shared by the checksum backends.
+ *
+ * Files are read with plain `read`/`pread` into one page-aligned buffer.
+ * With `ACQUIRE_FILE_READER_MAP`, regular files are memory-mapped instead
+ * and handed out as windows into the mapping, so digests are updated
+ * straight from the page cache with no copy; anything that cannot be mapped
+ * (empty files, pipes, address space exhaustion on 32-bit targets) is still
+ * read. Both paths ask the kernel for sequential read-ahead.
+ *
+ * A mapped file that is truncated while it is being hashed raises `SIGBUS`
+ * on POSIX, so only map files nothing else will shrink.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "libacquire_export.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include "acquire_windows.h"
+#endif
+
+#ifndef ACQUIRE_DEFAULT_READ_BUFFER_SIZE
+#define ACQUIRE_DEFAULT_READ_BUFFER_SIZE 262144
+#endif /* !ACQUIRE_DEFAULT_READ_BUFFER_SIZE */
+
+/* `acquire_file_reader_open` flag: map regular files rather than read them */
+#define ACQUIRE_FILE_READER_MAP 1
+
+struct acquire_file_reader {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  HANDLE file;
+  HANDLE mapping;
+#else
+  int fd;
+#endif
+  /* The whole file when mapped, otherwise `NULL` */
+  const unsigned char *map;
+  /* Read buffer of `block_size` bytes when not mapped */
+  unsigned char *buffer;
+  size_t block_size;
+  /* File size, or `-1` when it cannot be known up front (e.g., a pipe) */
+  off_t size;
+  /* Offset of the next block `acquire_file_reader_next` returns */
+  off_t offset;
+  /* `errno` value describing the last failure */
+  int error;
+  /* Set once the file is open; a zeroed reader is safe to close */
+  int opened;
+};
+
+/**
+ * @brief Open `path` for block-wise reading.
+ *
+ * @param block_size Bytes per block; `0` for
+ * `ACQUIRE_DEFAULT_READ_BUFFER_SIZE`.
+ * @param flags `0` or `ACQUIRE_FILE_READER_MAP`.
+ *
+ * @return `0` on success, `-1` with `reader->error` set on failure.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_file_reader_open(struct acquire_file_reader *reader, const char *path,
+                         size_t block_size, int flags);
+
+/**
+ * @brief Fetch the next block of the file.
+ *
+ * `*data` points into the mapping or the reader's buffer and stays valid
+ * until the next call on this reader.
+ *
+ * @return `1` with a non-empty block, `0` at end of file, `-1` on error.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_file_reader_next(struct acquire_file_reader *reader,
+                         const unsigned char **data, size_t *len);
+
+/**
+ * @brief Read up to `len` bytes at `offset` without moving the reader.
+ *
+ * Safe to call from several threads at once. Mapped files are returned in
+ * place; otherwise the bytes are read into the caller's `scratch`, which
+ * must hold `len` bytes.
+ *
+ * @return `0` on success (`*got` is `0` at end of file), or an `errno` value.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_file_reader_read_at(const struct acquire_file_reader *reader,
+                            off_t offset, size_t len, unsigned char *scratch,
+                            const unsigned char **data, size_t *got);
+
+/**
+ * @brief Continue `acquire_file_reader_next` from `offset`.
+ *
+ * @return `0` on success, `-1` with `reader->error` set on failure.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_file_reader_seek(struct acquire_file_reader *reader, off_t offset);
+
+/**
+ * @brief Describe `reader->error` in `buf`, for error messages.
+ *
+ * @return `buf`.
+ */
+extern LIBACQUIRE_EXPORT const char *
+acquire_file_reader_strerror(const struct acquire_file_reader *reader,
+                             char *buf, size_t len);
+
+/**
+ * @brief Unmap and close. Safe on a zeroed reader or one whose open failed.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_file_reader_close(struct acquire_file_reader *reader);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_FILE_READER_IMPL_
+#define ACQUIRE_FILE_READER_IMPL_
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <errhandlingapi.h>
+#include <fileapi.h>
+#include <handleapi.h>
+#include <malloc.h>
+#include <memoryapi.h>
+#include <winerror.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Read buffers are page aligned so the kernel can copy whole pages */
+#define ACQUIRE_FILE_READER_ALIGN 4096
+
+static unsigned char *file_reader_alloc(size_t size) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return (unsigned char *)_aligned_malloc(size, ACQUIRE_FILE_READER_ALIGN);
+#else
+  void *p = NULL;
+  if (posix_memalign(&p, ACQUIRE_FILE_READER_ALIGN, size) != 0)
+    return NULL;
+  return (unsigned char *)p;
+#endif
+}
+
+static void file_reader_free(unsigned char *p) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static int file_reader_win_errno(DWORD code) {
+  switch (code) {
+  case ERROR_FILE_NOT_FOUND:
+  case ERROR_PATH_NOT_FOUND:
+    return ENOENT;
+  case ERROR_ACCESS_DENIED:
+  case ERROR_SHARING_VIOLATION:
+    return EACCES;
+  case ERROR_NOT_ENOUGH_MEMORY:
+  case ERROR_OUTOFMEMORY:
+    return ENOMEM;
+  default:
+    return EIO;
+  }
+}
+
+/* Positional read that leaves the file pointer alone for other readers */
+static int file_reader_pread(HANDLE file, unsigned char *buf, size_t len,
+                             off_t offset, size_t *got) {
+  OVERLAPPED ov;
+  DWORD n = 0;
+  memset(&ov, 0, sizeof(ov));
+  ov.Offset = (DWORD)((unsigned __int64)offset & 0xFFFFFFFFu);
+  ov.OffsetHigh = (DWORD)((unsigned __int64)offset >> 32);
+  if (len > 0x40000000u)
+    len = 0x40000000u;
+  if (!ReadFile(file, buf, (DWORD)len, &n, &ov)) {
+    const DWORD code = GetLastError();
+    if (code == ERROR_HANDLE_EOF) {
+      *got = 0;
+      return 0;
+    }
+    return file_reader_win_errno(code);
+  }
+  *got = (size_t)n;
+  return 0;
+}
+#endif
+
+int acquire_file_reader_open(struct acquire_file_reader *reader,
+                             const char *path, size_t block_size, int flags) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  LARGE_INTEGER size;
+#else
+  struct stat st;
+#endif
+  if (!reader)
+    return -1;
+  memset(reader, 0, sizeof(*reader));
+  reader->size = -1;
+  reader->block_size =
+      block_size ? block_size : (size_t)ACQUIRE_DEFAULT_READ_BUFFER_SIZE;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  reader->file = INVALID_HANDLE_VALUE;
+  if (!path) {
+    reader->error = EINVAL;
+    return -1;
+  }
+  reader->file = CreateFileA(path, GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (reader->file == INVALID_HANDLE_VALUE) {
+    reader->error = file_reader_win_errno(GetLastError());
+    return -1;
+  }
+  reader->opened = 1;
+  if (GetFileSizeEx(reader->file, &size))
+    reader->size = (off_t)size.QuadPart;
+  if ((flags & ACQUIRE_FILE_READER_MAP) && reader->size > 0 &&
+      (unsigned __int64)size.QuadPart <= (unsigned __int64)(size_t)-1) {
+    reader->mapping =
+        CreateFileMappingA(reader->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (reader->mapping != NULL) {
+      reader->map = (const unsigned char *)MapViewOfFile(
+          reader->mapping, FILE_MAP_READ, 0, 0, 0);
+      if (reader->map == NULL) {
+        CloseHandle(reader->mapping);
+        reader->mapping = NULL;
+      }
+    }
+  }
+#else
+  reader->fd = -1;
+  if (!path) {
+    reader->error = EINVAL;
+    return -1;
+  }
+#ifdef O_CLOEXEC
+  reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+#else
+  reader->fd = open(path, O_RDONLY);
+#endif
+  if (reader->fd < 0) {
+    reader->error = errno;
+    return -1;
+  }
+  reader->opened = 1;
+  if (fstat(reader->fd, &st) != 0) {
+    reader->error = errno;
+    acquire_file_reader_close(reader);
+    return -1;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    reader->error = EISDIR;
+    acquire_file_reader_close(reader);
+    return -1;
+  }
+  if (S_ISREG(st.st_mode))
+    reader->size = (off_t)st.st_size;
+  if ((flags & ACQUIRE_FILE_READER_MAP) && reader->size > 0 &&
+      (unsigned long long)reader->size <= (unsigned long long)(size_t)-1) {
+    void *map = mmap(NULL, (size_t)reader->size, PROT_READ, MAP_PRIVATE,
+                     reader->fd, 0);
+    if (map != MAP_FAILED) {
+      reader->map = (const unsigned char *)map;
+#ifdef MADV_SEQUENTIAL
+      madvise(map, (size_t)reader->size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+    }
+  }
+#if defined(POSIX_FADV_SEQUENTIAL)
+  if (reader->map == NULL && reader->size >= 0)
+    posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* defined(POSIX_FADV_SEQUENTIAL) */
+#endif
+  if (reader->map == NULL) {
+    reader->buffer = file_reader_alloc(reader->block_size);
+    if (!reader->buffer) {
+      reader->error = ENOMEM;
+      acquire_file_reader_close(reader);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int acquire_file_reader_next(struct acquire_file_reader *reader,
+                             const unsigned char **data, size_t *len) {
+  size_t got = 0;
+  if (!reader || !data || !len)
+    return -1;
+  if (reader->map != NULL) {
+    const off_t left = reader->size - reader->offset;
+    if (left <= 0)
+      return 0;
+    got = left < (off_t)reader->block_size ? (size_t)left : reader->block_size;
+    *data = reader->map + reader->offset;
+  } else {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    const int err = file_reader_pread(reader->file, reader->buffer,
+                                      reader->block_size, reader->offset, &got);
+    if (err != 0) {
+      reader->error = err;
+      return -1;
+    }
+#else
+    ssize_t n;
+    do {
+      n = read(reader->fd, reader->buffer, reader->block_size);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      reader->error = errno;
+      return -1;
+    }
+    got = (size_t)n;
+#endif
+    if (got == 0)
+      return 0;
+    *data = reader->buffer;
+  }
+  reader->offset += (off_t)got;
+  *len = got;
+  return 1;
+}
+
+int acquire_file_reader_read_at(const struct acquire_file_reader *reader,
+                                off_t offset, size_t len,
+                                unsigned char *scratch,
+                                const unsigned char **data, size_t *got) {
+  if (!reader || !data || !got || offset < 0)
+    return EINVAL;
+  *got = 0;
+  if (reader->map != NULL) {
+    if (offset < reader->size) {
+      const off_t left = reader->size - offset;
+      *got = left < (off_t)len ? (size_t)left : len;
+      *data = reader->map + offset;
+    }
+    return 0;
+  }
+  if (!scratch)
+    return EINVAL;
+  *data = scratch;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return file_reader_pread(reader->file, scratch, len, offset, got);
+#else
+  for (;;) {
+    const ssize_t n = pread(reader->fd, scratch, len, offset);
+    if (n >= 0) {
+      *got = (size_t)n;
+      return 0;
+    }
+    if (errno != EINTR)
+      return errno;
+  }
+#endif
+}
+
+int acquire_file_reader_seek(struct acquire_file_reader *reader,
+                             off_t offset) {
+  if (!reader || offset < 0)
+    return -1;
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+  if (reader->map == NULL && lseek(reader->fd, offset, SEEK_SET) < 0) {
+    reader->error = errno;
+    return -1;
+  }
+#endif
+  reader->offset = offset;
+  return 0;
+}
+
+const char *
+acquire_file_reader_strerror(const struct acquire_file_reader *reader,
+                             char *buf, size_t len) {
+  if (!buf || len == 0)
+    return "";
+#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
+    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
+  strerror_s(buf, len, reader ? reader->error : EINVAL);
+#else
+  strncpy(buf, strerror(reader ? reader->error : EINVAL), len - 1);
+  buf[len - 1] = '\0';
+#endif
+  return buf;
+}
+
+void acquire_file_reader_close(struct acquire_file_reader *reader) {
+  if (!reader || !reader->opened)
+    return;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  if (reader->map != NULL)
+    UnmapViewOfFile(reader->map);
+  if (reader->mapping != NULL)
+    CloseHandle(reader->mapping);
+  if (reader->file != INVALID_HANDLE_VALUE && reader->file != NULL)
+    CloseHandle(reader->file);
+  reader->mapping = NULL;
+  reader->file = INVALID_HANDLE_VALUE;
+#else
+  if (reader->map != NULL)
+    munmap((void *)reader->map, (size_t)reader->size);
+  if (reader->fd >= 0)
+    close(reader->fd);
+  reader->fd = -1;
+#endif
+  file_reader_free(reader->buffer);
+  reader->buffer = NULL;
+  reader->map = NULL;
+  reader->opened = 0;
+}
+
+#endif /* !ACQUIRE_FILE_READER_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_FILE_READER_H */
@@ -34,10 +34,65 @@ enum acquire_backend_type {
   ACQUIRE_BACKEND_CHECKSUM_OPENSSL,
   ACQUIRE_BACKEND_CHECKSUM_WINCRYPT,
   ACQUIRE_BACKEND_CHECKSUM_LIBRHASH,
-  ACQUIRE_BACKEND_CHECKSUM_CRC32C
+  ACQUIRE_BACKEND_CHECKSUM_CRC32C,
+  ACQUIRE_BACKEND_CHECKSUM_BLAKE3,
+  ACQUIRE_BACKEND_CHECKSUM_XXHASH,
+  ACQUIRE_BACKEND_CHECKSUM_SHA2,
+  ACQUIRE_BACKEND_CHECKSUM_AF_ALG,
+  ACQUIRE_BACKEND_CHECKSUM_MULTI,
+  /* Only for `acquire_handle_set_checksum_backend`: the fastest measured */
+  ACQUIRE_BACKEND_CHECKSUM_AUTO
 };
 
+#ifndef ACQUIRE_MAX_DIGESTS
+#define ACQUIRE_MAX_DIGESTS 8
+#endif /* !ACQUIRE_MAX_DIGESTS */
+
+/* Outcome of one algorithm in a multi-digest verification */
+struct acquire_digest_result {
+  enum Checksum algorithm;
+  /* `1` if it matched, `0` if not, `-1` until the file has been read */
+  int matched;
+  /* Lowercase hex digest, empty until the file has been read */
+  char computed_hash[130];
+};
+
+struct acquire_digest_stream;
+struct acquire_engine;
+struct acquire_executor;
+struct acquire_session;
+struct acquire_verify_job;
+struct acquire_handle;
+
+/* A socket as the platform's event loop knows it */
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <basetsd.h>
+typedef UINT_PTR acquire_socket_t;
+#else
+typedef int acquire_socket_t;
+#endif
+
+/* Readiness a download waits for on a socket, or that an event loop saw */
+#define ACQUIRE_EVENT_IN 1
+#define ACQUIRE_EVENT_OUT 2
+#define ACQUIRE_EVENT_ERR 4
+
+/*
+ * Called when a download wants `fd` watched for `events`, which are `0`
+ * once it no longer does; the descriptor may be closed after that.
+ */
+typedef void (*acquire_socket_fn)(struct acquire_handle *handle,
+                                  acquire_socket_t fd, int events,
+                                  void *user_data);
+/*
+ * Called when a download wants waking once, in `timeout_ms` milliseconds;
+ * this replaces any earlier request, and `-1` cancels it.
+ */
+typedef void (*acquire_timer_fn)(struct acquire_handle *handle,
+                                 long timeout_ms, void *user_data);
+
 struct acquire_handle {
+  /* Read with `acquire_handle_get_progress` while an executor job runs */
   volatile off_t bytes_processed;
   volatile off_t total_size;
   char current_file[PATH_MAX];
@@ -47,9 +102,58 @@ struct acquire_handle {
   struct acquire_error_info error;
   volatile int cancel_flag;
   enum acquire_backend_type active_backend;
+  /* Checksum backend tried first; `ACQUIRE_BACKEND_NONE` for the default */
+  enum acquire_backend_type checksum_backend;
+  /* Work limits for a single checksum `_async_poll` call; `0` is unlimited */
+  size_t poll_budget_bytes;
+  unsigned long poll_budget_usec;
+  /* Threads a single verification may use; `0` means one per online CPU */
+  unsigned int verify_threads;
+  /* Bytes hashed per block by the checksum file reader; `0` is the default */
+  size_t read_buffer_size;
+  /* `acquire_file_reader_open` flags the checksum backends pass */
+  int file_reader_flags;
+  /* Reads manifest verification keeps in flight; `0` is the default */
+  unsigned int io_queue_depth;
+  /* Longest a download `_async_poll` call waits for the network; `0` never */
+  unsigned long poll_wait_msec;
+  /* Filled in by `acquire_verify_multi_*`, in the order requested */
+  struct acquire_digest_result digests[ACQUIRE_MAX_DIGESTS];
+  size_t digest_count;
+  /* Verifications run here when set; see `acquire_executor.h` */
+  struct acquire_executor *executor;
+  struct acquire_verify_job *job;
+  /* Completion notification: read end, write end (the same for eventfd) */
+  int completion_fd[2];
+  /* Hashes a verified download as it is written; owned by the backend */
+  struct acquire_digest_stream *download_digest;
+  /* Downloads run on this shared engine when set; see `acquire_download.h` */
+  struct acquire_engine *engine;
+  /* Downloads share this session's connections and caches when set */
+  struct acquire_session *session;
+  /* Told when a download's sockets and timeout change, if set */
+  acquire_socket_fn socket_fn;
+  acquire_timer_fn timer_fn;
+  void *event_data;
+  /* Set by the network backend that started a download: ends it when the
+   * handle is freed */
+  void (*download_release)(struct acquire_handle *handle);
 };
 
+#ifndef ACQUIRE_DEFAULT_POLL_BUDGET_BYTES
+#define ACQUIRE_DEFAULT_POLL_BUDGET_BYTES 1048576
+#endif /* !ACQUIRE_DEFAULT_POLL_BUDGET_BYTES */
+
 extern LIBACQUIRE_EXPORT struct acquire_handle *acquire_handle_init(void);
+
+/**
+ * @brief Free `handle`.
+ *
+ * A download still in progress is stopped and taken off its engine first,
+ * so a handle on a shared engine may be freed mid-download; the engine
+ * carries on with the others. A queued or running executor job is finished
+ * first too.
+ */
 extern LIBACQUIRE_EXPORT void
 acquire_handle_free(struct acquire_handle *handle);
 extern LIBACQUIRE_EXPORT enum acquire_error_code
@@ -61,12 +165,230 @@ acquire_handle_set_error(struct acquire_handle *handle,
                          enum acquire_error_code code, const char *fmt, ...)
     ACQUIRE_PRINTF_FORMAT(3, 4);
 
+/**
+ * @brief Bound the work a single checksum `_async_poll` call may perform.
+ *
+ * Each poll hashes until `max_bytes` have been consumed or `max_usec`
+ * microseconds have elapsed, whichever happens first. `0` disables a limit.
+ * The synchronous API ignores the budget and always runs to completion.
+ *
+ * @param handle The handle to configure.
+ * @param max_bytes Maximum bytes hashed per poll, or `0` for no byte limit.
+ * @param max_usec Maximum microseconds spent per poll, or `0` for no limit.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_poll_budget(struct acquire_handle *handle, size_t max_bytes,
+                               unsigned long max_usec);
+
+/**
+ * @brief Let a single verification hash the file on several threads.
+ *
+ * Backends that can merge partial results (the built-in CRC32C and BLAKE3)
+ * split large files into ranges hashed by that many threads, each reading
+ * its own range; others ignore this and hash sequentially. The default is
+ * `1`.
+ *
+ * @param handle The handle to configure.
+ * @param threads Worker threads to use, or `0` for one per online CPU.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_verify_threads(struct acquire_handle *handle,
+                                  unsigned int threads);
+
+/**
+ * @brief Set how many bytes checksum backends hash per block.
+ *
+ * Files are read into a buffer of this size; mapped files (see
+ * `acquire_handle_set_file_map`) are hashed in windows of this size. Larger
+ * blocks mean fewer system calls, smaller ones finer-grained progress and
+ * poll budgets.
+ *
+ * @param handle The handle to configure.
+ * @param bytes Block size, or `0` for `ACQUIRE_DEFAULT_READ_BUFFER_SIZE`.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_read_buffer_size(struct acquire_handle *handle,
+                                    size_t bytes);
+
+/**
+ * @brief Let checksum backends memory-map the files they hash.
+ *
+ * Hashing then reads straight from the page cache with no copy, but a file
+ * truncated mid-hash raises `SIGBUS` on POSIX, so only enable this for
+ * files nothing else will shrink. Off by default.
+ *
+ * @param handle The handle to configure.
+ * @param enabled Non-zero to map regular files, `0` to read them.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_file_map(struct acquire_handle *handle, int enabled);
+
+/**
+ * @brief Set how many reads manifest verification keeps in flight, shared
+ * between its workers, when files are read through io_uring.
+ *
+ * @param handle The handle to configure.
+ * @param depth Reads in flight, `0` for `ACQUIRE_DEFAULT_IO_QUEUE_DEPTH`,
+ * or `1` to read each file in turn without io_uring.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_io_queue_depth(struct acquire_handle *handle,
+                                  unsigned int depth);
+
+/**
+ * @brief Let each download `_async_poll` call sleep until the transfer's
+ * sockets are ready or curl's next timeout is due, for at most `max_msec`
+ * milliseconds, instead of returning at once.
+ *
+ * A caller with nothing else to do can then poll in a loop without
+ * spinning a core. The default, `0`, never waits. Backends whose start
+ * call already blocks until the end ignore this.
+ *
+ * @param handle The handle to configure.
+ * @param max_msec Longest wait per poll, or `0` not to wait.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_poll_wait(struct acquire_handle *handle,
+                             unsigned long max_msec);
+
+/**
+ * @brief Run this handle's downloads on `engine` alongside those of other
+ * handles, rather than on a multi stack of their own.
+ *
+ * `acquire_engine_poll` then drives them, and `acquire_download_async_poll`
+ * only reads their state. Pass `NULL` for a private engine again. Do not
+ * change this while a download is in progress.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_engine(struct acquire_handle *handle,
+                          struct acquire_engine *engine);
+
+/**
+ * @brief Let this handle's downloads reuse the connections, DNS lookups and
+ * TLS sessions of every other handle on `session`; see `acquire_download.h`.
+ * Pass `NULL` to stop. Do not change this while a download is in progress.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_session(struct acquire_handle *handle,
+                           struct acquire_session *session);
+
+/**
+ * @brief Have downloads started on this handle report the sockets they
+ * want watched and when they want waking, for an external event loop.
+ *
+ * `socket_fn` and `timer_fn` are called from within the download calls
+ * as things change, with `user_data`; either may be `NULL`. The same state
+ * can be read at any time with `acquire_download_get_fds`. Set these
+ * before starting the download. Downloads on a shared engine report
+ * through `acquire_engine_set_event_hooks` instead.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_event_hooks(struct acquire_handle *handle,
+                               acquire_socket_fn socket_fn,
+                               acquire_timer_fn timer_fn, void *user_data);
+
+/**
+ * @brief Try checksum backend `backend` before the usual order.
+ *
+ * `ACQUIRE_BACKEND_CHECKSUM_AF_ALG` is only ever used this way. If the
+ * chosen backend is not built in, cannot hash the algorithm, or (for
+ * AF_ALG) is refused by the kernel, the usual order applies; check
+ * `active_backend` after starting to see which one ran. Files it cannot
+ * open still fail.
+ *
+ * `ACQUIRE_BACKEND_CHECKSUM_AUTO` picks, per algorithm, whichever backend
+ * verified fastest on this machine, timing them on first use (see
+ * `acquire_calibrate.h`). Multi-threaded CRC32C keeps the built-in one.
+ *
+ * @param handle The handle to configure.
+ * @param backend An `ACQUIRE_BACKEND_CHECKSUM_*` value, or
+ * `ACQUIRE_BACKEND_NONE` for the usual order.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_checksum_backend(struct acquire_handle *handle,
+                                    enum acquire_backend_type backend);
+
+/**
+ * @brief Run this handle's verifications on `executor`'s threads.
+ *
+ * `acquire_verify_async_start` then opens the file, queues the hashing and
+ * returns at once; `acquire_verify_async_poll` only reads the job's state.
+ * Pass `NULL` to hash on the caller's thread again, and before freeing
+ * `executor`. Do not change this while a verification is in progress.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_executor(struct acquire_handle *handle,
+                            struct acquire_executor *executor);
+
+/**
+ * @brief Bytes processed so far, safe to call while another thread hashes.
+ */
+extern LIBACQUIRE_EXPORT off_t
+acquire_handle_get_progress(const struct acquire_handle *handle);
+
+/**
+ * @brief Record `bytes` more of progress; for backends.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_add_progress(struct acquire_handle *handle, off_t bytes);
+
+/**
+ * @brief Set the progress to `bytes`; for backends.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_handle_set_progress(struct acquire_handle *handle, off_t bytes);
+
+/**
+ * @brief Result `index` of the last multi-digest verification.
+ *
+ * @return The result, or `NULL` if `index` is not below `digest_count`.
+ */
+extern LIBACQUIRE_EXPORT const struct acquire_digest_result *
+acquire_handle_get_digest_result(const struct acquire_handle *handle,
+                                 size_t index);
+
+/**
+ * @brief Monotonic clock in seconds, for measuring elapsed time only.
+ */
+extern LIBACQUIRE_EXPORT double acquire_clock_seconds(void);
+
+/**
+ * @brief Whether a poll that started at `started` (see
+ * `acquire_clock_seconds`) and has hashed `bytes_done` should yield.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_handle_poll_budget_spent(const struct acquire_handle *handle,
+                                 size_t bytes_done, double started);
+
 #if defined(LIBACQUIRE_IMPLEMENTATION)
 #ifndef ACQUIRE_HANDLE_IMPL_
 #define ACQUIRE_HANDLE_IMPL_
+#include "acquire_file_reader.h"
 #include "acquire_status_codes.h"
+#include "acquire_threads.h"
 #include <string.h>
 
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include "acquire_windows.h"
+#include <profileapi.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Internal, in `acquire_executor.h`: finish any queued job and close the
+ * completion descriptors.
+ */
+extern LIBACQUIRE_EXPORT void
+_acquire_executor_release(struct acquire_handle *handle);
+
+/*
+ * Internal, in `acquire_executor.h`: why a verification was refused while
+ * the handle's job runs, or `NULL`.
+ */
+extern LIBACQUIRE_EXPORT const struct acquire_error_info *
+_acquire_executor_rejection(const struct acquire_handle *handle);
+
 struct acquire_handle *acquire_handle_init(void) {
   struct acquire_handle *h =
       (struct acquire_handle *)calloc(1, sizeof(struct acquire_handle));
@@ -75,19 +397,36 @@ struct acquire_handle *acquire_handle_init(void) {
     h->status = ACQUIRE_IDLE;
     h->error.code = ACQUIRE_OK;
     h->active_backend = ACQUIRE_BACKEND_NONE;
+    h->checksum_backend = ACQUIRE_BACKEND_NONE;
+    h->poll_budget_bytes = ACQUIRE_DEFAULT_POLL_BUDGET_BYTES;
+    h->poll_budget_usec = 0;
+    h->verify_threads = 1;
+    h->completion_fd[0] = h->completion_fd[1] = -1;
   }
   return h;
 }
 void acquire_handle_free(struct acquire_handle *h) {
-  if (h)
+  if (h) {
+    if (h->download_release)
+      h->download_release(h);
+    _acquire_executor_release(h);
     free(h);
+  }
 }
 enum acquire_error_code
 acquire_handle_get_error_code(struct acquire_handle *h) {
-  return h ? h->error.code : ACQUIRE_ERROR_INVALID_ARGUMENT;
+  const struct acquire_error_info *rejected;
+  if (!h)
+    return ACQUIRE_ERROR_INVALID_ARGUMENT;
+  rejected = _acquire_executor_rejection(h);
+  return rejected ? rejected->code : h->error.code;
 }
 const char *acquire_handle_get_error_string(struct acquire_handle *h) {
-  return h ? h->error.message : "Invalid handle provided.";
+  const struct acquire_error_info *rejected;
+  if (!h)
+    return "Invalid handle provided.";
+  rejected = _acquire_executor_rejection(h);
+  return rejected ? rejected->message : h->error.message;
 }
 void acquire_handle_set_error(struct acquire_handle *h,
                               enum acquire_error_code c, const char *fmt, ...) {
@@ -104,6 +443,109 @@ void acquire_handle_set_error(struct acquire_handle *h,
     h->error.message[0] = '\0';
   }
 }
+void acquire_handle_set_poll_budget(struct acquire_handle *h, size_t max_bytes,
+                                    unsigned long max_usec) {
+  if (!h)
+    return;
+  h->poll_budget_bytes = max_bytes;
+  h->poll_budget_usec = max_usec;
+}
+void acquire_handle_set_verify_threads(struct acquire_handle *h,
+                                       unsigned int threads) {
+  if (h)
+    h->verify_threads = threads;
+}
+void acquire_handle_set_read_buffer_size(struct acquire_handle *h,
+                                         size_t bytes) {
+  if (h)
+    h->read_buffer_size = bytes;
+}
+void acquire_handle_set_file_map(struct acquire_handle *h, int enabled) {
+  if (h)
+    h->file_reader_flags = enabled ? ACQUIRE_FILE_READER_MAP : 0;
+}
+void acquire_handle_set_io_queue_depth(struct acquire_handle *h,
+                                       unsigned int depth) {
+  if (h)
+    h->io_queue_depth = depth;
+}
+void acquire_handle_set_poll_wait(struct acquire_handle *h,
+                                  unsigned long max_msec) {
+  if (h)
+    h->poll_wait_msec = max_msec;
+}
+void acquire_handle_set_engine(struct acquire_handle *h,
+                               struct acquire_engine *engine) {
+  if (h)
+    h->engine = engine;
+}
+void acquire_handle_set_session(struct acquire_handle *h,
+                                struct acquire_session *session) {
+  if (h)
+    h->session = session;
+}
+void acquire_handle_set_event_hooks(struct acquire_handle *h,
+                                    acquire_socket_fn socket_fn,
+                                    acquire_timer_fn timer_fn,
+                                    void *user_data) {
+  if (!h)
+    return;
+  h->socket_fn = socket_fn;
+  h->timer_fn = timer_fn;
+  h->event_data = user_data;
+}
+void acquire_handle_set_checksum_backend(struct acquire_handle *h,
+                                         enum acquire_backend_type backend) {
+  if (h)
+    h->checksum_backend = backend;
+}
+void acquire_handle_set_executor(struct acquire_handle *h,
+                                 struct acquire_executor *executor) {
+  if (h)
+    h->executor = executor;
+}
+off_t acquire_handle_get_progress(const struct acquire_handle *h) {
+  return h ? acquire_atomic_load_off(&h->bytes_processed) : 0;
+}
+void acquire_handle_add_progress(struct acquire_handle *h, off_t bytes) {
+  if (h)
+    acquire_atomic_add_off(&h->bytes_processed, bytes);
+}
+void acquire_handle_set_progress(struct acquire_handle *h, off_t bytes) {
+  if (h)
+    acquire_atomic_store_off(&h->bytes_processed, bytes);
+}
+const struct acquire_digest_result *
+acquire_handle_get_digest_result(const struct acquire_handle *h,
+                                 size_t index) {
+  if (!h || index >= h->digest_count)
+    return NULL;
+  return &h->digests[index];
+}
+double acquire_clock_seconds(void) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  LARGE_INTEGER freq, now;
+  if (!QueryPerformanceFrequency(&freq) || !QueryPerformanceCounter(&now))
+    return 0.0;
+  return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0.0;
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+int acquire_handle_poll_budget_spent(const struct acquire_handle *h,
+                                     size_t bytes_done, double started) {
+  if (!h)
+    return 1;
+  if (h->poll_budget_bytes != 0 && bytes_done >= h->poll_budget_bytes)
+    return 1;
+  if (h->poll_budget_usec != 0 &&
+      (acquire_clock_seconds() - started) * 1e6 >= (double)h->poll_budget_usec)
+    return 1;
+  return 0;
+}
 #endif /* ACQUIRE_HANDLE_IMPL_ */
 #endif /* defined(LIBACQUIRE_IMPLEMENTATION) */
 
@@ -12,59 +12,233 @@
 #include <string.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <io.h>
 #include <synchapi.h>
+#define curl_fseeko _fseeki64
+#define curl_ftruncate(f, size) _chsize_s(_fileno(f), (size))
 #else
 #include <unistd.h>
+#define curl_fseeko fseeko
+#define curl_ftruncate(f, size) ftruncate(fileno(f), (size))
 #endif
 
+#include "acquire_blocks.h"
 #include "acquire_config.h"
 #include "acquire_download.h"
+#include "acquire_fileutils.h"
 #include "acquire_handle.h"
+#include "acquire_multi_digest.h"
+#include "acquire_threads.h"
+
+/*
+ * Longest a blocking download sleeps before it looks at the cancel flag
+ * again; it wakes sooner whenever curl has anything to do.
+ */
+#ifndef ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC
+#define ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC 100
+#endif /* !ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC */
 
 /* --- Global cURL State Management --- */
 static int g_acquire_curl_ref_count = 0;
+/* Guards `g_acquire_curl_ref_count`; sessions may come and go on any thread */
+static acquire_mutex_t g_acquire_curl_lock;
+static acquire_once_t g_acquire_curl_once = ACQUIRE_ONCE_INIT;
+
+static void acquire_curl_lock_init(void) {
+  acquire_mutex_init(&g_acquire_curl_lock);
+}
 
 static void acquire_curl_global_init(void) {
+  acquire_once(&g_acquire_curl_once, acquire_curl_lock_init);
+  acquire_mutex_lock(&g_acquire_curl_lock);
   if (g_acquire_curl_ref_count == 0) {
     curl_global_init(CURL_GLOBAL_ALL);
   }
   g_acquire_curl_ref_count++;
+  acquire_mutex_unlock(&g_acquire_curl_lock);
 }
 
 static void acquire_curl_global_cleanup(void) {
+  acquire_once(&g_acquire_curl_once, acquire_curl_lock_init);
+  acquire_mutex_lock(&g_acquire_curl_lock);
   g_acquire_curl_ref_count--;
   if (g_acquire_curl_ref_count == 0) {
     curl_global_cleanup();
   }
+  acquire_mutex_unlock(&g_acquire_curl_lock);
 }
 /* --- */
 
+/* --- Sessions --- */
+
+/* Finished transfer handles a session keeps for its next downloads */
+#ifndef ACQUIRE_SESSION_MAX_IDLE
+#define ACQUIRE_SESSION_MAX_IDLE 32
+#endif /* !ACQUIRE_SESSION_MAX_IDLE */
+
+struct acquire_session {
+  CURLSH *share;
+  /* One per kind of data curl shares, so unrelated lookups never wait */
+  acquire_mutex_t locks[CURL_LOCK_DATA_LAST];
+  /* Guards `idle` */
+  acquire_mutex_t pool_lock;
+  CURL *idle[ACQUIRE_SESSION_MAX_IDLE];
+  size_t idle_count;
+};
+
+static void session_lock(CURL *easy, curl_lock_data data,
+                         curl_lock_access access, void *userptr) {
+  (void)easy;
+  (void)access;
+  acquire_mutex_lock(&((struct acquire_session *)userptr)->locks[data]);
+}
+
+static void session_unlock(CURL *easy, curl_lock_data data, void *userptr) {
+  (void)easy;
+  acquire_mutex_unlock(&((struct acquire_session *)userptr)->locks[data]);
+}
+
+struct acquire_session *acquire_session_create(void) {
+  struct acquire_session *session =
+      (struct acquire_session *)calloc(1, sizeof(struct acquire_session));
+  int i;
+  if (!session)
+    return NULL;
+  acquire_curl_global_init();
+  session->share = curl_share_init();
+  if (!session->share) {
+    free(session);
+    acquire_curl_global_cleanup();
+    return NULL;
+  }
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    acquire_mutex_init(&session->locks[i]);
+  acquire_mutex_init(&session->pool_lock);
+  curl_share_setopt(session->share, CURLSHOPT_LOCKFUNC, session_lock);
+  curl_share_setopt(session->share, CURLSHOPT_UNLOCKFUNC, session_unlock);
+  curl_share_setopt(session->share, CURLSHOPT_USERDATA, session);
+  curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(session->share, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+  curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif /* LIBCURL_VERSION_NUM >= 0x073900 */
+#if LIBCURL_VERSION_NUM >= 0x075800
+  curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HSTS);
+#endif /* LIBCURL_VERSION_NUM >= 0x075800 */
+  return session;
+}
+
+void acquire_session_free(struct acquire_session *session) {
+  int i;
+  if (!session)
+    return;
+  while (session->idle_count > 0)
+    curl_easy_cleanup(session->idle[--session->idle_count]);
+  curl_share_cleanup(session->share);
+  for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    acquire_mutex_destroy(&session->locks[i]);
+  acquire_mutex_destroy(&session->pool_lock);
+  free(session);
+  acquire_curl_global_cleanup();
+}
+
+/*
+ * A transfer handle for a download in `session`, or a new standalone one
+ * if `session` is `NULL`.
+ */
+static CURL *curl_session_easy(struct acquire_session *session) {
+  CURL *easy = NULL;
+  if (!session)
+    return curl_easy_init();
+  acquire_mutex_lock(&session->pool_lock);
+  if (session->idle_count > 0)
+    easy = session->idle[--session->idle_count];
+  acquire_mutex_unlock(&session->pool_lock);
+  if (easy)
+    curl_easy_reset(easy);
+  else if ((easy = curl_easy_init()) == NULL)
+    return NULL;
+  curl_easy_setopt(easy, CURLOPT_SHARE, session->share);
+#if LIBCURL_VERSION_NUM >= 0x075800
+  curl_easy_setopt(easy, CURLOPT_HSTS_CTRL, (long)CURLHSTS_ENABLE);
+#endif /* LIBCURL_VERSION_NUM >= 0x075800 */
+  return easy;
+}
+
+/* Hand back a transfer handle from `curl_session_easy` */
+static void curl_session_release(struct acquire_session *session,
+                                 CURL *easy) {
+  if (session) {
+    acquire_mutex_lock(&session->pool_lock);
+    if (session->idle_count < ACQUIRE_SESSION_MAX_IDLE) {
+      session->idle[session->idle_count++] = easy;
+      easy = NULL;
+    }
+    acquire_mutex_unlock(&session->pool_lock);
+  }
+  if (easy)
+    curl_easy_cleanup(easy);
+}
+
 #ifdef LIBACQUIRE_DOWNLOAD_DIR_IMPL
 const char *get_download_dir(void) { return ".downloads"; }
 #endif /* LIBACQUIRE_DOWNLOAD_DIR_IMPL */
 
 /* --- Internal State --- */
-struct curl_backend {
+struct curl_backend;
+
+/* A multi stack that drives the downloads of one or more handles */
+struct acquire_engine {
   CURLM *multi_handle;
+  /* Downloads added and not yet settled */
+  struct curl_backend *transfers;
+  size_t transfer_count;
+  /* What curl wants watched, for `acquire_engine_get_fds` */
+  struct acquire_download_fd *sockets;
+  size_t socket_count, socket_capacity;
+  /* When curl next wants `curl_multi_socket_action`, or `-1` */
+  double timer_due;
+  acquire_socket_fn socket_fn;
+  acquire_timer_fn timer_fn;
+  void *event_data;
+  /* The handle this engine was made for, or `NULL` if it is shared */
+  struct acquire_handle *owner;
+};
+
+struct curl_backend {
+  struct acquire_handle *handle;
+  /* `handle->engine`, or a private one for this download alone */
+  struct acquire_engine *engine;
+  /* Where `easy_handle` came from and goes back to, if anywhere */
+  struct acquire_session *session;
   CURL *easy_handle;
+  /* Neighbours on `engine->transfers` */
+  struct curl_backend *prev, *next;
+  /* Bytes already on disk when resuming, which curl does not count */
+  off_t resume_from;
 };
 
 /* --- Internal Helpers --- */
-static void cleanup_curl_backend(struct acquire_handle *handle) {
+
+/* Take the handle's transfer off its engine and release it */
+static void curl_transfer_end(struct acquire_handle *handle) {
   if (!handle)
     return;
   if (handle->backend_handle) {
     struct curl_backend *be = (struct curl_backend *)handle->backend_handle;
-    if (be->multi_handle && be->easy_handle) {
-      curl_multi_remove_handle(be->multi_handle, be->easy_handle);
-    }
+    struct acquire_engine *engine = be->engine;
     if (be->easy_handle) {
-      curl_easy_cleanup(be->easy_handle);
-    }
-    if (be->multi_handle) {
-      curl_multi_cleanup(be->multi_handle);
+      curl_multi_remove_handle(engine->multi_handle, be->easy_handle);
+      curl_session_release(be->session, be->easy_handle);
     }
-    acquire_curl_global_cleanup(); /* Decrement ref count and maybe cleanup */
+    if (be->prev)
+      be->prev->next = be->next;
+    else
+      engine->transfers = be->next;
+    if (be->next)
+      be->next->prev = be->prev;
+    engine->transfer_count--;
     free(be);
     handle->backend_handle = NULL;
   }
@@ -72,30 +246,212 @@ static void cleanup_curl_backend(struct acquire_handle *handle) {
     fclose(handle->output_file);
     handle->output_file = NULL;
   }
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest = NULL;
+}
+
+static void curl_engine_free(struct acquire_engine *engine) {
+  while (engine->transfers) {
+    struct acquire_handle *handle = engine->transfers->handle;
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Download engine freed.");
+    curl_transfer_end(handle);
+  }
+  curl_multi_cleanup(engine->multi_handle);
+  if (engine->timer_due >= 0 && engine->timer_fn)
+    engine->timer_fn(engine->owner, -1, engine->event_data);
+  free(engine->sockets);
+  free(engine);
+  acquire_curl_global_cleanup(); /* Decrement ref count and maybe cleanup */
+}
+
+/* End the handle's transfer, and free its engine if that was private */
+static void cleanup_curl_backend(struct acquire_handle *handle) {
+  struct acquire_engine *engine = NULL;
+  if (handle && handle->backend_handle) {
+    engine = ((struct curl_backend *)handle->backend_handle)->engine;
+    if (engine->owner != handle)
+      engine = NULL;
+  }
+  curl_transfer_end(handle);
+  if (engine)
+    curl_engine_free(engine);
+}
+
+/* Stop the handle's download, if still in progress, as it is freed */
+static void curl_download_release(struct acquire_handle *handle) {
+  cleanup_curl_backend(handle);
+}
+
+/* The transfer succeeded: complete, unless the data failed its digest */
+static void curl_download_complete(struct acquire_handle *handle) {
+  if (handle->download_digest &&
+      acquire_digest_stream_finish(handle->download_digest, handle) != 0)
+    return;
+  handle->status = ACQUIRE_COMPLETE;
 }
 
 /* --- Internal Callbacks --- */
 static size_t write_callback(void *ptr, size_t size, size_t nmemb,
                              void *userdata) {
   struct acquire_handle *handle = (struct acquire_handle *)userdata;
-  return handle->output_file ? fwrite(ptr, size, nmemb, handle->output_file)
-                             : 0;
+  size_t written;
+  if (!handle->output_file)
+    return 0;
+  written = fwrite(ptr, size, nmemb, handle->output_file);
+  /* Hash the buffer while it is still hot instead of rereading the file */
+  if (handle->download_digest &&
+      acquire_digest_stream_update(handle->download_digest, ptr,
+                                   written * size) != 0)
+    return 0;
+  return written;
 }
 
 static int progress_callback(void *clientp, curl_off_t dltotal,
                              curl_off_t dlnow, curl_off_t ultotal,
                              curl_off_t ulnow) {
   struct acquire_handle *handle = (struct acquire_handle *)clientp;
+  const off_t resume_from =
+      handle->backend_handle
+          ? ((struct curl_backend *)handle->backend_handle)->resume_from
+          : 0;
   (void)ultotal;
   (void)ulnow;
-  if (handle->cancel_flag)
+  if (acquire_atomic_load_int(&handle->cancel_flag))
     return 1;
   if (dltotal > 0)
-    handle->total_size = (off_t)dltotal;
-  handle->bytes_processed = (off_t)dlnow;
+    handle->total_size = resume_from + (off_t)dltotal;
+  handle->bytes_processed = resume_from + (off_t)dlnow;
   return 0;
 }
 
+/* `CURLMOPT_SOCKETFUNCTION`: note what curl wants watched on `s` */
+static int socket_callback(CURL *easy, curl_socket_t s, int what,
+                           void *userp, void *socketp) {
+  struct acquire_engine *engine = (struct acquire_engine *)userp;
+  int events = 0;
+  size_t i;
+  (void)easy;
+  (void)socketp;
+  if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+    events |= ACQUIRE_EVENT_IN;
+  if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+    events |= ACQUIRE_EVENT_OUT;
+
+  for (i = 0; i < engine->socket_count; i++)
+    if (engine->sockets[i].fd == (acquire_socket_t)s)
+      break;
+  if (events == 0) {
+    if (i < engine->socket_count)
+      engine->sockets[i] = engine->sockets[--engine->socket_count];
+  } else {
+    if (i == engine->socket_count) {
+      if (engine->socket_count == engine->socket_capacity) {
+        const size_t capacity =
+            engine->socket_capacity ? engine->socket_capacity * 2 : 4;
+        struct acquire_download_fd *grown =
+            (struct acquire_download_fd *)realloc(
+                engine->sockets, capacity * sizeof(*grown));
+        if (!grown)
+          return -1;
+        engine->sockets = grown;
+        engine->socket_capacity = capacity;
+      }
+      engine->sockets[engine->socket_count++].fd = (acquire_socket_t)s;
+    }
+    engine->sockets[i].events = events;
+  }
+  if (engine->socket_fn)
+    engine->socket_fn(engine->owner, (acquire_socket_t)s, events,
+                      engine->event_data);
+  return 0;
+}
+
+/* `CURLMOPT_TIMERFUNCTION`: note when curl next wants to run */
+static int timer_callback(CURLM *multi, long timeout_ms, void *userp) {
+  struct acquire_engine *engine = (struct acquire_engine *)userp;
+  (void)multi;
+  engine->timer_due = timeout_ms < 0 ? -1.0
+                                     : acquire_clock_seconds() +
+                                           (double)timeout_ms / 1000.0;
+  if (engine->timer_fn)
+    engine->timer_fn(engine->owner, timeout_ms, engine->event_data);
+  return 0;
+}
+
+/*
+ * An engine for `owner`'s download alone, with its event hooks, or a
+ * shared one if `owner` is `NULL`.
+ */
+static struct acquire_engine *curl_engine_new(struct acquire_handle *owner) {
+  struct acquire_engine *engine =
+      (struct acquire_engine *)calloc(1, sizeof(struct acquire_engine));
+  if (!engine)
+    return NULL;
+  acquire_curl_global_init();
+  engine->multi_handle = curl_multi_init();
+  if (!engine->multi_handle) {
+    free(engine);
+    acquire_curl_global_cleanup();
+    return NULL;
+  }
+  engine->timer_due = -1.0;
+  engine->owner = owner;
+  if (owner) {
+    engine->socket_fn = owner->socket_fn;
+    engine->timer_fn = owner->timer_fn;
+    engine->event_data = owner->event_data;
+  }
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_SOCKETFUNCTION,
+                    socket_callback);
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_SOCKETDATA, engine);
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_TIMERFUNCTION,
+                    timer_callback);
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_TIMERDATA, engine);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+  /* Downloads to one origin share an HTTP/2 connection where they can */
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_PIPELINING,
+                    (long)CURLPIPE_MULTIPLEX);
+#endif /* LIBCURL_VERSION_NUM >= 0x072b00 */
+#if LIBCURL_VERSION_NUM >= 0x074300
+  curl_multi_setopt(engine->multi_handle, CURLMOPT_MAX_CONCURRENT_STREAMS,
+                    (long)ACQUIRE_ENGINE_MAX_STREAMS);
+#endif /* LIBCURL_VERSION_NUM >= 0x074300 */
+  return engine;
+}
+
+/*
+ * Sleep until one of the engine's sockets is ready or curl has a timeout
+ * due, for at most `msec` milliseconds.
+ */
+static CURLMcode curl_engine_wait(struct acquire_engine *engine,
+                                  unsigned long msec) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+  return curl_multi_poll(engine->multi_handle, NULL, 0, (int)msec, NULL);
+#else
+  /* Before 7.66 this returns at once while there is no socket yet */
+  return curl_multi_wait(engine->multi_handle, NULL, 0, (int)msec, NULL);
+#endif /* LIBCURL_VERSION_NUM >= 0x074200 */
+}
+
+/* Drive a started download to the end, asleep whenever it is idle */
+static int curl_download_run(struct acquire_handle *handle) {
+  if (handle->engine) {
+    /* The engine's other downloads move along with this one */
+    while (handle->status == ACQUIRE_IN_PROGRESS &&
+           acquire_engine_poll(handle->engine,
+                               ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC) >= 0)
+      ;
+  } else {
+    const unsigned long poll_wait = handle->poll_wait_msec;
+    handle->poll_wait_msec = ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC;
+    while (acquire_download_async_poll(handle) == ACQUIRE_IN_PROGRESS)
+      ;
+    handle->poll_wait_msec = poll_wait;
+  }
+  return (handle->status == ACQUIRE_COMPLETE) ? 0 : -1;
+}
+
 /* --- API Implementation --- */
 int acquire_download_sync(struct acquire_handle *handle, const char *url,
                           const char *dest_path) {
@@ -106,14 +462,85 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
   }
   if (acquire_download_async_start(handle, url, dest_path) != 0)
     return -1;
-  while (acquire_download_async_poll(handle) == ACQUIRE_IN_PROGRESS)
-    ;
-  return (handle->status == ACQUIRE_COMPLETE) ? 0 : -1;
+  return curl_download_run(handle);
+}
+
+int acquire_download_verified_sync(struct acquire_handle *handle,
+                                   const char *url, const char *dest_path,
+                                   enum Checksum algorithm,
+                                   const char *expected_hash) {
+  if (acquire_download_verified_async_start(handle, url, dest_path, algorithm,
+                                            expected_hash) != 0)
+    return -1;
+  return curl_download_run(handle);
+}
+
+static int curl_download_start(struct acquire_handle *handle, const char *url,
+                               const char *dest_path, off_t resume_from);
+
+/* Start a verified download, from `checkpoint` unless that is `NULL` */
+static int curl_verified_start(struct acquire_handle *handle, const char *url,
+                               const char *dest_path, enum Checksum algorithm,
+                               const char *expected_hash,
+                               const void *checkpoint,
+                               size_t checkpoint_size) {
+  struct acquire_digest_spec spec;
+  if (!handle)
+    return -1;
+  spec.algorithm = algorithm;
+  spec.expected_hash = expected_hash;
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest =
+      checkpoint ? acquire_digest_stream_resume(handle, &spec, 1, checkpoint,
+                                                checkpoint_size)
+                 : acquire_digest_stream_new(handle, &spec, 1);
+  if (!handle->download_digest)
+    return -1;
+  if (curl_download_start(
+          handle, url, dest_path,
+          checkpoint ? acquire_checkpoint_offset(checkpoint, checkpoint_size)
+                     : 0) != 0) {
+    acquire_digest_stream_free(handle->download_digest);
+    handle->download_digest = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+int acquire_download_verified_async_start(struct acquire_handle *handle,
+                                          const char *url,
+                                          const char *dest_path,
+                                          enum Checksum algorithm,
+                                          const char *expected_hash) {
+  return curl_verified_start(handle, url, dest_path, algorithm, expected_hash,
+                             NULL, 0);
+}
+
+int acquire_download_verified_resume_async_start(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    enum Checksum algorithm, const char *expected_hash,
+    const void *checkpoint, size_t checkpoint_size) {
+  if (!checkpoint) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Not a checkpoint");
+    return -1;
+  }
+  return curl_verified_start(handle, url, dest_path, algorithm, expected_hash,
+                             checkpoint, checkpoint_size);
 }
 
 int acquire_download_async_start(struct acquire_handle *handle, const char *url,
                                  const char *dest_path) {
+  return curl_download_start(handle, url, dest_path, 0);
+}
+
+/* Open `dest_path` and add the transfer, from `resume_from` if not `0` */
+static int curl_download_start(struct acquire_handle *handle, const char *url,
+                               const char *dest_path, off_t resume_from) {
+  struct acquire_engine *engine;
   struct curl_backend *be;
+  CURLMcode mc;
   if (!handle || !url || !dest_path) {
     if (handle)
       acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
@@ -121,27 +548,57 @@ int acquire_download_async_start(struct acquire_handle *handle, const char *url,
     return -1;
   }
 
+  acquire_atomic_store_int(&handle->cancel_flag, 0);
+
+  engine = handle->engine ? handle->engine : curl_engine_new(handle);
+  if (!engine) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
+                             "curl_multi_init() failed");
+    return -1;
+  }
   be = (struct curl_backend *)calloc(1, sizeof(struct curl_backend));
   if (!be) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
                              "curl backend memory allocation failed");
+    if (!handle->engine)
+      curl_engine_free(engine);
     return -1;
   }
+  be->handle = handle;
+  be->engine = engine;
+  be->next = engine->transfers;
+  if (be->next)
+    be->next->prev = be;
+  engine->transfers = be;
+  engine->transfer_count++;
+  handle->backend_handle = be;
+  handle->download_release = curl_download_release;
 
-  acquire_curl_global_init();
-
-  be->easy_handle = curl_easy_init();
+  be->session = handle->session;
+  be->easy_handle = curl_session_easy(be->session);
   if (!be->easy_handle) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
                              "curl_easy_init() failed");
-    free(be);
-    acquire_curl_global_cleanup(); /* Cleanup on failure */
+    cleanup_curl_backend(handle);
     return -1;
   }
-  handle->backend_handle = be; /* Assign only after successful init */
+  be->resume_from = resume_from;
+  handle->bytes_processed = resume_from;
 
-  handle->output_file = fopen(dest_path, "wb");
-  if (!handle->output_file) {
+  if (resume_from > 0 && filesize(dest_path) < resume_from) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "Destination file is shorter than the "
+                             "checkpoint: %s",
+                             dest_path);
+    cleanup_curl_backend(handle);
+    return -1;
+  }
+  /* Keep what the checkpoint covers, and write after it */
+  handle->output_file = fopen(dest_path, resume_from > 0 ? "r+b" : "wb");
+  if (!handle->output_file ||
+      (resume_from > 0 &&
+       (curl_ftruncate(handle->output_file, resume_from) != 0 ||
+        curl_fseeko(handle->output_file, resume_from, SEEK_SET) != 0))) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
                              "Failed to open destination file: %s", dest_path);
     cleanup_curl_backend(handle);
@@ -161,106 +618,545 @@ int acquire_download_async_start(struct acquire_handle *handle, const char *url,
                    "libacquire/" LIBACQUIRE_VERSION);
   curl_easy_setopt(be->easy_handle, CURLOPT_SSLVERSION,
                    CURL_SSLVERSION_TLSv1_2);
+#if LIBCURL_VERSION_NUM >= 0x072f00
+  curl_easy_setopt(be->easy_handle, CURLOPT_HTTP_VERSION,
+                   (long)CURL_HTTP_VERSION_2TLS);
+#endif /* LIBCURL_VERSION_NUM >= 0x072f00 */
+#if LIBCURL_VERSION_NUM >= 0x072b00
+  /*
+   * Wait for a connection already being made to this origin, in case it
+   * can multiplex, rather than open another alongside it.
+   */
+  curl_easy_setopt(be->easy_handle, CURLOPT_PIPEWAIT, 1L);
+#endif /* LIBCURL_VERSION_NUM >= 0x072b00 */
+  if (resume_from > 0)
+    curl_easy_setopt(be->easy_handle, CURLOPT_RESUME_FROM_LARGE,
+                     (curl_off_t)resume_from);
+  curl_easy_setopt(be->easy_handle, CURLOPT_PRIVATE, (char *)handle);
 
-  be->multi_handle = curl_multi_init();
-  if (!be->multi_handle) {
+  mc = curl_multi_add_handle(engine->multi_handle, be->easy_handle);
+  if (mc != CURLM_OK) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
-                             "curl_multi_init() failed");
+                             "cURL multi error: %s", curl_multi_strerror(mc));
     cleanup_curl_backend(handle);
     return -1;
   }
-  curl_multi_add_handle(be->multi_handle, be->easy_handle);
 
   handle->status = ACQUIRE_IN_PROGRESS;
   return 0;
 }
 
-enum acquire_status acquire_download_async_poll(struct acquire_handle *handle) {
-  struct curl_backend *be;
-  CURLMcode mc;
-  int still_running = 0;
-
-  /* 1. Basic sanity checks and state validation */
-  if (handle == NULL)
-    return ACQUIRE_ERROR;
-  if (handle->status != ACQUIRE_IN_PROGRESS)
-    return handle->status;
+/*
+ * The backend of a download that should carry on, or `NULL` if it is over
+ * (stopping it first if it was cancelled).
+ */
+static struct curl_backend *
+curl_download_active(struct acquire_handle *handle) {
+  if (handle == NULL || handle->status != ACQUIRE_IN_PROGRESS)
+    return NULL;
   if (handle->backend_handle == NULL) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
                              "Polling on an uninitialized backend.");
-    return ACQUIRE_ERROR;
+    return NULL;
   }
+  if (acquire_atomic_load_int(&handle->cancel_flag)) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Download cancelled by user.");
+    cleanup_curl_backend(handle);
+    return NULL;
+  }
+  return (struct curl_backend *)handle->backend_handle;
+}
 
-  be = (struct curl_backend *)handle->backend_handle;
+/* Settle `handle`'s download, which curl ended with `result` */
+static void curl_download_finish(struct acquire_handle *handle, CURL *easy,
+                                 CURLcode result) {
+  long response_code = 0;
+  if (result == CURLE_OK) {
+    curl_download_complete(handle);
+    return;
+  }
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response_code);
 
-  /* 2. Check for user cancellation first */
-  if (handle->cancel_flag) {
+  if (result == CURLE_ABORTED_BY_CALLBACK &&
+      acquire_atomic_load_int(&handle->cancel_flag)) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
                              "Download cancelled by user.");
-    cleanup_curl_backend(handle);
-    return ACQUIRE_ERROR;
+  } else if (result == CURLE_COULDNT_RESOLVE_HOST) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_HOST_NOT_FOUND,
+                             "Could not resolve host: %s",
+                             curl_easy_strerror(result));
+  } else if (response_code >= 400) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
+                             "HTTP error: %ld", response_code);
+  } else {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                             "cURL error: %s", curl_easy_strerror(result));
   }
+}
+
+/*
+ * Release a download that is over, unless `engine` is its handle's own:
+ * that one goes with the engine, once the caller is done with it.
+ */
+static void curl_engine_release(struct acquire_engine *engine,
+                                struct acquire_handle *handle) {
+  if (handle != engine->owner)
+    curl_transfer_end(handle);
+}
 
-  /* 3. Drive the multi stack to perform I/O */
-  mc = curl_multi_perform(be->multi_handle, &still_running);
+/*
+ * After driving `engine` with result `mc`: settle every download that is
+ * over. Returns how many are left, or `-1` if the multi stack failed.
+ */
+static int curl_engine_settle(struct acquire_engine *engine, CURLMcode mc,
+                              int still_running) {
+  CURLMsg *msg;
+  int msgs_left;
   if (mc != CURLM_OK) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
-                             "curl_multi_perform() failed: %s",
-                             curl_multi_strerror(mc));
-    cleanup_curl_backend(handle);
-    return ACQUIRE_ERROR;
-  }
-
-  /* 4. Check for transfer completion messages */
-  {
-    CURLMsg *msg;
-    int msgs_left;
-    while ((msg = curl_multi_info_read(be->multi_handle, &msgs_left))) {
-      if (msg->msg == CURLMSG_DONE) {
-        /* This transfer is finished. Since we only manage one, the whole
-         * operation is done. */
-        if (msg->data.result == CURLE_OK) {
-          handle->status = ACQUIRE_COMPLETE;
-        } else {
-          long response_code = 0;
-          curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
-                            &response_code);
-
-          if (msg->data.result == CURLE_COULDNT_RESOLVE_HOST) {
-            acquire_handle_set_error(handle, ACQUIRE_ERROR_HOST_NOT_FOUND,
-                                     "Could not resolve host: %s",
-                                     curl_easy_strerror(msg->data.result));
-          } else if (response_code >= 400) {
-            acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
-                                     "HTTP error: %ld", response_code);
-          } else {
-            acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
-                                     "cURL error: %s",
-                                     curl_easy_strerror(msg->data.result));
-          }
-        }
-        break; /* Exit loop, we only care about our one transfer */
-      }
+    struct curl_backend *be = engine->transfers, *next;
+    for (; be != NULL; be = next) {
+      next = be->next;
+      acquire_handle_set_error(be->handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                               "cURL multi error: %s",
+                               curl_multi_strerror(mc));
+      curl_engine_release(engine, be->handle);
     }
+    return -1;
+  }
+
+  while ((msg = curl_multi_info_read(engine->multi_handle, &msgs_left))) {
+    char *private_data = NULL;
+    struct acquire_handle *handle;
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &private_data);
+    handle = (struct acquire_handle *)private_data;
+    curl_download_finish(handle, msg->easy_handle, msg->data.result);
+    curl_engine_release(engine, handle);
   }
 
-  /* 5. If it's not running, the operation is over */
-  if (still_running == 0) {
-    if (handle->status == ACQUIRE_IN_PROGRESS) {
-      /* If curl reports not running but we haven't received a DONE message,
-       * it implies success. */
-      handle->status = ACQUIRE_COMPLETE;
+  /* If curl reports nothing running but we haven't received a DONE
+   * message, it implies success. */
+  if (still_running == 0 && engine->owner &&
+      engine->owner->status == ACQUIRE_IN_PROGRESS)
+    curl_download_complete(engine->owner);
+  return (int)engine->transfer_count;
+}
+
+/* Stop the downloads on a shared engine whose handles were cancelled */
+static void curl_engine_reap_cancelled(struct acquire_engine *engine) {
+  struct curl_backend *be = engine->transfers, *next;
+  for (; be != NULL; be = next) {
+    next = be->next;
+    if (acquire_atomic_load_int(&be->handle->cancel_flag)) {
+      acquire_handle_set_error(be->handle, ACQUIRE_ERROR_CANCELLED,
+                               "Download cancelled by user.");
+      curl_transfer_end(be->handle);
     }
-    cleanup_curl_backend(handle);
   }
+}
+
+/* Tell curl that `fd` saw `events`, or that the timeout passed */
+static CURLMcode curl_engine_action(struct acquire_engine *engine,
+                                    acquire_socket_t fd, int events,
+                                    int *still_running) {
+  int mask = 0;
+  if (fd == ACQUIRE_SOCKET_TIMEOUT) {
+    /* Each timeout fires once; curl asks again if it needs another */
+    engine->timer_due = -1.0;
+  } else {
+    if (events & ACQUIRE_EVENT_IN)
+      mask |= CURL_CSELECT_IN;
+    if (events & ACQUIRE_EVENT_OUT)
+      mask |= CURL_CSELECT_OUT;
+    if (events & ACQUIRE_EVENT_ERR)
+      mask |= CURL_CSELECT_ERR;
+  }
+  return curl_multi_socket_action(engine->multi_handle, (curl_socket_t)fd,
+                                  mask, still_running);
+}
 
+/* Copy out what the engine waits on; see `acquire_engine_get_fds` */
+static int curl_engine_fds(const struct acquire_engine *engine,
+                           struct acquire_download_fd *fds, size_t max,
+                           long *timeout_ms) {
+  size_t i;
+  for (i = 0; i < engine->socket_count && i < max; i++)
+    fds[i] = engine->sockets[i];
+  *timeout_ms = -1;
+  if (engine->timer_due >= 0) {
+    const double left =
+        (engine->timer_due - acquire_clock_seconds()) * 1000.0;
+    /* Round up, so that the timeout has passed when the caller wakes */
+    *timeout_ms = left > 0 ? (long)left + 1 : 0;
+  }
+  return (int)engine->socket_count;
+}
+
+/*
+ * After driving the private engine of `handle` with result `mc`: settle
+ * the download, and free the engine with it once it is over.
+ */
+static enum acquire_status curl_download_settle(struct acquire_handle *handle,
+                                                struct acquire_engine *engine,
+                                                CURLMcode mc,
+                                                int still_running) {
+  curl_engine_settle(engine, mc, still_running);
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    cleanup_curl_backend(handle);
   return handle->status;
 }
 
+enum acquire_status acquire_download_async_poll(struct acquire_handle *handle) {
+  struct curl_backend *be = curl_download_active(handle);
+  CURLMcode mc;
+  int still_running = 0;
+  if (be == NULL)
+    return handle ? handle->status : ACQUIRE_ERROR;
+  if (be->engine->owner != handle)
+    return handle->status; /* `acquire_engine_poll` drives it */
+
+  /* Wait for the network if allowed to, then drive the multi stack */
+  mc = handle->poll_wait_msec
+           ? curl_engine_wait(be->engine, handle->poll_wait_msec)
+           : CURLM_OK;
+  if (mc == CURLM_OK)
+    mc = curl_multi_perform(be->engine->multi_handle, &still_running);
+  return curl_download_settle(handle, be->engine, mc, still_running);
+}
+
+enum acquire_status
+acquire_download_socket_action(struct acquire_handle *handle,
+                               acquire_socket_t fd, int events) {
+  struct curl_backend *be = curl_download_active(handle);
+  int still_running = 0;
+  CURLMcode mc;
+  if (be == NULL)
+    return handle ? handle->status : ACQUIRE_ERROR;
+  if (be->engine->owner != handle)
+    return handle->status;
+  mc = curl_engine_action(be->engine, fd, events, &still_running);
+  return curl_download_settle(handle, be->engine, mc, still_running);
+}
+
+int acquire_download_get_fds(struct acquire_handle *handle,
+                             struct acquire_download_fd *fds, size_t max,
+                             long *timeout_ms) {
+  struct curl_backend *be;
+  int count;
+  if (!handle || !timeout_ms || (!fds && max > 0)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  *timeout_ms = -1;
+  be = (struct curl_backend *)handle->backend_handle;
+  if (handle->status != ACQUIRE_IN_PROGRESS || be == NULL ||
+      be->engine->owner != handle)
+    return 0;
+  count = curl_engine_fds(be->engine, fds, max, timeout_ms);
+  if (acquire_atomic_load_int(&handle->cancel_flag))
+    *timeout_ms = 0; /* So that the next action stops it */
+  return count;
+}
+
+/* --- Shared engine --- */
+
+struct acquire_engine *acquire_engine_create(void) {
+  return curl_engine_new(NULL);
+}
+
+void acquire_engine_free(struct acquire_engine *engine) {
+  if (engine)
+    curl_engine_free(engine);
+}
+
+int acquire_engine_poll(struct acquire_engine *engine,
+                        unsigned long max_wait_msec) {
+  CURLMcode mc = CURLM_OK;
+  int still_running = 0;
+  if (!engine)
+    return -1;
+  curl_engine_reap_cancelled(engine);
+  if (engine->transfer_count == 0)
+    return 0;
+  if (max_wait_msec)
+    mc = curl_engine_wait(engine, max_wait_msec);
+  if (mc == CURLM_OK)
+    mc = curl_multi_perform(engine->multi_handle, &still_running);
+  return curl_engine_settle(engine, mc, still_running);
+}
+
+int acquire_engine_get_fds(struct acquire_engine *engine,
+                           struct acquire_download_fd *fds, size_t max,
+                           long *timeout_ms) {
+  if (!engine || !timeout_ms || (!fds && max > 0))
+    return -1;
+  return curl_engine_fds(engine, fds, max, timeout_ms);
+}
+
+int acquire_engine_socket_action(struct acquire_engine *engine,
+                                 acquire_socket_t fd, int events) {
+  int still_running = 0;
+  CURLMcode mc;
+  if (!engine)
+    return -1;
+  curl_engine_reap_cancelled(engine);
+  mc = curl_engine_action(engine, fd, events, &still_running);
+  return curl_engine_settle(engine, mc, still_running);
+}
+
+void acquire_engine_set_event_hooks(struct acquire_engine *engine,
+                                    acquire_socket_fn socket_fn,
+                                    acquire_timer_fn timer_fn,
+                                    void *user_data) {
+  if (!engine)
+    return;
+  engine->socket_fn = socket_fn;
+  engine->timer_fn = timer_fn;
+  engine->event_data = user_data;
+}
+
+int acquire_engine_set_origin_limits(struct acquire_engine *engine,
+                                     long max_connections, long max_streams) {
+  if (!engine || max_connections < 0 || max_streams < 1)
+    return -1;
+  if (curl_multi_setopt(engine->multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS,
+                        max_connections) != CURLM_OK)
+    return -1;
+#if LIBCURL_VERSION_NUM >= 0x074300
+  if (curl_multi_setopt(engine->multi_handle,
+                        CURLMOPT_MAX_CONCURRENT_STREAMS,
+                        max_streams) != CURLM_OK)
+    return -1;
+#endif /* LIBCURL_VERSION_NUM >= 0x074300 */
+  return 0;
+}
+
+/* --- Batches --- */
+
+/* Whether any download of the batch is still going; those that failed to
+ * start have no backend and are not waited for */
+static int curl_batch_running(const struct acquire_download_item *items,
+                              size_t count) {
+  size_t i;
+  for (i = 0; i < count; i++)
+    if (items[i].handle->backend_handle != NULL &&
+        items[i].handle->status == ACQUIRE_IN_PROGRESS)
+      return 1;
+  return 0;
+}
+
+int acquire_download_batch(struct acquire_engine *engine,
+                           const struct acquire_download_item *items,
+                           size_t count) {
+  struct acquire_engine *own = NULL;
+  size_t i;
+  int failed = 0;
+  if (!items && count > 0)
+    return -1;
+  for (i = 0; i < count; i++)
+    if (!items[i].handle)
+      return -1;
+  if (!engine) {
+    engine = own = curl_engine_new(NULL);
+    if (!engine) {
+      for (i = 0; i < count; i++)
+        acquire_handle_set_error(items[i].handle,
+                                 ACQUIRE_ERROR_NETWORK_INIT_FAILED,
+                                 "curl_multi_init() failed");
+      return -1;
+    }
+    acquire_engine_set_origin_limits(engine, ACQUIRE_BATCH_MAX_CONNECTIONS,
+                                     ACQUIRE_ENGINE_MAX_STREAMS);
+  }
+
+  /* All of them are added before any runs, so they can share connections */
+  for (i = 0; i < count; i++) {
+    struct acquire_handle *handle = items[i].handle;
+    struct acquire_engine *const attached = handle->engine;
+    int started;
+    handle->engine = engine;
+    started = curl_download_start(handle, items[i].url, items[i].dest_path, 0);
+    handle->engine = attached;
+    if (started != 0 && handle->status != ACQUIRE_ERROR)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
+                               "Failed to start download: %s",
+                               items[i].url ? items[i].url : "(null)");
+  }
+  while (curl_batch_running(items, count) &&
+         acquire_engine_poll(engine, ACQUIRE_DOWNLOAD_SYNC_WAIT_MSEC) >= 0)
+    ;
+
+  for (i = 0; i < count; i++)
+    if (items[i].handle->status != ACQUIRE_COMPLETE)
+      failed++;
+  if (own)
+    curl_engine_free(own);
+  return failed;
+}
+
 void acquire_download_async_cancel(struct acquire_handle *handle) {
   if (handle) {
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+  }
+}
+
+/* --- Block repair --- */
+
+/* Where a range goes, and how much of it is still to come */
+struct curl_range {
+  struct acquire_handle *handle;
+  FILE *file;
+  off_t left;
+};
+
+static size_t range_write_callback(void *ptr, size_t size, size_t nmemb,
+                                   void *userdata) {
+  struct curl_range *range = (struct curl_range *)userdata;
+  const size_t bytes = size * nmemb;
+  /* A server that ignores `Range` sends the file from the start */
+  if ((off_t)bytes > range->left ||
+      fwrite(ptr, 1, bytes, range->file) != bytes)
+    return 0;
+  range->left -= (off_t)bytes;
+  acquire_handle_add_progress(range->handle, (off_t)bytes);
+  return bytes;
+}
+
+static int range_progress_callback(void *clientp, curl_off_t dltotal,
+                                   curl_off_t dlnow, curl_off_t ultotal,
+                                   curl_off_t ulnow) {
+  struct curl_range *range = (struct curl_range *)clientp;
+  (void)dltotal;
+  (void)dlnow;
+  (void)ultotal;
+  (void)ulnow;
+  return acquire_atomic_load_int(&range->handle->cancel_flag);
+}
+
+/* Fetch bytes `first` to `last` of `url` into `range->file` at `first` */
+static int curl_fetch_range(struct acquire_handle *handle, CURL *easy,
+                            struct curl_range *range, off_t first,
+                            off_t last) {
+  char spec[64];
+  CURLcode res;
+  long response_code = 0;
+  sprintf(spec, "%" CURL_FORMAT_CURL_OFF_T "-%" CURL_FORMAT_CURL_OFF_T,
+          (curl_off_t)first, (curl_off_t)last);
+  if (curl_fseeko(range->file, first, SEEK_SET) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot seek in destination file");
+    return -1;
   }
+  range->left = last - first + 1;
+  curl_easy_setopt(easy, CURLOPT_RANGE, spec);
+  res = curl_easy_perform(easy);
+  curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response_code);
+  if (res == CURLE_OK && range->left == 0)
+    return 0;
+  if (acquire_atomic_load_int(&handle->cancel_flag))
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Repair cancelled by user.");
+  else if (res == CURLE_COULDNT_RESOLVE_HOST)
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_HOST_NOT_FOUND,
+                             "Could not resolve host: %s",
+                             curl_easy_strerror(res));
+  else if (response_code >= 400)
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
+                             "HTTP error: %ld", response_code);
+  else if (res == CURLE_OK || res == CURLE_WRITE_ERROR)
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                             "Server did not send bytes %s", spec);
+  else
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                             "cURL error: %s", curl_easy_strerror(res));
+  return -1;
+}
+
+int acquire_download_repair_blocks(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    const struct acquire_block_manifest *manifest, const size_t *blocks,
+    size_t count) {
+  struct curl_range range;
+  CURL *easy;
+  size_t pos = 0;
+  off_t first, last;
+  int more, rc = 0, still_bad;
+  if (!handle || !url || !dest_path || !manifest || (count && !blocks)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  handle->status = ACQUIRE_IN_PROGRESS;
+  acquire_atomic_store_int(&handle->cancel_flag, 0);
+  acquire_handle_set_progress(handle, 0);
+  range.handle = handle;
+  range.file = fopen(dest_path, "r+b");
+  if (!range.file) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Failed to open destination file: %s", dest_path);
+    return -1;
+  }
+  acquire_curl_global_init();
+  easy = curl_session_easy(handle->session);
+  if (!easy) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
+                             "curl_easy_init() failed");
+    fclose(range.file);
+    acquire_curl_global_cleanup();
+    return -1;
+  }
+  curl_easy_setopt(easy, CURLOPT_URL, url);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, range_write_callback);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, &range);
+  curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, range_progress_callback);
+  curl_easy_setopt(easy, CURLOPT_XFERINFODATA, &range);
+  curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(easy, CURLOPT_USERAGENT, "libacquire/" LIBACQUIRE_VERSION);
+  curl_easy_setopt(easy, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+
+  /* One request per run of adjacent blocks, over one reused connection */
+  while (rc == 0 && (more = acquire_block_range(manifest, blocks, count, &pos,
+                                                &first, &last)) != 0) {
+    if (more < 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Blocks must be listed once, in order");
+      rc = -1;
+    } else {
+      rc = curl_fetch_range(handle, easy, &range, first, last);
+    }
+  }
+  curl_session_release(handle->session, easy);
+  acquire_curl_global_cleanup();
+  if (curl_ftruncate(range.file, manifest->size) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot truncate %s", dest_path);
+    rc = -1;
+  }
+  if (fclose(range.file) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot write %s", dest_path);
+    rc = -1;
+  }
+  if (rc != 0)
+    return -1;
+  still_bad = acquire_verify_block_list(handle, dest_path, manifest, blocks,
+                                        count, NULL, 0);
+  if (still_bad < 0)
+    return -1;
+  if (still_bad > 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+                             "%d of %lu repaired blocks still do not match",
+                             still_bad, (unsigned long)count);
+    return -1;
+  }
+  return 0;
 }
 
 #endif /* defined(LIBACQUIRE_IMPLEMENTATION) &&                                \
@@ -11,11 +11,23 @@
 #include <unistd.h>
 #endif
 
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <io.h>
+#define fetch_fseeko _fseeki64
+#define fetch_ftruncate(f, size) _chsize_s(_fileno(f), (size))
+#else
+#define fetch_fseeko fseeko
+#define fetch_ftruncate(f, size) ftruncate(fileno(f), (size))
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "acquire_blocks.h"
 #include "acquire_download.h"
+#include "acquire_fileutils.h"
+#include "acquire_multi_digest.h"
 #include "fetch.h"
 
 #ifdef LIBACQUIRE_DOWNLOAD_DIR_IMPL
@@ -24,19 +36,27 @@ const char *get_download_dir(void) { return ".downloads"; }
 
 /* --- Synchronous API --- */
 
-/**
- * @brief Downloads a file synchronously (blocking) using libfetch.
- */
-int acquire_download_sync(struct acquire_handle *handle, const char *url,
-                          const char *dest_path) {
+/* Download `url` to `dest_path`, from `resume_from` if not `0` */
+static int fetch_download(struct acquire_handle *handle, const char *url,
+                          const char *dest_path, off_t resume_from) {
   struct url *u;
   FILE *f;
   char buffer[4096];
   size_t bytes_read;
   struct url_stat st;
+  int hash_failed = 0;
 
   if (handle == NULL)
     return -1;
+  handle->cancel_flag = 0;
+
+  if (resume_from > 0 && filesize(dest_path) < resume_from) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "Destination file is shorter than the "
+                             "checkpoint: %s",
+                             dest_path);
+    return -1;
+  }
 
   u = fetchParseURL(url);
   if (u == NULL) {
@@ -50,6 +70,9 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
     handle->total_size = st.size;
   }
 
+  /* libfetch asks for, or skips to, the rest from here */
+  u->offset = resume_from;
+  handle->bytes_processed = resume_from;
   f = fetchGet(u, "");
   if (f == NULL) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_URL_PARSE_FAILED,
@@ -58,7 +81,14 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
     return -1;
   }
 
-  handle->output_file = fopen(dest_path, "wb");
+  /* Keep what the checkpoint covers, and write after it */
+  handle->output_file = fopen(dest_path, resume_from > 0 ? "r+b" : "wb");
+  if (handle->output_file && resume_from > 0 &&
+      (fetch_ftruncate(handle->output_file, resume_from) != 0 ||
+       fetch_fseeko(handle->output_file, resume_from, SEEK_SET) != 0)) {
+    fclose(handle->output_file);
+    handle->output_file = NULL;
+  }
   if (!handle->output_file) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
                              "Failed to open destination file");
@@ -74,6 +104,15 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
       break;
     }
     fwrite(buffer, 1, bytes_read, handle->output_file);
+    /* Hash the buffer while it is still hot instead of rereading the file */
+    if (handle->download_digest &&
+        acquire_digest_stream_update(handle->download_digest, buffer,
+                                     bytes_read) != 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "Hashing the download failed");
+      hash_failed = 1;
+      break;
+    }
     handle->bytes_processed += (off_t)bytes_read;
   }
 
@@ -86,11 +125,24 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
     handle->status = ACQUIRE_ERROR_CANCELLED;
     return -1;
   }
+  if (hash_failed)
+    return -1;
+  if (handle->download_digest &&
+      acquire_digest_stream_finish(handle->download_digest, handle) != 0)
+    return -1;
 
   handle->status = ACQUIRE_COMPLETE;
   return 0;
 }
 
+/**
+ * @brief Downloads a file synchronously (blocking) using libfetch.
+ */
+int acquire_download_sync(struct acquire_handle *handle, const char *url,
+                          const char *dest_path) {
+  return fetch_download(handle, url, dest_path, 0);
+}
+
 /* --- Asynchronous API (Faked) --- */
 
 /**
@@ -120,6 +172,121 @@ enum acquire_status acquire_download_async_poll(struct acquire_handle *handle) {
   return handle->status;
 }
 
+/**
+ * @brief The download is over by the time start returns, so there is never
+ * anything to watch.
+ */
+int acquire_download_get_fds(struct acquire_handle *handle,
+                             struct acquire_download_fd *fds, size_t max,
+                             long *timeout_ms) {
+  (void)fds;
+  (void)max;
+  if (handle == NULL || timeout_ms == NULL) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  *timeout_ms = -1;
+  return 0;
+}
+
+enum acquire_status
+acquire_download_socket_action(struct acquire_handle *handle,
+                               acquire_socket_t fd, int events) {
+  (void)fd;
+  (void)events;
+  return acquire_download_async_poll(handle);
+}
+
+/*
+ * Downloads here finish inside their start call, so an engine never has
+ * any in progress; it exists so that the same code runs on every backend.
+ */
+struct acquire_engine {
+  acquire_socket_fn socket_fn;
+  acquire_timer_fn timer_fn;
+  void *event_data;
+};
+
+struct acquire_engine *acquire_engine_create(void) {
+  return (struct acquire_engine *)calloc(1, sizeof(struct acquire_engine));
+}
+
+void acquire_engine_free(struct acquire_engine *engine) { free(engine); }
+
+int acquire_engine_poll(struct acquire_engine *engine,
+                        unsigned long max_wait_msec) {
+  (void)max_wait_msec;
+  return engine ? 0 : -1;
+}
+
+int acquire_engine_get_fds(struct acquire_engine *engine,
+                           struct acquire_download_fd *fds, size_t max,
+                           long *timeout_ms) {
+  (void)fds;
+  (void)max;
+  if (engine == NULL || timeout_ms == NULL)
+    return -1;
+  *timeout_ms = -1;
+  return 0;
+}
+
+int acquire_engine_socket_action(struct acquire_engine *engine,
+                                 acquire_socket_t fd, int events) {
+  (void)fd;
+  (void)events;
+  return engine ? 0 : -1;
+}
+
+void acquire_engine_set_event_hooks(struct acquire_engine *engine,
+                                    acquire_socket_fn socket_fn,
+                                    acquire_timer_fn timer_fn,
+                                    void *user_data) {
+  if (!engine)
+    return;
+  engine->socket_fn = socket_fn;
+  engine->timer_fn = timer_fn;
+  engine->event_data = user_data;
+}
+
+int acquire_engine_set_origin_limits(struct acquire_engine *engine,
+                                     long max_connections, long max_streams) {
+  if (!engine || max_connections < 0 || max_streams < 1)
+    return -1;
+  return 0;
+}
+
+/* Each download blocks here, so a batch runs them one after another */
+int acquire_download_batch(struct acquire_engine *engine,
+                           const struct acquire_download_item *items,
+                           size_t count) {
+  size_t i;
+  int failed = 0;
+  (void)engine;
+  if (!items && count > 0)
+    return -1;
+  for (i = 0; i < count; i++)
+    if (!items[i].handle)
+      return -1;
+  for (i = 0; i < count; i++)
+    if (acquire_download_sync(items[i].handle, items[i].url,
+                              items[i].dest_path) != 0)
+      failed++;
+  return failed;
+}
+
+/* Nothing here is shared between downloads yet */
+struct acquire_session {
+  int unused;
+};
+
+struct acquire_session *acquire_session_create(void) {
+  return (struct acquire_session *)calloc(1, sizeof(struct acquire_session));
+}
+
+void acquire_session_free(struct acquire_session *session) { free(session); }
+
 /**
  * @brief Requests cancellation.
  * TODO: True cancellation is impossible here as the sync function blocks.
@@ -130,6 +297,191 @@ void acquire_download_async_cancel(struct acquire_handle *handle) {
   }
 }
 
+/* --- Verified API --- */
+
+/* Run a verified download, from `checkpoint` unless that is `NULL` */
+static int fetch_verified_download(struct acquire_handle *handle,
+                                   const char *url, const char *dest_path,
+                                   enum Checksum algorithm,
+                                   const char *expected_hash,
+                                   const void *checkpoint,
+                                   size_t checkpoint_size) {
+  struct acquire_digest_spec spec;
+  int rc;
+  if (!handle)
+    return -1;
+  if (!url || !dest_path) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Invalid arguments");
+    return -1;
+  }
+  spec.algorithm = algorithm;
+  spec.expected_hash = expected_hash;
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest =
+      checkpoint ? acquire_digest_stream_resume(handle, &spec, 1, checkpoint,
+                                                checkpoint_size)
+                 : acquire_digest_stream_new(handle, &spec, 1);
+  if (!handle->download_digest)
+    return -1;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  rc = fetch_download(
+      handle, url, dest_path,
+      checkpoint ? acquire_checkpoint_offset(checkpoint, checkpoint_size) : 0);
+  /* That blocked until the end, so the stream is done with either way */
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest = NULL;
+  return rc;
+}
+
+int acquire_download_verified_async_start(struct acquire_handle *handle,
+                                          const char *url,
+                                          const char *dest_path,
+                                          enum Checksum algorithm,
+                                          const char *expected_hash) {
+  return fetch_verified_download(handle, url, dest_path, algorithm,
+                                 expected_hash, NULL, 0);
+}
+
+int acquire_download_verified_resume_async_start(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    enum Checksum algorithm, const char *expected_hash,
+    const void *checkpoint, size_t checkpoint_size) {
+  if (!checkpoint) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Not a checkpoint");
+    return -1;
+  }
+  return fetch_verified_download(handle, url, dest_path, algorithm,
+                                 expected_hash, checkpoint, checkpoint_size);
+}
+
+int acquire_download_verified_sync(struct acquire_handle *handle,
+                                   const char *url, const char *dest_path,
+                                   enum Checksum algorithm,
+                                   const char *expected_hash) {
+  return acquire_download_verified_async_start(handle, url, dest_path,
+                                               algorithm, expected_hash);
+}
+
+/* --- Block repair --- */
+
+/* Copy bytes `first` to `last` of `url` into `out` at `first` */
+static int fetch_range(struct acquire_handle *handle, const char *url,
+                       FILE *out, off_t first, off_t last) {
+  struct url *u;
+  FILE *f;
+  char buffer[4096];
+  off_t left = last - first + 1;
+  size_t bytes_read;
+
+  u = fetchParseURL(url);
+  if (u == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_URL_PARSE_FAILED, "%s",
+                             fetchLastErrString);
+    return -1;
+  }
+  /* As for resuming: libfetch asks for, or skips to, `first` */
+  u->offset = first;
+  f = fetchGet(u, "");
+  if (f == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE, "%s",
+                             fetchLastErrString);
+    fetchFreeURL(u);
+    return -1;
+  }
+  if (fetch_fseeko(out, first, SEEK_SET) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot seek in destination file");
+    left = -1;
+  }
+  while (left > 0 &&
+         (bytes_read = fread(buffer, 1,
+                             left < (off_t)sizeof(buffer) ? (size_t)left
+                                                          : sizeof(buffer),
+                             f)) > 0) {
+    if (handle->cancel_flag) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Repair cancelled");
+      left = -1;
+      break;
+    }
+    if (fwrite(buffer, 1, bytes_read, out) != bytes_read) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                               "Cannot write destination file");
+      left = -1;
+      break;
+    }
+    left -= (off_t)bytes_read;
+    handle->bytes_processed += (off_t)bytes_read;
+  }
+  fclose(f);
+  fetchFreeURL(u);
+  if (left > 0)
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                             "Server sent too little of %s", url);
+  return left == 0 ? 0 : -1;
+}
+
+int acquire_download_repair_blocks(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    const struct acquire_block_manifest *manifest, const size_t *blocks,
+    size_t count) {
+  FILE *out;
+  size_t pos = 0;
+  off_t first, last;
+  int more, rc = 0, still_bad;
+  if (!handle || !url || !dest_path || !manifest || (count && !blocks)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  handle->status = ACQUIRE_IN_PROGRESS;
+  handle->cancel_flag = 0;
+  handle->bytes_processed = 0;
+  out = fopen(dest_path, "r+b");
+  if (!out) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Failed to open destination file");
+    return -1;
+  }
+  while (rc == 0 && (more = acquire_block_range(manifest, blocks, count, &pos,
+                                                &first, &last)) != 0) {
+    if (more < 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Blocks must be listed once, in order");
+      rc = -1;
+    } else {
+      rc = fetch_range(handle, url, out, first, last);
+    }
+  }
+  if (fetch_ftruncate(out, manifest->size) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot truncate destination file");
+    rc = -1;
+  }
+  if (fclose(out) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot write destination file");
+    rc = -1;
+  }
+  if (rc != 0)
+    return -1;
+  still_bad = acquire_verify_block_list(handle, dest_path, manifest, blocks,
+                                        count, NULL, 0);
+  if (still_bad < 0)
+    return -1;
+  if (still_bad > 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+                             "%d of %lu repaired blocks still do not match",
+                             still_bad, (unsigned long)count);
+    return -1;
+  }
+  return 0;
+}
+
 #endif /* defined(LIBACQUIRE_USE_LIBFETCH) && LIBACQUIRE_USE_LIBFETCH &&       \
           defined(LIBACQUIRE_IMPLEMENTATION) */
 
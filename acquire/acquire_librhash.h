@@ -10,23 +10,19 @@ extern "C" {
 #include <rhash.h>
 
 #include "acquire_common_defs.h"
+#include "acquire_digest_pool.h"
+#include "acquire_file_reader.h"
 #include "acquire_handle.h"
 #include "libacquire_export.h"
 #include <acquire_string_extras.h>
 
 struct rhash_backend {
   rhash handle;
-  FILE *file;
+  struct acquire_file_reader reader;
   char expected_hash[130];
   unsigned int algorithm_id;
 };
 
-#if defined(_MSC_VER) && !defined(__INTEL_COMPILER)
-#else
-__attribute__((unused))
-#endif
-static int rhash_lib_initialized = 0;
-
 extern LIBACQUIRE_EXPORT int
 _librhash_verify_async_start(struct acquire_handle *handle,
                              const char *filepath, enum Checksum algorithm,
@@ -38,14 +34,11 @@ _librhash_verify_async_cancel(struct acquire_handle *handle);
 
 #ifdef LIBACQUIRE_IMPLEMENTATION
 #include "acquire_handle.h"
+#include "acquire_threads.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifndef CHUNK_SIZE
-#define CHUNK_SIZE 4096
-#endif /* !CHUNK_SIZE */
-
 static void to_hex(char *dest, const unsigned char *const src,
                    const size_t len) {
   size_t i;
@@ -56,10 +49,8 @@ static void to_hex(char *dest, const unsigned char *const src,
 void cleanup_rhash_backend(struct acquire_handle *handle) {
   if (handle && handle->backend_handle) {
     struct rhash_backend *be = (struct rhash_backend *)handle->backend_handle;
-    if (be->handle)
-      rhash_free(be->handle);
-    if (be->file)
-      fclose(be->file);
+    acquire_digest_pool_rhash_give(be->algorithm_id, be->handle);
+    acquire_file_reader_close(&be->reader);
     free(be);
     handle->backend_handle = NULL;
   }
@@ -92,38 +83,25 @@ int _librhash_verify_async_start(struct acquire_handle *handle,
                              "Invalid hash length for selected algorithm");
     return -1;
   }
-  if (!rhash_lib_initialized) {
-    rhash_library_init();
-    rhash_lib_initialized = 1;
-  }
   be = (struct rhash_backend *)calloc(1, sizeof(struct rhash_backend));
   if (!be) { /* LCOV_EXCL_START */
     acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
                              "rhash backend allocation failed");
     return -1;
   } /* LCOV_EXCL_STOP */
-#if defined(_MSC_VER) || defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-  {
-    const errno_t err = fopen_s(&be->file, filepath, "rb");
-    if (err != 0 || be->file == NULL) {
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                               "Cannot open file: %s", filepath);
-      free(be);
-      return -1;
-    }
-  }
-#else
-  be->file = fopen(filepath, "rb");
-  if (!be->file) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                             "Cannot open file: %s", strerror(errno));
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
     free(be);
     return -1;
   }
-#endif
-  be->handle = rhash_init(rhash_algo_id);
+  be->handle = acquire_digest_pool_rhash_take(rhash_algo_id);
   if (!be->handle) { /* LCOV_EXCL_START */
-    cleanup_rhash_backend(handle);
+    acquire_file_reader_close(&be->reader);
+    free(be);
     acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
                              "rhash_init failed");
     return -1;
@@ -148,8 +126,10 @@ int _librhash_verify_async_start(struct acquire_handle *handle,
 
 enum acquire_status _librhash_verify_async_poll(struct acquire_handle *handle) {
   struct rhash_backend *be;
-  unsigned char buffer[CHUNK_SIZE];
-  size_t bytes_read;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
   if (!handle)
     return ACQUIRE_ERROR;
   if (handle->status != ACQUIRE_IN_PROGRESS)
@@ -159,35 +139,35 @@ enum acquire_status _librhash_verify_async_poll(struct acquire_handle *handle) {
                              "In-progress poll with NULL backend");
     return ACQUIRE_ERROR;
   }
-  if (handle->cancel_flag) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
-                             "Checksum cancelled");
-    cleanup_rhash_backend(handle);
-    return ACQUIRE_ERROR;
-  }
   be = (struct rhash_backend *)handle->backend_handle;
-  bytes_read = fread(buffer, 1, sizeof(buffer), be->file);
-  if (bytes_read > 0) {
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Checksum cancelled");
+      cleanup_rhash_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
     if (rhash_update(be->handle, buffer, bytes_read) <
         0) { /* LCOV_EXCL_START */
       acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
                                "rhash_update failed");
-    } else { /* LCOV_EXCL_STOP */
-      handle->bytes_processed += (off_t)bytes_read;
-      return ACQUIRE_IN_PROGRESS;
-    }
-  }
-  if (ferror(be->file)) { /* LCOV_EXCL_START */
-#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
-    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-    char error_code[256];
-    strerror_s(error_code, sizeof(error_code), errno);
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", error_code);
-#else
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", strerror(errno));
-#endif
+      cleanup_rhash_backend(handle);
+      return ACQUIRE_ERROR;
+    } /* LCOV_EXCL_STOP */
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) { /* LCOV_EXCL_START */
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
   } else { /* LCOV_EXCL_STOP */
     unsigned char hash[64];
     char computed_hex[130];
@@ -209,7 +189,7 @@ enum acquire_status _librhash_verify_async_poll(struct acquire_handle *handle) {
 
 void _librhash_verify_async_cancel(struct acquire_handle *handle) {
   if (handle)
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
 }
 #endif /* LIBACQUIRE_IMPLEMENTATION */
 
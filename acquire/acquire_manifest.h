@@ -0,0 +1,961 @@
+#ifndef LIBACQUIRE_ACQUIRE_MANIFEST_H
+#define LIBACQUIRE_ACQUIRE_MANIFEST_H
+
+/*
+ * Verify every file listed in a checksum manifest, spread over all cores.
+ *
+ * Both common layouts are understood, and may be mixed in one file:
+ *
+ *   coreutils: `<hex>  <path>` or `<hex> *<path>` (as `sha256sum` writes)
+ *   BSD/tag:   `SHA256 (<path>) = <hex>` (as `sha256sum --tag` or `sha256`
+ *              write)
+ *
+ * A leading backslash marks a line whose path has `\\`, `\n` and `\r`
+ * escaped, as coreutils writes them. Blank lines and `#` comments are
+ * skipped.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "acquire_common_defs.h"
+#include "acquire_handle.h"
+#include "acquire_status_codes.h"
+#include "libacquire_export.h"
+
+/* One manifest line and, after verification, what became of it */
+struct acquire_manifest_entry {
+  /* Path as listed, and the expected digest; both point into the manifest */
+  const char *path;
+  const char *expected_hash;
+  enum Checksum algorithm;
+  /* `ACQUIRE_OK` if the file matched; `ACQUIRE_ERROR_CANCELLED` if unread */
+  enum acquire_error_code error;
+  /* Bytes hashed */
+  off_t bytes;
+};
+
+struct acquire_manifest_stats {
+  size_t files;
+  size_t passed;
+  size_t failed;
+  /* Lines that were neither entries, blanks nor comments */
+  size_t malformed;
+  off_t bytes;
+  double seconds;
+  double bytes_per_second;
+  double files_per_second;
+  /* Worker threads actually used */
+  unsigned int threads;
+};
+
+struct acquire_manifest {
+  struct acquire_manifest_entry *entries;
+  size_t count;
+  struct acquire_manifest_stats stats;
+  /* The manifest's text, which entries point into */
+  char *text;
+};
+
+/**
+ * @brief Parse manifest `text` of `length` bytes into `manifest`.
+ *
+ * The text is copied. Lines without an algorithm tag use `algorithm`; pass
+ * `LIBACQUIRE_UNSUPPORTED_CHECKSUM` to tell it from the digest's length
+ * (8: CRC32C, 16: XXH3_64, 32: XXH128, 64: SHA256, 128: SHA512).
+ *
+ * @return `0` on success, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_manifest_parse(struct acquire_handle *handle,
+                       struct acquire_manifest *manifest, const char *text,
+                       size_t length, enum Checksum algorithm);
+
+/**
+ * @brief Read and parse the manifest at `manifest_path`; see
+ * `acquire_manifest_parse`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_manifest_load(struct acquire_handle *handle,
+                      struct acquire_manifest *manifest,
+                      const char *manifest_path, enum Checksum algorithm);
+
+/**
+ * @brief Verify every entry of a parsed manifest.
+ *
+ * Entries are dealt out to `threads` workers (`0` for one per online CPU),
+ * the calling thread being one of them; a worker that runs out steals half
+ * of the largest backlog it finds, so a few huge files do not leave the
+ * other cores idle. Paths are taken relative to `base_dir`, or to the
+ * current directory if it is `NULL`. `acquire_verify_async_cancel` on
+ * `handle` from another thread stops workers between files.
+ *
+ * Where io_uring is available, workers read several files at once through
+ * an `acquire_batch_reader`, with `acquire_handle_set_io_queue_depth` reads
+ * in flight between them, and hash blocks as they complete.
+ *
+ * Files are hashed with `handle`'s checksum backend, block size, file
+ * mapping and verify threads. Each entry's `error` and `bytes` are filled
+ * in, along with `manifest->stats`.
+ *
+ * @return `0` if every entry matched, `-1` otherwise (details on the
+ * handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_manifest_verify(struct acquire_handle *handle,
+                        struct acquire_manifest *manifest,
+                        const char *base_dir, unsigned int threads);
+
+/**
+ * @brief Load the manifest at `manifest_path` and verify it in one call.
+ *
+ * `manifest` holds the results whatever the outcome; release it with
+ * `acquire_manifest_free`.
+ *
+ * @return `0` if every entry matched, `-1` otherwise (details on the
+ * handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_manifest(struct acquire_handle *handle,
+                        const char *manifest_path, const char *base_dir,
+                        enum Checksum algorithm, unsigned int threads,
+                        struct acquire_manifest *manifest);
+
+extern LIBACQUIRE_EXPORT void
+acquire_manifest_free(struct acquire_manifest *manifest);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_MANIFEST_IMPL_
+#define ACQUIRE_MANIFEST_IMPL_
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_batch_reader.h"
+#include "acquire_checksums.h"
+#include "acquire_multi_digest.h"
+#include "acquire_sha2.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+/* Hex digits in a digest of `algorithm`, or `0` if it is not a digest */
+static size_t manifest_hex_length(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return 8;
+  case LIBACQUIRE_XXH3_64:
+    return 16;
+  case LIBACQUIRE_XXH128:
+    return 32;
+  case LIBACQUIRE_SHA256:
+  case LIBACQUIRE_BLAKE3:
+    return 64;
+  case LIBACQUIRE_SHA512:
+    return 128;
+  default:
+    return 0;
+  }
+}
+
+static enum Checksum manifest_algorithm_for_length(size_t hex_len) {
+  switch (hex_len) {
+  case 8:
+    return LIBACQUIRE_CRC32C;
+  case 16:
+    return LIBACQUIRE_XXH3_64;
+  case 32:
+    return LIBACQUIRE_XXH128;
+  case 64:
+    return LIBACQUIRE_SHA256;
+  case 128:
+    return LIBACQUIRE_SHA512;
+  default:
+    return LIBACQUIRE_UNSUPPORTED_CHECKSUM;
+  }
+}
+
+static int manifest_is_hex(const char *s, size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++)
+    if (!isxdigit((unsigned char)s[i]))
+      return 0;
+  return len > 0;
+}
+
+/* Undo coreutils' escaping of `\\`, `\n` and `\r` in place */
+static int manifest_unescape(char *path) {
+  char *out = path;
+  for (; *path; path++) {
+    if (*path != '\\') {
+      *out++ = *path;
+      continue;
+    }
+    switch (*++path) {
+    case '\\':
+      *out++ = '\\';
+      break;
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    default:
+      return -1;
+    }
+  }
+  *out = '\0';
+  return 0;
+}
+
+/* `SHA256 (path) = hex`; `line` has no line terminator */
+static int manifest_parse_tagged(char *line, struct acquire_manifest_entry *e) {
+  char *tag_end = line, *open, *close, *hex;
+  char saved;
+  while (isalnum((unsigned char)*tag_end) || *tag_end == '_' ||
+         *tag_end == '-')
+    tag_end++;
+  open = tag_end;
+  if (*open == ' ')
+    open++;
+  if (tag_end == line || *open != '(')
+    return -1;
+  /* The path may itself contain `) = `, so the last one ends it */
+  hex = strrchr(open, '=');
+  if (hex == NULL)
+    return -1;
+  close = hex;
+  while (close > open && close[-1] == ' ')
+    close--;
+  if (close <= open + 2 || close[-1] != ')')
+    return -1;
+  close--;
+  hex++;
+  while (*hex == ' ')
+    hex++;
+
+  saved = *tag_end;
+  *tag_end = '\0';
+  e->algorithm = string2checksum(line);
+  *tag_end = saved;
+  if (e->algorithm == LIBACQUIRE_UNSUPPORTED_CHECKSUM)
+    return -1;
+  *close = '\0';
+  e->path = open + 1;
+  e->expected_hash = hex;
+  return 0;
+}
+
+/* `hex  path` or `hex *path` */
+static int manifest_parse_plain(char *line, enum Checksum algorithm,
+                                struct acquire_manifest_entry *e) {
+  char *sep = line;
+  while (isxdigit((unsigned char)*sep))
+    sep++;
+  if (sep == line || *sep != ' ')
+    return -1;
+  *sep++ = '\0';
+  if (*sep == ' ' || *sep == '*')
+    sep++;
+  if (*sep == '\0')
+    return -1;
+  e->expected_hash = line;
+  e->path = sep;
+  e->algorithm = algorithm != LIBACQUIRE_UNSUPPORTED_CHECKSUM
+                     ? algorithm
+                     : manifest_algorithm_for_length(strlen(line));
+  return 0;
+}
+
+/* `1` for an entry, `0` for a blank or comment line, `-1` if malformed */
+static int manifest_parse_line(char *line, enum Checksum algorithm,
+                               struct acquire_manifest_entry *e) {
+  size_t hex_len;
+  int escaped = 0;
+  if (*line == '\0' || *line == '#')
+    return 0;
+  if (*line == '\\') {
+    escaped = 1;
+    line++;
+  }
+  if (isxdigit((unsigned char)line[0]) && strchr(line, ' ') != NULL &&
+      manifest_is_hex(line, (size_t)(strchr(line, ' ') - line))) {
+    if (manifest_parse_plain(line, algorithm, e) != 0)
+      return -1;
+  } else if (manifest_parse_tagged(line, e) != 0) {
+    return -1;
+  }
+  hex_len = manifest_hex_length(e->algorithm);
+  if (hex_len == 0 || strlen(e->expected_hash) != hex_len ||
+      !manifest_is_hex(e->expected_hash, hex_len))
+    return -1;
+  if (escaped && manifest_unescape((char *)e->path) != 0)
+    return -1;
+  e->error = ACQUIRE_ERROR_CANCELLED;
+  e->bytes = 0;
+  return 1;
+}
+
+int acquire_manifest_parse(struct acquire_handle *handle,
+                           struct acquire_manifest *manifest,
+                           const char *text, size_t length,
+                           enum Checksum algorithm) {
+  size_t lines = 1, i;
+  char *line, *end;
+  if (!handle || !manifest || (!text && length)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for manifest");
+    return -1;
+  }
+  memset(manifest, 0, sizeof(*manifest));
+  for (i = 0; i < length; i++)
+    lines += text[i] == '\n';
+  manifest->text = (char *)malloc(length + 1);
+  manifest->entries = (struct acquire_manifest_entry *)malloc(
+      lines * sizeof(struct acquire_manifest_entry));
+  if (!manifest->text || !manifest->entries) { /* LCOV_EXCL_START */
+    acquire_manifest_free(manifest);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Manifest allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  if (length)
+    memcpy(manifest->text, text, length);
+  manifest->text[length] = '\0';
+
+  for (line = manifest->text; line < manifest->text + length; line = end + 1) {
+    struct acquire_manifest_entry *e = &manifest->entries[manifest->count];
+    int parsed;
+    end = (char *)memchr(line, '\n', (size_t)(manifest->text + length - line));
+    if (end == NULL)
+      end = manifest->text + length;
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+    parsed = manifest_parse_line(line, algorithm, e);
+    if (parsed > 0)
+      manifest->count++;
+    else if (parsed < 0)
+      manifest->stats.malformed++;
+  }
+  manifest->stats.files = manifest->count;
+  return 0;
+}
+
+int acquire_manifest_load(struct acquire_handle *handle,
+                          struct acquire_manifest *manifest,
+                          const char *manifest_path, enum Checksum algorithm) {
+  FILE *f;
+  char *text = NULL, *grown;
+  size_t length = 0, capacity = 0, got;
+  int rc;
+  if (!handle || !manifest || !manifest_path) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for manifest");
+    return -1;
+  }
+  f = fopen(manifest_path, "rb");
+  if (f == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Cannot open manifest %s: %s", manifest_path,
+                             strerror(errno));
+    return -1;
+  }
+  do {
+    if (length == capacity) {
+      capacity = capacity ? capacity * 2 : 65536;
+      grown = (char *)realloc(text, capacity);
+      if (grown == NULL) { /* LCOV_EXCL_START */
+        free(text);
+        fclose(f);
+        acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                                 "Manifest allocation failed");
+        return -1;
+      } /* LCOV_EXCL_STOP */
+      text = grown;
+    }
+    got = fread(text + length, 1, capacity - length, f);
+    length += got;
+  } while (got > 0);
+  if (ferror(f)) {
+    fclose(f);
+    free(text);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "Cannot read manifest %s", manifest_path);
+    return -1;
+  }
+  fclose(f);
+  rc = acquire_manifest_parse(handle, manifest, text, length, algorithm);
+  free(text);
+  return rc;
+}
+
+/*
+ * Work stealing: each worker owns the entries `[next, end)` and takes them
+ * from the front; a worker with none left takes the back half of the
+ * largest range it can find. Ranges only ever shrink, so once a full scan
+ * finds nothing the manifest is done.
+ *
+ * Where io_uring is available each worker also owns a batch reader: it
+ * keeps several of its files queued there, and hashes whichever block
+ * completes next with that file's digest stream.
+ *
+ * With the bundled SHA-2, small SHA256 files are instead read whole into
+ * one of a worker's lanes, and each `ACQUIRE_SHA256_MB_LANES` of them are
+ * hashed together by `acquire_sha256_update_many`.
+ */
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+/* Largest file hashed in a lane */
+#define MANIFEST_LANE_FILE_MAX 65536
+
+struct manifest_lanes {
+  /* Only where the bundled SHA-256 is at least as quick as the backends */
+  int enabled;
+  struct acquire_manifest_entry *entries[ACQUIRE_SHA256_MB_LANES];
+  size_t lens[ACQUIRE_SHA256_MB_LANES];
+  /* `MANIFEST_LANE_FILE_MAX` bytes per lane, allocated on first use */
+  unsigned char *data;
+  unsigned int count;
+};
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+/* A file queued on a worker's batch reader */
+struct manifest_pending {
+  struct acquire_manifest_entry *entry;
+  struct acquire_digest_stream *stream;
+  int failed;
+};
+
+struct manifest_worker {
+  struct manifest_run *run;
+  acquire_thread_t thread;
+  int started;
+  acquire_mutex_t lock;
+  size_t next, end;
+  struct acquire_handle *handle;
+  char *path;
+  size_t path_capacity;
+  off_t bytes;
+  struct acquire_batch_reader *batch;
+  /* One per file the batch reader can hold; free when `entry` is `NULL` */
+  struct manifest_pending *pending;
+  unsigned int n_pending;
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  struct manifest_lanes lanes;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+};
+
+struct manifest_run {
+  struct acquire_manifest *manifest;
+  struct acquire_handle *owner;
+  const char *base_dir;
+  struct manifest_worker *workers;
+  unsigned int n_workers;
+};
+
+static int manifest_worker_take(struct manifest_worker *w, size_t *index) {
+  struct manifest_run *run = w->run;
+  unsigned int i;
+  for (;;) {
+    struct manifest_worker *victim = NULL;
+    size_t best = 0, from, to;
+
+    acquire_mutex_lock(&w->lock);
+    if (w->next < w->end) {
+      *index = w->next++;
+      acquire_mutex_unlock(&w->lock);
+      return 1;
+    }
+    acquire_mutex_unlock(&w->lock);
+
+    /* Sizes only pick a victim; the range may shrink before the steal */
+    for (i = 0; i < run->n_workers; i++) {
+      struct manifest_worker *other = &run->workers[i];
+      size_t left;
+      if (other == w)
+        continue;
+      acquire_mutex_lock(&other->lock);
+      left = other->end - other->next;
+      acquire_mutex_unlock(&other->lock);
+      if (left > best) {
+        best = left;
+        victim = other;
+      }
+    }
+    if (victim == NULL)
+      return 0;
+
+    acquire_mutex_lock(&victim->lock);
+    to = victim->end;
+    from = victim->next + (victim->end - victim->next) / 2;
+    victim->end = from;
+    acquire_mutex_unlock(&victim->lock);
+    if (from == to)
+      continue;
+
+    acquire_mutex_lock(&w->lock);
+    w->next = from;
+    w->end = to;
+    acquire_mutex_unlock(&w->lock);
+  }
+}
+
+static const char *manifest_entry_path(struct manifest_worker *w,
+                                       const char *path) {
+  const char *base = w->run->base_dir;
+  size_t need;
+  if (base == NULL || *base == '\0')
+    return path;
+  need = strlen(base) + strlen(PATH_SEP) + strlen(path) + 1;
+  if (need > w->path_capacity) {
+    char *grown = (char *)realloc(w->path, need);
+    if (grown == NULL)
+      return NULL;
+    w->path = grown;
+    w->path_capacity = need;
+  }
+  sprintf(w->path, "%s%s%s", base, PATH_SEP, path);
+  return w->path;
+}
+
+/* Verify one entry through the checksum backends */
+static void manifest_verify_entry(struct manifest_worker *w,
+                                  struct acquire_manifest_entry *e,
+                                  const char *path) {
+  acquire_handle_set_progress(w->handle, 0);
+  acquire_verify_sync(w->handle, path, e->algorithm, e->expected_hash);
+  e->error = acquire_handle_get_error_code(w->handle);
+  e->bytes = acquire_handle_get_progress(w->handle);
+  w->bytes += e->bytes;
+}
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+static int manifest_lanes_wanted(const struct manifest_worker *w,
+                                 const struct acquire_manifest_entry *e,
+                                 size_t len) {
+  return w->lanes.enabled && e->algorithm == LIBACQUIRE_SHA256 &&
+         len <= MANIFEST_LANE_FILE_MAX;
+}
+
+/* Where the next lane's file goes, or `NULL` */
+static unsigned char *manifest_lanes_slot(struct manifest_worker *w) {
+  if (w->lanes.data == NULL)
+    w->lanes.data = (unsigned char *)malloc(ACQUIRE_SHA256_MB_LANES *
+                                            MANIFEST_LANE_FILE_MAX);
+  if (w->lanes.data == NULL)
+    return NULL;
+  return w->lanes.data + w->lanes.count * MANIFEST_LANE_FILE_MAX;
+}
+
+static void manifest_lanes_flush(struct manifest_worker *w) {
+  struct acquire_sha2_hasher hashers[ACQUIRE_SHA256_MB_LANES];
+  struct acquire_sha2_hasher *lanes[ACQUIRE_SHA256_MB_LANES];
+  unsigned char digests[ACQUIRE_SHA256_MB_LANES][ACQUIRE_SHA512_OUT_LEN];
+  unsigned char *outs[ACQUIRE_SHA256_MB_LANES];
+  const void *inputs[ACQUIRE_SHA256_MB_LANES];
+  char hex[2 * ACQUIRE_SHA256_OUT_LEN + 1];
+  unsigned int i;
+  size_t j;
+  for (i = 0; i < w->lanes.count; i++) {
+    acquire_sha2_init(&hashers[i], LIBACQUIRE_SHA256);
+    lanes[i] = &hashers[i];
+    inputs[i] = w->lanes.data + i * MANIFEST_LANE_FILE_MAX;
+    outs[i] = digests[i];
+  }
+  acquire_sha256_update_many(lanes, inputs, w->lanes.lens, w->lanes.count);
+  acquire_sha256_final_many(lanes, outs, w->lanes.count);
+  for (i = 0; i < w->lanes.count; i++) {
+    struct acquire_manifest_entry *e = w->lanes.entries[i];
+    for (j = 0; j < ACQUIRE_SHA256_OUT_LEN; j++)
+      sprintf(hex + 2 * j, "%02x", digests[i][j]);
+    /* Mismatches read as they do from `acquire_verify_sync` */
+    e->error = strncasecmp(hex, e->expected_hash, sizeof(hex) - 1) == 0
+                   ? ACQUIRE_OK
+                   : ACQUIRE_ERROR_UNKNOWN;
+    e->bytes = (off_t)w->lanes.lens[i];
+    w->bytes += e->bytes;
+  }
+  w->lanes.count = 0;
+}
+
+/* `e`'s file is in the next slot; hash the lanes once they are all full */
+static void manifest_lanes_commit(struct manifest_worker *w,
+                                  struct acquire_manifest_entry *e,
+                                  size_t len) {
+  w->lanes.entries[w->lanes.count] = e;
+  w->lanes.lens[w->lanes.count] = len;
+  if (++w->lanes.count == ACQUIRE_SHA256_MB_LANES)
+    manifest_lanes_flush(w);
+}
+
+/* Read `path` whole into a lane; `-1` leaves it to the backends */
+static int manifest_lanes_read(struct manifest_worker *w,
+                               struct acquire_manifest_entry *e,
+                               const char *path) {
+  unsigned char *slot = manifest_lanes_slot(w);
+  size_t len;
+  FILE *fh;
+  if (slot == NULL)
+    return -1;
+  fh = fopen(path, "rb");
+  if (fh == NULL)
+    return -1;
+  len = fread(slot, 1, MANIFEST_LANE_FILE_MAX, fh);
+  /* Too big, or unreadable: the backends say which */
+  if (ferror(fh) || (len == MANIFEST_LANE_FILE_MAX && fgetc(fh) != EOF)) {
+    fclose(fh);
+    return -1;
+  }
+  fclose(fh);
+  manifest_lanes_commit(w, e, len);
+  return 0;
+}
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+/* Queue `e` on the batch reader, or verify it now if it cannot be queued */
+static void manifest_batch_add(struct manifest_worker *w,
+                               struct acquire_manifest_entry *e) {
+  struct manifest_pending *p = NULL;
+  struct acquire_digest_spec spec;
+  const char *path = manifest_entry_path(w, e->path);
+  unsigned int i;
+  if (path == NULL) { /* LCOV_EXCL_START */
+    e->error = ACQUIRE_ERROR_OUT_OF_MEMORY;
+    return;
+  } /* LCOV_EXCL_STOP */
+  for (i = 0; i < w->n_pending && p == NULL; i++)
+    if (w->pending[i].entry == NULL)
+      p = &w->pending[i];
+  spec.algorithm = e->algorithm;
+  spec.expected_hash = e->expected_hash;
+  if (p != NULL)
+    p->stream = acquire_digest_stream_new(w->handle, &spec, 1);
+  if (p == NULL || p->stream == NULL ||
+      acquire_batch_reader_add(w->batch, path, p) != 0) {
+    if (p != NULL) {
+      acquire_digest_stream_free(p->stream);
+      p->stream = NULL;
+    }
+    /* Missing, not a regular file, or no streaming digest: the backends
+     * report it exactly as they would have */
+    manifest_verify_entry(w, e, path);
+    return;
+  }
+  p->entry = e;
+  p->failed = 0;
+  e->bytes = 0;
+}
+
+static void manifest_batch_block(struct manifest_worker *w,
+                                 const struct acquire_batch_block *block) {
+  struct manifest_pending *p = (struct manifest_pending *)block->user;
+  struct acquire_manifest_entry *e = p->entry;
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  unsigned char *slot;
+  /* A whole small file in one block waits for a lane instead */
+  if (block->last && !block->error && block->offset == 0 &&
+      manifest_lanes_wanted(w, e, block->len) &&
+      (slot = manifest_lanes_slot(w)) != NULL) {
+    if (block->len > 0)
+      memcpy(slot, block->data, block->len);
+    acquire_digest_stream_free(p->stream);
+    p->stream = NULL;
+    p->entry = NULL;
+    manifest_lanes_commit(w, e, block->len);
+    return;
+  }
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  if (block->error) {
+    e->error = ACQUIRE_ERROR_FILE_READ_FAILED;
+  } else {
+    if (acquire_digest_stream_update(p->stream, block->data, block->len) != 0)
+      p->failed = 1;
+    e->bytes += (off_t)block->len;
+    w->bytes += (off_t)block->len;
+    /* Mismatches read as they do from `acquire_verify_sync` */
+    if (block->last)
+      e->error = !p->failed &&
+                         acquire_digest_stream_finish(p->stream, w->handle) == 0
+                     ? ACQUIRE_OK
+                     : ACQUIRE_ERROR_UNKNOWN;
+  }
+  if (block->last) {
+    acquire_digest_stream_free(p->stream);
+    p->stream = NULL;
+    p->entry = NULL;
+  }
+}
+
+static void manifest_worker_run_batched(struct manifest_worker *w) {
+  struct acquire_manifest *manifest = w->run->manifest;
+  struct acquire_batch_block block;
+  size_t index;
+  int more = 1, got;
+  for (;;) {
+    /* Keep the reader full, so later files are read while this one hashes */
+    while (more && !acquire_batch_reader_full(w->batch)) {
+      if (acquire_atomic_load_int(&w->run->owner->cancel_flag) ||
+          !manifest_worker_take(w, &index)) {
+        more = 0;
+        break;
+      }
+      manifest_batch_add(w, &manifest->entries[index]);
+    }
+    if (acquire_atomic_load_int(&w->run->owner->cancel_flag))
+      return;
+    got = acquire_batch_reader_next(w->batch, &block);
+    if (got < 0) { /* LCOV_EXCL_START */
+      /* The ring broke: check what it still held the ordinary way */
+      unsigned int i;
+      acquire_batch_reader_free(w->batch);
+      w->batch = NULL;
+      for (i = 0; i < w->n_pending; i++) {
+        struct acquire_manifest_entry *e = w->pending[i].entry;
+        const char *path;
+        if (e == NULL)
+          continue;
+        w->bytes -= e->bytes;
+        acquire_digest_stream_free(w->pending[i].stream);
+        w->pending[i].stream = NULL;
+        w->pending[i].entry = NULL;
+        path = manifest_entry_path(w, e->path);
+        if (path == NULL)
+          e->error = ACQUIRE_ERROR_OUT_OF_MEMORY;
+        else
+          manifest_verify_entry(w, e, path);
+      }
+      return;
+    } /* LCOV_EXCL_STOP */
+    if (got == 0)
+      return;
+    manifest_batch_block(w, &block);
+  }
+}
+
+static void manifest_worker_run(void *arg) {
+  struct manifest_worker *w = (struct manifest_worker *)arg;
+  struct acquire_manifest *manifest = w->run->manifest;
+  size_t index;
+  if (w->batch != NULL)
+    manifest_worker_run_batched(w);
+  while (!acquire_atomic_load_int(&w->run->owner->cancel_flag) &&
+         manifest_worker_take(w, &index)) {
+    struct acquire_manifest_entry *e = &manifest->entries[index];
+    const char *path = manifest_entry_path(w, e->path);
+    if (path == NULL) { /* LCOV_EXCL_START */
+      e->error = ACQUIRE_ERROR_OUT_OF_MEMORY;
+      continue;
+    } /* LCOV_EXCL_STOP */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+    if (manifest_lanes_wanted(w, e, 0) && manifest_lanes_read(w, e, path) == 0)
+      continue;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+    manifest_verify_entry(w, e, path);
+  }
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  manifest_lanes_flush(w);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+}
+
+/* Give `w` a batch reader, if io_uring can keep `depth` reads in flight */
+static void manifest_worker_batch(struct manifest_worker *w,
+                                  unsigned int depth, size_t block_size) {
+  w->batch = acquire_batch_reader_create(depth, block_size);
+  /* One blocking `pread` at a time is no better than the backends' reads */
+  if (acquire_batch_reader_uses_io_uring(w->batch))
+    w->pending = (struct manifest_pending *)calloc(depth, sizeof(*w->pending));
+  if (w->pending == NULL) {
+    acquire_batch_reader_free(w->batch);
+    w->batch = NULL;
+    return;
+  }
+  w->n_pending = depth;
+}
+
+static void manifest_workers_free(struct manifest_run *run) {
+  unsigned int i;
+  for (i = 0; i < run->n_workers; i++) {
+    struct manifest_worker *w = &run->workers[i];
+    unsigned int j;
+    if (w->started)
+      acquire_thread_join(w->thread);
+    acquire_batch_reader_free(w->batch);
+    for (j = 0; j < w->n_pending; j++)
+      acquire_digest_stream_free(w->pending[j].stream);
+    free(w->pending);
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+    free(w->lanes.data);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+    acquire_handle_free(w->handle);
+    free(w->path);
+    acquire_mutex_destroy(&w->lock);
+  }
+  free(run->workers);
+}
+
+/* Have a worker verify as its owner's handle is set up to */
+static void manifest_worker_inherit(struct acquire_handle *worker,
+                                    const struct acquire_handle *owner) {
+  worker->checksum_backend = owner->checksum_backend;
+  worker->poll_budget_bytes = owner->poll_budget_bytes;
+  worker->poll_budget_usec = owner->poll_budget_usec;
+  worker->verify_threads = owner->verify_threads;
+  worker->read_buffer_size = owner->read_buffer_size;
+  worker->file_reader_flags = owner->file_reader_flags;
+  worker->io_queue_depth = owner->io_queue_depth;
+}
+
+int acquire_manifest_verify(struct acquire_handle *handle,
+                            struct acquire_manifest *manifest,
+                            const char *base_dir, unsigned int threads) {
+  struct manifest_run run;
+  double started;
+  size_t i;
+  unsigned int n, depth;
+  if (!handle || !manifest) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments provided for manifest");
+    return -1;
+  }
+  handle->status = ACQUIRE_IN_PROGRESS;
+  handle->error.code = ACQUIRE_OK;
+  handle->error.message[0] = '\0';
+  handle->cancel_flag = 0;
+  acquire_handle_set_progress(handle, 0);
+
+  if (threads == 0)
+    threads = acquire_cpu_count();
+  if ((size_t)threads > manifest->count)
+    threads = manifest->count ? (unsigned int)manifest->count : 1;
+  memset(&run, 0, sizeof(run));
+  run.manifest = manifest;
+  run.owner = handle;
+  run.base_dir = base_dir;
+  run.workers = (struct manifest_worker *)calloc(
+      threads, sizeof(struct manifest_worker));
+  if (run.workers == NULL) { /* LCOV_EXCL_START */
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Manifest worker allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+  depth = handle->io_queue_depth ? handle->io_queue_depth
+                                 : ACQUIRE_DEFAULT_IO_QUEUE_DEPTH;
+  /* Equal shares up front; stealing evens out what file sizes do not */
+  for (n = 0; n < threads; n++) {
+    struct manifest_worker *w = &run.workers[n];
+    w->run = &run;
+    w->next = manifest->count * n / threads;
+    w->end = manifest->count * (n + 1) / threads;
+    w->handle = acquire_handle_init();
+    if (w->handle == NULL || acquire_mutex_init(&w->lock) != 0) {
+      acquire_handle_free(w->handle);
+      break;
+    }
+    manifest_worker_inherit(w->handle, handle);
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+    /* Scalar SHA-256 one file at a time trails the crypto libraries */
+    w->lanes.enabled =
+        acquire_sha256_mb_supported() ||
+        acquire_sha2_active_kernel() != ACQUIRE_SHA2_KERNEL_PORTABLE;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+    if (depth > 1)
+      manifest_worker_batch(w, (depth + threads - 1) / threads,
+                            handle->read_buffer_size);
+  }
+  run.n_workers = n;
+  if (n < threads) { /* LCOV_EXCL_START */
+    manifest_workers_free(&run);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Manifest worker allocation failed");
+    return -1;
+  } /* LCOV_EXCL_STOP */
+
+  started = acquire_clock_seconds();
+  /* Workers that fail to start leave their share to be stolen */
+  for (n = 1; n < run.n_workers; n++)
+    run.workers[n].started = acquire_thread_create(
+                                 &run.workers[n].thread, manifest_worker_run,
+                                 &run.workers[n]) == 0;
+  manifest_worker_run(&run.workers[0]);
+  for (n = 1; n < run.n_workers; n++)
+    if (run.workers[n].started) {
+      acquire_thread_join(run.workers[n].thread);
+      run.workers[n].started = 0;
+    }
+
+  manifest->stats.files = manifest->count;
+  manifest->stats.passed = manifest->stats.failed = 0;
+  manifest->stats.bytes = 0;
+  manifest->stats.threads = run.n_workers;
+  for (n = 0; n < run.n_workers; n++)
+    manifest->stats.bytes += run.workers[n].bytes;
+  for (i = 0; i < manifest->count; i++) {
+    if (manifest->entries[i].error == ACQUIRE_OK)
+      manifest->stats.passed++;
+    else
+      manifest->stats.failed++;
+  }
+  manifest->stats.seconds = acquire_clock_seconds() - started;
+  if (manifest->stats.seconds > 0) {
+    manifest->stats.bytes_per_second =
+        (double)manifest->stats.bytes / manifest->stats.seconds;
+    manifest->stats.files_per_second =
+        (double)manifest->count / manifest->stats.seconds;
+  }
+  manifest_workers_free(&run);
+  acquire_handle_set_progress(handle, manifest->stats.bytes);
+
+  if (acquire_atomic_load_int(&handle->cancel_flag)) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                             "Manifest verification cancelled");
+    return -1;
+  }
+  if (manifest->stats.failed) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                             "%lu of %lu files failed verification",
+                             (unsigned long)manifest->stats.failed,
+                             (unsigned long)manifest->count);
+    return -1;
+  }
+  handle->status = ACQUIRE_COMPLETE;
+  return 0;
+}
+
+int acquire_verify_manifest(struct acquire_handle *handle,
+                            const char *manifest_path, const char *base_dir,
+                            enum Checksum algorithm, unsigned int threads,
+                            struct acquire_manifest *manifest) {
+  if (acquire_manifest_load(handle, manifest, manifest_path, algorithm) != 0)
+    return -1;
+  return acquire_manifest_verify(handle, manifest, base_dir, threads);
+}
+
+void acquire_manifest_free(struct acquire_manifest *manifest) {
+  if (manifest == NULL)
+    return;
+  free(manifest->entries);
+  free(manifest->text);
+  manifest->entries = NULL;
+  manifest->text = NULL;
+  manifest->count = 0;
+}
+
+#endif /* !ACQUIRE_MANIFEST_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_MANIFEST_H */
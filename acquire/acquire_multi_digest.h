@@ -0,0 +1,1434 @@
+#ifndef LIBACQUIRE_ACQUIRE_MULTI_DIGEST_H
+#define LIBACQUIRE_ACQUIRE_MULTI_DIGEST_H
+
+/*
+ * Verify one file against several digests while reading it only once.
+ * Each chunk read is fed to every requested algorithm in turn; with
+ * librhash, CRC32C, SHA256 and SHA512 share a single multi-hash context
+ * selected by bitmask.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+#include "acquire_common_defs.h"
+#include "acquire_executor.h"
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "libacquire_export.h"
+
+/* One algorithm to check, and the hex digest it must produce */
+struct acquire_digest_spec {
+  enum Checksum algorithm;
+  const char *expected_hash;
+};
+
+/**
+ * @brief Begin checking `filepath` against every digest in `specs`.
+ *
+ * The file is read once and each chunk is hashed by all `count` algorithms
+ * (at most `ACQUIRE_MAX_DIGESTS`, each listed once). Drive it with
+ * `acquire_verify_async_poll` as for a single digest. Per-algorithm results
+ * land in the handle's `digests`, in the order of `specs`, whatever the
+ * outcome; the operation only completes if every digest matched.
+ *
+ * @return `0` if started, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_multi_async_start(struct acquire_handle *handle,
+                                 const char *filepath,
+                                 const struct acquire_digest_spec *specs,
+                                 size_t count);
+
+/**
+ * @brief Blocking form of `acquire_verify_multi_async_start`.
+ *
+ * @return `0` if every digest matched, `-1` otherwise.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_verify_multi_sync(struct acquire_handle *handle, const char *filepath,
+                          const struct acquire_digest_spec *specs,
+                          size_t count);
+
+/*
+ * The same digests over data that arrives in pieces rather than from a
+ * file, e.g. straight from the network as it is written to disk.
+ */
+struct acquire_digest_stream;
+
+/**
+ * @brief Start hashing against every digest in `specs`, which are checked
+ * as by `acquire_verify_multi_async_start`.
+ *
+ * @return The stream, or `NULL` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT struct acquire_digest_stream *
+acquire_digest_stream_new(struct acquire_handle *handle,
+                          const struct acquire_digest_spec *specs,
+                          size_t count);
+
+/**
+ * @brief Hash the next `len` bytes.
+ *
+ * @return `0` on success, `-1` if the hashing library failed.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_digest_stream_update(struct acquire_digest_stream *stream,
+                             const void *data, size_t len);
+
+/**
+ * @brief Finish every digest into the handle's `digests`.
+ *
+ * A stream can only be finished once.
+ *
+ * @return `0` if all matched, `-1` with `ACQUIRE_ERROR_CHECKSUM_MISMATCH`
+ * on the handle otherwise.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_digest_stream_finish(struct acquire_digest_stream *stream,
+                             struct acquire_handle *handle);
+
+extern LIBACQUIRE_EXPORT void
+acquire_digest_stream_free(struct acquire_digest_stream *stream);
+
+/*
+ * Checkpoints: the hashing state of a digest stream or of a multi-digest
+ * verification, with the number of bytes hashed so far. Resuming from one
+ * skips rehashing that prefix, whether after a cancellation or in another
+ * process. A checkpoint only means something to the same build of the
+ * library on the same kind of machine. It does not hold the expected
+ * digests, which are passed again on resume. One that was damaged, or whose
+ * states no hasher could be in, is refused rather than resumed.
+ */
+
+/* Room for a checkpoint of every algorithm this library hashes at once */
+#define ACQUIRE_CHECKPOINT_MAX_SIZE 8192
+
+/**
+ * @brief Save the hashing state of `stream` to `out`.
+ *
+ * Only contexts whose state can be copied out can be saved: the bundled
+ * CRC32C, SHA-2, BLAKE3 and xxHash, CommonCrypto, and librhash 1.4.1 or
+ * later. OpenSSL's EVP contexts cannot; with OpenSSL, select the bundled
+ * SHA-2 with `acquire_handle_set_checksum_backend` before starting.
+ *
+ * @return Bytes the checkpoint takes, or `0` if it cannot be taken. Nothing
+ * is written if `size` is smaller, so a `NULL` `out` asks for the size.
+ */
+extern LIBACQUIRE_EXPORT size_t
+acquire_digest_stream_checkpoint(const struct acquire_digest_stream *stream,
+                                 void *out, size_t size);
+
+/**
+ * @brief Like `acquire_digest_stream_new`, but carrying on from
+ * `checkpoint`, which must be of the same algorithms in the same order.
+ *
+ * @return The stream, or `NULL` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT struct acquire_digest_stream *
+acquire_digest_stream_resume(struct acquire_handle *handle,
+                             const struct acquire_digest_spec *specs,
+                             size_t count, const void *checkpoint,
+                             size_t size);
+
+/**
+ * @brief Bytes that had been hashed when `checkpoint` was taken.
+ *
+ * @return The offset, or `-1` if `checkpoint` is not a checkpoint.
+ */
+extern LIBACQUIRE_EXPORT off_t acquire_checkpoint_offset(const void *checkpoint,
+                                                         size_t size);
+
+/**
+ * @brief Checkpoint what `handle` is hashing: a multi-digest verification
+ * between polls, or a verified download.
+ *
+ * A download's file is flushed first, so it holds at least the bytes the
+ * checkpoint covers. To stop and carry on later, take a checkpoint and then
+ * cancel; to survive the process going away, take one every so often while
+ * polling. Verifications running on an executor cannot be checkpointed.
+ *
+ * @return As `acquire_digest_stream_checkpoint`, and `0` if nothing that
+ * can be checkpointed is running.
+ */
+extern LIBACQUIRE_EXPORT size_t
+acquire_checkpoint(struct acquire_handle *handle, void *out, size_t size);
+
+/**
+ * @brief Carry on a verification from `checkpoint`, reading `filepath` from
+ * the offset it reached. Otherwise as `acquire_verify_multi_async_start`.
+ *
+ * @return `0` if started, `-1` on error (details on the handle).
+ */
+extern LIBACQUIRE_EXPORT int acquire_verify_multi_resume_async_start(
+    struct acquire_handle *handle, const char *filepath,
+    const struct acquire_digest_spec *specs, size_t count,
+    const void *checkpoint, size_t size);
+
+enum acquire_status _multi_verify_async_poll(struct acquire_handle *handle);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_MULTI_DIGEST_IMPL_
+#define ACQUIRE_MULTI_DIGEST_IMPL_
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_digest_pool.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+/* Internal, in `acquire_calibrate.h` */
+extern LIBACQUIRE_EXPORT enum acquire_backend_type
+_acquire_calibrated_backend(enum Checksum algorithm);
+
+/* Where CRC32C and SHA-2 come from, in the single-digest dispatch order */
+#if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH
+#include <rhash.h>
+#define MULTI_DIGEST_RHASH 1
+#elif defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL ||             \
+    defined(LIBACQUIRE_USE_LIBRESSL) && LIBACQUIRE_USE_LIBRESSL
+#include <openssl/evp.h>
+#define MULTI_DIGEST_EVP 1
+#elif defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO
+#include <CommonCrypto/CommonDigest.h>
+#define MULTI_DIGEST_COMMON_CRYPTO 1
+#endif
+
+/* librhash has saved and restored whole contexts since 1.4.1 */
+#if defined(MULTI_DIGEST_RHASH) && defined(RHASH_XVERSION) &&                  \
+    RHASH_XVERSION >= 0x01040100
+#define MULTI_DIGEST_RHASH_EXPORT 1
+#endif
+
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+#include "acquire_crc32c.h"
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+#include "acquire_blake3.h"
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+#include "acquire_xxhash.h"
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+#include "acquire_sha2.h"
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+enum multi_lane_kind {
+  MULTI_LANE_NONE,
+  MULTI_LANE_RHASH,
+  MULTI_LANE_EVP,
+  MULTI_LANE_COMMON_CRYPTO,
+  MULTI_LANE_CRC32C,
+  MULTI_LANE_BLAKE3,
+  MULTI_LANE_XXHASH,
+  MULTI_LANE_SHA2
+};
+
+/* Hashing state for one requested algorithm */
+struct multi_lane {
+  enum Checksum algorithm;
+  enum multi_lane_kind kind;
+  char expected_hash[130];
+  union {
+#ifdef MULTI_DIGEST_RHASH
+    unsigned int rhash_id; /* state lives in the shared `multi_backend.rh` */
+#endif /* MULTI_DIGEST_RHASH */
+#ifdef MULTI_DIGEST_EVP
+    EVP_MD_CTX *evp;
+#endif /* MULTI_DIGEST_EVP */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+    CC_SHA256_CTX *sha256;
+    CC_SHA512_CTX *sha512;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+    uint32_t crc;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+    struct acquire_blake3_hasher *blake3;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+    struct acquire_xxhash_hasher *xxhash;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+    struct acquire_sha2_hasher *sha2;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+    void *unused;
+  } ctx;
+};
+
+struct acquire_digest_stream {
+  size_t count;
+  off_t offset; /* bytes hashed so far */
+  struct multi_lane lanes[ACQUIRE_MAX_DIGESTS];
+#ifdef MULTI_DIGEST_RHASH
+  rhash rh;
+  unsigned int rhash_mask;
+#endif /* MULTI_DIGEST_RHASH */
+};
+
+struct multi_backend {
+  struct acquire_file_reader reader;
+  struct acquire_digest_stream stream;
+};
+
+static const char *multi_algorithm_name(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return "CRC32C";
+  case LIBACQUIRE_SHA256:
+    return "SHA256";
+  case LIBACQUIRE_SHA512:
+    return "SHA512";
+  case LIBACQUIRE_BLAKE3:
+    return "BLAKE3";
+  case LIBACQUIRE_XXH3_64:
+    return "XXH3_64";
+  case LIBACQUIRE_XXH128:
+    return "XXH128";
+  default:
+    return "unknown";
+  }
+}
+
+/* Hex digits in a digest of `algorithm`, or `0` if it is not a digest */
+static size_t multi_hex_length(enum Checksum algorithm) {
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+    return 8;
+  case LIBACQUIRE_XXH3_64:
+    return 16;
+  case LIBACQUIRE_XXH128:
+    return 32;
+  case LIBACQUIRE_SHA256:
+  case LIBACQUIRE_BLAKE3:
+    return 64;
+  case LIBACQUIRE_SHA512:
+    return 128;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Which context hashes `algorithm` in this build. The bundled CRC32C and
+ * SHA-2 are used if `preferred` asks for them, since their state can be
+ * checkpointed where a crypto library's may not.
+ */
+static enum multi_lane_kind
+multi_lane_kind_for(enum Checksum algorithm,
+                    enum acquire_backend_type preferred) {
+  if (preferred == ACQUIRE_BACKEND_CHECKSUM_AUTO)
+    preferred = _acquire_calibrated_backend(algorithm);
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  if (algorithm == LIBACQUIRE_CRC32C &&
+      preferred == ACQUIRE_BACKEND_CHECKSUM_CRC32C)
+    return MULTI_LANE_CRC32C;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  if ((algorithm == LIBACQUIRE_SHA256 || algorithm == LIBACQUIRE_SHA512) &&
+      preferred == ACQUIRE_BACKEND_CHECKSUM_SHA2)
+    return MULTI_LANE_SHA2;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  (void)preferred;
+  switch (algorithm) {
+  case LIBACQUIRE_CRC32C:
+#ifdef MULTI_DIGEST_RHASH
+    return MULTI_LANE_RHASH;
+#elif defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+    return MULTI_LANE_CRC32C;
+#else
+    return MULTI_LANE_NONE;
+#endif
+  case LIBACQUIRE_SHA256:
+  case LIBACQUIRE_SHA512:
+#if defined(MULTI_DIGEST_RHASH)
+    return MULTI_LANE_RHASH;
+#elif defined(MULTI_DIGEST_EVP)
+    return MULTI_LANE_EVP;
+#elif defined(MULTI_DIGEST_COMMON_CRYPTO)
+    return MULTI_LANE_COMMON_CRYPTO;
+#elif defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+    return MULTI_LANE_SHA2;
+#else
+    return MULTI_LANE_NONE;
+#endif
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case LIBACQUIRE_BLAKE3:
+    return MULTI_LANE_BLAKE3;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case LIBACQUIRE_XXH3_64:
+  case LIBACQUIRE_XXH128:
+    return MULTI_LANE_XXHASH;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+  default:
+    return MULTI_LANE_NONE;
+  }
+}
+
+static void multi_lane_free(struct multi_lane *lane) {
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_EVP
+  case MULTI_LANE_EVP:
+    acquire_digest_pool_evp_give(lane->algorithm, lane->ctx.evp);
+    break;
+#endif /* MULTI_DIGEST_EVP */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    free(lane->ctx.unused);
+    break;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3:
+    free(lane->ctx.blake3);
+    break;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    acquire_xxhash_free(lane->ctx.xxhash);
+    break;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2:
+    free(lane->ctx.sha2);
+    break;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    break;
+  }
+  lane->kind = MULTI_LANE_NONE;
+}
+
+/* Free every context of `stream`, leaving the struct itself */
+static void multi_stream_release(struct acquire_digest_stream *stream) {
+  size_t i;
+  for (i = 0; i < stream->count; i++)
+    multi_lane_free(&stream->lanes[i]);
+  stream->count = 0;
+#ifdef MULTI_DIGEST_RHASH
+  acquire_digest_pool_rhash_give(stream->rhash_mask, stream->rh);
+  stream->rh = NULL;
+  stream->rhash_mask = 0;
+#endif /* MULTI_DIGEST_RHASH */
+}
+
+static void cleanup_multi_backend(struct acquire_handle *handle) {
+  struct multi_backend *be;
+  if (!handle || !handle->backend_handle)
+    return;
+  be = (struct multi_backend *)handle->backend_handle;
+  multi_stream_release(&be->stream);
+  acquire_file_reader_close(&be->reader);
+  free(be);
+  handle->backend_handle = NULL;
+}
+
+/* Allocate and initialise the context of `lane`; `-1` if out of memory */
+static int multi_lane_init(struct acquire_digest_stream *stream,
+                           struct multi_lane *lane) {
+#ifndef MULTI_DIGEST_RHASH
+  (void)stream;
+#endif /* !MULTI_DIGEST_RHASH */
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_RHASH
+  case MULTI_LANE_RHASH:
+    lane->ctx.rhash_id = lane->algorithm == LIBACQUIRE_CRC32C ? RHASH_CRC32C
+                         : lane->algorithm == LIBACQUIRE_SHA256
+                             ? RHASH_SHA256
+                             : RHASH_SHA512;
+    stream->rhash_mask |= lane->ctx.rhash_id;
+    return 0;
+#endif /* MULTI_DIGEST_RHASH */
+#ifdef MULTI_DIGEST_EVP
+  case MULTI_LANE_EVP:
+    lane->ctx.evp = acquire_digest_pool_evp_take(lane->algorithm);
+    return lane->ctx.evp ? 0 : -1;
+#endif /* MULTI_DIGEST_EVP */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    if (lane->algorithm == LIBACQUIRE_SHA256) {
+      lane->ctx.sha256 = (CC_SHA256_CTX *)malloc(sizeof(CC_SHA256_CTX));
+      if (!lane->ctx.sha256)
+        return -1;
+      CC_SHA256_Init(lane->ctx.sha256);
+    } else {
+      lane->ctx.sha512 = (CC_SHA512_CTX *)malloc(sizeof(CC_SHA512_CTX));
+      if (!lane->ctx.sha512)
+        return -1;
+      CC_SHA512_Init(lane->ctx.sha512);
+    }
+    return 0;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case MULTI_LANE_CRC32C:
+    lane->ctx.crc = 0;
+    return 0;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3:
+    lane->ctx.blake3 = (struct acquire_blake3_hasher *)malloc(
+        sizeof(struct acquire_blake3_hasher));
+    if (!lane->ctx.blake3)
+      return -1;
+    acquire_blake3_init(lane->ctx.blake3);
+    return 0;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    lane->ctx.xxhash = acquire_xxhash_create(lane->algorithm);
+    return lane->ctx.xxhash ? 0 : -1;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2:
+    lane->ctx.sha2 = (struct acquire_sha2_hasher *)malloc(
+        sizeof(struct acquire_sha2_hasher));
+    if (!lane->ctx.sha2)
+      return -1;
+    return acquire_sha2_init(lane->ctx.sha2, lane->algorithm);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    return -1;
+  }
+}
+
+/* Feed `data` to `lane`; `0` on success, `-1` if the library failed */
+static int multi_lane_update(struct multi_lane *lane,
+                             const unsigned char *data, size_t len) {
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_EVP
+  case MULTI_LANE_EVP:
+    return EVP_DigestUpdate(lane->ctx.evp, data, len) == 1 ? 0 : -1;
+#endif /* MULTI_DIGEST_EVP */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    if (lane->algorithm == LIBACQUIRE_SHA256)
+      CC_SHA256_Update(lane->ctx.sha256, data, (CC_LONG)len);
+    else
+      CC_SHA512_Update(lane->ctx.sha512, data, (CC_LONG)len);
+    break;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case MULTI_LANE_CRC32C:
+    lane->ctx.crc = acquire_crc32c(lane->ctx.crc, data, len);
+    break;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3:
+    acquire_blake3_update(lane->ctx.blake3, data, len);
+    break;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    acquire_xxhash_update(lane->ctx.xxhash, data, len);
+    break;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2:
+    acquire_sha2_update(lane->ctx.sha2, data, len);
+    break;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    /* librhash lanes are all fed at once through the shared context */
+    break;
+  }
+  return 0;
+}
+
+static void multi_hex(char *dest, const unsigned char *src, size_t len) {
+  size_t i;
+  for (i = 0; i < len; ++i)
+    snprintf(dest + 2 * i, 3, "%02x", src[i]);
+}
+
+/* Write the lowercase hex digest of `lane` to `hex` (130 bytes) */
+static void multi_lane_final(struct acquire_digest_stream *stream,
+                             struct multi_lane *lane, char *hex) {
+  unsigned char digest[64];
+#ifndef MULTI_DIGEST_RHASH
+  (void)stream;
+#endif /* !MULTI_DIGEST_RHASH */
+  hex[0] = '\0';
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_RHASH
+  case MULTI_LANE_RHASH:
+    rhash_print(hex, stream->rh, lane->ctx.rhash_id, RHPR_HEX);
+    hex[multi_hex_length(lane->algorithm)] = '\0';
+    break;
+#endif /* MULTI_DIGEST_RHASH */
+#ifdef MULTI_DIGEST_EVP
+  case MULTI_LANE_EVP: {
+    unsigned int digest_len = 0;
+    if (EVP_DigestFinal_ex(lane->ctx.evp, digest, &digest_len) == 1)
+      multi_hex(hex, digest, digest_len);
+    break;
+  }
+#endif /* MULTI_DIGEST_EVP */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    if (lane->algorithm == LIBACQUIRE_SHA256) {
+      CC_SHA256_Final(digest, lane->ctx.sha256);
+      multi_hex(hex, digest, CC_SHA256_DIGEST_LENGTH);
+    } else {
+      CC_SHA512_Final(digest, lane->ctx.sha512);
+      multi_hex(hex, digest, CC_SHA512_DIGEST_LENGTH);
+    }
+    break;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case MULTI_LANE_CRC32C:
+    snprintf(hex, 9, "%08lx", (unsigned long)lane->ctx.crc);
+    break;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3:
+    acquire_blake3_final(lane->ctx.blake3, digest);
+    multi_hex(hex, digest, ACQUIRE_BLAKE3_OUT_LEN);
+    break;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    acquire_xxhash_final_hex(lane->ctx.xxhash, hex);
+    break;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2:
+    acquire_sha2_final(lane->ctx.sha2, digest);
+    multi_hex(hex, digest, multi_hex_length(lane->algorithm) / 2);
+    break;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    break;
+  }
+  (void)digest;
+}
+
+/*
+ * Check `specs` and set up a context for each, of the kinds in `kinds` or,
+ * if that is `NULL`, the ones this build and `handle` prefer. On failure
+ * the error is on `handle` and nothing is left allocated.
+ */
+static int multi_stream_init(struct acquire_handle *handle,
+                             struct acquire_digest_stream *stream,
+                             const struct acquire_digest_spec *specs,
+                             size_t count, const enum multi_lane_kind *kinds) {
+  enum multi_lane_kind chosen[ACQUIRE_MAX_DIGESTS];
+  size_t i, j;
+  if (!specs || count == 0 || count > ACQUIRE_MAX_DIGESTS) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Expected 1 to %d digests", ACQUIRE_MAX_DIGESTS);
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    const size_t hex_len = multi_hex_length(specs[i].algorithm);
+    if (!specs[i].expected_hash) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Missing expected hash for %s",
+                               multi_algorithm_name(specs[i].algorithm));
+      return -1;
+    }
+    for (j = 0; j < i; j++)
+      if (specs[j].algorithm == specs[i].algorithm) {
+        acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                                 "%s listed more than once",
+                                 multi_algorithm_name(specs[i].algorithm));
+        return -1;
+      }
+    chosen[i] = kinds ? kinds[i]
+                      : multi_lane_kind_for(specs[i].algorithm,
+                                            handle->checksum_backend);
+    if (hex_len == 0 || chosen[i] == MULTI_LANE_NONE) {
+      acquire_handle_set_error(
+          handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+          "Unsupported checksum algorithm or no backend available");
+      return -1;
+    }
+    if (strlen(specs[i].expected_hash) != hex_len) {
+      acquire_handle_set_error(handle,
+                               ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                               "Invalid hash length for %s",
+                               multi_algorithm_name(specs[i].algorithm));
+      return -1;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    struct multi_lane *lane = &stream->lanes[i];
+    lane->algorithm = specs[i].algorithm;
+    lane->kind = chosen[i];
+    memcpy(lane->expected_hash, specs[i].expected_hash,
+           multi_hex_length(specs[i].algorithm) + 1);
+    stream->count = i + 1;
+    if (multi_lane_init(stream, lane) != 0) {
+      multi_stream_release(stream);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                               "Could not set up %s context",
+                               multi_algorithm_name(specs[i].algorithm));
+      return -1;
+    }
+  }
+#ifdef MULTI_DIGEST_RHASH
+  if (stream->rhash_mask != 0) {
+    stream->rh = acquire_digest_pool_rhash_take(stream->rhash_mask);
+    if (!stream->rh) {
+      multi_stream_release(stream);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "rhash_init failed");
+      return -1;
+    }
+  }
+#endif /* MULTI_DIGEST_RHASH */
+  return 0;
+}
+
+static int multi_stream_update(struct acquire_digest_stream *stream,
+                               const unsigned char *data, size_t len) {
+  size_t i;
+#ifdef MULTI_DIGEST_RHASH
+  if (stream->rh && rhash_update(stream->rh, data, len) < 0)
+    return -1;
+#endif /* MULTI_DIGEST_RHASH */
+  for (i = 0; i < stream->count; i++)
+    if (multi_lane_update(&stream->lanes[i], data, len) != 0)
+      return -1;
+  stream->offset += (off_t)len;
+  return 0;
+}
+
+/*
+ * Finish every digest into `handle->digests`; `0` if all matched, else the
+ * first mismatch is reported on `handle` as `mismatch_code`.
+ */
+static int multi_stream_final(struct acquire_handle *handle,
+                              struct acquire_digest_stream *stream,
+                              enum acquire_error_code mismatch_code) {
+  size_t i, mismatches = 0, first_mismatch = 0;
+#ifdef MULTI_DIGEST_RHASH
+  if (stream->rh)
+    rhash_final(stream->rh, NULL);
+#endif /* MULTI_DIGEST_RHASH */
+  for (i = 0; i < stream->count; i++) {
+    struct acquire_digest_result *result = &handle->digests[i];
+    result->algorithm = stream->lanes[i].algorithm;
+    multi_lane_final(stream, &stream->lanes[i], result->computed_hash);
+    result->matched =
+        strcasecmp(result->computed_hash, stream->lanes[i].expected_hash) == 0;
+    if (!result->matched && mismatches++ == 0)
+      first_mismatch = i;
+  }
+  handle->digest_count = stream->count;
+  if (mismatches == 0)
+    return 0;
+  acquire_handle_set_error(
+      handle, mismatch_code,
+      "Hash mismatch in %lu of %lu digests; %s expected %s, got %s",
+      (unsigned long)mismatches, (unsigned long)stream->count,
+      multi_algorithm_name(stream->lanes[first_mismatch].algorithm),
+      stream->lanes[first_mismatch].expected_hash,
+      handle->digests[first_mismatch].computed_hash);
+  return -1;
+}
+
+/*
+ * Checkpoints are laid out in native byte order. A header of
+ * `MULTI_CHECKPOINT_MAGIC`, `MULTI_CHECKPOINT_VERSION`, the checkpoint's
+ * whole length and a 64-bit FNV-1a sum of everything after the header is
+ * followed by the offset as 64 bits, the lane count, then for each lane its
+ * algorithm, kind and state length followed by the state, and last the
+ * shared librhash context's length and contents. Counts and lengths are 32
+ * bits.
+ */
+#define MULTI_CHECKPOINT_MAGIC "ACQCKPT\n"
+#define MULTI_CHECKPOINT_MAGIC_LEN 8
+#define MULTI_CHECKPOINT_VERSION 2
+#define MULTI_CHECKPOINT_HEADER_LEN (MULTI_CHECKPOINT_MAGIC_LEN + 4 + 4 + 8)
+
+/* Catches a checkpoint damaged on disk; it is not a MAC */
+static uint64_t multi_checkpoint_sum(const unsigned char *p, size_t len) {
+  uint64_t h = UINT64_C(0xCBF29CE484222325);
+  for (; len > 0; len--)
+    h = (h ^ *p++) * UINT64_C(0x100000001B3);
+  return h;
+}
+
+/* Whether this build has a `kind` context that can hash `algorithm` */
+static int multi_lane_kind_fits(enum multi_lane_kind kind,
+                                enum Checksum algorithm) {
+  return kind != MULTI_LANE_NONE &&
+         (kind == multi_lane_kind_for(algorithm, ACQUIRE_BACKEND_NONE) ||
+          kind == multi_lane_kind_for(algorithm,
+                                      ACQUIRE_BACKEND_CHECKSUM_SHA2) ||
+          kind == multi_lane_kind_for(algorithm,
+                                      ACQUIRE_BACKEND_CHECKSUM_CRC32C));
+}
+
+/*
+ * Set `*len` to the size of `lane`'s state and copy it to `out` if `size`
+ * allows. librhash lanes have none of their own. `-1` if the context's
+ * state cannot be copied out.
+ */
+static int multi_lane_save(const struct multi_lane *lane, unsigned char *out,
+                           size_t size, size_t *len) {
+  const void *state = NULL;
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_RHASH_EXPORT
+  case MULTI_LANE_RHASH:
+    *len = 0;
+    return 0;
+#endif /* MULTI_DIGEST_RHASH_EXPORT */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    state = lane->ctx.unused;
+    *len = lane->algorithm == LIBACQUIRE_SHA256 ? sizeof(CC_SHA256_CTX)
+                                                : sizeof(CC_SHA512_CTX);
+    break;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case MULTI_LANE_CRC32C:
+    state = &lane->ctx.crc;
+    *len = sizeof(lane->ctx.crc);
+    break;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3:
+    state = lane->ctx.blake3;
+    *len = sizeof(struct acquire_blake3_hasher);
+    break;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    *len = acquire_xxhash_save(lane->ctx.xxhash, out, size);
+    return 0;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2:
+    state = lane->ctx.sha2;
+    *len = sizeof(struct acquire_sha2_hasher);
+    break;
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    return -1;
+  }
+  if (out && size >= *len)
+    memcpy(out, state, *len);
+  return 0;
+}
+
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+/* Whether `s` is a state `acquire_blake3_update` could have left behind */
+static int multi_blake3_state_ok(const struct acquire_blake3_hasher *s) {
+  const size_t chunk_len =
+      (size_t)ACQUIRE_BLAKE3_BLOCK_LEN * s->chunk.blocks_compressed +
+      s->chunk.buf_len;
+  return s->chunk.buf_len <= ACQUIRE_BLAKE3_BLOCK_LEN &&
+         chunk_len <= ACQUIRE_BLAKE3_CHUNK_LEN &&
+         s->cv_stack_len <= ACQUIRE_BLAKE3_MAX_DEPTH &&
+         s->chunk.chunk_counter >= s->base_counter &&
+         /* With no chunk done there is nothing to merge the stack into */
+         (s->cv_stack_len == 0 || s->chunk.chunk_counter > s->base_counter);
+}
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+/* Whether `s` is a state `acquire_sha2_update` could have left behind */
+static int multi_sha2_state_ok(const struct acquire_sha2_hasher *s,
+                               enum Checksum algorithm) {
+  const size_t block_len = algorithm == LIBACQUIRE_SHA512 ? 128 : 64;
+  return s->algorithm == algorithm && s->buf_len < block_len &&
+         s->length % block_len == s->buf_len;
+}
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+/*
+ * Load `len` bytes of state saved by `multi_lane_save` into `lane`. States
+ * are checked before they replace the lane's, so a forged one cannot send
+ * the hasher outside its buffers; `-1` if it is not one the lane could be
+ * in. CommonCrypto's are opaque and only have the checkpoint's checksum.
+ */
+static int multi_lane_restore(struct multi_lane *lane, const unsigned char *in,
+                              size_t len) {
+  switch (lane->kind) {
+#ifdef MULTI_DIGEST_RHASH_EXPORT
+  case MULTI_LANE_RHASH:
+    return len == 0 ? 0 : -1;
+#endif /* MULTI_DIGEST_RHASH_EXPORT */
+#ifdef MULTI_DIGEST_COMMON_CRYPTO
+  case MULTI_LANE_COMMON_CRYPTO:
+    if (len != (lane->algorithm == LIBACQUIRE_SHA256 ? sizeof(CC_SHA256_CTX)
+                                                     : sizeof(CC_SHA512_CTX)))
+      return -1;
+    memcpy(lane->ctx.unused, in, len);
+    return 0;
+#endif /* MULTI_DIGEST_COMMON_CRYPTO */
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  case MULTI_LANE_CRC32C:
+    if (len != sizeof(lane->ctx.crc))
+      return -1;
+    memcpy(&lane->ctx.crc, in, len);
+    return 0;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  case MULTI_LANE_BLAKE3: {
+    struct acquire_blake3_hasher saved;
+    if (len != sizeof(saved))
+      return -1;
+    memcpy(&saved, in, len);
+    if (!multi_blake3_state_ok(&saved))
+      return -1;
+    /* Keep the kernel picked for this CPU, not the one that saved it */
+    saved.kernel = lane->ctx.blake3->kernel;
+    *lane->ctx.blake3 = saved;
+    return 0;
+  }
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  case MULTI_LANE_XXHASH:
+    return acquire_xxhash_restore(lane->ctx.xxhash, in, len);
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  case MULTI_LANE_SHA2: {
+    struct acquire_sha2_hasher saved;
+    if (len != sizeof(saved))
+      return -1;
+    memcpy(&saved, in, len);
+    if (!multi_sha2_state_ok(&saved, lane->algorithm))
+      return -1;
+    saved.kernel = lane->ctx.sha2->kernel;
+    *lane->ctx.sha2 = saved;
+    return 0;
+  }
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  default:
+    return -1;
+  }
+}
+
+/* A checkpoint being written: bytes beyond `size` are counted, not stored */
+struct multi_checkpoint_out {
+  unsigned char *data;
+  size_t size;
+  size_t used;
+};
+
+/* Where the next `len` bytes go, or `NULL` if they do not fit */
+static unsigned char *multi_checkpoint_room(struct multi_checkpoint_out *out,
+                                            size_t len) {
+  return out->data && out->used <= out->size && len <= out->size - out->used
+             ? out->data + out->used
+             : NULL;
+}
+
+static void multi_checkpoint_put(struct multi_checkpoint_out *out,
+                                 const void *src, size_t len) {
+  unsigned char *dest = multi_checkpoint_room(out, len);
+  if (dest)
+    memcpy(dest, src, len);
+  out->used += len;
+}
+
+static void multi_checkpoint_put_u32(struct multi_checkpoint_out *out,
+                                     size_t value) {
+  const uint32_t v = (uint32_t)value;
+  multi_checkpoint_put(out, &v, sizeof(v));
+}
+
+/* A checkpoint read back by `multi_checkpoint_parse`, pointing into it */
+struct multi_checkpoint {
+  off_t offset;
+  size_t count;
+  enum Checksum algorithms[ACQUIRE_MAX_DIGESTS];
+  enum multi_lane_kind kinds[ACQUIRE_MAX_DIGESTS];
+  const unsigned char *states[ACQUIRE_MAX_DIGESTS];
+  size_t lens[ACQUIRE_MAX_DIGESTS];
+  const unsigned char *rhash_state;
+  size_t rhash_len;
+};
+
+/* Take the next `len` bytes of the checkpoint; `NULL` if it runs out */
+static const unsigned char *multi_checkpoint_take(const unsigned char **p,
+                                                  const unsigned char *end,
+                                                  size_t len) {
+  const unsigned char *at = *p;
+  if ((size_t)(end - at) < len)
+    return NULL;
+  *p += len;
+  return at;
+}
+
+static int multi_checkpoint_take_u32(const unsigned char **p,
+                                     const unsigned char *end, size_t *value) {
+  const unsigned char *at = multi_checkpoint_take(p, end, sizeof(uint32_t));
+  uint32_t v;
+  if (!at)
+    return -1;
+  memcpy(&v, at, sizeof(v));
+  *value = v;
+  return 0;
+}
+
+/* Split `data` into its parts; `-1` if it is not a whole checkpoint */
+static int multi_checkpoint_parse(const void *data, size_t size,
+                                  struct multi_checkpoint *cp) {
+  const unsigned char *p = (const unsigned char *)data, *end, *at;
+  uint64_t offset, sum;
+  size_t i, value;
+  if (!data)
+    return -1;
+  end = p + size;
+  at = multi_checkpoint_take(&p, end, MULTI_CHECKPOINT_MAGIC_LEN);
+  if (!at || memcmp(at, MULTI_CHECKPOINT_MAGIC, MULTI_CHECKPOINT_MAGIC_LEN) ||
+      multi_checkpoint_take_u32(&p, end, &value) != 0 ||
+      value != MULTI_CHECKPOINT_VERSION ||
+      multi_checkpoint_take_u32(&p, end, &value) != 0 || value != size)
+    return -1;
+  at = multi_checkpoint_take(&p, end, sizeof(sum));
+  if (!at)
+    return -1;
+  memcpy(&sum, at, sizeof(sum));
+  if (sum != multi_checkpoint_sum(p, (size_t)(end - p)))
+    return -1;
+  at = multi_checkpoint_take(&p, end, sizeof(offset));
+  if (!at)
+    return -1;
+  memcpy(&offset, at, sizeof(offset));
+  cp->offset = (off_t)offset;
+  if (cp->offset < 0 || (uint64_t)cp->offset != offset ||
+      multi_checkpoint_take_u32(&p, end, &cp->count) != 0 ||
+      cp->count == 0 || cp->count > ACQUIRE_MAX_DIGESTS)
+    return -1;
+  for (i = 0; i < cp->count; i++) {
+    if (multi_checkpoint_take_u32(&p, end, &value) != 0)
+      return -1;
+    cp->algorithms[i] = (enum Checksum)value;
+    if (multi_checkpoint_take_u32(&p, end, &value) != 0)
+      return -1;
+    cp->kinds[i] = (enum multi_lane_kind)value;
+    if (multi_checkpoint_take_u32(&p, end, &cp->lens[i]) != 0)
+      return -1;
+    cp->states[i] = multi_checkpoint_take(&p, end, cp->lens[i]);
+    if (!cp->states[i])
+      return -1;
+  }
+  if (multi_checkpoint_take_u32(&p, end, &cp->rhash_len) != 0)
+    return -1;
+  cp->rhash_state = multi_checkpoint_take(&p, end, cp->rhash_len);
+  return cp->rhash_state && p == end ? 0 : -1;
+}
+
+/*
+ * Check that `cp` was taken of the digests in `specs`, with contexts this
+ * build has; the error is on `handle` otherwise.
+ */
+static int multi_checkpoint_check(struct acquire_handle *handle,
+                                  const struct multi_checkpoint *cp,
+                                  const struct acquire_digest_spec *specs,
+                                  size_t count) {
+  size_t i;
+  if (cp->count != count) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Checkpoint is of %lu digests, not %lu",
+                             (unsigned long)cp->count, (unsigned long)count);
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    if (cp->algorithms[i] != specs[i].algorithm) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Checkpoint digest %lu is not %s",
+                               (unsigned long)i + 1,
+                               multi_algorithm_name(specs[i].algorithm));
+      return -1;
+    }
+    if (!multi_lane_kind_fits(cp->kinds[i], cp->algorithms[i])) {
+      acquire_handle_set_error(
+          handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+          "Checkpoint of %s was taken with a backend not in this build",
+          multi_algorithm_name(cp->algorithms[i]));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Load the states in `cp` into `stream`, set up from the same kinds */
+static int multi_stream_restore(struct acquire_handle *handle,
+                                struct acquire_digest_stream *stream,
+                                const struct multi_checkpoint *cp) {
+  size_t i;
+  for (i = 0; i < stream->count; i++)
+    if (multi_lane_restore(&stream->lanes[i], cp->states[i], cp->lens[i]) !=
+        0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Checkpoint of %s is not from this build",
+                               multi_algorithm_name(cp->algorithms[i]));
+      return -1;
+    }
+#ifdef MULTI_DIGEST_RHASH_EXPORT
+  if (stream->rh) {
+    rhash rh = cp->rhash_len ? rhash_import(cp->rhash_state, cp->rhash_len)
+                             : NULL;
+    if (!rh) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Checkpoint has no usable librhash context");
+      return -1;
+    }
+    acquire_digest_pool_rhash_give(stream->rhash_mask, stream->rh);
+    stream->rh = rh;
+  }
+#endif /* MULTI_DIGEST_RHASH_EXPORT */
+  stream->offset = cp->offset;
+  return 0;
+}
+
+/* Start a verification, from checkpoint `cp` unless that is `NULL` */
+static int multi_verify_start(struct acquire_handle *handle,
+                              const char *filepath,
+                              const struct acquire_digest_spec *specs,
+                              size_t count, const struct multi_checkpoint *cp) {
+  struct multi_backend *be;
+  size_t i;
+  if (!handle || _acquire_executor_busy(handle))
+    return -1;
+  handle->active_backend = ACQUIRE_BACKEND_NONE;
+  handle->status = ACQUIRE_IDLE;
+  handle->error.code = ACQUIRE_OK;
+  handle->error.message[0] = '\0';
+  handle->digest_count = 0;
+  if (!filepath) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Expected a file and 1 to %d digests",
+                             ACQUIRE_MAX_DIGESTS);
+    return -1;
+  }
+
+  be = (struct multi_backend *)calloc(1, sizeof(struct multi_backend));
+  if (!be) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "multi-digest backend allocation failed");
+    return -1;
+  }
+  if (cp && multi_checkpoint_check(handle, cp, specs, count) != 0) {
+    free(be);
+    return -1;
+  }
+  if (multi_stream_init(handle, &be->stream, specs, count,
+                        cp ? cp->kinds : NULL) != 0) {
+    free(be);
+    return -1;
+  }
+  handle->backend_handle = be;
+  if (cp && multi_stream_restore(handle, &be->stream, cp) != 0) {
+    cleanup_multi_backend(handle);
+    return -1;
+  }
+
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_file_reader_strerror(&be->reader, reason, sizeof(reason));
+    cleanup_multi_backend(handle);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Cannot open file: %s", reason);
+    return -1;
+  }
+  if (be->stream.offset > 0) {
+    char reason[128];
+    if (be->reader.size >= 0 && be->reader.size < be->stream.offset) {
+      cleanup_multi_backend(handle);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "File is shorter than the checkpoint");
+      return -1;
+    }
+    if (acquire_file_reader_seek(&be->reader, be->stream.offset) != 0) {
+      acquire_file_reader_strerror(&be->reader, reason, sizeof(reason));
+      cleanup_multi_backend(handle);
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                               "Cannot seek to the checkpoint: %s", reason);
+      return -1;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    handle->digests[i].algorithm = specs[i].algorithm;
+    handle->digests[i].matched = -1;
+    handle->digests[i].computed_hash[0] = '\0';
+  }
+  handle->digest_count = count;
+  acquire_handle_set_progress(handle, be->stream.offset);
+  handle->cancel_flag = 0;
+  handle->active_backend = ACQUIRE_BACKEND_CHECKSUM_MULTI;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  if (handle->executor)
+    return _acquire_executor_submit(handle, _multi_verify_async_poll);
+  return 0;
+}
+
+int acquire_verify_multi_async_start(struct acquire_handle *handle,
+                                     const char *filepath,
+                                     const struct acquire_digest_spec *specs,
+                                     size_t count) {
+  return multi_verify_start(handle, filepath, specs, count, NULL);
+}
+
+int acquire_verify_multi_resume_async_start(
+    struct acquire_handle *handle, const char *filepath,
+    const struct acquire_digest_spec *specs, size_t count,
+    const void *checkpoint, size_t size) {
+  struct multi_checkpoint cp;
+  if (!handle || _acquire_executor_busy(handle))
+    return -1;
+  if (multi_checkpoint_parse(checkpoint, size, &cp) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Not a checkpoint");
+    return -1;
+  }
+  return multi_verify_start(handle, filepath, specs, count, &cp);
+}
+
+enum acquire_status _multi_verify_async_poll(struct acquire_handle *handle) {
+  struct multi_backend *be;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
+  if (!handle)
+    return ACQUIRE_ERROR;
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    return handle->status;
+  if (!handle->backend_handle) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                             "In-progress poll with NULL backend");
+    return ACQUIRE_ERROR;
+  }
+  be = (struct multi_backend *)handle->backend_handle;
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Checksum cancelled");
+      cleanup_multi_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
+    if (multi_stream_update(&be->stream, buffer, bytes_read) != 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "Digest update failed");
+      cleanup_multi_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+  } else if (multi_stream_final(handle, &be->stream, ACQUIRE_ERROR_UNKNOWN) ==
+             0) {
+    handle->status = ACQUIRE_COMPLETE;
+  }
+  cleanup_multi_backend(handle);
+  return handle->status;
+}
+
+int acquire_verify_multi_sync(struct acquire_handle *handle,
+                              const char *filepath,
+                              const struct acquire_digest_spec *specs,
+                              size_t count) {
+  enum acquire_status status;
+  size_t budget_bytes;
+  unsigned long budget_usec;
+  if (acquire_verify_multi_async_start(handle, filepath, specs, count) != 0)
+    return -1;
+  if (handle->job)
+    return acquire_executor_wait(handle) == ACQUIRE_COMPLETE ? 0 : -1;
+  budget_bytes = handle->poll_budget_bytes;
+  budget_usec = handle->poll_budget_usec;
+  acquire_handle_set_poll_budget(handle, 0, 0);
+  do {
+    status = _multi_verify_async_poll(handle);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  acquire_handle_set_poll_budget(handle, budget_bytes, budget_usec);
+  return (status == ACQUIRE_COMPLETE) ? 0 : -1;
+}
+
+struct acquire_digest_stream *
+acquire_digest_stream_new(struct acquire_handle *handle,
+                          const struct acquire_digest_spec *specs,
+                          size_t count) {
+  struct acquire_digest_stream *stream;
+  size_t i;
+  if (!handle)
+    return NULL;
+  stream = (struct acquire_digest_stream *)calloc(
+      1, sizeof(struct acquire_digest_stream));
+  if (!stream) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "digest stream allocation failed");
+    return NULL;
+  }
+  if (multi_stream_init(handle, stream, specs, count, NULL) != 0) {
+    free(stream);
+    return NULL;
+  }
+  for (i = 0; i < count; i++) {
+    handle->digests[i].algorithm = specs[i].algorithm;
+    handle->digests[i].matched = -1;
+    handle->digests[i].computed_hash[0] = '\0';
+  }
+  handle->digest_count = count;
+  return stream;
+}
+
+int acquire_digest_stream_update(struct acquire_digest_stream *stream,
+                                 const void *data, size_t len) {
+  if (!stream || (!data && len))
+    return -1;
+  return multi_stream_update(stream, (const unsigned char *)data, len);
+}
+
+int acquire_digest_stream_finish(struct acquire_digest_stream *stream,
+                                 struct acquire_handle *handle) {
+  if (!stream || !handle)
+    return -1;
+  return multi_stream_final(handle, stream, ACQUIRE_ERROR_CHECKSUM_MISMATCH);
+}
+
+void acquire_digest_stream_free(struct acquire_digest_stream *stream) {
+  if (!stream)
+    return;
+  multi_stream_release(stream);
+  free(stream);
+}
+
+size_t
+acquire_digest_stream_checkpoint(const struct acquire_digest_stream *stream,
+                                 void *out, size_t size) {
+  struct multi_checkpoint_out cp;
+  const uint64_t offset = stream ? (uint64_t)stream->offset : 0;
+  uint64_t sum;
+  size_t i, len;
+  if (!stream || stream->count == 0)
+    return 0;
+  cp.data = (unsigned char *)out;
+  cp.size = size;
+  cp.used = 0;
+  multi_checkpoint_put(&cp, MULTI_CHECKPOINT_MAGIC,
+                       MULTI_CHECKPOINT_MAGIC_LEN);
+  multi_checkpoint_put_u32(&cp, MULTI_CHECKPOINT_VERSION);
+  /* The length and sum are filled in once the rest is written */
+  cp.used += 4 + sizeof(sum);
+  multi_checkpoint_put(&cp, &offset, sizeof(offset));
+  multi_checkpoint_put_u32(&cp, stream->count);
+  for (i = 0; i < stream->count; i++) {
+    const struct multi_lane *lane = &stream->lanes[i];
+    if (multi_lane_save(lane, NULL, 0, &len) != 0)
+      return 0;
+    multi_checkpoint_put_u32(&cp, lane->algorithm);
+    multi_checkpoint_put_u32(&cp, lane->kind);
+    multi_checkpoint_put_u32(&cp, len);
+    multi_lane_save(lane, multi_checkpoint_room(&cp, len), len, &len);
+    cp.used += len;
+  }
+  len = 0;
+#ifdef MULTI_DIGEST_RHASH_EXPORT
+  if (stream->rh && (len = rhash_export(stream->rh, NULL, 0)) == 0)
+    return 0;
+#endif /* MULTI_DIGEST_RHASH_EXPORT */
+  multi_checkpoint_put_u32(&cp, len);
+#ifdef MULTI_DIGEST_RHASH_EXPORT
+  if (len && multi_checkpoint_room(&cp, len))
+    rhash_export(stream->rh, multi_checkpoint_room(&cp, len), len);
+#endif /* MULTI_DIGEST_RHASH_EXPORT */
+  cp.used += len;
+  if (cp.data && cp.used <= cp.size) {
+    const uint32_t total = (uint32_t)cp.used;
+    sum = multi_checkpoint_sum(cp.data + MULTI_CHECKPOINT_HEADER_LEN,
+                               cp.used - MULTI_CHECKPOINT_HEADER_LEN);
+    memcpy(cp.data + MULTI_CHECKPOINT_MAGIC_LEN + 4, &total, sizeof(total));
+    memcpy(cp.data + MULTI_CHECKPOINT_HEADER_LEN - sizeof(sum), &sum,
+           sizeof(sum));
+  }
+  return cp.used;
+}
+
+struct acquire_digest_stream *
+acquire_digest_stream_resume(struct acquire_handle *handle,
+                             const struct acquire_digest_spec *specs,
+                             size_t count, const void *checkpoint,
+                             size_t size) {
+  struct acquire_digest_stream *stream;
+  struct multi_checkpoint cp;
+  size_t i;
+  if (!handle)
+    return NULL;
+  if (multi_checkpoint_parse(checkpoint, size, &cp) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                             "Not a checkpoint");
+    return NULL;
+  }
+  if (multi_checkpoint_check(handle, &cp, specs, count) != 0)
+    return NULL;
+  stream = (struct acquire_digest_stream *)calloc(
+      1, sizeof(struct acquire_digest_stream));
+  if (!stream) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "digest stream allocation failed");
+    return NULL;
+  }
+  if (multi_stream_init(handle, stream, specs, count, cp.kinds) != 0) {
+    free(stream);
+    return NULL;
+  }
+  if (multi_stream_restore(handle, stream, &cp) != 0) {
+    acquire_digest_stream_free(stream);
+    return NULL;
+  }
+  for (i = 0; i < count; i++) {
+    handle->digests[i].algorithm = specs[i].algorithm;
+    handle->digests[i].matched = -1;
+    handle->digests[i].computed_hash[0] = '\0';
+  }
+  handle->digest_count = count;
+  return stream;
+}
+
+off_t acquire_checkpoint_offset(const void *checkpoint, size_t size) {
+  struct multi_checkpoint cp;
+  return multi_checkpoint_parse(checkpoint, size, &cp) == 0 ? cp.offset : -1;
+}
+
+size_t acquire_checkpoint(struct acquire_handle *handle, void *out,
+                          size_t size) {
+  if (!handle || handle->job)
+    return 0;
+  if (handle->active_backend == ACQUIRE_BACKEND_CHECKSUM_MULTI &&
+      handle->status == ACQUIRE_IN_PROGRESS && handle->backend_handle)
+    return acquire_digest_stream_checkpoint(
+        &((struct multi_backend *)handle->backend_handle)->stream, out, size);
+  if (!handle->download_digest)
+    return 0;
+  /* The file must hold everything the checkpoint has hashed */
+  if (handle->output_file && fflush(handle->output_file) != 0)
+    return 0;
+  return acquire_digest_stream_checkpoint(handle->download_digest, out, size);
+}
+
+#endif /* !ACQUIRE_MULTI_DIGEST_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_MULTI_DIGEST_H */
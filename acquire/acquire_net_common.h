@@ -23,6 +23,7 @@ extern LIBACQUIRE_EXPORT const char *get_download_dir(void);
     defined(LIBACQUIRE_ACQUIRE_NET_COMMON_IMPL)
 
 /* Implementation-specific includes */
+#include "acquire_digest_cache.h"
 #include "acquire_fileutils.h"
 #include "acquire_handle.h"
 #include "acquire_url_utils.h"
@@ -35,6 +36,7 @@ bool is_downloaded(const char *url_or_path, enum Checksum checksum,
   char path_buffer[NAME_MAX + 1];
   const char *file_to_check;
   char *filename_from_url = NULL;
+  struct acquire_digest_cache *cache;
   struct acquire_handle *verify_handle;
   int result;
 
@@ -67,6 +69,13 @@ bool is_downloaded(const char *url_or_path, enum Checksum checksum,
     return false;
   }
 
+  /* With a digest cache set, an unchanged verified file costs a `stat` */
+  cache = acquire_digest_cache_default();
+  if (cache != NULL &&
+      acquire_digest_cache_lookup(cache, file_to_check, checksum, hash) == 1) {
+    return true;
+  }
+
   verify_handle = acquire_handle_init();
   if (!verify_handle) {
     return false;
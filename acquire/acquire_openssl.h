@@ -36,7 +36,12 @@ void _openssl_verify_async_cancel(struct acquire_handle *handle);
 #define EVP_MAX_MD_SIZE 64
 #endif /* !EVP_MAX_MD_SIZE */
 
+#if !defined(LIBACQUIRE_USE_COMMON_CRYPTO) || !LIBACQUIRE_USE_COMMON_CRYPTO
+#include "acquire_digest_pool.h"
+#endif
+#include "acquire_file_reader.h"
 #include "acquire_handle.h"
+#include "acquire_threads.h"
 #include <acquire_string_extras.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -45,21 +50,17 @@ void _openssl_verify_async_cancel(struct acquire_handle *handle);
 #include <openssl/err.h>
 #endif
 
-#ifndef CHUNK_SIZE
-#define CHUNK_SIZE 4096
-#endif /* !CHUNK_SIZE */
-
 struct openssl_backend {
 #if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO
   union {
     CC_SHA256_CTX sha256;
     CC_SHA512_CTX sha512;
   } ctx;
-  enum Checksum algorithm;
 #else
-  EVP_MD_CTX *ctx;
+  EVP_MD_CTX *ctx; /* from, and given back to, the digest pool */
 #endif
-  FILE *file;
+  enum Checksum algorithm;
+  struct acquire_file_reader reader;
   char expected_hash[130];
 };
 
@@ -68,11 +69,9 @@ static void cleanup_openssl_backend(struct acquire_handle *handle) {
     struct openssl_backend *be =
         (struct openssl_backend *)handle->backend_handle;
 #if !defined(LIBACQUIRE_USE_COMMON_CRYPTO) || !LIBACQUIRE_USE_COMMON_CRYPTO
-    if (be->ctx)
-      EVP_MD_CTX_free(be->ctx);
+    acquire_digest_pool_evp_give(be->algorithm, be->ctx);
 #endif
-    if (be->file)
-      fclose(be->file);
+    acquire_file_reader_close(&be->reader);
     free(be);
     handle->backend_handle = NULL;
   }
@@ -104,28 +103,18 @@ int _openssl_verify_async_start(struct acquire_handle *handle,
                              "openssl backend memory allocation failed");
     return -1;
   }
-#if defined(_MSC_VER) || defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-  {
-    const errno_t err = fopen_s(&be->file, filepath, "rb");
-    if (err != 0 || be->file == NULL) {
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                               "Cannot open file: %s", filepath);
-      free(be);
-      return -1;
-    }
-  }
-#else
-  be->file = fopen(filepath, "rb");
-  if (!be->file) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "%s",
-                             strerror(errno));
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
     free(be);
     return -1;
   }
-#endif
 
-#if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO
   be->algorithm = algorithm;
+#if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO
   switch (algorithm) {
   case LIBACQUIRE_SHA256:
     CC_SHA256_Init(&be->ctx.sha256);
@@ -137,16 +126,13 @@ int _openssl_verify_async_start(struct acquire_handle *handle,
     break;
   }
 #else
-  {
-    const EVP_MD *md =
-        (algorithm == LIBACQUIRE_SHA256) ? EVP_sha256() : EVP_sha512();
-    be->ctx = EVP_MD_CTX_new();
-    if (!be->ctx || (1 != EVP_DigestInit_ex(be->ctx, md, NULL))) {
-      cleanup_openssl_backend(handle);
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
-                               "EVP_DigestInit_ex failed");
-      return -1;
-    }
+  be->ctx = acquire_digest_pool_evp_take(algorithm);
+  if (!be->ctx) {
+    acquire_file_reader_close(&be->reader);
+    free(be);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                             "EVP_DigestInit_ex failed");
+    return -1;
   }
 #endif
 
@@ -169,8 +155,10 @@ int _openssl_verify_async_start(struct acquire_handle *handle,
 
 enum acquire_status _openssl_verify_async_poll(struct acquire_handle *handle) {
   struct openssl_backend *be;
-  unsigned char buffer[CHUNK_SIZE];
-  size_t bytes_read;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
   if (!handle)
     return ACQUIRE_ERROR;
   if (handle->status != ACQUIRE_IN_PROGRESS)
@@ -180,15 +168,18 @@ enum acquire_status _openssl_verify_async_poll(struct acquire_handle *handle) {
                              "In-progress poll with NULL backend");
     return ACQUIRE_ERROR;
   }
-  if (handle->cancel_flag) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
-                             "Checksum cancelled");
-    cleanup_openssl_backend(handle);
-    return ACQUIRE_ERROR;
-  }
   be = (struct openssl_backend *)handle->backend_handle;
-  bytes_read = fread(buffer, 1, sizeof(buffer), be->file);
-  if (bytes_read > 0) {
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Checksum cancelled");
+      cleanup_openssl_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
 #if defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO
     switch (be->algorithm) {
     case LIBACQUIRE_SHA256:
@@ -204,24 +195,20 @@ enum acquire_status _openssl_verify_async_poll(struct acquire_handle *handle) {
     if (1 != EVP_DigestUpdate(be->ctx, buffer, bytes_read)) {
       acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
                                "EVP_DigestUpdate failed");
+      cleanup_openssl_backend(handle);
+      return ACQUIRE_ERROR;
     }
 #endif
-    if (handle->error.code == ACQUIRE_OK) {
-      handle->bytes_processed += (off_t)bytes_read;
-      return ACQUIRE_IN_PROGRESS;
-    }
-  }
-  if (ferror(be->file)) {
-#if defined(_MSC_VER) && !defined(__INTEL_COMPILER) ||                         \
-    defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__
-    char error_code[256];
-    strerror_s(error_code, sizeof(error_code), errno);
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", error_code);
-#else
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", strerror(errno));
-#endif
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
   } else {
     unsigned char hash[EVP_MAX_MD_SIZE];
     char computed_hex[EVP_MAX_MD_SIZE * 2 + 1];
@@ -264,7 +251,7 @@ enum acquire_status _openssl_verify_async_poll(struct acquire_handle *handle) {
 
 void _openssl_verify_async_cancel(struct acquire_handle *handle) {
   if (handle)
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
 }
 #endif /* (defined(LIBACQUIRE_USE_COMMON_CRYPTO) &&                            \
           LIBACQUIRE_USE_COMMON_CRYPTO || defined(LIBACQUIRE_USE_OPENSSL) &&   \
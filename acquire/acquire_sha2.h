@@ -0,0 +1,1139 @@
+#ifndef LIBACQUIRE_ACQUIRE_SHA2_H
+#define LIBACQUIRE_ACQUIRE_SHA2_H
+
+/*
+ * Bundled SHA-256 and SHA-512 (FIPS 180-4), so that builds without OpenSSL,
+ * LibreSSL, CommonCrypto, librhash or WinCrypt can still check the digests
+ * most release manifests use. SHA-256 runs on the x86-64 SHA extensions or
+ * the AArch64 SHA2 instructions when the CPU has them; SHA-512 and every
+ * other CPU use portable C.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acquire_common_defs.h"
+#include "libacquire_export.h"
+
+struct acquire_handle; /* Forward declaration */
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+
+#define ACQUIRE_SHA256_OUT_LEN 32
+#define ACQUIRE_SHA512_OUT_LEN 64
+
+/* Implementations of the SHA-256 block function, selected at runtime */
+enum acquire_sha2_kernel {
+  ACQUIRE_SHA2_KERNEL_PORTABLE, /* plain C, runs anywhere */
+  ACQUIRE_SHA2_KERNEL_SHANI,    /* x86-64 `sha256rnds2`/`sha256msg[12]` */
+  ACQUIRE_SHA2_KERNEL_ARMV8     /* AArch64 `sha256h`/`sha256su[01]` */
+};
+
+/* Incremental hasher; treat as opaque and only use through the functions */
+struct acquire_sha2_hasher {
+  union {
+    uint32_t s256[8];
+    uint64_t s512[8];
+  } state;
+  uint64_t length; /* bytes added so far */
+  unsigned char buf[128];
+  size_t buf_len;
+  enum Checksum algorithm;
+  enum acquire_sha2_kernel kernel;
+};
+
+/**
+ * @brief Start a new hash using the fastest kernel this CPU supports.
+ *
+ * @param algorithm `LIBACQUIRE_SHA256` or `LIBACQUIRE_SHA512`.
+ *
+ * @return `0` on success, `-1` for another algorithm.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_sha2_init(struct acquire_sha2_hasher *self, enum Checksum algorithm);
+
+/**
+ * @brief Like `acquire_sha2_init`, but force a specific kernel.
+ *
+ * Mainly useful to test and benchmark the kernels against each other. An
+ * unsupported `kernel` falls back to the portable one.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_sha2_init_with_kernel(struct acquire_sha2_hasher *self,
+                              enum Checksum algorithm,
+                              enum acquire_sha2_kernel kernel);
+
+/**
+ * @brief Add `len` bytes of `input` to the hash.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_sha2_update(struct acquire_sha2_hasher *self, const void *input,
+                    size_t len);
+
+/**
+ * @brief Write the digest of everything added so far to `out`: 32 bytes for
+ * SHA-256, 64 for SHA-512.
+ *
+ * Does not modify the hasher, so more input may be added afterwards.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_sha2_final(const struct acquire_sha2_hasher *self,
+                   unsigned char out[ACQUIRE_SHA512_OUT_LEN]);
+
+/**
+ * @brief Report which kernel `acquire_sha2_init` selects on this machine.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_sha2_kernel
+acquire_sha2_active_kernel(void);
+
+/**
+ * @brief Check whether `kernel` was compiled in and this CPU can run it.
+ *
+ * @return `1` if the kernel can be used, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_sha2_kernel_supported(enum acquire_sha2_kernel kernel);
+
+/* SHA-256 states `acquire_sha256_update_many` can advance side by side */
+#define ACQUIRE_SHA256_MB_LANES 8
+
+/**
+ * @brief Check whether hashers from `acquire_sha2_init` are hashed side by
+ * side by `acquire_sha256_update_many`.
+ *
+ * That takes AVX2 (x86-64) and a CPU without SHA extensions: one SHA-NI
+ * stream outruns eight AVX2 lanes, so SHA-NI hashers are updated one by one.
+ *
+ * @return `1` if the multi-buffer kernel is used, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int acquire_sha256_mb_supported(void);
+
+/**
+ * @brief Add `lens[i]` bytes of `inputs[i]` to `hashers[i]` for each `i`
+ * below `count`, advancing up to `ACQUIRE_SHA256_MB_LANES` SHA-256 states in
+ * lockstep.
+ *
+ * The result is the same as calling `acquire_sha2_update` on each hasher,
+ * which is what happens to SHA-512 hashers, to hashers on a SHA-NI or ARMv8
+ * kernel, and on CPUs without AVX2. Worth it for many short messages, whose
+ * hashing is otherwise one serial chain of rounds after another.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_sha256_update_many(struct acquire_sha2_hasher *const hashers[],
+                           const void *const inputs[], const size_t lens[],
+                           size_t count);
+
+/**
+ * @brief `acquire_sha2_final` for each of `count` hashers, padding the
+ * SHA-256 ones through `acquire_sha256_update_many`. The hashers are left
+ * unchanged.
+ *
+ * For messages of a block or two the padding block is much of the work.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_sha256_final_many(struct acquire_sha2_hasher *const hashers[],
+                          unsigned char *const outs[], size_t count);
+
+int _sha2_verify_async_start(struct acquire_handle *handle,
+                             const char *filepath, enum Checksum algorithm,
+                             const char *expected_hash);
+enum acquire_status _sha2_verify_async_poll(struct acquire_handle *handle);
+void _sha2_verify_async_cancel(struct acquire_handle *handle);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+#if defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_SHA2) &&      \
+    LIBACQUIRE_USE_SHA2
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define LIBACQUIRE_SHA2_HAVE_SHANI 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LIBACQUIRE_SHA2_TARGET_SHANI
+#define LIBACQUIRE_SHA2_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define LIBACQUIRE_SHA2_TARGET_SHANI                                           \
+  __attribute__((target("sha,sse4.1,ssse3")))
+#define LIBACQUIRE_SHA2_TARGET_AVX2 __attribute__((target("avx2")))
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+#endif /* x86-64 */
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) &&       \
+    (defined(__linux__) || defined(__APPLE__))
+#define LIBACQUIRE_SHA2_HAVE_ARMV8 1
+#include <arm_neon.h>
+#ifdef __clang__
+#define LIBACQUIRE_SHA2_TARGET_ARMV8 __attribute__((target("crypto")))
+#else
+#define LIBACQUIRE_SHA2_TARGET_ARMV8 __attribute__((target("+crypto")))
+#endif /* __clang__ */
+#ifdef __linux__
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif /* !HWCAP_SHA2 */
+#endif /* __linux__ */
+#endif /* AArch64 */
+
+/* 64-bit constants from 32-bit halves, as C90 has no `ULL` suffix */
+#define SHA2_U64(hi, lo) (((uint64_t)(hi) << 32) | (uint64_t)(lo))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU,
+    0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U, 0xd807aa98U, 0x12835b01U,
+    0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U,
+    0xc19bf174U, 0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU,
+    0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU, 0x983e5152U,
+    0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U,
+    0x06ca6351U, 0x14292967U, 0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU,
+    0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U,
+    0xd6990624U, 0xf40e3585U, 0x106aa070U, 0x19a4c116U, 0x1e376c08U,
+    0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU,
+    0x682e6ff3U, 0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U,
+    0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU, 0x510e527fU,
+    0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U};
+
+static const uint64_t sha512_k[80] = {
+    SHA2_U64(0x428a2f98U, 0xd728ae22U), SHA2_U64(0x71374491U, 0x23ef65cdU),
+    SHA2_U64(0xb5c0fbcfU, 0xec4d3b2fU), SHA2_U64(0xe9b5dba5U, 0x8189dbbcU),
+    SHA2_U64(0x3956c25bU, 0xf348b538U), SHA2_U64(0x59f111f1U, 0xb605d019U),
+    SHA2_U64(0x923f82a4U, 0xaf194f9bU), SHA2_U64(0xab1c5ed5U, 0xda6d8118U),
+    SHA2_U64(0xd807aa98U, 0xa3030242U), SHA2_U64(0x12835b01U, 0x45706fbeU),
+    SHA2_U64(0x243185beU, 0x4ee4b28cU), SHA2_U64(0x550c7dc3U, 0xd5ffb4e2U),
+    SHA2_U64(0x72be5d74U, 0xf27b896fU), SHA2_U64(0x80deb1feU, 0x3b1696b1U),
+    SHA2_U64(0x9bdc06a7U, 0x25c71235U), SHA2_U64(0xc19bf174U, 0xcf692694U),
+    SHA2_U64(0xe49b69c1U, 0x9ef14ad2U), SHA2_U64(0xefbe4786U, 0x384f25e3U),
+    SHA2_U64(0x0fc19dc6U, 0x8b8cd5b5U), SHA2_U64(0x240ca1ccU, 0x77ac9c65U),
+    SHA2_U64(0x2de92c6fU, 0x592b0275U), SHA2_U64(0x4a7484aaU, 0x6ea6e483U),
+    SHA2_U64(0x5cb0a9dcU, 0xbd41fbd4U), SHA2_U64(0x76f988daU, 0x831153b5U),
+    SHA2_U64(0x983e5152U, 0xee66dfabU), SHA2_U64(0xa831c66dU, 0x2db43210U),
+    SHA2_U64(0xb00327c8U, 0x98fb213fU), SHA2_U64(0xbf597fc7U, 0xbeef0ee4U),
+    SHA2_U64(0xc6e00bf3U, 0x3da88fc2U), SHA2_U64(0xd5a79147U, 0x930aa725U),
+    SHA2_U64(0x06ca6351U, 0xe003826fU), SHA2_U64(0x14292967U, 0x0a0e6e70U),
+    SHA2_U64(0x27b70a85U, 0x46d22ffcU), SHA2_U64(0x2e1b2138U, 0x5c26c926U),
+    SHA2_U64(0x4d2c6dfcU, 0x5ac42aedU), SHA2_U64(0x53380d13U, 0x9d95b3dfU),
+    SHA2_U64(0x650a7354U, 0x8baf63deU), SHA2_U64(0x766a0abbU, 0x3c77b2a8U),
+    SHA2_U64(0x81c2c92eU, 0x47edaee6U), SHA2_U64(0x92722c85U, 0x1482353bU),
+    SHA2_U64(0xa2bfe8a1U, 0x4cf10364U), SHA2_U64(0xa81a664bU, 0xbc423001U),
+    SHA2_U64(0xc24b8b70U, 0xd0f89791U), SHA2_U64(0xc76c51a3U, 0x0654be30U),
+    SHA2_U64(0xd192e819U, 0xd6ef5218U), SHA2_U64(0xd6990624U, 0x5565a910U),
+    SHA2_U64(0xf40e3585U, 0x5771202aU), SHA2_U64(0x106aa070U, 0x32bbd1b8U),
+    SHA2_U64(0x19a4c116U, 0xb8d2d0c8U), SHA2_U64(0x1e376c08U, 0x5141ab53U),
+    SHA2_U64(0x2748774cU, 0xdf8eeb99U), SHA2_U64(0x34b0bcb5U, 0xe19b48a8U),
+    SHA2_U64(0x391c0cb3U, 0xc5c95a63U), SHA2_U64(0x4ed8aa4aU, 0xe3418acbU),
+    SHA2_U64(0x5b9cca4fU, 0x7763e373U), SHA2_U64(0x682e6ff3U, 0xd6b2b8a3U),
+    SHA2_U64(0x748f82eeU, 0x5defb2fcU), SHA2_U64(0x78a5636fU, 0x43172f60U),
+    SHA2_U64(0x84c87814U, 0xa1f0ab72U), SHA2_U64(0x8cc70208U, 0x1a6439ecU),
+    SHA2_U64(0x90befffaU, 0x23631e28U), SHA2_U64(0xa4506cebU, 0xde82bde9U),
+    SHA2_U64(0xbef9a3f7U, 0xb2c67915U), SHA2_U64(0xc67178f2U, 0xe372532bU),
+    SHA2_U64(0xca273eceU, 0xea26619cU), SHA2_U64(0xd186b8c7U, 0x21c0c207U),
+    SHA2_U64(0xeada7dd6U, 0xcde0eb1eU), SHA2_U64(0xf57d4f7fU, 0xee6ed178U),
+    SHA2_U64(0x06f067aaU, 0x72176fbaU), SHA2_U64(0x0a637dc5U, 0xa2c898a6U),
+    SHA2_U64(0x113f9804U, 0xbef90daeU), SHA2_U64(0x1b710b35U, 0x131c471bU),
+    SHA2_U64(0x28db77f5U, 0x23047d84U), SHA2_U64(0x32caab7bU, 0x40c72493U),
+    SHA2_U64(0x3c9ebe0aU, 0x15c9bebcU), SHA2_U64(0x431d67c4U, 0x9c100d4cU),
+    SHA2_U64(0x4cc5d4beU, 0xcb3e42b6U), SHA2_U64(0x597f299cU, 0xfc657e2aU),
+    SHA2_U64(0x5fcb6fabU, 0x3ad6faecU), SHA2_U64(0x6c44198cU, 0x4a475817U)};
+
+static const uint64_t sha512_iv[8] = {
+    SHA2_U64(0x6a09e667U, 0xf3bcc908U), SHA2_U64(0xbb67ae85U, 0x84caa73bU),
+    SHA2_U64(0x3c6ef372U, 0xfe94f82bU), SHA2_U64(0xa54ff53aU, 0x5f1d36f1U),
+    SHA2_U64(0x510e527fU, 0xade682d1U), SHA2_U64(0x9b05688cU, 0x2b3e6c1fU),
+    SHA2_U64(0x1f83d9abU, 0xfb41bd6bU), SHA2_U64(0x5be0cd19U, 0x137e2179U)};
+
+static uint32_t sha2_load32(const unsigned char *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         (uint32_t)p[3];
+}
+
+static uint64_t sha2_load64(const unsigned char *p) {
+  return (uint64_t)sha2_load32(p) << 32 | (uint64_t)sha2_load32(p + 4);
+}
+
+static void sha2_store32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)(v >> 24);
+  p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >> 8);
+  p[3] = (unsigned char)v;
+}
+
+static void sha2_store64(unsigned char *p, uint64_t v) {
+  sha2_store32(p, (uint32_t)(v >> 32));
+  sha2_store32(p + 4, (uint32_t)v);
+}
+
+/******************************
+ * Portable block functions   *
+ ******************************/
+
+#define SHA2_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA2_ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define SHA2_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA2_MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define SHA256_BSIG0(x)                                                        \
+  (SHA2_ROTR32(x, 2) ^ SHA2_ROTR32(x, 13) ^ SHA2_ROTR32(x, 22))
+#define SHA256_BSIG1(x)                                                        \
+  (SHA2_ROTR32(x, 6) ^ SHA2_ROTR32(x, 11) ^ SHA2_ROTR32(x, 25))
+#define SHA256_SSIG0(x) (SHA2_ROTR32(x, 7) ^ SHA2_ROTR32(x, 18) ^ ((x) >> 3))
+#define SHA256_SSIG1(x) (SHA2_ROTR32(x, 17) ^ SHA2_ROTR32(x, 19) ^ ((x) >> 10))
+
+#define SHA512_BSIG0(x)                                                        \
+  (SHA2_ROTR64(x, 28) ^ SHA2_ROTR64(x, 34) ^ SHA2_ROTR64(x, 39))
+#define SHA512_BSIG1(x)                                                        \
+  (SHA2_ROTR64(x, 14) ^ SHA2_ROTR64(x, 18) ^ SHA2_ROTR64(x, 41))
+#define SHA512_SSIG0(x) (SHA2_ROTR64(x, 1) ^ SHA2_ROTR64(x, 8) ^ ((x) >> 7))
+#define SHA512_SSIG1(x) (SHA2_ROTR64(x, 19) ^ SHA2_ROTR64(x, 61) ^ ((x) >> 6))
+
+static void sha256_blocks_portable(uint32_t state[8], const unsigned char *in,
+                                   size_t blocks) {
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+  size_t i;
+  for (; blocks > 0; blocks--, in += 64) {
+    for (i = 0; i < 16; i++)
+      w[i] = sha2_load32(in + 4 * i);
+    for (; i < 64; i++)
+      w[i] = SHA256_SSIG1(w[i - 2]) + w[i - 7] + SHA256_SSIG0(w[i - 15]) +
+             w[i - 16];
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    for (i = 0; i < 64; i++) {
+      t1 = h + SHA256_BSIG1(e) + SHA2_CH(e, f, g) + sha256_k[i] + w[i];
+      t2 = SHA256_BSIG0(a) + SHA2_MAJ(a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+static void sha512_blocks_portable(uint64_t state[8], const unsigned char *in,
+                                   size_t blocks) {
+  uint64_t w[80];
+  uint64_t a, b, c, d, e, f, g, h, t1, t2;
+  size_t i;
+  for (; blocks > 0; blocks--, in += 128) {
+    for (i = 0; i < 16; i++)
+      w[i] = sha2_load64(in + 8 * i);
+    for (; i < 80; i++)
+      w[i] = SHA512_SSIG1(w[i - 2]) + w[i - 7] + SHA512_SSIG0(w[i - 15]) +
+             w[i - 16];
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+    for (i = 0; i < 80; i++) {
+      t1 = h + SHA512_BSIG1(e) + SHA2_CH(e, f, g) + sha512_k[i] + w[i];
+      t2 = SHA512_BSIG0(a) + SHA2_MAJ(a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+
+/******************************
+ * x86-64 SHA extensions      *
+ ******************************/
+
+static int sha2_cpu_has_shani(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return 0;
+  __cpuid(info, 1);
+  if (!((info[2] >> 9) & 1) || !((info[2] >> 19) & 1)) /* SSSE3, SSE4.1 */
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 29) & 1;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid(1, eax, ebx, ecx, edx);
+  if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+    return 0;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx >> 29) & 1;
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+}
+
+/* Four rounds: `sha256rnds2` does two with the low half of its last operand */
+#define SHA256_SHANI_ROUNDS(msg, k)                                            \
+  do {                                                                         \
+    tmp = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *)&sha256_k[k]));  \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, tmp);                       \
+    tmp = _mm_shuffle_epi32(tmp, 0x0E);                                        \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, tmp);                       \
+  } while (0)
+
+/* `m0` holds W[t-16..t-13] and becomes W[t..t+3] */
+#define SHA256_SHANI_SCHEDULE(m0, m1, m2, m3)                                  \
+  m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1),        \
+                                          _mm_alignr_epi8(m3, m2, 4)),         \
+                            m3)
+
+LIBACQUIRE_SHA2_TARGET_SHANI
+static void sha256_blocks_shani(uint32_t state[8], const unsigned char *in,
+                                size_t blocks) {
+  const __m128i bswap =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m128i state0, state1, tmp, abef, cdgh, m0, m1, m2, m3;
+  int k;
+
+  /* The instructions want the state as ABEF and CDGH */
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  for (; blocks > 0; blocks--, in += 64) {
+    abef = state0;
+    cdgh = state1;
+    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), bswap);
+    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), bswap);
+    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 32)), bswap);
+    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 48)), bswap);
+    SHA256_SHANI_ROUNDS(m0, 0);
+    SHA256_SHANI_ROUNDS(m1, 4);
+    SHA256_SHANI_ROUNDS(m2, 8);
+    SHA256_SHANI_ROUNDS(m3, 12);
+    for (k = 16; k < 64; k += 16) {
+      SHA256_SHANI_SCHEDULE(m0, m1, m2, m3);
+      SHA256_SHANI_ROUNDS(m0, k);
+      SHA256_SHANI_SCHEDULE(m1, m2, m3, m0);
+      SHA256_SHANI_ROUNDS(m1, k + 4);
+      SHA256_SHANI_SCHEDULE(m2, m3, m0, m1);
+      SHA256_SHANI_ROUNDS(m2, k + 8);
+      SHA256_SHANI_SCHEDULE(m3, m0, m1, m2);
+      SHA256_SHANI_ROUNDS(m3, k + 12);
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+/******************************
+ * AVX2: 8 messages at once   *
+ ******************************/
+
+static int sha2_cpu_has_avx2(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 1);
+  if (!((info[2] >> 27) & 1)) /* OSXSAVE: the OS manages extended state */
+    return 0;
+  if ((_xgetbv(0) & 0x6) != 0x6)
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 5) & 1;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+}
+
+#define SHA256_AVX2_ROTR(x, n)                                                 \
+  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SHA256_AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define SHA256_AVX2_ADD3(x, y, z) _mm256_add_epi32(_mm256_add_epi32(x, y), z)
+
+/* Transpose eight rows of eight 32-bit words, so lane `i` of `r[j]` holds
+ * what was word `j` of row `i` */
+LIBACQUIRE_SHA2_TARGET_AVX2
+static void sha256_avx2_transpose(__m256i r[8]) {
+  __m256i t0, t1, t2, t3, t4, t5, t6, t7, u0, u1, u2, u3, u4, u5, u6, u7;
+  t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  u0 = _mm256_unpacklo_epi64(t0, t2);
+  u1 = _mm256_unpackhi_epi64(t0, t2);
+  u2 = _mm256_unpacklo_epi64(t1, t3);
+  u3 = _mm256_unpackhi_epi64(t1, t3);
+  u4 = _mm256_unpacklo_epi64(t4, t6);
+  u5 = _mm256_unpackhi_epi64(t4, t6);
+  u6 = _mm256_unpacklo_epi64(t5, t7);
+  u7 = _mm256_unpackhi_epi64(t5, t7);
+  r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/*
+ * `blocks` blocks of each of eight messages, lane `i` reading `in[i]` and
+ * updating `states[i]`. Each vector holds one SHA-256 variable of all eight
+ * messages, so the rounds are the portable ones with 8-wide operations.
+ */
+LIBACQUIRE_SHA2_TARGET_AVX2
+static void sha256_blocks_avx2x8(uint32_t *const states[8],
+                                 const unsigned char *in[8], size_t blocks) {
+  const __m256i bswap = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m256i v[8], w[16], saved[8], t1, t2, s0, s1;
+  size_t offset = 0;
+  int i, t;
+
+  for (i = 0; i < 8; i++)
+    v[i] = _mm256_loadu_si256((const __m256i *)states[i]);
+  sha256_avx2_transpose(v);
+
+  for (; blocks > 0; blocks--, offset += 64) {
+    for (i = 0; i < 8; i++)
+      w[i] = _mm256_loadu_si256((const __m256i *)(in[i] + offset));
+    sha256_avx2_transpose(w);
+    for (i = 0; i < 8; i++)
+      w[8 + i] = _mm256_loadu_si256((const __m256i *)(in[i] + offset + 32));
+    sha256_avx2_transpose(w + 8);
+    for (i = 0; i < 16; i++)
+      w[i] = _mm256_shuffle_epi8(w[i], bswap);
+    for (i = 0; i < 8; i++)
+      saved[i] = v[i];
+
+    for (t = 0; t < 64; t++) {
+      /* The schedule is kept as a ring of the last 16 words */
+      if (t >= 16) {
+        const __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+        s0 = SHA256_AVX2_XOR3(SHA256_AVX2_ROTR(w15, 7),
+                              SHA256_AVX2_ROTR(w15, 18),
+                              _mm256_srli_epi32(w15, 3));
+        s1 = SHA256_AVX2_XOR3(SHA256_AVX2_ROTR(w2, 17),
+                              SHA256_AVX2_ROTR(w2, 19),
+                              _mm256_srli_epi32(w2, 10));
+        w[t & 15] = _mm256_add_epi32(
+            SHA256_AVX2_ADD3(w[t & 15], s0, w[(t - 7) & 15]), s1);
+      }
+      s1 = SHA256_AVX2_XOR3(SHA256_AVX2_ROTR(v[4], 6),
+                            SHA256_AVX2_ROTR(v[4], 11),
+                            SHA256_AVX2_ROTR(v[4], 25));
+      t1 = _mm256_xor_si256(_mm256_and_si256(v[4], v[5]),
+                            _mm256_andnot_si256(v[4], v[6]));
+      t1 = _mm256_add_epi32(
+          SHA256_AVX2_ADD3(v[7], s1, t1),
+          _mm256_add_epi32(_mm256_set1_epi32((int)sha256_k[t]), w[t & 15]));
+      s0 = SHA256_AVX2_XOR3(SHA256_AVX2_ROTR(v[0], 2),
+                            SHA256_AVX2_ROTR(v[0], 13),
+                            SHA256_AVX2_ROTR(v[0], 22));
+      t2 = _mm256_add_epi32(
+          s0, _mm256_or_si256(_mm256_and_si256(v[0], v[1]),
+                              _mm256_and_si256(v[2], _mm256_or_si256(v[0],
+                                                                     v[1]))));
+      v[7] = v[6];
+      v[6] = v[5];
+      v[5] = v[4];
+      v[4] = _mm256_add_epi32(v[3], t1);
+      v[3] = v[2];
+      v[2] = v[1];
+      v[1] = v[0];
+      v[0] = _mm256_add_epi32(t1, t2);
+    }
+    for (i = 0; i < 8; i++)
+      v[i] = _mm256_add_epi32(v[i], saved[i]);
+  }
+
+  sha256_avx2_transpose(v);
+  for (i = 0; i < 8; i++)
+    _mm256_storeu_si256((__m256i *)states[i], v[i]);
+}
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+
+#ifdef LIBACQUIRE_SHA2_HAVE_ARMV8
+
+/******************************
+ * AArch64 SHA2 instructions  *
+ ******************************/
+
+static int sha2_cpu_has_armv8(void) {
+#ifdef __linux__
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+  return 1; /* every Apple arm64 CPU implements the SHA2 extension */
+#endif /* __linux__ */
+}
+
+#define SHA256_ARMV8_ROUNDS(msg, k)                                            \
+  do {                                                                         \
+    tmp = vaddq_u32(msg, vld1q_u32(&sha256_k[k]));                             \
+    prev = state0;                                                             \
+    state0 = vsha256hq_u32(state0, state1, tmp);                               \
+    state1 = vsha256h2q_u32(state1, prev, tmp);                                \
+  } while (0)
+
+/* `m0` holds W[t-16..t-13] and becomes W[t..t+3] */
+#define SHA256_ARMV8_SCHEDULE(m0, m1, m2, m3)                                  \
+  m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3)
+
+LIBACQUIRE_SHA2_TARGET_ARMV8
+static void sha256_blocks_armv8(uint32_t state[8], const unsigned char *in,
+                                size_t blocks) {
+  uint32x4_t state0 = vld1q_u32(&state[0]), state1 = vld1q_u32(&state[4]);
+  uint32x4_t abcd, efgh, prev, tmp, m0, m1, m2, m3;
+  int k;
+
+  for (; blocks > 0; blocks--, in += 64) {
+    abcd = state0;
+    efgh = state1;
+    m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in)));
+    m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in + 16)));
+    m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in + 32)));
+    m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in + 48)));
+    SHA256_ARMV8_ROUNDS(m0, 0);
+    SHA256_ARMV8_ROUNDS(m1, 4);
+    SHA256_ARMV8_ROUNDS(m2, 8);
+    SHA256_ARMV8_ROUNDS(m3, 12);
+    for (k = 16; k < 64; k += 16) {
+      SHA256_ARMV8_SCHEDULE(m0, m1, m2, m3);
+      SHA256_ARMV8_ROUNDS(m0, k);
+      SHA256_ARMV8_SCHEDULE(m1, m2, m3, m0);
+      SHA256_ARMV8_ROUNDS(m1, k + 4);
+      SHA256_ARMV8_SCHEDULE(m2, m3, m0, m1);
+      SHA256_ARMV8_ROUNDS(m2, k + 8);
+      SHA256_ARMV8_SCHEDULE(m3, m0, m1, m2);
+      SHA256_ARMV8_ROUNDS(m3, k + 12);
+    }
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+  }
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+#endif /* LIBACQUIRE_SHA2_HAVE_ARMV8 */
+
+/******************************
+ * Kernel dispatch            *
+ ******************************/
+
+int acquire_sha2_kernel_supported(enum acquire_sha2_kernel kernel) {
+  switch (kernel) {
+  case ACQUIRE_SHA2_KERNEL_PORTABLE:
+    return 1;
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+  case ACQUIRE_SHA2_KERNEL_SHANI:
+    return sha2_cpu_has_shani();
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+#ifdef LIBACQUIRE_SHA2_HAVE_ARMV8
+  case ACQUIRE_SHA2_KERNEL_ARMV8:
+    return sha2_cpu_has_armv8();
+#endif /* LIBACQUIRE_SHA2_HAVE_ARMV8 */
+  default:
+    return 0;
+  }
+}
+
+/* The fastest kernel this CPU runs, as `sha2_resolve` found */
+static enum acquire_sha2_kernel sha2_active_id = ACQUIRE_SHA2_KERNEL_PORTABLE;
+static acquire_once_t sha2_active_once = ACQUIRE_ONCE_INIT;
+
+static void sha2_resolve(void) {
+  enum acquire_sha2_kernel kernel = ACQUIRE_SHA2_KERNEL_PORTABLE;
+  if (acquire_sha2_kernel_supported(ACQUIRE_SHA2_KERNEL_SHANI))
+    kernel = ACQUIRE_SHA2_KERNEL_SHANI;
+  else if (acquire_sha2_kernel_supported(ACQUIRE_SHA2_KERNEL_ARMV8))
+    kernel = ACQUIRE_SHA2_KERNEL_ARMV8;
+  sha2_active_id = kernel;
+}
+
+enum acquire_sha2_kernel acquire_sha2_active_kernel(void) {
+  acquire_once(&sha2_active_once, sha2_resolve);
+  return sha2_active_id;
+}
+
+static size_t sha2_block_len(enum Checksum algorithm) {
+  return algorithm == LIBACQUIRE_SHA512 ? 128 : 64;
+}
+
+static void sha2_blocks(struct acquire_sha2_hasher *self,
+                        const unsigned char *in, size_t blocks) {
+  if (self->algorithm == LIBACQUIRE_SHA512) {
+    sha512_blocks_portable(self->state.s512, in, blocks);
+    return;
+  }
+  switch (self->kernel) {
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+  case ACQUIRE_SHA2_KERNEL_SHANI:
+    sha256_blocks_shani(self->state.s256, in, blocks);
+    break;
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+#ifdef LIBACQUIRE_SHA2_HAVE_ARMV8
+  case ACQUIRE_SHA2_KERNEL_ARMV8:
+    sha256_blocks_armv8(self->state.s256, in, blocks);
+    break;
+#endif /* LIBACQUIRE_SHA2_HAVE_ARMV8 */
+  default:
+    sha256_blocks_portable(self->state.s256, in, blocks);
+    break;
+  }
+}
+
+int acquire_sha2_init_with_kernel(struct acquire_sha2_hasher *self,
+                                  enum Checksum algorithm,
+                                  enum acquire_sha2_kernel kernel) {
+  if (!self ||
+      (algorithm != LIBACQUIRE_SHA256 && algorithm != LIBACQUIRE_SHA512))
+    return -1;
+  if (algorithm == LIBACQUIRE_SHA512)
+    memcpy(self->state.s512, sha512_iv, sizeof(sha512_iv));
+  else
+    memcpy(self->state.s256, sha256_iv, sizeof(sha256_iv));
+  self->length = 0;
+  self->buf_len = 0;
+  self->algorithm = algorithm;
+  /* Checking the active kernel first skips a `cpuid` per message, which a
+   * hypervisor may trap */
+  self->kernel = kernel == acquire_sha2_active_kernel() ||
+                         acquire_sha2_kernel_supported(kernel)
+                     ? kernel
+                     : ACQUIRE_SHA2_KERNEL_PORTABLE;
+  return 0;
+}
+
+int acquire_sha2_init(struct acquire_sha2_hasher *self,
+                      enum Checksum algorithm) {
+  return acquire_sha2_init_with_kernel(self, algorithm,
+                                       acquire_sha2_active_kernel());
+}
+
+void acquire_sha2_update(struct acquire_sha2_hasher *self, const void *input,
+                         size_t len) {
+  const unsigned char *in = (const unsigned char *)input;
+  size_t block_len, take;
+  if (!self || len == 0)
+    return;
+  block_len = sha2_block_len(self->algorithm);
+  self->length += len;
+  if (self->buf_len > 0) {
+    take = block_len - self->buf_len;
+    if (take > len)
+      take = len;
+    memcpy(self->buf + self->buf_len, in, take);
+    self->buf_len += take;
+    in += take;
+    len -= take;
+    if (self->buf_len < block_len)
+      return;
+    sha2_blocks(self, self->buf, 1);
+    self->buf_len = 0;
+  }
+  if (len >= block_len) {
+    sha2_blocks(self, in, len / block_len);
+    in += len - len % block_len;
+    len %= block_len;
+  }
+  memcpy(self->buf, in, len);
+  self->buf_len = len;
+}
+
+void acquire_sha2_final(const struct acquire_sha2_hasher *self,
+                        unsigned char out[ACQUIRE_SHA512_OUT_LEN]) {
+  struct acquire_sha2_hasher tail;
+  size_t block_len, i;
+  if (!self || !out)
+    return;
+  tail = *self;
+  block_len = sha2_block_len(tail.algorithm);
+  /* A 1 bit, zeros, then the length in bits filling the block's end */
+  tail.buf[tail.buf_len++] = 0x80;
+  if (tail.buf_len > block_len - block_len / 8) {
+    memset(tail.buf + tail.buf_len, 0, block_len - tail.buf_len);
+    sha2_blocks(&tail, tail.buf, 1);
+    tail.buf_len = 0;
+  }
+  memset(tail.buf + tail.buf_len, 0, block_len - tail.buf_len);
+  sha2_store32(tail.buf + block_len - 8, (uint32_t)(self->length >> 29));
+  sha2_store32(tail.buf + block_len - 4, (uint32_t)(self->length << 3));
+  if (tail.algorithm == LIBACQUIRE_SHA512)
+    /* Only a 2^61 byte input reaches the top of the 128-bit count */
+    sha2_store32(tail.buf + block_len - 12, (uint32_t)(self->length >> 61));
+  sha2_blocks(&tail, tail.buf, 1);
+  if (tail.algorithm == LIBACQUIRE_SHA512)
+    for (i = 0; i < 8; i++)
+      sha2_store64(out + 8 * i, tail.state.s512[i]);
+  else
+    for (i = 0; i < 8; i++)
+      sha2_store32(out + 4 * i, tail.state.s256[i]);
+}
+
+/******************************
+ * Many messages at once      *
+ ******************************/
+
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+/*
+ * With fewer messages than this still holding whole blocks, hashing the rest
+ * one at a time is quicker than running mostly idle lanes.
+ */
+#define SHA256_MB_MIN_LANES 3
+
+/* Whether the CPU has AVX2 for the lanes; set by `sha256_lanes_resolve` */
+static int sha256_lanes_id = 0;
+static acquire_once_t sha256_lanes_once = ACQUIRE_ONCE_INIT;
+
+static void sha256_lanes_resolve(void) {
+  sha256_lanes_id = sha2_cpu_has_avx2();
+}
+
+static int sha256_lanes_available(void) {
+  acquire_once(&sha256_lanes_once, sha256_lanes_resolve);
+  return sha256_lanes_id;
+}
+
+/* Up to eight hashers; those the lanes would slow down go on their own */
+static void sha256_update_lanes(struct acquire_sha2_hasher *const hashers[],
+                                const void *const inputs[],
+                                const size_t lens[], size_t n) {
+  uint32_t scratch[8][8];
+  uint32_t *states[8];
+  const unsigned char *in[8], *lane_in[8];
+  size_t blocks[8], tails[8];
+  size_t i, take, active, busy = 0, step;
+
+  for (i = 0; i < n; i++) {
+    struct acquire_sha2_hasher *self = hashers[i];
+    const unsigned char *p = (const unsigned char *)inputs[i];
+    size_t len = lens[i];
+    blocks[i] = tails[i] = 0;
+    if (self->algorithm != LIBACQUIRE_SHA256 ||
+        self->kernel != ACQUIRE_SHA2_KERNEL_PORTABLE) {
+      acquire_sha2_update(self, p, len);
+      continue;
+    }
+    self->length += len;
+    /* Top up a partial block first, so the rest starts on a boundary */
+    if (self->buf_len > 0) {
+      take = 64 - self->buf_len;
+      if (take > len)
+        take = len;
+      memcpy(self->buf + self->buf_len, p, take);
+      self->buf_len += take;
+      p += take;
+      len -= take;
+      if (self->buf_len < 64)
+        continue;
+      sha2_blocks(self, self->buf, 1);
+      self->buf_len = 0;
+    }
+    in[i] = p;
+    blocks[i] = len / 64;
+    tails[i] = len % 64;
+  }
+
+  for (;;) {
+    active = 0;
+    step = (size_t)-1;
+    for (i = 0; i < n; i++)
+      if (blocks[i] > 0) {
+        if (active++ == 0)
+          busy = i;
+        if (blocks[i] < step)
+          step = blocks[i];
+      }
+    if (active < SHA256_MB_MIN_LANES)
+      break;
+    /* Idle lanes rehash a busy lane's input into scratch state */
+    for (i = 0; i < 8; i++) {
+      if (i < n && blocks[i] > 0) {
+        states[i] = hashers[i]->state.s256;
+        lane_in[i] = in[i];
+      } else {
+        states[i] = scratch[i];
+        lane_in[i] = in[busy];
+      }
+    }
+    sha256_blocks_avx2x8(states, lane_in, step);
+    for (i = 0; i < n; i++)
+      if (blocks[i] > 0) {
+        in[i] += step * 64;
+        blocks[i] -= step;
+      }
+  }
+
+  for (i = 0; i < n; i++) {
+    if (blocks[i] > 0) {
+      sha2_blocks(hashers[i], in[i], blocks[i]);
+      in[i] += blocks[i] * 64;
+    }
+    if (tails[i] > 0) {
+      memcpy(hashers[i]->buf, in[i], tails[i]);
+      hashers[i]->buf_len = tails[i];
+    }
+  }
+}
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+
+int acquire_sha256_mb_supported(void) {
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+  return acquire_sha2_active_kernel() == ACQUIRE_SHA2_KERNEL_PORTABLE &&
+         sha256_lanes_available();
+#else
+  return 0;
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+}
+
+void acquire_sha256_update_many(struct acquire_sha2_hasher *const hashers[],
+                                const void *const inputs[],
+                                const size_t lens[], size_t count) {
+  size_t i;
+  if (!hashers || !inputs || !lens)
+    return;
+#ifdef LIBACQUIRE_SHA2_HAVE_SHANI
+  if (count > 1 && sha256_lanes_available()) {
+    for (i = 0; i < count; i += ACQUIRE_SHA256_MB_LANES)
+      sha256_update_lanes(hashers + i, inputs + i, lens + i,
+                          count - i < ACQUIRE_SHA256_MB_LANES
+                              ? count - i
+                              : ACQUIRE_SHA256_MB_LANES);
+    return;
+  }
+#endif /* LIBACQUIRE_SHA2_HAVE_SHANI */
+  for (i = 0; i < count; i++)
+    acquire_sha2_update(hashers[i], inputs[i], lens[i]);
+}
+
+void acquire_sha256_final_many(struct acquire_sha2_hasher *const hashers[],
+                               unsigned char *const outs[], size_t count) {
+  struct acquire_sha2_hasher tails[ACQUIRE_SHA256_MB_LANES];
+  struct acquire_sha2_hasher *lanes[ACQUIRE_SHA256_MB_LANES];
+  /* The 0x80, up to 63 zeros, and the length in bits */
+  unsigned char pads[ACQUIRE_SHA256_MB_LANES][72];
+  const void *inputs[ACQUIRE_SHA256_MB_LANES];
+  size_t lens[ACQUIRE_SHA256_MB_LANES];
+  size_t i, j, n;
+  if (!hashers || !outs)
+    return;
+  for (i = 0; i < count; i += n) {
+    n = count - i < ACQUIRE_SHA256_MB_LANES ? count - i
+                                            : ACQUIRE_SHA256_MB_LANES;
+    for (j = 0; j < n; j++) {
+      const struct acquire_sha2_hasher *self = hashers[i + j];
+      tails[j] = *self;
+      lanes[j] = &tails[j];
+      inputs[j] = pads[j];
+      lens[j] = 0;
+      if (self->algorithm != LIBACQUIRE_SHA256)
+        continue;
+      lens[j] = 64 - (self->buf_len + 8) % 64;
+      memset(pads[j], 0, lens[j]);
+      pads[j][0] = 0x80;
+      sha2_store32(pads[j] + lens[j], (uint32_t)(self->length >> 29));
+      sha2_store32(pads[j] + lens[j] + 4, (uint32_t)(self->length << 3));
+      lens[j] += 8;
+    }
+    acquire_sha256_update_many(lanes, inputs, lens, n);
+    for (j = 0; j < n; j++) {
+      size_t k;
+      if (hashers[i + j]->algorithm != LIBACQUIRE_SHA256) {
+        acquire_sha2_final(hashers[i + j], outs[i + j]);
+        continue;
+      }
+      for (k = 0; k < 8; k++)
+        sha2_store32(outs[i + j] + 4 * k, tails[j].state.s256[k]);
+    }
+  }
+}
+
+/******************************
+ * Verification backend       *
+ ******************************/
+
+struct sha2_backend {
+  struct acquire_file_reader reader;
+  struct acquire_sha2_hasher hasher;
+  char expected_hash[129];
+};
+
+static void cleanup_sha2_backend(struct acquire_handle *handle) {
+  struct sha2_backend *be;
+  if (!handle || !handle->backend_handle)
+    return;
+  be = (struct sha2_backend *)handle->backend_handle;
+  acquire_file_reader_close(&be->reader);
+  free(be);
+  handle->backend_handle = NULL;
+}
+
+int _sha2_verify_async_start(struct acquire_handle *handle,
+                             const char *filepath, enum Checksum algorithm,
+                             const char *expected_hash) {
+  struct sha2_backend *be;
+  size_t hex_len;
+  if (algorithm != LIBACQUIRE_SHA256 && algorithm != LIBACQUIRE_SHA512)
+    return -1;
+  if (!handle || !filepath || !expected_hash) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  hex_len = algorithm == LIBACQUIRE_SHA512 ? 128 : 64;
+  if (strlen(expected_hash) != hex_len) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                             "Invalid hash length for %s",
+                             algorithm == LIBACQUIRE_SHA512 ? "SHA512"
+                                                            : "SHA256");
+    return -1;
+  }
+  be = (struct sha2_backend *)calloc(1, sizeof(struct sha2_backend));
+  if (!be) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Out of memory");
+    return -1;
+  }
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+    free(be);
+    return -1;
+  }
+  acquire_sha2_init(&be->hasher, algorithm);
+  memcpy(be->expected_hash, expected_hash, hex_len);
+  be->expected_hash[hex_len] = '\0';
+  handle->backend_handle = be;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  return 0;
+}
+
+enum acquire_status _sha2_verify_async_poll(struct acquire_handle *handle) {
+  struct sha2_backend *be;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
+  if (!handle || !handle->backend_handle)
+    return ACQUIRE_ERROR;
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    return handle->status;
+  be = (struct sha2_backend *)handle->backend_handle;
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Operation cancelled");
+      cleanup_sha2_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
+    acquire_sha2_update(&be->hasher, buffer, bytes_read);
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+  } else {
+    unsigned char digest[ACQUIRE_SHA512_OUT_LEN];
+    char computed_hex[129];
+    const size_t out_len = be->hasher.algorithm == LIBACQUIRE_SHA512
+                               ? ACQUIRE_SHA512_OUT_LEN
+                               : ACQUIRE_SHA256_OUT_LEN;
+    size_t i;
+    acquire_sha2_final(&be->hasher, digest);
+    for (i = 0; i < out_len; i++)
+      snprintf(computed_hex + 2 * i, 3, "%02x", digest[i]);
+    if (strncasecmp(computed_hex, be->expected_hash, 2 * out_len) == 0) {
+      handle->status = ACQUIRE_COMPLETE;
+    } else {
+      acquire_handle_set_error(
+          handle, ACQUIRE_ERROR_UNKNOWN, "%s mismatch: expected %s, got %s",
+          be->hasher.algorithm == LIBACQUIRE_SHA512 ? "SHA512" : "SHA256",
+          be->expected_hash, computed_hex);
+    }
+  }
+  cleanup_sha2_backend(handle);
+  return handle->status;
+}
+
+void _sha2_verify_async_cancel(struct acquire_handle *handle) {
+  if (handle)
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+}
+
+#endif /* defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_SHA2) \
+          && LIBACQUIRE_USE_SHA2 */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_SHA2_H */
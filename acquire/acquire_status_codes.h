@@ -39,7 +39,8 @@ enum acquire_error_code {
   ACQUIRE_ERROR_ARCHIVE_READ_HEADER_FAILED = 301,
   ACQUIRE_ERROR_ARCHIVE_EXTRACT_FAILED = 302,
   ACQUIRE_ERROR_UNSUPPORTED_ARCHIVE_FORMAT = 303,
-  ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT = 304
+  ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT = 304,
+  ACQUIRE_ERROR_CHECKSUM_MISMATCH = 305
 };
 
 #endif /* !ACQUIRE_STATUS_CODES_H */
@@ -0,0 +1,344 @@
+#ifndef LIBACQUIRE_ACQUIRE_THREADS_H
+#define LIBACQUIRE_ACQUIRE_THREADS_H
+
+/*
+ * Minimal threading shim over pthreads and Win32, just enough for the
+ * worker threads used by the checksum backends and the verification
+ * executor.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <sys/types.h>
+
+#include "libacquire_export.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include "acquire_windows.h"
+typedef HANDLE acquire_thread_t;
+typedef CRITICAL_SECTION acquire_mutex_t;
+typedef CONDITION_VARIABLE acquire_cond_t;
+typedef INIT_ONCE acquire_once_t;
+#define ACQUIRE_ONCE_INIT INIT_ONCE_STATIC_INIT
+typedef DWORD acquire_tls_key_t;
+#define ACQUIRE_TLS_CALLBACK NTAPI
+#else
+#include <pthread.h>
+typedef pthread_t acquire_thread_t;
+typedef pthread_mutex_t acquire_mutex_t;
+typedef pthread_cond_t acquire_cond_t;
+typedef pthread_once_t acquire_once_t;
+#define ACQUIRE_ONCE_INIT PTHREAD_ONCE_INIT
+typedef pthread_key_t acquire_tls_key_t;
+#define ACQUIRE_TLS_CALLBACK
+#endif
+
+typedef void (*acquire_thread_fn)(void *arg);
+
+/**
+ * @brief Start a thread running `fn(arg)`.
+ *
+ * @return `0` on success, `-1` if the thread could not be created.
+ */
+extern LIBACQUIRE_EXPORT int acquire_thread_create(acquire_thread_t *thread,
+                                                   acquire_thread_fn fn,
+                                                   void *arg);
+
+/**
+ * @brief Wait for a thread started by `acquire_thread_create` to exit.
+ *
+ * @return `0` on success, `-1` on failure.
+ */
+extern LIBACQUIRE_EXPORT int acquire_thread_join(acquire_thread_t thread);
+
+/**
+ * @brief Number of CPUs currently online; always at least `1`.
+ */
+extern LIBACQUIRE_EXPORT unsigned int acquire_cpu_count(void);
+
+/**
+ * @brief Initialise a mutex or condition variable.
+ *
+ * @return `0` on success, `-1` on failure.
+ */
+extern LIBACQUIRE_EXPORT int acquire_mutex_init(acquire_mutex_t *mutex);
+extern LIBACQUIRE_EXPORT int acquire_cond_init(acquire_cond_t *cond);
+extern LIBACQUIRE_EXPORT void acquire_mutex_destroy(acquire_mutex_t *mutex);
+extern LIBACQUIRE_EXPORT void acquire_cond_destroy(acquire_cond_t *cond);
+extern LIBACQUIRE_EXPORT void acquire_mutex_lock(acquire_mutex_t *mutex);
+extern LIBACQUIRE_EXPORT void acquire_mutex_unlock(acquire_mutex_t *mutex);
+
+/**
+ * @brief Release `mutex`, sleep until `cond` is signalled, then relock.
+ *
+ * Wakeups may be spurious; re-check the predicate in a loop.
+ */
+extern LIBACQUIRE_EXPORT void acquire_cond_wait(acquire_cond_t *cond,
+                                               acquire_mutex_t *mutex);
+extern LIBACQUIRE_EXPORT void acquire_cond_broadcast(acquire_cond_t *cond);
+
+typedef void (*acquire_once_fn)(void);
+
+/**
+ * @brief Run `fn` exactly once per `once` (initialised with
+ * `ACQUIRE_ONCE_INIT`), however many threads get here first.
+ */
+extern LIBACQUIRE_EXPORT void acquire_once(acquire_once_t *once,
+                                           acquire_once_fn fn);
+
+/* Declare destructors as `void ACQUIRE_TLS_CALLBACK name(void *value)` */
+typedef void(ACQUIRE_TLS_CALLBACK *acquire_tls_destructor)(void *value);
+
+/**
+ * @brief Create a thread-local slot. When a thread that stored a non-NULL
+ * value exits, `destructor` (may be NULL) is called with it.
+ *
+ * @return `0` on success, `-1` on failure.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_tls_create(acquire_tls_key_t *key, acquire_tls_destructor destructor);
+extern LIBACQUIRE_EXPORT void *acquire_tls_get(acquire_tls_key_t key);
+extern LIBACQUIRE_EXPORT int acquire_tls_set(acquire_tls_key_t key,
+                                             void *value);
+
+/*
+ * Sequentially consistent access to counters and flags shared between
+ * threads. `volatile` alone neither orders the surrounding memory accesses
+ * nor makes a 64-bit `off_t` tear-free on 32-bit targets.
+ */
+extern LIBACQUIRE_EXPORT off_t
+acquire_atomic_load_off(const volatile off_t *value);
+extern LIBACQUIRE_EXPORT void acquire_atomic_store_off(volatile off_t *value,
+                                                      off_t v);
+extern LIBACQUIRE_EXPORT void acquire_atomic_add_off(volatile off_t *value,
+                                                    off_t delta);
+extern LIBACQUIRE_EXPORT int acquire_atomic_load_int(const volatile int *value);
+extern LIBACQUIRE_EXPORT void acquire_atomic_store_int(volatile int *value,
+                                                      int v);
+
+#ifdef LIBACQUIRE_IMPLEMENTATION
+#ifndef ACQUIRE_THREADS_IMPL_
+#define ACQUIRE_THREADS_IMPL_
+
+#include <stdlib.h>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <handleapi.h>
+#include <processthreadsapi.h>
+#include <synchapi.h>
+#include <sysinfoapi.h>
+#else
+#include <unistd.h>
+#endif
+
+struct acquire_thread_start {
+  acquire_thread_fn fn;
+  void *arg;
+};
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+static DWORD WINAPI acquire_thread_trampoline(LPVOID p) {
+#else
+static void *acquire_thread_trampoline(void *p) {
+#endif
+  struct acquire_thread_start start = *(struct acquire_thread_start *)p;
+  free(p);
+  start.fn(start.arg);
+  return 0;
+}
+
+int acquire_thread_create(acquire_thread_t *thread, acquire_thread_fn fn,
+                          void *arg) {
+  struct acquire_thread_start *start;
+  if (!thread || !fn)
+    return -1;
+  start = (struct acquire_thread_start *)malloc(sizeof *start);
+  if (!start)
+    return -1;
+  start->fn = fn;
+  start->arg = arg;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  *thread = CreateThread(NULL, 0, acquire_thread_trampoline, start, 0, NULL);
+  if (*thread == NULL) {
+    free(start);
+    return -1;
+  }
+#else
+  if (pthread_create(thread, NULL, acquire_thread_trampoline, start) != 0) {
+    free(start);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+int acquire_thread_join(acquire_thread_t thread) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  if (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0)
+    return -1;
+  CloseHandle(thread);
+  return 0;
+#else
+  return pthread_join(thread, NULL) == 0 ? 0 : -1;
+#endif
+}
+
+unsigned int acquire_cpu_count(void) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors
+                                       : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned int)n : 1;
+#else
+  return 1;
+#endif
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+int acquire_mutex_init(acquire_mutex_t *mutex) {
+  InitializeCriticalSection(mutex);
+  return 0;
+}
+int acquire_cond_init(acquire_cond_t *cond) {
+  InitializeConditionVariable(cond);
+  return 0;
+}
+void acquire_mutex_destroy(acquire_mutex_t *mutex) {
+  DeleteCriticalSection(mutex);
+}
+void acquire_cond_destroy(acquire_cond_t *cond) { (void)cond; }
+void acquire_mutex_lock(acquire_mutex_t *mutex) { EnterCriticalSection(mutex); }
+void acquire_mutex_unlock(acquire_mutex_t *mutex) {
+  LeaveCriticalSection(mutex);
+}
+void acquire_cond_wait(acquire_cond_t *cond, acquire_mutex_t *mutex) {
+  SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+void acquire_cond_broadcast(acquire_cond_t *cond) {
+  WakeAllConditionVariable(cond);
+}
+struct acquire_once_call {
+  acquire_once_fn fn;
+};
+static BOOL CALLBACK acquire_once_trampoline(PINIT_ONCE once, PVOID param,
+                                             PVOID *context) {
+  (void)once;
+  (void)context;
+  ((const struct acquire_once_call *)param)->fn();
+  return TRUE;
+}
+void acquire_once(acquire_once_t *once, acquire_once_fn fn) {
+  struct acquire_once_call call;
+  call.fn = fn;
+  InitOnceExecuteOnce(once, acquire_once_trampoline, &call, NULL);
+}
+/* Fiber-local storage is the variant that runs destructors on thread exit */
+int acquire_tls_create(acquire_tls_key_t *key,
+                       acquire_tls_destructor destructor) {
+  *key = FlsAlloc(destructor);
+  return *key == FLS_OUT_OF_INDEXES ? -1 : 0;
+}
+void *acquire_tls_get(acquire_tls_key_t key) { return FlsGetValue(key); }
+int acquire_tls_set(acquire_tls_key_t key, void *value) {
+  return FlsSetValue(key, value) ? 0 : -1;
+}
+#else
+int acquire_mutex_init(acquire_mutex_t *mutex) {
+  return pthread_mutex_init(mutex, NULL) == 0 ? 0 : -1;
+}
+int acquire_cond_init(acquire_cond_t *cond) {
+  return pthread_cond_init(cond, NULL) == 0 ? 0 : -1;
+}
+void acquire_mutex_destroy(acquire_mutex_t *mutex) {
+  pthread_mutex_destroy(mutex);
+}
+void acquire_cond_destroy(acquire_cond_t *cond) { pthread_cond_destroy(cond); }
+void acquire_mutex_lock(acquire_mutex_t *mutex) { pthread_mutex_lock(mutex); }
+void acquire_mutex_unlock(acquire_mutex_t *mutex) {
+  pthread_mutex_unlock(mutex);
+}
+void acquire_cond_wait(acquire_cond_t *cond, acquire_mutex_t *mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+void acquire_cond_broadcast(acquire_cond_t *cond) {
+  pthread_cond_broadcast(cond);
+}
+void acquire_once(acquire_once_t *once, acquire_once_fn fn) {
+  pthread_once(once, fn);
+}
+int acquire_tls_create(acquire_tls_key_t *key,
+                       acquire_tls_destructor destructor) {
+  return pthread_key_create(key, destructor) == 0 ? 0 : -1;
+}
+void *acquire_tls_get(acquire_tls_key_t key) {
+  return pthread_getspecific(key);
+}
+int acquire_tls_set(acquire_tls_key_t key, void *value) {
+  return pthread_setspecific(key, value) == 0 ? 0 : -1;
+}
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+off_t acquire_atomic_load_off(const volatile off_t *value) {
+  return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+void acquire_atomic_store_off(volatile off_t *value, off_t v) {
+  __atomic_store_n(value, v, __ATOMIC_SEQ_CST);
+}
+void acquire_atomic_add_off(volatile off_t *value, off_t delta) {
+  __atomic_fetch_add(value, delta, __ATOMIC_SEQ_CST);
+}
+int acquire_atomic_load_int(const volatile int *value) {
+  return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+void acquire_atomic_store_int(volatile int *value, int v) {
+  __atomic_store_n(value, v, __ATOMIC_SEQ_CST);
+}
+#elif defined(_MSC_VER)
+/* `off_t` is a 32-bit `long` with MSVC, but not with every Windows CRT */
+off_t acquire_atomic_load_off(const volatile off_t *value) {
+  if (sizeof(off_t) == 8)
+    return (off_t)InterlockedCompareExchange64((volatile LONG64 *)value, 0, 0);
+  return (off_t)InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+}
+void acquire_atomic_store_off(volatile off_t *value, off_t v) {
+  if (sizeof(off_t) == 8)
+    InterlockedExchange64((volatile LONG64 *)value, (LONG64)v);
+  else
+    InterlockedExchange((volatile LONG *)value, (LONG)v);
+}
+void acquire_atomic_add_off(volatile off_t *value, off_t delta) {
+  if (sizeof(off_t) == 8)
+    InterlockedExchangeAdd64((volatile LONG64 *)value, (LONG64)delta);
+  else
+    InterlockedExchangeAdd((volatile LONG *)value, (LONG)delta);
+}
+int acquire_atomic_load_int(const volatile int *value) {
+  return (int)InterlockedCompareExchange((volatile LONG *)value, 0, 0);
+}
+void acquire_atomic_store_int(volatile int *value, int v) {
+  InterlockedExchange((volatile LONG *)value, (LONG)v);
+}
+#else
+off_t acquire_atomic_load_off(const volatile off_t *value) { return *value; }
+void acquire_atomic_store_off(volatile off_t *value, off_t v) { *value = v; }
+void acquire_atomic_add_off(volatile off_t *value, off_t delta) {
+  *value += delta;
+}
+int acquire_atomic_load_int(const volatile int *value) { return *value; }
+void acquire_atomic_store_int(volatile int *value, int v) { *value = v; }
+#endif
+
+#endif /* ACQUIRE_THREADS_IMPL_ */
+#endif /* LIBACQUIRE_IMPLEMENTATION */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_THREADS_H */
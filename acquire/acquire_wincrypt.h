@@ -9,6 +9,7 @@ extern "C" {
 
 #include "acquire_common_defs.h"
 #include "acquire_string_extras.h"
+#include "acquire_threads.h"
 #include "acquire_windows.h"
 
 #include <Guiddef.h>
@@ -27,20 +28,17 @@ void _wincrypt_verify_async_cancel(struct acquire_handle *handle);
 
 #ifdef LIBACQUIRE_IMPLEMENTATION
 
+#include "acquire_file_reader.h"
 #include "acquire_handle.h"
 #include "acquire_string_extras.h"
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifndef CHUNK_SIZE
-#define CHUNK_SIZE 4096
-#endif /* !CHUNK_SIZE */
-
 struct wincrypt_backend {
   HCRYPTPROV hProv;
   HCRYPTHASH hHash;
-  FILE *file;
+  struct acquire_file_reader reader;
   char expected_hash[130];
   ALG_ID alg_id;
 };
@@ -62,8 +60,7 @@ static void cleanup_wincrypt_backend(struct acquire_handle *handle) {
       CryptDestroyHash(be->hHash);
     if (be->hProv)
       CryptReleaseContext(be->hProv, 0);
-    if (be->file)
-      fclose(be->file);
+    acquire_file_reader_close(&be->reader);
     free(be);
     handle->backend_handle = NULL;
   }
@@ -97,14 +94,14 @@ int _wincrypt_verify_async_start(struct acquire_handle *handle,
     acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY, "wincrypt");
     return -1;
   }
-  {
-    const errno_t err = fopen_s(&be->file, filepath, "rb");
-    if (err != 0 || be->file == NULL) {
-      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
-                               "Cannot open file: %s", filepath);
-      free(be);
-      return -1;
-    }
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+    free(be);
+    return -1;
   }
   if (!CryptAcquireContext(&be->hProv, NULL, NULL, PROV_RSA_AES,
                            CRYPT_VERIFYCONTEXT) ||
@@ -134,33 +131,41 @@ int _wincrypt_verify_async_start(struct acquire_handle *handle,
 
 enum acquire_status _wincrypt_verify_async_poll(struct acquire_handle *handle) {
   struct wincrypt_backend *be;
-  unsigned char buffer[CHUNK_SIZE];
-  size_t bytes_read;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
   if (!handle || !handle->backend_handle)
     return ACQUIRE_ERROR;
   if (handle->status != ACQUIRE_IN_PROGRESS)
     return handle->status;
-  if (handle->cancel_flag) {
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED, "Cancelled");
-    cleanup_wincrypt_backend(handle);
-    return ACQUIRE_ERROR;
-  }
   be = (struct wincrypt_backend *)handle->backend_handle;
-  bytes_read = fread(buffer, 1, sizeof(buffer), be->file);
-  if (bytes_read > 0) {
-    if (!CryptHashData(be->hHash, buffer, (DWORD)bytes_read, 0)) {
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED, "Cancelled");
+      cleanup_wincrypt_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
+    if (!CryptHashData(be->hHash, (BYTE *)buffer, (DWORD)bytes_read, 0)) {
       acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
                                "CryptHashData failed");
-    } else {
-      handle->bytes_processed += (off_t)bytes_read;
-      return ACQUIRE_IN_PROGRESS;
+      cleanup_wincrypt_backend(handle);
+      return ACQUIRE_ERROR;
     }
-  }
-  if (ferror(be->file)) {
-    char error_code[256];
-    strerror_s(error_code, sizeof(error_code), errno);
-    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
-                             "File read error: %s", error_code);
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
   } else {
     BYTE hash[64];
     DWORD hash_len = sizeof(hash);
@@ -193,7 +198,7 @@ enum acquire_status _wincrypt_verify_async_poll(struct acquire_handle *handle) {
 
 void _wincrypt_verify_async_cancel(struct acquire_handle *handle) {
   if (handle)
-    handle->cancel_flag = 1;
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
 }
 
 #endif /* LIBACQUIRE_IMPLEMENTATION */
@@ -5,13 +5,18 @@
     defined(LIBACQUIRE_IMPLEMENTATION)
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "acquire_windows.h"
 
+#include <io.h>
 #include <wininet.h>
 
+#include "acquire_blocks.h"
 #include "acquire_download.h"
+#include "acquire_fileutils.h"
+#include "acquire_multi_digest.h"
 
 #ifdef LIBACQUIRE_DOWNLOAD_DIR_IMPL
 const char *get_download_dir(void) { return ".downloads"; }
@@ -19,16 +24,14 @@ const char *get_download_dir(void) { return ".downloads"; }
 
 /* --- Synchronous API --- */
 
-/**
- * @brief Downloads a file synchronously (blocking) using WinINet.
- * This is the main implementation for this backend.
- */
-int acquire_download_sync(struct acquire_handle *handle, const char *url,
-                          const char *dest_path) {
+/* Download `url` to `dest_path`, from `resume_from` if not `0` */
+static int wininet_download(struct acquire_handle *handle, const char *url,
+                            const char *dest_path, off_t resume_from) {
   HINTERNET h_internet, h_url;
   DWORD bytes_read, content_len_size = sizeof(handle->total_size),
                     dwStatusCode = 0, dwSize = sizeof(dwStatusCode);
   char buffer[4096];
+  char range[64];
 
   if (!handle || !url || !dest_path) {
     if (handle)
@@ -36,6 +39,17 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
                                "Invalid arguments for sync download");
     return -1;
   }
+  handle->cancel_flag = 0;
+  if (resume_from > 0 && filesize(dest_path) < resume_from) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_READ_FAILED,
+                             "Destination file is shorter than the "
+                             "checkpoint: %s",
+                             dest_path);
+    return -1;
+  }
+  sprintf_s(range, sizeof(range), "Range: bytes=%lld-\r\n",
+            (long long)resume_from);
+  handle->bytes_processed = resume_from;
 
   h_internet = InternetOpen("acquire_wininet", INTERNET_OPEN_TYPE_PRECONFIG,
                             NULL, NULL, 0);
@@ -45,7 +59,8 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
     return -1;
   }
 
-  h_url = InternetOpenUrl(h_internet, url, NULL, 0,
+  h_url = InternetOpenUrl(h_internet, url, resume_from > 0 ? range : NULL,
+                          resume_from > 0 ? (DWORD)-1L : 0,
                           INTERNET_FLAG_RELOAD | INTERNET_FLAG_SECURE, 0);
   if (h_url == NULL) {
     acquire_handle_set_error(handle, ACQUIRE_ERROR_HOST_NOT_FOUND,
@@ -61,11 +76,23 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
                                "HTTP error: %lu", dwStatusCode);
       goto fail;
     }
+    /* A whole file in reply would be written after the part already kept */
+    if (resume_from > 0 && dwStatusCode != 206) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
+                               "Server cannot resume: HTTP %lu",
+                               dwStatusCode);
+      goto fail;
+    }
   }
 
   {
-    const errno_t err = fopen_s(&handle->output_file, dest_path, "wb");
-    if (err != 0 || handle->output_file == NULL) {
+    /* Keep what the checkpoint covers, and write after it */
+    const errno_t err = fopen_s(&handle->output_file, dest_path,
+                                resume_from > 0 ? "r+b" : "wb");
+    if (err != 0 || handle->output_file == NULL ||
+        (resume_from > 0 &&
+         (_chsize_s(_fileno(handle->output_file), resume_from) != 0 ||
+          _fseeki64(handle->output_file, resume_from, SEEK_SET) != 0))) {
       acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
                                "Failed to open destination file: %s",
                                dest_path);
@@ -74,8 +101,9 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
   }
 
   /* Query file size for progress reporting */
-  HttpQueryInfo(h_url, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER,
-                (LPVOID)&handle->total_size, &content_len_size, NULL);
+  if (HttpQueryInfo(h_url, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER,
+                    (LPVOID)&handle->total_size, &content_len_size, NULL))
+    handle->total_size += resume_from;
 
   while (InternetReadFile(h_url, buffer, sizeof(buffer), &bytes_read) &&
          bytes_read > 0) {
@@ -85,6 +113,14 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
       goto fail;
     }
     fwrite(buffer, 1, bytes_read, handle->output_file);
+    /* Hash the buffer while it is still hot instead of rereading the file */
+    if (handle->download_digest &&
+        acquire_digest_stream_update(handle->download_digest, buffer,
+                                     bytes_read) != 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "Hashing the download failed");
+      goto fail;
+    }
     handle->bytes_processed += (off_t)bytes_read;
   }
 
@@ -92,6 +128,9 @@ int acquire_download_sync(struct acquire_handle *handle, const char *url,
   handle->output_file = NULL;
   InternetCloseHandle(h_url);
   InternetCloseHandle(h_internet);
+  if (handle->download_digest &&
+      acquire_digest_stream_finish(handle->download_digest, handle) != 0)
+    return -1;
   handle->status = ACQUIRE_COMPLETE;
   return 0;
 
@@ -104,6 +143,15 @@ fail:
   return -1;
 }
 
+/**
+ * @brief Downloads a file synchronously (blocking) using WinINet.
+ * This is the main implementation for this backend.
+ */
+int acquire_download_sync(struct acquire_handle *handle, const char *url,
+                          const char *dest_path) {
+  return wininet_download(handle, url, dest_path, 0);
+}
+
 /* --- Asynchronous API (Faked) --- */
 
 /**
@@ -133,6 +181,121 @@ enum acquire_status acquire_download_async_poll(struct acquire_handle *handle) {
   return handle->status;
 }
 
+/**
+ * @brief The download is over by the time start returns, so there is never
+ * anything to watch.
+ */
+int acquire_download_get_fds(struct acquire_handle *handle,
+                             struct acquire_download_fd *fds, size_t max,
+                             long *timeout_ms) {
+  (void)fds;
+  (void)max;
+  if (handle == NULL || timeout_ms == NULL) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  *timeout_ms = -1;
+  return 0;
+}
+
+enum acquire_status
+acquire_download_socket_action(struct acquire_handle *handle,
+                               acquire_socket_t fd, int events) {
+  (void)fd;
+  (void)events;
+  return acquire_download_async_poll(handle);
+}
+
+/*
+ * Downloads here finish inside their start call, so an engine never has
+ * any in progress; it exists so that the same code runs on every backend.
+ */
+struct acquire_engine {
+  acquire_socket_fn socket_fn;
+  acquire_timer_fn timer_fn;
+  void *event_data;
+};
+
+struct acquire_engine *acquire_engine_create(void) {
+  return (struct acquire_engine *)calloc(1, sizeof(struct acquire_engine));
+}
+
+void acquire_engine_free(struct acquire_engine *engine) { free(engine); }
+
+int acquire_engine_poll(struct acquire_engine *engine,
+                        unsigned long max_wait_msec) {
+  (void)max_wait_msec;
+  return engine ? 0 : -1;
+}
+
+int acquire_engine_get_fds(struct acquire_engine *engine,
+                           struct acquire_download_fd *fds, size_t max,
+                           long *timeout_ms) {
+  (void)fds;
+  (void)max;
+  if (engine == NULL || timeout_ms == NULL)
+    return -1;
+  *timeout_ms = -1;
+  return 0;
+}
+
+int acquire_engine_socket_action(struct acquire_engine *engine,
+                                 acquire_socket_t fd, int events) {
+  (void)fd;
+  (void)events;
+  return engine ? 0 : -1;
+}
+
+void acquire_engine_set_event_hooks(struct acquire_engine *engine,
+                                    acquire_socket_fn socket_fn,
+                                    acquire_timer_fn timer_fn,
+                                    void *user_data) {
+  if (!engine)
+    return;
+  engine->socket_fn = socket_fn;
+  engine->timer_fn = timer_fn;
+  engine->event_data = user_data;
+}
+
+int acquire_engine_set_origin_limits(struct acquire_engine *engine,
+                                     long max_connections, long max_streams) {
+  if (!engine || max_connections < 0 || max_streams < 1)
+    return -1;
+  return 0;
+}
+
+/* Each download blocks here, so a batch runs them one after another */
+int acquire_download_batch(struct acquire_engine *engine,
+                           const struct acquire_download_item *items,
+                           size_t count) {
+  size_t i;
+  int failed = 0;
+  (void)engine;
+  if (!items && count > 0)
+    return -1;
+  for (i = 0; i < count; i++)
+    if (!items[i].handle)
+      return -1;
+  for (i = 0; i < count; i++)
+    if (acquire_download_sync(items[i].handle, items[i].url,
+                              items[i].dest_path) != 0)
+      failed++;
+  return failed;
+}
+
+/* Nothing here is shared between downloads yet */
+struct acquire_session {
+  int unused;
+};
+
+struct acquire_session *acquire_session_create(void) {
+  return (struct acquire_session *)calloc(1, sizeof(struct acquire_session));
+}
+
+void acquire_session_free(struct acquire_session *session) { free(session); }
+
 /**
  * @brief Requests cancellation.
  * TODO: True cancellation is impossible here as the sync function blocks.
@@ -143,6 +306,204 @@ void acquire_download_async_cancel(struct acquire_handle *handle) {
   }
 }
 
+/* --- Verified API --- */
+
+/* Run a verified download, from `checkpoint` unless that is `NULL` */
+static int wininet_verified_download(struct acquire_handle *handle,
+                                     const char *url, const char *dest_path,
+                                     enum Checksum algorithm,
+                                     const char *expected_hash,
+                                     const void *checkpoint,
+                                     size_t checkpoint_size) {
+  struct acquire_digest_spec spec;
+  int rc;
+  if (!handle)
+    return -1;
+  spec.algorithm = algorithm;
+  spec.expected_hash = expected_hash;
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest =
+      checkpoint ? acquire_digest_stream_resume(handle, &spec, 1, checkpoint,
+                                                checkpoint_size)
+                 : acquire_digest_stream_new(handle, &spec, 1);
+  if (!handle->download_digest)
+    return -1;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  rc = wininet_download(
+      handle, url, dest_path,
+      checkpoint ? acquire_checkpoint_offset(checkpoint, checkpoint_size) : 0);
+  /* That blocked until the end, so the stream is done with either way */
+  acquire_digest_stream_free(handle->download_digest);
+  handle->download_digest = NULL;
+  return rc;
+}
+
+int acquire_download_verified_async_start(struct acquire_handle *handle,
+                                          const char *url,
+                                          const char *dest_path,
+                                          enum Checksum algorithm,
+                                          const char *expected_hash) {
+  return wininet_verified_download(handle, url, dest_path, algorithm,
+                                   expected_hash, NULL, 0);
+}
+
+int acquire_download_verified_resume_async_start(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    enum Checksum algorithm, const char *expected_hash,
+    const void *checkpoint, size_t checkpoint_size) {
+  if (!checkpoint) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Not a checkpoint");
+    return -1;
+  }
+  return wininet_verified_download(handle, url, dest_path, algorithm,
+                                   expected_hash, checkpoint, checkpoint_size);
+}
+
+int acquire_download_verified_sync(struct acquire_handle *handle,
+                                   const char *url, const char *dest_path,
+                                   enum Checksum algorithm,
+                                   const char *expected_hash) {
+  return acquire_download_verified_async_start(handle, url, dest_path,
+                                               algorithm, expected_hash);
+}
+
+/* --- Block repair --- */
+
+/* Copy bytes `first` to `last` of `url` into `out` at `first` */
+static int wininet_range(struct acquire_handle *handle, HINTERNET h_internet,
+                         const char *url, FILE *out, off_t first,
+                         off_t last) {
+  HINTERNET h_url;
+  DWORD bytes_read, dwStatusCode = 0, dwSize = sizeof(dwStatusCode);
+  char buffer[4096];
+  char range[96];
+  off_t left = last - first + 1;
+
+  sprintf_s(range, sizeof(range), "Range: bytes=%lld-%lld\r\n",
+            (long long)first, (long long)last);
+  h_url = InternetOpenUrl(h_internet, url, range, (DWORD)-1L,
+                          INTERNET_FLAG_RELOAD | INTERNET_FLAG_SECURE, 0);
+  if (h_url == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_HOST_NOT_FOUND,
+                             "InternetOpenUrl failed");
+    return -1;
+  }
+  if (HttpQueryInfo(h_url, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER,
+                    &dwStatusCode, &dwSize, NULL)) {
+    if (dwStatusCode >= 400) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
+                               "HTTP error: %lu", dwStatusCode);
+      left = -1;
+    } else if (dwStatusCode != 206) {
+      /* The whole file in reply would land in the middle of this one */
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_HTTP_FAILURE,
+                               "Server cannot send ranges: HTTP %lu",
+                               dwStatusCode);
+      left = -1;
+    }
+  }
+  if (left > 0 && _fseeki64(out, first, SEEK_SET) != 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot seek in destination file");
+    left = -1;
+  }
+  while (left > 0 &&
+         InternetReadFile(h_url, buffer,
+                          left < (off_t)sizeof(buffer) ? (DWORD)left
+                                                       : sizeof(buffer),
+                          &bytes_read) &&
+         bytes_read > 0) {
+    if (handle->cancel_flag) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Repair cancelled");
+      left = -1;
+      break;
+    }
+    if (fwrite(buffer, 1, bytes_read, out) != bytes_read) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                               "Cannot write destination file");
+      left = -1;
+      break;
+    }
+    left -= (off_t)bytes_read;
+    handle->bytes_processed += (off_t)bytes_read;
+  }
+  InternetCloseHandle(h_url);
+  if (left > 0)
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_FAILURE,
+                             "Server sent too little of %s", url);
+  return left == 0 ? 0 : -1;
+}
+
+int acquire_download_repair_blocks(
+    struct acquire_handle *handle, const char *url, const char *dest_path,
+    const struct acquire_block_manifest *manifest, const size_t *blocks,
+    size_t count) {
+  HINTERNET h_internet;
+  FILE *out = NULL;
+  size_t pos = 0;
+  off_t first, last;
+  int more, rc = 0, still_bad;
+  if (!handle || !url || !dest_path || !manifest || (count && !blocks)) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  handle->status = ACQUIRE_IN_PROGRESS;
+  handle->cancel_flag = 0;
+  handle->bytes_processed = 0;
+  if (fopen_s(&out, dest_path, "r+b") != 0 || out == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                             "Failed to open destination file: %s", dest_path);
+    return -1;
+  }
+  h_internet = InternetOpen("acquire_wininet", INTERNET_OPEN_TYPE_PRECONFIG,
+                            NULL, NULL, 0);
+  if (h_internet == NULL) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_NETWORK_INIT_FAILED,
+                             "InternetOpen failed");
+    fclose(out);
+    return -1;
+  }
+  while (rc == 0 && (more = acquire_block_range(manifest, blocks, count, &pos,
+                                                &first, &last)) != 0) {
+    if (more < 0) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Blocks must be listed once, in order");
+      rc = -1;
+    } else {
+      rc = wininet_range(handle, h_internet, url, out, first, last);
+    }
+  }
+  InternetCloseHandle(h_internet);
+  if (_chsize_s(_fileno(out), manifest->size) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot truncate %s", dest_path);
+    rc = -1;
+  }
+  if (fclose(out) != 0 && rc == 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_FILE_WRITE_FAILED,
+                             "Cannot write %s", dest_path);
+    rc = -1;
+  }
+  if (rc != 0)
+    return -1;
+  still_bad = acquire_verify_block_list(handle, dest_path, manifest, blocks,
+                                        count, NULL, 0);
+  if (still_bad < 0)
+    return -1;
+  if (still_bad > 0) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+                             "%d of %lu repaired blocks still do not match",
+                             still_bad, (unsigned long)count);
+    return -1;
+  }
+  return 0;
+}
+
 #endif /* defined(LIBACQUIRE_USE_WININET) && LIBACQUIRE_USE_WININET &&         \
           defined(LIBACQUIRE_IMPLEMENTATION) */
 
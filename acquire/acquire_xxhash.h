@@ -0,0 +1,493 @@
+#ifndef LIBACQUIRE_ACQUIRE_XXHASH_H
+#define LIBACQUIRE_ACQUIRE_XXHASH_H
+
+/*
+ * XXH3 (64-bit) and XXH128 verification using the vendored xxHash in
+ * `xxhash/xxhash.h`. These are not cryptographic: use them to catch
+ * corruption between trusted peers, where they run at memory bandwidth.
+ * Hex digests are xxHash's canonical (big-endian) form, as printed by
+ * `xxhsum -H3` and `xxhsum -H2`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+#include "acquire_common_defs.h"
+#include "libacquire_export.h"
+
+struct acquire_handle; /* Forward declaration */
+
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+
+/* Implementations of the XXH3 long-input loop, selected at runtime */
+enum acquire_xxhash_kernel {
+  /* Compile-time default: SSE2 on x86-64, NEON on AArch64, else scalar */
+  ACQUIRE_XXHASH_KERNEL_BASELINE,
+  ACQUIRE_XXHASH_KERNEL_AVX2,
+  ACQUIRE_XXHASH_KERNEL_AVX512
+};
+
+/**
+ * @brief Report which kernel the verification backend uses on this machine.
+ */
+extern LIBACQUIRE_EXPORT enum acquire_xxhash_kernel
+acquire_xxhash_active_kernel(void);
+
+/**
+ * @brief Check whether `kernel` was compiled in and this CPU can run it.
+ *
+ * @return `1` if the kernel can be used, otherwise `0`.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_xxhash_kernel_supported(enum acquire_xxhash_kernel kernel);
+
+/**
+ * @brief Hash `len` bytes of `data` and write the canonical hex digest.
+ *
+ * @param algorithm `LIBACQUIRE_XXH3_64` or `LIBACQUIRE_XXH128`.
+ * @param kernel Kernel to use; unsupported ones fall back to the baseline.
+ * @param hex Receives 16 (XXH3_64) or 32 (XXH128) hex digits plus a NUL.
+ *
+ * @return `0` on success, `-1` for another algorithm or allocation failure.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_xxhash_hex(enum Checksum algorithm, enum acquire_xxhash_kernel kernel,
+                   const void *data, size_t len, char hex[33]);
+
+/* Incremental XXH3_64/XXH128 state; opaque since xxHash stays internal */
+struct acquire_xxhash_hasher;
+
+/**
+ * @brief Start an incremental hash on the active kernel.
+ *
+ * @param algorithm `LIBACQUIRE_XXH3_64` or `LIBACQUIRE_XXH128`.
+ *
+ * @return A hasher to free with `acquire_xxhash_free`, or `NULL` for another
+ * algorithm or on allocation failure.
+ */
+extern LIBACQUIRE_EXPORT struct acquire_xxhash_hasher *
+acquire_xxhash_create(enum Checksum algorithm);
+
+/**
+ * @brief Add `len` bytes of `data` to the hash.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_xxhash_update(struct acquire_xxhash_hasher *hasher, const void *data,
+                      size_t len);
+
+/**
+ * @brief Write the canonical hex digest of everything hashed so far.
+ *
+ * The hasher is left untouched, so more data may still be added.
+ */
+extern LIBACQUIRE_EXPORT void
+acquire_xxhash_final_hex(const struct acquire_xxhash_hasher *hasher,
+                         char hex[33]);
+
+extern LIBACQUIRE_EXPORT void
+acquire_xxhash_free(struct acquire_xxhash_hasher *hasher);
+
+/**
+ * @brief Copy the hasher's state to `out`, for `acquire_xxhash_restore`.
+ *
+ * The bytes only mean something to the same build of the library on the
+ * same kind of machine.
+ *
+ * @return Bytes the state takes; nothing is written if `size` is smaller.
+ */
+extern LIBACQUIRE_EXPORT size_t
+acquire_xxhash_save(const struct acquire_xxhash_hasher *hasher, void *out,
+                    size_t size);
+
+/**
+ * @brief Replace the hasher's state with one from `acquire_xxhash_save`.
+ *
+ * The hasher must be of the same algorithm as the one saved, and unseeded.
+ *
+ * @return `0` on success, `-1` if `in` is not a state such a hasher could
+ * be in; the hasher is then unchanged.
+ */
+extern LIBACQUIRE_EXPORT int
+acquire_xxhash_restore(struct acquire_xxhash_hasher *hasher, const void *in,
+                       size_t size);
+
+int _xxhash_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash);
+enum acquire_status _xxhash_verify_async_poll(struct acquire_handle *handle);
+void _xxhash_verify_async_cancel(struct acquire_handle *handle);
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+
+#if defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_XXHASH) &&    \
+    LIBACQUIRE_USE_XXHASH
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "acquire_string_extras.h"
+#include "acquire_threads.h"
+
+/*
+ * Build the AVX2 and AVX-512 accumulate loops alongside the baseline one,
+ * as xxHash's own `xxh_x86dispatch.c` does, and pick between them at runtime
+ * so the library itself can still be compiled for plain x86-64.
+ */
+#if (defined(__x86_64__) || defined(_M_X64)) &&                                \
+    (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#define LIBACQUIRE_XXHASH_HAVE_X86 1
+#define XXH_X86DISPATCH 1
+#define XXH_DISPATCH_AVX2 1
+#define XXH_DISPATCH_AVX512 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define XXH_TARGET_AVX2
+#define XXH_TARGET_AVX512
+#else
+#define XXH_TARGET_AVX2 __attribute__((target("avx2")))
+#define XXH_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+#endif /* x86-64 */
+
+/* Everything `static`, so nothing of xxHash leaks out of this library */
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+
+#ifdef LIBACQUIRE_XXHASH_HAVE_X86
+XXH_TARGET_AVX2 static XXH_errorcode
+xxhash_update_avx2(XXH3_state_t *state, const void *input, size_t len) {
+  return XXH3_update(state, (const xxh_u8 *)input, len, XXH3_accumulate_avx2,
+                     XXH3_scrambleAcc_avx2);
+}
+
+XXH_TARGET_AVX512 static XXH_errorcode
+xxhash_update_avx512(XXH3_state_t *state, const void *input, size_t len) {
+  return XXH3_update(state, (const xxh_u8 *)input, len,
+                     XXH3_accumulate_avx512, XXH3_scrambleAcc_avx512);
+}
+
+static int xxhash_cpu_has(enum acquire_xxhash_kernel kernel) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  unsigned __int64 xcr0;
+  __cpuid(info, 1);
+  if (!((info[2] >> 27) & 1)) /* OSXSAVE: the OS manages extended state */
+    return 0;
+  xcr0 = _xgetbv(0);
+  __cpuidex(info, 7, 0);
+  if (kernel == ACQUIRE_XXHASH_KERNEL_AVX2)
+    return (xcr0 & 0x6) == 0x6 && ((info[1] >> 5) & 1);
+  return (xcr0 & 0xE6) == 0xE6 && ((info[1] >> 16) & 1);
+#else
+  __builtin_cpu_init();
+  if (kernel == ACQUIRE_XXHASH_KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2") != 0;
+  return __builtin_cpu_supports("avx512f") != 0;
+#endif /* defined(_MSC_VER) && !defined(__clang__) */
+}
+#endif /* LIBACQUIRE_XXHASH_HAVE_X86 */
+
+int acquire_xxhash_kernel_supported(enum acquire_xxhash_kernel kernel) {
+  switch (kernel) {
+  case ACQUIRE_XXHASH_KERNEL_BASELINE:
+    return 1;
+#ifdef LIBACQUIRE_XXHASH_HAVE_X86
+  case ACQUIRE_XXHASH_KERNEL_AVX2:
+  case ACQUIRE_XXHASH_KERNEL_AVX512:
+    return xxhash_cpu_has(kernel);
+#endif /* LIBACQUIRE_XXHASH_HAVE_X86 */
+  default:
+    return 0;
+  }
+}
+
+/* Set by `xxhash_resolve` from what the CPU reports */
+static enum acquire_xxhash_kernel xxhash_active_id =
+    ACQUIRE_XXHASH_KERNEL_BASELINE;
+static acquire_once_t xxhash_active_once = ACQUIRE_ONCE_INIT;
+
+static void xxhash_resolve(void) {
+  enum acquire_xxhash_kernel kernel = ACQUIRE_XXHASH_KERNEL_BASELINE;
+  if (acquire_xxhash_kernel_supported(ACQUIRE_XXHASH_KERNEL_AVX512))
+    kernel = ACQUIRE_XXHASH_KERNEL_AVX512;
+  else if (acquire_xxhash_kernel_supported(ACQUIRE_XXHASH_KERNEL_AVX2))
+    kernel = ACQUIRE_XXHASH_KERNEL_AVX2;
+  xxhash_active_id = kernel;
+}
+
+enum acquire_xxhash_kernel acquire_xxhash_active_kernel(void) {
+  acquire_once(&xxhash_active_once, xxhash_resolve);
+  return xxhash_active_id;
+}
+
+static void xxhash_update(enum acquire_xxhash_kernel kernel,
+                          XXH3_state_t *state, const void *input, size_t len) {
+#ifdef LIBACQUIRE_XXHASH_HAVE_X86
+  if (kernel == ACQUIRE_XXHASH_KERNEL_AVX512) {
+    xxhash_update_avx512(state, input, len);
+    return;
+  }
+  if (kernel == ACQUIRE_XXHASH_KERNEL_AVX2) {
+    xxhash_update_avx2(state, input, len);
+    return;
+  }
+#endif /* LIBACQUIRE_XXHASH_HAVE_X86 */
+  (void)kernel;
+  XXH3_64bits_update(state, input, len);
+}
+
+/* The 64 and 128 bit variants share their state; only the digest differs */
+static void xxhash_digest_hex(enum Checksum algorithm,
+                              const XXH3_state_t *state, char hex[33]) {
+  unsigned char bytes[16];
+  size_t n, i;
+  if (algorithm == LIBACQUIRE_XXH128) {
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(state));
+    memcpy(bytes, canonical.digest, 16);
+    n = 16;
+  } else {
+    XXH64_canonical_t canonical;
+    XXH64_canonicalFromHash(&canonical, XXH3_64bits_digest(state));
+    memcpy(bytes, canonical.digest, 8);
+    n = 8;
+  }
+  for (i = 0; i < n; i++)
+    snprintf(hex + 2 * i, 3, "%02x", bytes[i]);
+}
+
+int acquire_xxhash_hex(enum Checksum algorithm,
+                       enum acquire_xxhash_kernel kernel, const void *data,
+                       size_t len, char hex[33]) {
+  XXH3_state_t *state;
+  if (algorithm != LIBACQUIRE_XXH3_64 && algorithm != LIBACQUIRE_XXH128)
+    return -1;
+  if (!hex || (!data && len > 0))
+    return -1;
+  state = XXH3_createState();
+  if (!state)
+    return -1;
+  XXH3_64bits_reset(state);
+  if (!acquire_xxhash_kernel_supported(kernel))
+    kernel = ACQUIRE_XXHASH_KERNEL_BASELINE;
+  xxhash_update(kernel, state, data, len);
+  xxhash_digest_hex(algorithm, state, hex);
+  XXH3_freeState(state);
+  return 0;
+}
+
+struct acquire_xxhash_hasher {
+  XXH3_state_t *state;
+  enum Checksum algorithm;
+  enum acquire_xxhash_kernel kernel;
+};
+
+struct acquire_xxhash_hasher *acquire_xxhash_create(enum Checksum algorithm) {
+  struct acquire_xxhash_hasher *hasher;
+  if (algorithm != LIBACQUIRE_XXH3_64 && algorithm != LIBACQUIRE_XXH128)
+    return NULL;
+  hasher = (struct acquire_xxhash_hasher *)malloc(sizeof(*hasher));
+  if (!hasher)
+    return NULL;
+  hasher->state = XXH3_createState();
+  if (!hasher->state) {
+    free(hasher);
+    return NULL;
+  }
+  XXH3_64bits_reset(hasher->state);
+  hasher->algorithm = algorithm;
+  hasher->kernel = acquire_xxhash_active_kernel();
+  return hasher;
+}
+
+void acquire_xxhash_update(struct acquire_xxhash_hasher *hasher,
+                           const void *data, size_t len) {
+  if (hasher && (data || len == 0))
+    xxhash_update(hasher->kernel, hasher->state, data, len);
+}
+
+void acquire_xxhash_final_hex(const struct acquire_xxhash_hasher *hasher,
+                              char hex[33]) {
+  if (hasher && hex)
+    xxhash_digest_hex(hasher->algorithm, hasher->state, hex);
+}
+
+void acquire_xxhash_free(struct acquire_xxhash_hasher *hasher) {
+  if (!hasher)
+    return;
+  XXH3_freeState(hasher->state);
+  free(hasher);
+}
+
+size_t acquire_xxhash_save(const struct acquire_xxhash_hasher *hasher,
+                           void *out, size_t size) {
+  if (!hasher)
+    return 0;
+  if (out && size >= sizeof(XXH3_state_t))
+    memcpy(out, hasher->state, sizeof(XXH3_state_t));
+  return sizeof(XXH3_state_t);
+}
+
+int acquire_xxhash_restore(struct acquire_xxhash_hasher *hasher,
+                           const void *in, size_t size) {
+  XXH3_state_t saved;
+  if (!hasher || !in || size != sizeof(XXH3_state_t))
+    return -1;
+  memcpy(&saved, in, sizeof(saved));
+  /* Only an unseeded state with the default secret's geometry, as
+   * `acquire_xxhash_new` makes, keeps the update loop inside its buffers */
+  if (saved.bufferedSize > XXH3_INTERNALBUFFER_SIZE ||
+      saved.bufferedSize > saved.totalLen || saved.useSeed != 0 ||
+      saved.seed != 0 ||
+      saved.nbStripesPerBlock != hasher->state->nbStripesPerBlock ||
+      saved.secretLimit != hasher->state->secretLimit ||
+      saved.nbStripesSoFar >= saved.nbStripesPerBlock)
+    return -1;
+  /* The saved pointer is to the default secret in another process, maybe;
+   * the freshly reset state already points at this one's */
+  saved.extSecret = hasher->state->extSecret;
+  memcpy(hasher->state, &saved, sizeof(saved));
+  return 0;
+}
+
+/******************************
+ * Verification backend       *
+ ******************************/
+
+struct xxhash_backend {
+  struct acquire_file_reader reader;
+  XXH3_state_t *state;
+  enum Checksum algorithm;
+  enum acquire_xxhash_kernel kernel;
+  char expected_hash[33];
+};
+
+static void cleanup_xxhash_backend(struct acquire_handle *handle) {
+  struct xxhash_backend *be;
+  if (!handle || !handle->backend_handle)
+    return;
+  be = (struct xxhash_backend *)handle->backend_handle;
+  acquire_file_reader_close(&be->reader);
+  if (be->state)
+    XXH3_freeState(be->state);
+  free(be);
+  handle->backend_handle = NULL;
+}
+
+int _xxhash_verify_async_start(struct acquire_handle *handle,
+                               const char *filepath, enum Checksum algorithm,
+                               const char *expected_hash) {
+  struct xxhash_backend *be;
+  size_t hex_len;
+  if (algorithm != LIBACQUIRE_XXH3_64 && algorithm != LIBACQUIRE_XXH128)
+    return -1;
+  if (!handle || !filepath || !expected_hash) {
+    if (handle)
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_INVALID_ARGUMENT,
+                               "Invalid arguments");
+    return -1;
+  }
+  hex_len = algorithm == LIBACQUIRE_XXH128 ? 32 : 16;
+  if (strlen(expected_hash) != hex_len) {
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+                             "Invalid hash length for %s",
+                             algorithm == LIBACQUIRE_XXH128 ? "XXH128"
+                                                            : "XXH3_64");
+    return -1;
+  }
+  be = (struct xxhash_backend *)calloc(1, sizeof(struct xxhash_backend));
+  if (!be || !(be->state = XXH3_createState())) {
+    free(be);
+    acquire_handle_set_error(handle, ACQUIRE_ERROR_OUT_OF_MEMORY,
+                             "Out of memory");
+    return -1;
+  }
+  if (acquire_file_reader_open(&be->reader, filepath, handle->read_buffer_size,
+                               handle->file_reader_flags) != 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_OPEN_FAILED, "Cannot open file: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+    XXH3_freeState(be->state);
+    free(be);
+    return -1;
+  }
+  XXH3_64bits_reset(be->state);
+  be->algorithm = algorithm;
+  be->kernel = acquire_xxhash_active_kernel();
+  memcpy(be->expected_hash, expected_hash, hex_len);
+  be->expected_hash[hex_len] = '\0';
+  handle->backend_handle = be;
+  handle->status = ACQUIRE_IN_PROGRESS;
+  return 0;
+}
+
+enum acquire_status _xxhash_verify_async_poll(struct acquire_handle *handle) {
+  struct xxhash_backend *be;
+  const unsigned char *buffer;
+  size_t bytes_read, bytes_done = 0;
+  int got;
+  double started;
+  if (!handle || !handle->backend_handle)
+    return ACQUIRE_ERROR;
+  if (handle->status != ACQUIRE_IN_PROGRESS)
+    return handle->status;
+  be = (struct xxhash_backend *)handle->backend_handle;
+  started = acquire_clock_seconds();
+  do {
+    if (acquire_atomic_load_int(&handle->cancel_flag)) {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_CANCELLED,
+                               "Operation cancelled");
+      cleanup_xxhash_backend(handle);
+      return ACQUIRE_ERROR;
+    }
+    got = acquire_file_reader_next(&be->reader, &buffer, &bytes_read);
+    if (got <= 0)
+      break;
+    xxhash_update(be->kernel, be->state, buffer, bytes_read);
+    acquire_handle_add_progress(handle, (off_t)bytes_read);
+    bytes_done += bytes_read;
+  } while (!acquire_handle_poll_budget_spent(handle, bytes_done, started));
+  if (got > 0)
+    return ACQUIRE_IN_PROGRESS;
+  if (got < 0) {
+    char reason[128];
+    acquire_handle_set_error(
+        handle, ACQUIRE_ERROR_FILE_READ_FAILED, "File read error: %s",
+        acquire_file_reader_strerror(&be->reader, reason, sizeof(reason)));
+  } else {
+    char computed_hex[33];
+    xxhash_digest_hex(be->algorithm, be->state, computed_hex);
+    if (strncasecmp(computed_hex, be->expected_hash,
+                    strlen(be->expected_hash)) == 0) {
+      handle->status = ACQUIRE_COMPLETE;
+    } else {
+      acquire_handle_set_error(handle, ACQUIRE_ERROR_UNKNOWN,
+                               "%s mismatch: expected %s, got %s",
+                               be->algorithm == LIBACQUIRE_XXH128 ? "XXH128"
+                                                                  : "XXH3_64",
+                               be->expected_hash, computed_hex);
+    }
+  }
+  cleanup_xxhash_backend(handle);
+  return handle->status;
+}
+
+void _xxhash_verify_async_cancel(struct acquire_handle *handle) {
+  if (handle)
+    acquire_atomic_store_int(&handle->cancel_flag, 1);
+}
+
+#endif /* defined(LIBACQUIRE_IMPLEMENTATION) && defined(LIBACQUIRE_USE_XXHASH) \
+          && LIBACQUIRE_USE_XXHASH */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LIBACQUIRE_ACQUIRE_XXHASH_H */
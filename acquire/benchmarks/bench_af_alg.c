@@ -0,0 +1,163 @@
+/*
+ * Kernel AF_ALG against user-space hashing
+ *
+ * Writes a 256 MiB file of zeros then verifies it with SHA256 and SHA512
+ * through each backend this build has: the kernel's AF_ALG sockets fed by
+ * splice, the crypto library's EVP digests, and the bundled SHA-2. Besides
+ * wall-clock throughput it reports the user and system CPU time spent, since
+ * AF_ALG moves the hashing (and the file's pages) into the kernel rather
+ * than making it free: without an offload engine the sum is what to compare.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acquire_checksums.h>
+#include <acquire_common_defs.h>
+#include <acquire_config.h>
+#include <acquire_handle.h>
+
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+
+#include <sys/resource.h>
+
+#include <acquire_af_alg.h>
+
+/* Digests below are of this many zero bytes; change them together */
+#define BENCH_FILE_SIZE 268435456UL
+
+struct bench_case {
+  const char *name;
+  enum Checksum algorithm;
+  const char *digest;
+};
+
+static const struct bench_case bench_cases[] = {
+    {"SHA256", LIBACQUIRE_SHA256,
+     "a6d72ac7690f53be6ae46ba88506bd97302a093f7108472bd9efc3cefda06484"},
+    {"SHA512", LIBACQUIRE_SHA512,
+     "24078827a9a954d8be723eb76b658bf484146d67a47d6f660c72bc641e19a83e"
+     "6c38099559e7ce76a9640d25f242d89f69e54fc235e1532804395aaf3fb3d671"}};
+
+struct bench_backend {
+  const char *name;
+  enum acquire_backend_type backend;
+};
+
+static const struct bench_backend bench_backends[] = {
+    {"AF_ALG", ACQUIRE_BACKEND_CHECKSUM_AF_ALG},
+    {"EVP", ACQUIRE_BACKEND_CHECKSUM_OPENSSL},
+    {"bundled", ACQUIRE_BACKEND_CHECKSUM_SHA2}};
+
+static int write_zero_file(const char *path, unsigned long size) {
+  static const unsigned char zeros[65536];
+  FILE *fh = fopen(path, "wb");
+  if (fh == NULL)
+    return -1;
+  while (size > 0) {
+    const size_t n = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+    if (fwrite(zeros, 1, n, fh) != n) {
+      fclose(fh);
+      return -1;
+    }
+    size -= (unsigned long)n;
+  }
+  return fclose(fh);
+}
+
+static double cpu_seconds(const struct timeval *tv) {
+  return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  char path[1024];
+  int iterations = 3, rc = EXIT_SUCCESS;
+  size_t i, j;
+
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+  if (iterations < 1)
+    iterations = 1;
+
+  snprintf(path, sizeof(path), "%s%s%s", TMPDIR, PATH_SEP,
+           "acquire_bench_af_alg.bin");
+  if (write_zero_file(path, BENCH_FILE_SIZE) != 0) {
+    fprintf(stderr, "Could not write benchmark file: %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  printf("%-8s %-8s %10s %10s %10s\n", "algo", "backend", "MB/s", "user s",
+         "sys s");
+  for (i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+    const struct bench_case *bc = &bench_cases[i];
+    for (j = 0; j < sizeof(bench_backends) / sizeof(bench_backends[0]); j++) {
+      const struct bench_backend *bb = &bench_backends[j];
+      double best = 0.0, user = 0.0, sys = 0.0;
+      int run;
+      for (run = 0; run < iterations; run++) {
+        struct acquire_handle *handle = acquire_handle_init();
+        struct rusage before, after;
+        double started, elapsed;
+        if (handle == NULL) {
+          rc = EXIT_FAILURE;
+          break;
+        }
+        acquire_handle_set_checksum_backend(handle, bb->backend);
+        getrusage(RUSAGE_SELF, &before);
+        started = acquire_clock_seconds();
+        if (acquire_verify_async_start(handle, path, bc->algorithm,
+                                       bc->digest) != 0 ||
+            handle->active_backend != bb->backend) {
+          /* Not built in, or AF_ALG refused: do not time a fallback */
+          if (handle->error.code == ACQUIRE_OK)
+            printf("%-8s %-8s %10s\n", bc->name, bb->name, "unavailable");
+          else {
+            fprintf(stderr, "%s/%s verification failed: %s\n", bc->name,
+                    bb->name, acquire_handle_get_error_string(handle));
+            rc = EXIT_FAILURE;
+          }
+          acquire_verify_async_cancel(handle);
+          while (acquire_verify_async_poll(handle) == ACQUIRE_IN_PROGRESS) {
+          }
+          acquire_handle_free(handle);
+          best = -1.0;
+          break;
+        }
+        while (acquire_verify_async_poll(handle) == ACQUIRE_IN_PROGRESS) {
+        }
+        elapsed = acquire_clock_seconds() - started;
+        getrusage(RUSAGE_SELF, &after);
+        if (handle->status != ACQUIRE_COMPLETE) {
+          fprintf(stderr, "%s/%s verification failed: %s\n", bc->name,
+                  bb->name, acquire_handle_get_error_string(handle));
+          acquire_handle_free(handle);
+          rc = EXIT_FAILURE;
+          best = -1.0;
+          break;
+        }
+        acquire_handle_free(handle);
+        if (elapsed > 0.0 && (double)BENCH_FILE_SIZE / elapsed > best) {
+          best = (double)BENCH_FILE_SIZE / elapsed;
+          user = cpu_seconds(&after.ru_utime) - cpu_seconds(&before.ru_utime);
+          sys = cpu_seconds(&after.ru_stime) - cpu_seconds(&before.ru_stime);
+        }
+      }
+      if (best > 0.0)
+        printf("%-8s %-8s %10.1f %10.3f %10.3f\n", bc->name, bb->name,
+               best / 1e6, user, sys);
+    }
+  }
+
+  remove(path);
+  return rc;
+}
+
+#else
+
+int main(void) {
+  puts("bench_af_alg needs the AF_ALG backend (LIBACQUIRE_USE_AF_ALG)");
+  return EXIT_SUCCESS;
+}
+
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
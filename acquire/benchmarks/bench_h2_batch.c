@@ -0,0 +1,141 @@
+/*
+ * Batched download benchmark
+ *
+ * Downloads one URL `BENCH_FILE_COUNT` times (or as many as the second
+ * argument says) and reports files per second: one after another, one
+ * after another in a session, and as one `acquire_download_batch`, with
+ * and without a limit of one connection to the origin. Point it at a
+ * local HTTP/2 server serving a small file over HTTPS, e.g.
+ * `nghttpd 8443 key.pem cert.pem -d dir`, whose certificate the system
+ * trusts; the batches then share one TLS connection.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <acquire_common_defs.h>
+#include <acquire_config.h>
+#include <acquire_download.h>
+#include <acquire_handle.h>
+
+#define BENCH_FILE_COUNT 200
+
+static void file_path(char *path, size_t len, unsigned long n) {
+  snprintf(path, len, "%s%sacquire_bench_h2_%lu.bin", TMPDIR, PATH_SEP, n);
+}
+
+static void report(const char *name, unsigned long count, double bytes,
+                   double seconds) {
+  if (seconds <= 0.0)
+    seconds = 1e-9;
+  printf("%-28s %12.0f %10.2f\n", name, (double)count / seconds,
+         bytes / seconds / 1e6);
+}
+
+/* Fetch every file on `handle` in turn; returns seconds, `-1` on error */
+static double fetch_singly(struct acquire_handle *handle, const char *url,
+                           const struct acquire_download_item *items,
+                           unsigned long count, double *bytes) {
+  const double started = acquire_clock_seconds();
+  unsigned long n;
+  *bytes = 0.0;
+  for (n = 0; n < count; n++) {
+    if (acquire_download_sync(handle, url, items[n].dest_path) != 0) {
+      fprintf(stderr, "Download failed: %s\n",
+              acquire_handle_get_error_string(handle));
+      return -1.0;
+    }
+    *bytes += (double)acquire_handle_get_progress(handle);
+  }
+  return acquire_clock_seconds() - started;
+}
+
+/* Fetch every file as one batch; returns seconds, `-1` on error */
+static double fetch_batch(struct acquire_engine *engine,
+                          const struct acquire_download_item *items,
+                          unsigned long count, double *bytes) {
+  const double started = acquire_clock_seconds();
+  double seconds;
+  unsigned long n;
+  int failed = acquire_download_batch(engine, items, count);
+  seconds = acquire_clock_seconds() - started;
+  *bytes = 0.0;
+  for (n = 0; n < count; n++)
+    *bytes += (double)acquire_handle_get_progress(items[n].handle);
+  if (failed != 0) {
+    fprintf(stderr, "%d downloads failed, e.g.: %s\n", failed,
+            acquire_handle_get_error_string(items[count - 1].handle));
+    return -1.0;
+  }
+  return seconds;
+}
+
+int main(int argc, char *argv[]) {
+  struct acquire_download_item *items = NULL;
+  struct acquire_session *session = NULL;
+  struct acquire_engine *engine = NULL;
+  struct acquire_handle *handle = NULL;
+  char (*paths)[1024] = NULL;
+  unsigned long count = BENCH_FILE_COUNT, n;
+  double seconds, bytes;
+  int rc = EXIT_FAILURE;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s URL [COUNT]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc > 2)
+    count = strtoul(argv[2], NULL, 10);
+  if (count < 1)
+    count = 1;
+
+  items = (struct acquire_download_item *)calloc(count, sizeof(*items));
+  paths = (char(*)[1024])calloc(count, sizeof(*paths));
+  session = acquire_session_create();
+  engine = acquire_engine_create();
+  handle = acquire_handle_init();
+  if (items == NULL || paths == NULL || session == NULL || engine == NULL ||
+      handle == NULL)
+    goto done;
+  for (n = 0; n < count; n++) {
+    file_path(paths[n], sizeof(paths[n]), n);
+    items[n].url = argv[1];
+    items[n].dest_path = paths[n];
+    items[n].handle = acquire_handle_init();
+    if (items[n].handle == NULL)
+      goto done;
+  }
+
+  printf("%lu downloads of %s\n", count, argv[1]);
+  printf("%-28s %12s %10s\n", "", "files/s", "MB/s");
+  if ((seconds = fetch_singly(handle, argv[1], items, count, &bytes)) < 0)
+    goto done;
+  report("one by one", count, bytes, seconds);
+  acquire_handle_set_session(handle, session);
+  if ((seconds = fetch_singly(handle, argv[1], items, count, &bytes)) < 0)
+    goto done;
+  report("one by one, session", count, bytes, seconds);
+  if ((seconds = fetch_batch(NULL, items, count, &bytes)) < 0)
+    goto done;
+  report("batch", count, bytes, seconds);
+  if (acquire_engine_set_origin_limits(engine, 1,
+                                       ACQUIRE_ENGINE_MAX_STREAMS) != 0 ||
+      (seconds = fetch_batch(engine, items, count, &bytes)) < 0)
+    goto done;
+  report("batch, one connection", count, bytes, seconds);
+  rc = EXIT_SUCCESS;
+
+done:
+  if (items != NULL)
+    for (n = 0; n < count; n++)
+      acquire_handle_free(items[n].handle);
+  if (paths != NULL)
+    for (n = 0; n < count; n++)
+      remove(paths[n]);
+  acquire_handle_free(handle);
+  acquire_engine_free(engine);
+  acquire_session_free(session);
+  free(items);
+  free(paths);
+  return rc;
+}
@@ -0,0 +1,208 @@
+/*
+ * Many-small-files SHA256 benchmark
+ *
+ * Writes a synthetic corpus of `BENCH_FILE_COUNT` files (or as many as the
+ * first argument says) of 256 B to 8 KiB, then reports SHA256 throughput
+ * over it: hashed in memory one file after another, hashed in memory
+ * `ACQUIRE_SHA256_MB_LANES` files at a time with
+ * `acquire_sha256_update_many`, and verified from disk with
+ * `acquire_manifest_verify` on one thread and on every core.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acquire_common_defs.h>
+#include <acquire_config.h>
+#include <acquire_handle.h>
+#include <acquire_manifest.h>
+#include <acquire_sha2.h>
+
+#define BENCH_FILE_COUNT 100000
+#define BENCH_MIN_SIZE 256
+#define BENCH_MAX_SIZE 8192
+/* Files are slices of one pool, so the corpus needs no memory of its own */
+#define BENCH_POOL_SIZE (2 * BENCH_MAX_SIZE)
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+
+static unsigned char pool[BENCH_POOL_SIZE];
+
+static const char *const kernel_names[] = {"portable", "SHA-NI", "ARMv8"};
+
+static const unsigned char *file_data(unsigned long n, size_t *size) {
+  *size = BENCH_MIN_SIZE + (size_t)(n * 7919UL) %
+                               (BENCH_MAX_SIZE - BENCH_MIN_SIZE + 1);
+  return pool + (size_t)(n * 104729UL) % (BENCH_POOL_SIZE - BENCH_MAX_SIZE);
+}
+
+static void file_path(char *path, size_t len, unsigned long n) {
+  snprintf(path, len, "%s%sacquire_bench_many_%lu.bin", TMPDIR, PATH_SEP, n);
+}
+
+/* Hash every file one at a time on `kernel`; returns seconds */
+static double hash_singly(unsigned long count,
+                          enum acquire_sha2_kernel kernel) {
+  struct acquire_sha2_hasher hasher;
+  unsigned char digest[ACQUIRE_SHA512_OUT_LEN];
+  const double started = acquire_clock_seconds();
+  unsigned long n;
+  for (n = 0; n < count; n++) {
+    size_t size;
+    const unsigned char *data = file_data(n, &size);
+    acquire_sha2_init_with_kernel(&hasher, LIBACQUIRE_SHA256, kernel);
+    acquire_sha2_update(&hasher, data, size);
+    acquire_sha2_final(&hasher, digest);
+  }
+  return acquire_clock_seconds() - started;
+}
+
+/* Hash the files a lane-full at a time on `kernel`; returns seconds */
+static double hash_many(unsigned long count, enum acquire_sha2_kernel kernel) {
+  struct acquire_sha2_hasher hashers[ACQUIRE_SHA256_MB_LANES];
+  struct acquire_sha2_hasher *lanes[ACQUIRE_SHA256_MB_LANES];
+  unsigned char digests[ACQUIRE_SHA256_MB_LANES][ACQUIRE_SHA512_OUT_LEN];
+  unsigned char *outs[ACQUIRE_SHA256_MB_LANES];
+  const void *inputs[ACQUIRE_SHA256_MB_LANES];
+  size_t sizes[ACQUIRE_SHA256_MB_LANES];
+  const double started = acquire_clock_seconds();
+  unsigned long n;
+  size_t i, lanes_used;
+  for (n = 0; n < count; n += lanes_used) {
+    lanes_used = count - n < ACQUIRE_SHA256_MB_LANES ? count - n
+                                                     : ACQUIRE_SHA256_MB_LANES;
+    for (i = 0; i < lanes_used; i++) {
+      acquire_sha2_init_with_kernel(&hashers[i], LIBACQUIRE_SHA256, kernel);
+      lanes[i] = &hashers[i];
+      outs[i] = digests[i];
+      inputs[i] = file_data(n + i, &sizes[i]);
+    }
+    acquire_sha256_update_many(lanes, inputs, sizes, lanes_used);
+    acquire_sha256_final_many(lanes, outs, lanes_used);
+  }
+  return acquire_clock_seconds() - started;
+}
+
+/* Write the corpus and its manifest text; `NULL` on error */
+static char *write_corpus(unsigned long count) {
+  const size_t line_len = 2 * ACQUIRE_SHA256_OUT_LEN + 48;
+  char *text = (char *)malloc(count * line_len + 1), *p = text;
+  char path[1024];
+  unsigned long n;
+  size_t i;
+  if (text == NULL)
+    return NULL;
+  for (n = 0; n < count; n++) {
+    struct acquire_sha2_hasher hasher;
+    unsigned char digest[ACQUIRE_SHA512_OUT_LEN];
+    size_t size;
+    const unsigned char *data = file_data(n, &size);
+    FILE *fh;
+    file_path(path, sizeof(path), n);
+    fh = fopen(path, "wb");
+    if (fh == NULL || fwrite(data, 1, size, fh) != size) {
+      fprintf(stderr, "Could not write benchmark file: %s\n", path);
+      if (fh != NULL)
+        fclose(fh);
+      free(text);
+      return NULL;
+    }
+    fclose(fh);
+    acquire_sha2_init(&hasher, LIBACQUIRE_SHA256);
+    acquire_sha2_update(&hasher, data, size);
+    acquire_sha2_final(&hasher, digest);
+    for (i = 0; i < ACQUIRE_SHA256_OUT_LEN; i++)
+      p += sprintf(p, "%02x", digest[i]);
+    p += sprintf(p, "  acquire_bench_many_%lu.bin\n", n);
+  }
+  return text;
+}
+
+static void report(const char *name, unsigned long count, double bytes,
+                   double seconds) {
+  if (seconds <= 0.0)
+    seconds = 1e-9;
+  printf("%-28s %12.0f %10.0f\n", name, (double)count / seconds,
+         bytes / seconds / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+  const enum acquire_sha2_kernel active = acquire_sha2_active_kernel();
+  struct acquire_handle *handle = NULL;
+  struct acquire_manifest manifest;
+  unsigned long count = BENCH_FILE_COUNT, n;
+  unsigned int threads[2] = {1, 0};
+  double bytes = 0.0;
+  char *text, name[64], path[1024];
+  int rc = EXIT_SUCCESS;
+  size_t i;
+
+  if (argc > 1)
+    count = strtoul(argv[1], NULL, 10);
+  if (count < 1)
+    count = 1;
+  for (i = 0; i < BENCH_POOL_SIZE; i++)
+    pool[i] = (unsigned char)(i * 31 + (i >> 8));
+  for (n = 0; n < count; n++) {
+    size_t size;
+    file_data(n, &size);
+    bytes += (double)size;
+  }
+
+  printf("%lu files, %.1f MB; SHA-256 kernel %s, multi-buffer %s\n", count,
+         bytes / 1e6, kernel_names[active],
+         acquire_sha256_mb_supported() ? "in use" : "not in use");
+  text = write_corpus(count);
+  if (text == NULL) {
+    rc = EXIT_FAILURE;
+    goto done;
+  }
+
+  printf("%-28s %12s %10s\n", "", "files/s", "MB/s");
+  sprintf(name, "in memory, %s", kernel_names[active]);
+  report(name, count, bytes, hash_singly(count, active));
+  if (active != ACQUIRE_SHA2_KERNEL_PORTABLE)
+    report("in memory, portable", count, bytes,
+           hash_singly(count, ACQUIRE_SHA2_KERNEL_PORTABLE));
+  sprintf(name, "in memory, portable x%d", ACQUIRE_SHA256_MB_LANES);
+  report(name, count, bytes, hash_many(count, ACQUIRE_SHA2_KERNEL_PORTABLE));
+
+  handle = acquire_handle_init();
+  if (handle == NULL ||
+      acquire_manifest_parse(handle, &manifest, text, strlen(text),
+                             LIBACQUIRE_SHA256) != 0) {
+    rc = EXIT_FAILURE;
+    goto done;
+  }
+  for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+    if (acquire_manifest_verify(handle, &manifest, TMPDIR, threads[i]) != 0) {
+      fprintf(stderr, "Manifest verification failed: %s\n",
+              acquire_handle_get_error_string(handle));
+      rc = EXIT_FAILURE;
+      break;
+    }
+    sprintf(name, "manifest, %u thread%s", manifest.stats.threads,
+            manifest.stats.threads == 1 ? "" : "s");
+    report(name, count, (double)manifest.stats.bytes, manifest.stats.seconds);
+  }
+  acquire_manifest_free(&manifest);
+
+done:
+  acquire_handle_free(handle);
+  free(text);
+  for (n = 0; n < count; n++) {
+    file_path(path, sizeof(path), n);
+    remove(path);
+  }
+  return rc;
+}
+
+#else
+
+int main(void) {
+  puts("bench_many_files needs the bundled SHA-2 (LIBACQUIRE_USE_SHA2)");
+  return EXIT_SUCCESS;
+}
+
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
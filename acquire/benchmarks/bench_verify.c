@@ -0,0 +1,109 @@
+/*
+ * Verification throughput benchmark
+ *
+ * Writes a 256 MiB file of zeros then times `acquire_verify_sync` over it with
+ * every checksum algorithm this build supports. The file is freshly written so
+ * it sits in the page cache: the figures are hashing, not disk, throughput.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acquire_checksums.h>
+#include <acquire_common_defs.h>
+#include <acquire_config.h>
+#include <acquire_handle.h>
+
+/* Digests below are of this many zero bytes; change them together */
+#define BENCH_FILE_SIZE 268435456UL
+
+struct bench_case {
+  const char *name;
+  enum Checksum algorithm;
+  const char *digest;
+};
+
+static const struct bench_case bench_cases[] = {
+    {"CRC32C", LIBACQUIRE_CRC32C, "02f63b78"},
+    {"SHA256", LIBACQUIRE_SHA256,
+     "a6d72ac7690f53be6ae46ba88506bd97302a093f7108472bd9efc3cefda06484"},
+    {"SHA512", LIBACQUIRE_SHA512,
+     "24078827a9a954d8be723eb76b658bf484146d67a47d6f660c72bc641e19a83e"
+     "6c38099559e7ce76a9640d25f242d89f69e54fc235e1532804395aaf3fb3d671"},
+    {"BLAKE3", LIBACQUIRE_BLAKE3,
+     "9216a60cba88b32b18349b83c57c22d2e3b514a9720916952e214e5fc065c538"},
+    {"XXH3_64", LIBACQUIRE_XXH3_64, "998e510addb2da2d"},
+    {"XXH128", LIBACQUIRE_XXH128, "e7e6e2cfd0fb193c998e510addb2da2d"}};
+
+static int write_zero_file(const char *path, unsigned long size) {
+  static const unsigned char zeros[65536];
+  FILE *fh = fopen(path, "wb");
+  if (fh == NULL)
+    return -1;
+  while (size > 0) {
+    const size_t n = size < sizeof(zeros) ? (size_t)size : sizeof(zeros);
+    if (fwrite(zeros, 1, n, fh) != n) {
+      fclose(fh);
+      return -1;
+    }
+    size -= (unsigned long)n;
+  }
+  return fclose(fh);
+}
+
+int main(int argc, char *argv[]) {
+  char path[1024];
+  int iterations = 3, rc = EXIT_SUCCESS;
+  size_t i;
+
+  if (argc > 1)
+    iterations = atoi(argv[1]);
+  if (iterations < 1)
+    iterations = 1;
+
+  snprintf(path, sizeof(path), "%s%s%s", TMPDIR, PATH_SEP,
+           "acquire_bench_verify.bin");
+  if (write_zero_file(path, BENCH_FILE_SIZE) != 0) {
+    fprintf(stderr, "Could not write benchmark file: %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  printf("%-8s %12s %10s\n", "algo", "MB/s", "GB/s");
+  for (i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+    const struct bench_case *bc = &bench_cases[i];
+    double best = 0.0;
+    int run;
+    for (run = 0; run < iterations; run++) {
+      struct acquire_handle *handle = acquire_handle_init();
+      double started, elapsed;
+      if (handle == NULL) {
+        rc = EXIT_FAILURE;
+        break;
+      }
+      started = acquire_clock_seconds();
+      if (acquire_verify_sync(handle, path, bc->algorithm, bc->digest) != 0) {
+        if (acquire_handle_get_error_code(handle) ==
+            ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT) {
+          printf("%-8s %12s\n", bc->name, "unsupported");
+        } else {
+          fprintf(stderr, "%s verification failed: %s\n", bc->name,
+                  acquire_handle_get_error_string(handle));
+          rc = EXIT_FAILURE;
+        }
+        acquire_handle_free(handle);
+        best = -1.0;
+        break;
+      }
+      elapsed = acquire_clock_seconds() - started;
+      acquire_handle_free(handle);
+      if (elapsed > 0.0 && (double)BENCH_FILE_SIZE / elapsed > best)
+        best = (double)BENCH_FILE_SIZE / elapsed;
+    }
+    if (best > 0.0)
+      printf("%-8s %12.1f %10.2f\n", bc->name, best / 1e6, best / 1e9);
+  }
+
+  remove(path);
+  return rc;
+}
@@ -4,7 +4,7 @@
 
 #include "cli.h"
 
-enum { HELP_MSG_COUNT = 17 };
+enum { HELP_MSG_COUNT = 21 };
 
 int docopt(struct DocoptArgs *args, int argc, char *argv[], const bool help,
            const char *version) {
@@ -19,6 +19,7 @@ int docopt(struct DocoptArgs *args, int argc, char *argv[], const bool help,
       "  acquire --check --directory=<d> --hash=<h> --checksum=<sha> <url>...",
       "  acquire --directory=<d> --hash=<h> --checksum=<sha> <url>...",
       "  acquire --output=<f> <url>...",
+      "  acquire --check-manifest=<m> [--directory=<d>] [--checksum=<sha>]",
       "  acquire --help",
       "  acquire --version",
       "",
@@ -26,8 +27,13 @@ int docopt(struct DocoptArgs *args, int argc, char *argv[], const bool help,
       "  -h --help               Show this screen.",
       "  --version               Show version.",
       "  --check                 Check if already downloaded.",
+      "  --check-manifest=<m>    Verify every file listed in a "
+      "SHA256SUMS-style",
+      "                          manifest.",
       "  --hash=<h>              Hash to verify.",
-      "  --checksum=<sha>        Checksum algorithm, e.g., SHA256 or SHA512.",
+      "  --checksum=<sha>        Checksum algorithm, e.g., SHA256, SHA512, "
+      "BLAKE3",
+      "                          or XXH3.",
       "  -d=<d>, --directory=<d> Location to download files to.",
       "  -o=<f>, --output=<f>    Output file. If not specified, will derive "
       "from URL."};
@@ -80,7 +86,16 @@ int docopt(struct DocoptArgs *args, int argc, char *argv[], const bool help,
       continue;
     }
 
-    if (strncmp(arg, "--directory=", 12) == 0) {
+    if (strncmp(arg, "--check-manifest=", 17) == 0) {
+      args->check_manifest = (char *)(arg + 17);
+    } else if (strcmp(arg, "--check-manifest") == 0) {
+      if (i + 1 < argc) {
+        args->check_manifest = argv[++i];
+      } else {
+        fprintf(stderr, "Option %s requires an argument.\n", arg);
+        return EXIT_FAILURE;
+      }
+    } else if (strncmp(arg, "--directory=", 12) == 0) {
       args->directory = (char *)(arg + 12);
     } else if (strcmp(arg, "-d") == 0 || strcmp(arg, "--directory") == 0) {
       if (i + 1 < argc) {
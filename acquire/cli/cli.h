@@ -106,13 +106,14 @@ typedef size_t bool;
 struct DocoptArgs {
   char *url;
   size_t check;
+  char *check_manifest;
   size_t help;
   size_t version;
   char *checksum;
   char *directory;
   char *hash;
   char *output;
-  const char *help_message[17];
+  const char *help_message[21];
 };
 
 extern ACQUIRE_CLI_LIB_EXPORT int docopt(struct DocoptArgs *, int, char *[],
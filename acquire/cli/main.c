@@ -9,6 +9,7 @@
 #include "acquire_config.h"
 #include "acquire_download.h"
 #include "acquire_handle.h"
+#include "acquire_manifest.h"
 #include "acquire_net_common.h"
 #include "acquire_url_utils.h"
 
@@ -18,6 +19,52 @@
 #include <minwindef.h>
 #endif
 
+/* Report like `sha256sum -c --quiet`: failures, then a summary */
+static int check_manifest(struct acquire_handle *handle,
+                          const struct DocoptArgs *args) {
+  struct acquire_manifest manifest;
+  const enum Checksum algorithm =
+      args->checksum != NULL ? string2checksum(args->checksum)
+                             : LIBACQUIRE_UNSUPPORTED_CHECKSUM;
+  size_t i;
+  int rc;
+  if (args->checksum != NULL &&
+      algorithm == LIBACQUIRE_UNSUPPORTED_CHECKSUM) {
+    fprintf(stderr, "Error: Unsupported checksum '%s'.\n", args->checksum);
+    return EXIT_FAILURE;
+  }
+  if (acquire_manifest_load(handle, &manifest, args->check_manifest,
+                            algorithm) != 0) {
+    fprintf(stderr, "Error: %s\n", acquire_handle_get_error_string(handle));
+    return EXIT_FAILURE;
+  }
+  rc = acquire_manifest_verify(handle, &manifest, args->directory, 0);
+  for (i = 0; i < manifest.count; i++) {
+    const struct acquire_manifest_entry *e = &manifest.entries[i];
+    if (e->error == ACQUIRE_OK)
+      continue;
+    printf("%s: %s\n", e->path,
+           e->error == ACQUIRE_ERROR_FILE_OPEN_FAILED ||
+                   e->error == ACQUIRE_ERROR_FILE_READ_FAILED
+               ? "FAILED open or read"
+               : "FAILED");
+  }
+  if (manifest.stats.malformed)
+    fprintf(stderr, "WARNING: %lu improperly formatted lines skipped\n",
+            (unsigned long)manifest.stats.malformed);
+  if (rc != 0)
+    fprintf(stderr, "WARNING: %s\n", acquire_handle_get_error_string(handle));
+  printf("%lu of %lu files verified, %.1f MiB in %.2fs (%.1f MiB/s, %.0f "
+         "files/s, %u threads)\n",
+         (unsigned long)manifest.stats.passed,
+         (unsigned long)manifest.stats.files,
+         (double)manifest.stats.bytes / 1048576.0, manifest.stats.seconds,
+         manifest.stats.bytes_per_second / 1048576.0,
+         manifest.stats.files_per_second, manifest.stats.threads);
+  acquire_manifest_free(&manifest);
+  return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
   struct DocoptArgs args;
   struct acquire_handle *handle;
@@ -39,6 +86,11 @@ int main(int argc, char *argv[]) {
     return ENOMEM;
   }
 
+  if (args.check_manifest != NULL) {
+    rc = check_manifest(handle, &args);
+    goto cleanup;
+  }
+
   url_to_use = NULL;
   if (args.url != NULL) {
     url_to_use = args.url;
@@ -88,7 +140,12 @@ int main(int argc, char *argv[]) {
     }
   } else {
     printf("Downloading '%s' to '%s'...\n", url_to_use, output_path);
-    if (acquire_download_sync(handle, url_to_use, output_path) != 0) {
+    /* With a hash, the data is checked as it arrives rather than reread */
+    if ((args.hash != NULL
+             ? acquire_download_verified_sync(handle, url_to_use, output_path,
+                                              string2checksum(args.checksum),
+                                              args.hash)
+             : acquire_download_sync(handle, url_to_use, output_path)) != 0) {
       fprintf(stderr, "Download failed: %s\n",
               acquire_handle_get_error_string(handle));
       rc = EXIT_FAILURE;
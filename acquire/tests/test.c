@@ -1,14 +1,38 @@
 #include <greatest.h>
 
 #include "acquire_common_defs.h"
+#include "acquire_digest_pool.h"
 
 #include "test_checksum.h"
 #include "test_checksums_dispatch.h"
 #include "test_cli.h"
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+#include "test_crc32c.h"
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+#include "test_blake3.h"
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+#include "test_xxhash.h"
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+#include "test_sha2.h"
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+#include "test_af_alg.h"
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
+#include "test_batch_reader.h"
+#include "test_blocks.h"
+#include "test_calibrate.h"
+#include "test_digest_cache.h"
 #include "test_download.h"
+#include "test_executor.h"
 #include "test_extract.h"
+#include "test_file_reader.h"
 #include "test_fileutils.h"
 #include "test_handle.h"
+#include "test_manifest.h"
+#include "test_multi_digest.h"
 #if defined(LIBACQUIRE_USE_LIBFETCH) && LIBACQUIRE_USE_MY_LIBFETCH
 #include "test_libfetch.h"
 #endif /* defined(LIBACQUIRE_USE_LIBFETCH) && LIBACQUIRE_USE_MY_LIBFETCH */
@@ -38,6 +62,29 @@ int main(int argc, char **argv) {
   RUN_SUITE(string_extras_suite);
   RUN_SUITE(checksum_dispatch_suite);
   RUN_SUITE(checksums_suite);
+  RUN_SUITE(multi_digest_suite);
+  RUN_SUITE(file_reader_suite);
+  RUN_SUITE(executor_suite);
+  RUN_SUITE(manifest_suite);
+  RUN_SUITE(digest_cache_suite);
+  RUN_SUITE(batch_reader_suite);
+  RUN_SUITE(calibrate_suite);
+  RUN_SUITE(blocks_suite);
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  RUN_SUITE(crc32c_suite);
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  RUN_SUITE(blake3_suite);
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  RUN_SUITE(xxhash_suite);
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  RUN_SUITE(sha2_suite);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#if defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG
+  RUN_SUITE(af_alg_suite);
+#endif /* defined(LIBACQUIRE_USE_AF_ALG) && LIBACQUIRE_USE_AF_ALG */
   RUN_SUITE(downloads_suite);
   RUN_SUITE(net_common_suite);
 
@@ -53,5 +100,7 @@ int main(int argc, char **argv) {
   RUN_SUITE(libfetch_suite);
 #endif /* defined(LIBACQUIRE_USE_LIBFETCH) && LIBACQUIRE_USE_MY_LIBFETCH */
   RUN_SUITE(cli_suite);
+  /* The main thread's pool is not freed at exit otherwise */
+  acquire_digest_pool_cleanup();
   GREATEST_MAIN_END();
 }
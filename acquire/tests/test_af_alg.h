@@ -0,0 +1,150 @@
+#ifndef TEST_AF_ALG_H
+#define TEST_AF_ALG_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_af_alg.h"
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *AF_ALG_FILE_PATH = DOWNLOAD_DIR PATH_SEP "af_alg_test.bin";
+
+#define AF_ALG_FILE_LEN (3 * 1048576 + 11)
+#define AF_ALG_FILE_SHA256                                                     \
+  "6ad8a20df6fdb90553fa0d96fee4ffa60ae400d181140e35c0ced9a13ec15ab7"
+#define AF_ALG_FILE_SHA512                                                     \
+  "3a511e16ae0472d116e3530bed21f6a56f96da28803a7104517cb0250704b7f3"           \
+  "c6b98f24081dff6e73dfcc8d9929631d1feea9163abc173b1e0df9cc3fbd5ed9"
+
+static const struct test_pattern AF_ALG_PATTERN = {1, 0, 251};
+
+static enum acquire_status af_alg_test_verify(struct acquire_handle *h,
+                                              enum Checksum algorithm,
+                                              const char *expected) {
+  enum acquire_status status;
+  if (_af_alg_verify_async_start(h, AF_ALG_FILE_PATH, algorithm, expected) !=
+      0)
+    return ACQUIRE_ERROR;
+  do {
+    status = _af_alg_verify_async_poll(h);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  return status;
+}
+
+TEST test_af_alg_verify(void) {
+  struct acquire_handle *h;
+  if (!acquire_af_alg_supported(LIBACQUIRE_SHA256))
+    SKIPm("AF_ALG hashing not available from this kernel");
+  h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(AF_ALG_FILE_PATH, AF_ALG_FILE_LEN,
+                                  &AF_ALG_PATTERN));
+
+  ASSERT_EQ(ACQUIRE_COMPLETE,
+            af_alg_test_verify(h, LIBACQUIRE_SHA256, AF_ALG_FILE_SHA256));
+  ASSERT_EQ((off_t)AF_ALG_FILE_LEN, h->bytes_processed);
+  if (acquire_af_alg_supported(LIBACQUIRE_SHA512))
+    ASSERT_EQ(ACQUIRE_COMPLETE,
+              af_alg_test_verify(h, LIBACQUIRE_SHA512, AF_ALG_FILE_SHA512));
+
+  /* Small budgets split the file over many polls */
+  acquire_handle_set_poll_budget(h, 65536, 0);
+  ASSERT_EQ(0, _af_alg_verify_async_start(h, AF_ALG_FILE_PATH,
+                                          LIBACQUIRE_SHA256,
+                                          AF_ALG_FILE_SHA256));
+  ASSERT_EQ(ACQUIRE_IN_PROGRESS, _af_alg_verify_async_poll(h));
+  ASSERT(h->bytes_processed < (off_t)AF_ALG_FILE_LEN);
+  while (_af_alg_verify_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+
+  ASSERT_EQ(ACQUIRE_ERROR,
+            af_alg_test_verify(h, LIBACQUIRE_SHA256,
+                               "6ad8a20df6fdb90553fa0d96fee4ffa6"
+                               "0ae400d181140e35c0ced9a13ec15ab6"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  ASSERT_EQ(ACQUIRE_ERROR,
+            af_alg_test_verify(h, LIBACQUIRE_SHA512, AF_ALG_FILE_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+  /* Other algorithms are left to the rest of the chain */
+  h->error.code = ACQUIRE_OK;
+  ASSERT_EQ(-1, _af_alg_verify_async_start(h, AF_ALG_FILE_PATH,
+                                           LIBACQUIRE_CRC32C, "00000000"));
+  ASSERT_EQ(ACQUIRE_OK, acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(AF_ALG_FILE_PATH);
+  PASS();
+}
+
+/* Runs whether or not the kernel offers AF_ALG: it falls back if not */
+TEST test_af_alg_selected_backend(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  const enum acquire_backend_type expected =
+      acquire_af_alg_supported(LIBACQUIRE_SHA256)
+          ? ACQUIRE_BACKEND_CHECKSUM_AF_ALG
+          : ACQUIRE_BACKEND_NONE;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(AF_ALG_FILE_PATH, AF_ALG_FILE_LEN,
+                                  &AF_ALG_PATTERN));
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_AF_ALG);
+
+  ASSERT_EQ(0, acquire_verify_async_start(h, AF_ALG_FILE_PATH,
+                                          LIBACQUIRE_SHA256,
+                                          AF_ALG_FILE_SHA256));
+  if (expected == ACQUIRE_BACKEND_CHECKSUM_AF_ALG)
+    ASSERT_EQ(expected, h->active_backend);
+  else
+    ASSERT(h->active_backend != ACQUIRE_BACKEND_CHECKSUM_AF_ALG);
+  while (acquire_verify_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+
+  ASSERT_EQ(-1, acquire_verify_sync(h, AF_ALG_FILE_PATH, LIBACQUIRE_SHA256,
+                                    "6ad8a20df6fdb90553fa0d96fee4ffa6"
+                                    "0ae400d181140e35c0ced9a13ec15ab6"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  /* The kernel is not asked for algorithms it is not used for */
+  ASSERT_EQ(0, acquire_verify_async_start(h, AF_ALG_FILE_PATH,
+                                          LIBACQUIRE_CRC32C, "00000000"));
+  ASSERT(h->active_backend != ACQUIRE_BACKEND_CHECKSUM_AF_ALG);
+  while (acquire_verify_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ(ACQUIRE_ERROR, h->status);
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+
+  ASSERT_EQ(-1, acquire_verify_async_start(h, "af_alg_missing.bin",
+                                           LIBACQUIRE_SHA256,
+                                           AF_ALG_FILE_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_SHA2);
+  ASSERT_EQ(0, acquire_verify_async_start(h, AF_ALG_FILE_PATH,
+                                          LIBACQUIRE_SHA512,
+                                          AF_ALG_FILE_SHA512));
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_SHA2, h->active_backend);
+  while (acquire_verify_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+  acquire_handle_free(h);
+  remove(AF_ALG_FILE_PATH);
+  PASS();
+}
+
+SUITE(af_alg_suite) {
+  RUN_TEST(test_af_alg_verify);
+  RUN_TEST(test_af_alg_selected_backend);
+}
+
+#endif /* !TEST_AF_ALG_H */
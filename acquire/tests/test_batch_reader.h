@@ -0,0 +1,144 @@
+#ifndef TEST_BATCH_READER_H
+#define TEST_BATCH_READER_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_batch_reader.h"
+#include "acquire_handle.h"
+#include "acquire_manifest.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+
+static const char *BATCH_READER_PATHS[] = {
+    DOWNLOAD_DIR PATH_SEP "batch_reader_big.bin",
+    DOWNLOAD_DIR PATH_SEP "batch_reader_empty.bin",
+    DOWNLOAD_DIR PATH_SEP "batch_reader_small.bin"};
+/* Not multiples of the block size used below */
+static const size_t BATCH_READER_SIZES[] = {100003, 0, 5000};
+
+/* Each file its own, so blocks handed out for the wrong one show */
+static const struct test_pattern BATCH_READER_PATTERNS[] = {
+    {13, 5, 251}, {13, 12, 251}, {13, 19, 251}};
+
+static int batch_reader_write_files(void) {
+  size_t f;
+  for (f = 0; f < 3; f++)
+    if (test_write_pattern(BATCH_READER_PATHS[f], BATCH_READER_SIZES[f],
+                           &BATCH_READER_PATTERNS[f]) != 0)
+      return -1;
+  return 0;
+}
+
+/* Blocks of each file arrive in order and intact, whichever file is next */
+TEST test_batch_reader_reads_files_in_order(void) {
+  struct acquire_batch_reader *reader;
+  struct acquire_batch_block block;
+  size_t ids[3] = {0, 1, 2}, done[3] = {0, 0, 0};
+  size_t f, i, lasts = 0;
+  int got;
+  ASSERT_EQ(0, batch_reader_write_files());
+  /* Room for three files, with fewer slots than the big one has blocks */
+  reader = acquire_batch_reader_create(3, 4096);
+  ASSERT(reader != NULL);
+  ASSERT_EQ(ENOENT, acquire_batch_reader_add(
+                        reader, DOWNLOAD_DIR PATH_SEP "batch_missing", NULL));
+  ASSERT_EQ(EINVAL, acquire_batch_reader_add(reader, DOWNLOAD_DIR, NULL));
+  for (f = 0; f < 3; f++) {
+    ASSERT_FALSE(acquire_batch_reader_full(reader));
+    ASSERT_EQ(0, acquire_batch_reader_add(reader, BATCH_READER_PATHS[f],
+                                          &ids[f]));
+  }
+  ASSERT(acquire_batch_reader_full(reader));
+  ASSERT_EQ(EBUSY, acquire_batch_reader_add(reader, BATCH_READER_PATHS[0],
+                                            &ids[0]));
+
+  while ((got = acquire_batch_reader_next(reader, &block)) == 1) {
+    f = *(size_t *)block.user;
+    ASSERT_EQ(0, block.error);
+    ASSERT(block.len <= 4096);
+    ASSERT_EQ((off_t)done[f], block.offset);
+    for (i = 0; i < block.len; i++)
+      if (block.data[i] !=
+          test_pattern_byte(&BATCH_READER_PATTERNS[f], done[f] + i))
+        FAILm("Block contents differ from the file");
+    done[f] += block.len;
+    if (block.last) {
+      ASSERT_EQ(BATCH_READER_SIZES[f], done[f]);
+      lasts++;
+    }
+  }
+  ASSERT_EQ(0, got);
+  ASSERT_EQ(3, lasts);
+  for (f = 0; f < 3; f++)
+    ASSERT_EQ(BATCH_READER_SIZES[f], done[f]);
+  ASSERT_FALSE(acquire_batch_reader_full(reader));
+  acquire_batch_reader_free(reader);
+  PASS();
+}
+
+/* Freeing with reads still in flight waits for them */
+TEST test_batch_reader_free_mid_read(void) {
+  struct acquire_batch_reader *reader;
+  struct acquire_batch_block block;
+  ASSERT_EQ(0, batch_reader_write_files());
+  reader = acquire_batch_reader_create(8, 512);
+  ASSERT(reader != NULL);
+  ASSERT_EQ(0, acquire_batch_reader_add(reader, BATCH_READER_PATHS[0], NULL));
+  ASSERT_EQ(1, acquire_batch_reader_next(reader, &block));
+  ASSERT_EQ(0, block.offset);
+  acquire_batch_reader_free(reader);
+  acquire_batch_reader_free(NULL);
+  PASS();
+}
+
+/* Batched and one-file-at-a-time manifest checks agree */
+TEST test_batch_reader_manifest_depths(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_manifest m;
+  const char text[] =
+      "SHA256 (batch_reader_empty.bin) = "
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\n"
+      "SHA256 (batch_reader_small.bin) = "
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\n"
+      "SHA256 (batch_missing) = "
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855\n";
+  unsigned int depth;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, batch_reader_write_files());
+  for (depth = 1; depth <= 4; depth += 3) {
+    acquire_handle_set_io_queue_depth(h, depth);
+    ASSERT_EQ(0, acquire_manifest_parse(h, &m, text, sizeof(text) - 1,
+                                        LIBACQUIRE_SHA256));
+    ASSERT_EQ(-1, acquire_manifest_verify(h, &m, DOWNLOAD_DIR, 1));
+    ASSERT_EQ(ACQUIRE_OK, m.entries[0].error);
+    ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, m.entries[1].error);
+    ASSERT_EQ((off_t)BATCH_READER_SIZES[2], m.entries[1].bytes);
+    ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, m.entries[2].error);
+    ASSERT_EQ(1, m.stats.passed);
+    acquire_manifest_free(&m);
+  }
+  acquire_handle_free(h);
+  PASS();
+}
+
+SUITE(batch_reader_suite) {
+  RUN_TEST(test_batch_reader_reads_files_in_order);
+  RUN_TEST(test_batch_reader_free_mid_read);
+  RUN_TEST(test_batch_reader_manifest_depths);
+}
+
+#else
+
+SUITE(batch_reader_suite) {}
+
+#endif /* !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&     \
+          !defined(__NT__) */
+
+#endif /* !TEST_BATCH_READER_H */
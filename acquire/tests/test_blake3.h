@@ -0,0 +1,202 @@
+#ifndef TEST_BLAKE3_H
+#define TEST_BLAKE3_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_blake3.h"
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *BLAKE3_FILE_PATH = DOWNLOAD_DIR PATH_SEP "blake3_test.bin";
+
+/* Official test vector inputs: byte `i` is `i % 251` */
+static void blake3_fill_input(unsigned char *buf, size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++)
+    buf[i] = (unsigned char)(i % 251);
+}
+
+static void blake3_hex(const uint8_t digest[ACQUIRE_BLAKE3_OUT_LEN],
+                       char hex[2 * ACQUIRE_BLAKE3_OUT_LEN + 1]) {
+  size_t i;
+  for (i = 0; i < ACQUIRE_BLAKE3_OUT_LEN; i++)
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+}
+
+struct blake3_vector {
+  size_t len;
+  const char *hash;
+};
+
+/* From the BLAKE3 reference `test_vectors.json`, covering every tree shape */
+static const struct blake3_vector blake3_vectors[] = {
+    {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+    {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+    {64, "4eed7141ea4a5cd4b788606bd23f46e212af9cacebacdc7d1f4c6dc7f2511b98"},
+    {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+    {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+    {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+    {2049, "5f4d72f40d7a5f82b15ca2b2e44b1de3c2ef86c426c95c1af0b6879522563030"},
+    {8193, "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b"},
+    {31744,
+     "62b6960e1a44bcc1eb1a611a8d6235b6b4b78f32e7abc4fb4c6cdcce94895c47"},
+    {102400,
+     "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"}};
+
+TEST test_blake3_vectors(enum acquire_blake3_kernel kernel) {
+  const size_t max_len = 102400;
+  struct acquire_blake3_hasher hasher;
+  uint8_t digest[ACQUIRE_BLAKE3_OUT_LEN];
+  char hex[2 * ACQUIRE_BLAKE3_OUT_LEN + 1];
+  unsigned char *buf;
+  size_t i;
+
+  if (!acquire_blake3_kernel_supported(kernel))
+    SKIPm("BLAKE3 kernel not supported on this CPU");
+
+  buf = (unsigned char *)malloc(max_len);
+  ASSERT(buf != NULL);
+  blake3_fill_input(buf, max_len);
+  for (i = 0; i < sizeof(blake3_vectors) / sizeof(blake3_vectors[0]); i++) {
+    acquire_blake3_init_with_kernel(&hasher, kernel);
+    acquire_blake3_update(&hasher, buf, blake3_vectors[i].len);
+    acquire_blake3_final(&hasher, digest);
+    blake3_hex(digest, hex);
+    if (strcmp(hex, blake3_vectors[i].hash) != 0) {
+      free(buf);
+      ASSERT_STR_EQ(blake3_vectors[i].hash, hex);
+    }
+  }
+  free(buf);
+  PASS();
+}
+
+/* Split points that land inside blocks, on chunk edges and in SIMD batches */
+TEST test_blake3_incremental(enum acquire_blake3_kernel kernel) {
+  static const size_t steps[] = {1, 63, 64, 65, 1000, 1024, 3071, 20000};
+  const size_t len = 102400;
+  struct acquire_blake3_hasher hasher;
+  uint8_t digest[ACQUIRE_BLAKE3_OUT_LEN];
+  char hex[2 * ACQUIRE_BLAKE3_OUT_LEN + 1];
+  unsigned char *buf;
+  size_t i, pos;
+
+  if (!acquire_blake3_kernel_supported(kernel))
+    SKIPm("BLAKE3 kernel not supported on this CPU");
+
+  buf = (unsigned char *)malloc(len);
+  ASSERT(buf != NULL);
+  blake3_fill_input(buf, len);
+  for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    acquire_blake3_init_with_kernel(&hasher, kernel);
+    for (pos = 0; pos < len; pos += steps[i])
+      acquire_blake3_update(&hasher, buf + pos,
+                            len - pos < steps[i] ? len - pos : steps[i]);
+    acquire_blake3_final(&hasher, digest);
+    blake3_hex(digest, hex);
+    if (strcmp(hex, blake3_vectors[9].hash) != 0) {
+      free(buf);
+      ASSERT_STR_EQ(blake3_vectors[9].hash, hex);
+    }
+  }
+  free(buf);
+  PASS();
+}
+
+TEST test_blake3_dispatch_uses_supported_kernel(void) {
+  ASSERT(acquire_blake3_kernel_supported(acquire_blake3_active_kernel()));
+  ASSERT(acquire_blake3_kernel_supported(ACQUIRE_BLAKE3_KERNEL_PORTABLE));
+  ASSERT_EQ(LIBACQUIRE_BLAKE3, string2checksum("blake3"));
+  ASSERT_EQ(LIBACQUIRE_BLAKE3, string2checksum("BLAKE3"));
+  PASS();
+}
+
+static const struct test_pattern BLAKE3_PATTERN = {1, 0, 251};
+
+TEST test_blake3_verify(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  char hash[65];
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(BLAKE3_FILE_PATH, blake3_vectors[8].len,
+                                  &BLAKE3_PATTERN));
+
+  ASSERT_EQ(0, acquire_verify_sync(h, BLAKE3_FILE_PATH, LIBACQUIRE_BLAKE3,
+                                   blake3_vectors[8].hash));
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_BLAKE3, h->active_backend);
+  ASSERT_EQ((off_t)blake3_vectors[8].len, h->bytes_processed);
+
+  strcpy(hash, blake3_vectors[8].hash);
+  hash[0] = hash[0] == '0' ? '1' : '0';
+  ASSERT_EQ(-1, acquire_verify_sync(h, BLAKE3_FILE_PATH, LIBACQUIRE_BLAKE3,
+                                    hash));
+  ASSERT_EQ(ACQUIRE_ERROR, h->status);
+
+  ASSERT_EQ(-1, acquire_verify_sync(h, BLAKE3_FILE_PATH, LIBACQUIRE_BLAKE3,
+                                    "abc"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(BLAKE3_FILE_PATH);
+  PASS();
+}
+
+TEST test_blake3_parallel_verify(void) {
+  static const char *expected =
+      "3921c624961dc453b3ad2f5ec310c0daab99a5e8dbb8a7ef758918800094e2c4";
+  /* Several subtrees per thread plus an uneven tail */
+  const size_t len = 9 * 1048576 + 7;
+  struct acquire_handle *h = acquire_handle_init();
+  enum acquire_status status;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(BLAKE3_FILE_PATH, len, &BLAKE3_PATTERN));
+
+  /* Non-blocking polls while the workers run */
+  acquire_handle_set_verify_threads(h, 4);
+  acquire_handle_set_poll_budget(h, 1, 0);
+  ASSERT_EQ(0, acquire_verify_async_start(h, BLAKE3_FILE_PATH,
+                                          LIBACQUIRE_BLAKE3, expected));
+  do {
+    status = acquire_verify_async_poll(h);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, status, "%d");
+  ASSERT_EQ((off_t)len, h->bytes_processed);
+
+  acquire_handle_set_verify_threads(h, 0);
+  ASSERT_EQ(0, acquire_verify_sync(h, BLAKE3_FILE_PATH, LIBACQUIRE_BLAKE3,
+                                   expected));
+
+  /* Cancelled while the workers are running */
+  acquire_handle_set_verify_threads(h, 2);
+  ASSERT_EQ(0, acquire_verify_async_start(h, BLAKE3_FILE_PATH,
+                                          LIBACQUIRE_BLAKE3, expected));
+  acquire_verify_async_cancel(h);
+  ASSERT_EQ(ACQUIRE_ERROR, acquire_verify_async_poll(h));
+  ASSERT_EQ(ACQUIRE_ERROR_CANCELLED, acquire_handle_get_error_code(h));
+  ASSERT(h->backend_handle == NULL);
+
+  acquire_handle_free(h);
+  remove(BLAKE3_FILE_PATH);
+  PASS();
+}
+
+SUITE(blake3_suite) {
+  static const enum acquire_blake3_kernel kernels[] = {
+      ACQUIRE_BLAKE3_KERNEL_PORTABLE, ACQUIRE_BLAKE3_KERNEL_NEON,
+      ACQUIRE_BLAKE3_KERNEL_AVX2, ACQUIRE_BLAKE3_KERNEL_AVX512};
+  size_t i;
+  for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    RUN_TEST1(test_blake3_vectors, kernels[i]);
+    RUN_TEST1(test_blake3_incremental, kernels[i]);
+  }
+  RUN_TEST(test_blake3_dispatch_uses_supported_kernel);
+  RUN_TEST(test_blake3_verify);
+  RUN_TEST(test_blake3_parallel_verify);
+}
+
+#endif /* !TEST_BLAKE3_H */
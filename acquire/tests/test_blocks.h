@@ -0,0 +1,218 @@
+#ifndef TEST_BLOCKS_H
+#define TEST_BLOCKS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_blocks.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *BLOCKS_FILE = DOWNLOAD_DIR PATH_SEP "blocks_test.bin";
+static const char *BLOCKS_MANIFEST =
+    DOWNLOAD_DIR PATH_SEP "blocks_test.blocks";
+
+#define BLOCKS_ABC_SHA256                                                      \
+  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+#define BLOCKS_EMPTY_SHA256                                                    \
+  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+/* SHA256(0x01 || SHA256("abc") || SHA256("abc")) */
+#define BLOCKS_ABCABC_ROOT                                                     \
+  "32a5ba7bf46442de5041e40493e85e6ffa89cb004498b3ef2b67ca320e730dcf"
+/* Blocks "abc", "def", "ghi": the third is carried up to pair with the root
+ * of the first two */
+#define BLOCKS_ABCDEFGHI_ROOT                                                  \
+  "19249cd4a0623b7331489cdcc3d093fa633c0a299198425b5d98c0a25ad5a59b"
+
+TEST test_block_manifest_create(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_block_manifest m;
+  ASSERT(h != NULL);
+
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcabc"));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 3));
+  ASSERT_EQ(2, m.count);
+  ASSERT_EQ(6, m.size);
+  ASSERT_STR_EQ(BLOCKS_ABC_SHA256, acquire_block_manifest_hash(&m, 0));
+  ASSERT_STR_EQ(BLOCKS_ABC_SHA256, acquire_block_manifest_hash(&m, 1));
+  ASSERT_EQ(NULL, acquire_block_manifest_hash(&m, 2));
+  ASSERT_STR_EQ(BLOCKS_ABCABC_ROOT, m.root);
+  acquire_block_manifest_free(&m);
+
+  /* An odd block out, spread over several threads */
+  acquire_handle_set_verify_threads(h, 3);
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcdefghi"));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 3));
+  ASSERT_EQ(3, m.count);
+  ASSERT_STR_EQ(BLOCKS_ABCDEFGHI_ROOT, m.root);
+  ASSERT_EQ(9, acquire_handle_get_progress(h));
+  acquire_block_manifest_free(&m);
+
+  /* One short block is its own root, and no blocks hash to nothing */
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abc"));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 4096));
+  ASSERT_EQ(1, m.count);
+  ASSERT_STR_EQ(BLOCKS_ABC_SHA256, m.root);
+  acquire_block_manifest_free(&m);
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, ""));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 4096));
+  ASSERT_EQ(0, m.count);
+  ASSERT_STR_EQ(BLOCKS_EMPTY_SHA256, m.root);
+  acquire_block_manifest_free(&m);
+
+  ASSERT_EQ(-1, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                              LIBACQUIRE_SHA256, 0));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_block_manifest_create(
+                    h, &m, "non" PATH_SEP "existent", LIBACQUIRE_SHA256, 3));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(BLOCKS_FILE);
+  PASS();
+}
+
+TEST test_block_manifest_save_load(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_block_manifest m, loaded;
+  const char tampered[] = "acquire-blocks 1\n"
+                          "# two blocks of \"abc\"\n"
+                          "algorithm sha256\n"
+                          "block-size 3\n"
+                          "size 6\r\n"
+                          "root " BLOCKS_ABCABC_ROOT "\n"
+                          "\n" BLOCKS_ABC_SHA256 "\n" BLOCKS_EMPTY_SHA256 "\n";
+  const char malformed[] = "acquire-blocks 1\n"
+                           "algorithm sha256\n"
+                           "block-size 3\n"
+                           "size 6\n"
+                           "root " BLOCKS_ABCABC_ROOT "\n"
+                           "abc\n";
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcabc"));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 3));
+  ASSERT_EQ(0, acquire_block_manifest_save(h, &m, BLOCKS_MANIFEST));
+
+  ASSERT_EQ(0, acquire_block_manifest_load(h, &loaded, BLOCKS_MANIFEST,
+                                           BLOCKS_ABCABC_ROOT));
+  ASSERT_EQ(LIBACQUIRE_SHA256, loaded.algorithm);
+  ASSERT_EQ(3, loaded.block_size);
+  ASSERT_EQ(6, loaded.size);
+  ASSERT_EQ(2, loaded.count);
+  ASSERT_STR_EQ(m.root, loaded.root);
+  ASSERT_STR_EQ(BLOCKS_ABC_SHA256, acquire_block_manifest_hash(&loaded, 1));
+  acquire_block_manifest_free(&loaded);
+
+  /* A root from a trusted source has to be the one the blocks give */
+  ASSERT_EQ(-1, acquire_block_manifest_load(h, &loaded, BLOCKS_MANIFEST,
+                                            BLOCKS_ABC_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_CHECKSUM_MISMATCH, acquire_handle_get_error_code(h));
+  ASSERT_EQ(NULL, loaded.hashes);
+  ASSERT_EQ(-1, acquire_block_manifest_parse(h, &loaded, tampered,
+                                             sizeof(tampered) - 1, NULL));
+  ASSERT_EQ(ACQUIRE_ERROR_CHECKSUM_MISMATCH, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_block_manifest_parse(h, &loaded, malformed,
+                                             sizeof(malformed) - 1, NULL));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_block_manifest_parse(h, &loaded, malformed,
+                                             sizeof(malformed) - 5, NULL));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_block_manifest_load(h, &loaded, BLOCKS_FILE, NULL));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+
+  acquire_block_manifest_free(&m);
+  acquire_handle_free(h);
+  remove(BLOCKS_FILE);
+  remove(BLOCKS_MANIFEST);
+  PASS();
+}
+
+TEST test_verify_blocks(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_block_manifest m;
+  size_t bad[4];
+  const size_t some[] = {0, 2};
+  const size_t beyond[] = {3};
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcdefghi"));
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, BLOCKS_FILE,
+                                             LIBACQUIRE_SHA256, 3));
+  ASSERT_EQ(0, acquire_verify_blocks(h, BLOCKS_FILE, &m, bad, 4));
+
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcdXfghX"));
+  acquire_handle_set_verify_threads(h, 2);
+  ASSERT_EQ(2, acquire_verify_blocks(h, BLOCKS_FILE, &m, bad, 4));
+  ASSERT_EQ(1, bad[0]);
+  ASSERT_EQ(2, bad[1]);
+  /* Counted whether or not there is room to list them */
+  ASSERT_EQ(2, acquire_verify_blocks(h, BLOCKS_FILE, &m, NULL, 0));
+  ASSERT_EQ(1, acquire_verify_block_list(h, BLOCKS_FILE, &m, some, 2, bad,
+                                         4));
+  ASSERT_EQ(2, bad[0]);
+
+  /* Missing blocks are bad, and so is the last one if more follows it */
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcd"));
+  ASSERT_EQ(2, acquire_verify_blocks(h, BLOCKS_FILE, &m, bad, 4));
+  ASSERT_EQ(1, bad[0]);
+  ASSERT_EQ(2, bad[1]);
+  ASSERT_EQ(0, test_write_string(BLOCKS_FILE, "abcdefghij"));
+  ASSERT_EQ(1, acquire_verify_blocks(h, BLOCKS_FILE, &m, bad, 4));
+  ASSERT_EQ(2, bad[0]);
+
+  ASSERT_EQ(-1, acquire_verify_block_list(h, BLOCKS_FILE, &m, beyond, 1, NULL,
+                                          0));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_verify_blocks(h, "non" PATH_SEP "existent", &m, NULL,
+                                      0));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+
+  acquire_block_manifest_free(&m);
+  acquire_handle_free(h);
+  remove(BLOCKS_FILE);
+  PASS();
+}
+
+TEST test_block_range(void) {
+  struct acquire_block_manifest m;
+  const size_t runs[] = {0, 1, 3, 4};
+  const size_t unordered[] = {2, 1};
+  size_t pos = 0;
+  off_t first, last;
+  memset(&m, 0, sizeof(m));
+  m.block_size = 10;
+  m.size = 45;
+  m.count = 5;
+
+  ASSERT_EQ(1, acquire_block_range(&m, runs, 4, &pos, &first, &last));
+  ASSERT_EQ(0, first);
+  ASSERT_EQ(19, last);
+  /* The last block is short */
+  ASSERT_EQ(1, acquire_block_range(&m, runs, 4, &pos, &first, &last));
+  ASSERT_EQ(30, first);
+  ASSERT_EQ(44, last);
+  ASSERT_EQ(0, acquire_block_range(&m, runs, 4, &pos, &first, &last));
+
+  pos = 0;
+  ASSERT_EQ(-1, acquire_block_range(&m, unordered, 2, &pos, &first, &last));
+  pos = 0;
+  m.count = 4;
+  ASSERT_EQ(-1, acquire_block_range(&m, runs + 3, 1, &pos, &first, &last));
+  PASS();
+}
+
+SUITE(blocks_suite) {
+  RUN_TEST(test_block_manifest_create);
+  RUN_TEST(test_block_manifest_save_load);
+  RUN_TEST(test_verify_blocks);
+  RUN_TEST(test_block_range);
+}
+
+#endif /* !TEST_BLOCKS_H */
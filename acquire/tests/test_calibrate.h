@@ -0,0 +1,113 @@
+#ifndef TEST_CALIBRATE_H
+#define TEST_CALIBRATE_H
+
+#include <stdio.h>
+
+#include <greatest.h>
+
+#include "acquire_calibrate.h"
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *CALIBRATE_PROFILE =
+    DOWNLOAD_DIR PATH_SEP "calibration_test.txt";
+static const char *CALIBRATE_FILE = DOWNLOAD_DIR PATH_SEP "calibrate_abc.txt";
+
+#define CALIBRATE_ABC_SHA256                                                   \
+  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+
+TEST test_calibration_run(void) {
+  struct acquire_calibration cal;
+  acquire_calibration_reset();
+  ASSERT_EQ(-1, acquire_calibration_get(LIBACQUIRE_SHA256, &cal));
+
+  ASSERT_EQ(0, acquire_calibration_run(LIBACQUIRE_SHA256));
+  ASSERT_EQ(0, acquire_calibration_get(LIBACQUIRE_SHA256, &cal));
+  ASSERT_EQ(LIBACQUIRE_SHA256, cal.algorithm);
+  ASSERT(cal.backend != ACQUIRE_BACKEND_NONE);
+  ASSERT(cal.gbps > 0.0);
+  /* Other algorithms are left alone */
+  ASSERT_EQ(-1, acquire_calibration_get(LIBACQUIRE_SHA512, &cal));
+
+  ASSERT_EQ(-1, acquire_calibration_run(LIBACQUIRE_UNSUPPORTED_CHECKSUM));
+  ASSERT_EQ(-1, acquire_calibration_get(LIBACQUIRE_SHA256, NULL));
+  PASS();
+}
+
+TEST test_calibration_auto_backend(void) {
+  struct acquire_calibration cal;
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_string(CALIBRATE_FILE, "abc"));
+  acquire_calibration_reset();
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_AUTO);
+
+  /* Timed on first use, then routed to the winner */
+  ASSERT_EQ(0, acquire_verify_sync(h, CALIBRATE_FILE, LIBACQUIRE_SHA256,
+                                   CALIBRATE_ABC_SHA256));
+  ASSERT_EQ(0, acquire_calibration_get(LIBACQUIRE_SHA256, &cal));
+  ASSERT_EQ(cal.backend, h->active_backend);
+
+  ASSERT_EQ(-1, acquire_verify_sync(h, CALIBRATE_FILE, LIBACQUIRE_SHA256,
+                                    "ba7816bf8f01cfea414140de5dae2223"
+                                    "b00361a396177a9cb410ff61f20015ae"));
+  ASSERT_EQ(cal.backend, h->active_backend);
+
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  /* Several threads on one file are only for the built-in CRC32C */
+  acquire_handle_set_verify_threads(h, 2);
+  ASSERT_EQ(0, acquire_verify_sync(h, CALIBRATE_FILE, LIBACQUIRE_CRC32C,
+                                   "364b3fb7"));
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_CRC32C, h->active_backend);
+  ASSERT_EQ(-1, acquire_calibration_get(LIBACQUIRE_CRC32C, &cal));
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+
+  acquire_handle_free(h);
+  remove(CALIBRATE_FILE);
+  PASS();
+}
+
+TEST test_calibration_profile(void) {
+  struct acquire_calibration cal, saved;
+  acquire_calibration_reset();
+  ASSERT_EQ(0, acquire_calibration_run(LIBACQUIRE_SHA256));
+  ASSERT_EQ(0, acquire_calibration_get(LIBACQUIRE_SHA256, &saved));
+  ASSERT_EQ(0, acquire_calibration_save(CALIBRATE_PROFILE));
+
+  acquire_calibration_reset();
+  ASSERT_EQ(1, acquire_calibration_load(CALIBRATE_PROFILE));
+  ASSERT_EQ(0, acquire_calibration_get(LIBACQUIRE_SHA256, &cal));
+  ASSERT_EQ(saved.backend, cal.backend);
+  ASSERT(cal.gbps > 0.0);
+
+  /* Unknown names, and backends that cannot do the algorithm, are skipped */
+  ASSERT_EQ(0, test_write_string(CALIBRATE_PROFILE,
+                                 "# acquire-calibration 1\n"
+                                 "sha512 none 0.000\n"
+                                 "sha256 blake3 9.000\n"
+                                 "md5 openssl 1.000\n"
+                                 "sha512 nonesuch 1.000\n"
+                                 "not a line\n"));
+  acquire_calibration_reset();
+  ASSERT_EQ(1, acquire_calibration_load(CALIBRATE_PROFILE));
+  ASSERT_EQ(-1, acquire_calibration_get(LIBACQUIRE_SHA256, &cal));
+  ASSERT_EQ(0, acquire_calibration_get(LIBACQUIRE_SHA512, &cal));
+  ASSERT_EQ(ACQUIRE_BACKEND_NONE, cal.backend);
+
+  remove(CALIBRATE_PROFILE);
+  ASSERT_EQ(-1, acquire_calibration_load(CALIBRATE_PROFILE));
+  ASSERT_EQ(-1, acquire_calibration_save("non" PATH_SEP "existent" PATH_SEP
+                                         "calibration.txt"));
+  acquire_calibration_reset();
+  PASS();
+}
+
+SUITE(calibrate_suite) {
+  RUN_TEST(test_calibration_run);
+  RUN_TEST(test_calibration_auto_backend);
+  RUN_TEST(test_calibration_profile);
+}
+
+#endif /* !TEST_CALIBRATE_H */
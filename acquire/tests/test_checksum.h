@@ -105,6 +105,7 @@ TEST test_verify_async_cancellation(void) {
   ASSERT(h != NULL);
 
   /* Start hashing a larger file to ensure we can cancel it mid-process */
+  acquire_handle_set_poll_budget(h, 4096, 0);
   acquire_verify_async_start(h, GREATEST_ARCHIVE, LIBACQUIRE_SHA256,
                              GREATEST_ARCHIVE_SHA256);
 
@@ -122,6 +123,48 @@ TEST test_verify_async_cancellation(void) {
   PASS();
 }
 
+TEST test_verify_async_poll_budget(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  enum acquire_status status;
+  int polls = 0;
+  ASSERT(h != NULL);
+
+  acquire_handle_set_poll_budget(h, 1, 0);
+  ASSERT_EQ(0, acquire_verify_async_start(h, GREATEST_ARCHIVE,
+                                          LIBACQUIRE_SHA256,
+                                          GREATEST_ARCHIVE_SHA256));
+  status = acquire_verify_async_poll(h);
+  ++polls;
+  /* A one byte budget yields after the first read */
+  ASSERT_EQ_FMT(ACQUIRE_IN_PROGRESS, status, "%d");
+  ASSERT(h->bytes_processed > 0);
+
+  acquire_handle_set_poll_budget(h, 0, 0);
+  do {
+    status = acquire_verify_async_poll(h);
+    ++polls;
+  } while (status == ACQUIRE_IN_PROGRESS);
+  /* An unlimited budget finishes in a single further poll */
+  ASSERT_EQ_FMT(2, polls, "%d");
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, status, "%d");
+  acquire_handle_free(h);
+  PASS();
+}
+
+TEST test_verify_sync_keeps_poll_budget(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  acquire_handle_set_poll_budget(h, 4096, 1000);
+  ASSERT_EQ_FMT(0,
+                acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                    GREATEST_SHA256),
+                "%d");
+  ASSERT_EQ(4096, h->poll_budget_bytes);
+  ASSERT_EQ(1000, h->poll_budget_usec);
+  acquire_handle_free(h);
+  PASS();
+}
+
 TEST test_verify_empty_file(void) {
   struct acquire_handle *h = acquire_handle_init();
   int result;
@@ -208,6 +251,8 @@ SUITE(checksums_suite) {
   RUN_TEST(test_verify_sync_failure_bad_file);
   RUN_TEST(test_verify_async_success);
   RUN_TEST(test_verify_async_cancellation);
+  RUN_TEST(test_verify_async_poll_budget);
+  RUN_TEST(test_verify_sync_keeps_poll_budget);
   RUN_TEST(test_verify_empty_file);
   RUN_TEST(test_verify_reusability);
 }
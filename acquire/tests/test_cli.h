@@ -105,6 +105,35 @@ TEST test_cli_parsing_check(void) {
   PASS();
 }
 
+TEST test_cli_parsing_check_manifest(void) {
+  struct DocoptArgs args;
+  char **argv;
+  const char *const src_argv[] = {"acquire", "--check-manifest=SHA256SUMS",
+                                  "-d", "./release"};
+  argv = create_argv(src_argv, 4);
+  ASSERT_EQ(EXIT_SUCCESS, docopt(&args, 4, argv, 0, "v1"));
+  ASSERT_STR_EQ("SHA256SUMS", args.check_manifest);
+  ASSERT_STR_EQ("./release", args.directory);
+  ASSERT_EQ(NULL, args.url);
+  free_argv(argv);
+
+  {
+    const char *const spaced_argv[] = {"acquire", "--check-manifest", "SUMS"};
+    argv = create_argv(spaced_argv, 3);
+    ASSERT_EQ(EXIT_SUCCESS, docopt(&args, 3, argv, 0, "v1"));
+    ASSERT_STR_EQ("SUMS", args.check_manifest);
+    free_argv(argv);
+  }
+
+  {
+    const char *const missing_argv[] = {"acquire", "--check-manifest"};
+    argv = create_argv(missing_argv, 2);
+    ASSERT_EQ(EXIT_FAILURE, docopt(&args, 2, argv, 0, "v1"));
+    free_argv(argv);
+  }
+  PASS();
+}
+
 TEST test_cli_parsing_output_file(void) {
   struct DocoptArgs args;
   const char *const src_argv[] = {"acquire", "--output=file.out",
@@ -284,6 +313,7 @@ TEST test_cli_multiple_positional_args(void) {
 SUITE(cli_suite) {
   RUN_TEST(test_cli_parsing_download_and_verify);
   RUN_TEST(test_cli_parsing_check);
+  RUN_TEST(test_cli_parsing_check_manifest);
   RUN_TEST(test_cli_parsing_output_file);
   RUN_TEST(test_cli_parsing_help);
   RUN_TEST(test_cli_missing_required_arg_value);
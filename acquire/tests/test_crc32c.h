@@ -0,0 +1,240 @@
+#ifndef TEST_CRC32C_H
+#define TEST_CRC32C_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_checksums.h"
+#include "acquire_crc32c.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *CRC32C_PARALLEL_FILE_PATH =
+    DOWNLOAD_DIR PATH_SEP "crc32c_parallel.bin";
+
+/* Bit-at-a-time CRC32C, slow but obviously correct */
+static uint32_t crc32c_reference(const unsigned char *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFFU;
+  size_t i;
+  int k;
+  for (i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0x82F63B78U & (0U - (crc & 1U)));
+  }
+  return crc ^ 0xFFFFFFFFU;
+}
+
+/* RFC 3720 (iSCSI) appendix B.4 and the usual "123456789" check value */
+TEST test_crc32c_rfc3720_vectors(enum acquire_crc32c_kernel kernel) {
+  static const unsigned char read_pdu[48] = {
+      0x01, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+      0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18, 0x28, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  unsigned char buf[32];
+  int i;
+
+  if (!acquire_crc32c_kernel_supported(kernel))
+    SKIPm("CRC32C kernel not supported on this CPU");
+
+  memset(buf, 0, sizeof(buf));
+  ASSERT_EQ_FMT(0x8A9136AAU,
+                acquire_crc32c_with_kernel(kernel, 0, buf, sizeof(buf)), "%08x");
+  memset(buf, 0xFF, sizeof(buf));
+  ASSERT_EQ_FMT(0x62A8AB43U,
+                acquire_crc32c_with_kernel(kernel, 0, buf, sizeof(buf)), "%08x");
+  for (i = 0; i < 32; i++)
+    buf[i] = (unsigned char)i;
+  ASSERT_EQ_FMT(0x46DD794EU,
+                acquire_crc32c_with_kernel(kernel, 0, buf, sizeof(buf)), "%08x");
+  for (i = 0; i < 32; i++)
+    buf[i] = (unsigned char)(31 - i);
+  ASSERT_EQ_FMT(0x113FDB5CU,
+                acquire_crc32c_with_kernel(kernel, 0, buf, sizeof(buf)), "%08x");
+  ASSERT_EQ_FMT(0xD9963A56U,
+                acquire_crc32c_with_kernel(kernel, 0, read_pdu,
+                                           sizeof(read_pdu)),
+                "%08x");
+  ASSERT_EQ_FMT(0xE3069283U,
+                acquire_crc32c_with_kernel(kernel, 0, "123456789", 9), "%08x");
+  PASS();
+}
+
+/*
+ * Long enough to take the 3 x 8 KiB interleaved path in the hardware
+ * kernels, with offsets and lengths that exercise every alignment prologue,
+ * the short interleaved path, the 16/8 byte slices and the byte tail.
+ */
+TEST test_crc32c_kernel_matches_reference(enum acquire_crc32c_kernel kernel) {
+  static const size_t offsets[] = {0, 1, 3, 7, 8};
+  static const size_t lengths[] = {0,    1,    7,     8,     15,   255,
+                                   768,  769,  4099,  24576, 24583, 60000};
+  const size_t size = 65536;
+  unsigned char *buf;
+  uint32_t seed = 0x12345678U;
+  size_t i, j, k;
+
+  if (!acquire_crc32c_kernel_supported(kernel))
+    SKIPm("CRC32C kernel not supported on this CPU");
+
+  buf = (unsigned char *)malloc(size);
+  ASSERT(buf != NULL);
+  for (i = 0; i < size; i++) {
+    seed = seed * 1103515245U + 12345U;
+    buf[i] = (unsigned char)(seed >> 16);
+  }
+
+  for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    for (j = 0; j < sizeof(lengths) / sizeof(lengths[0]); j++) {
+      const unsigned char *p = buf + offsets[i];
+      const size_t len = lengths[j];
+      const uint32_t expected = crc32c_reference(p, len);
+      uint32_t crc = acquire_crc32c_with_kernel(kernel, 0, p, len);
+      if (crc != expected) {
+        free(buf);
+        FAILm("one-shot CRC32C differs from reference");
+      }
+      /* Feeding the same bytes in uneven pieces must not change the result */
+      crc = 0;
+      for (k = 0; k < len; k += 1000)
+        crc = acquire_crc32c_with_kernel(kernel, crc, p + k,
+                                         len - k < 1000 ? len - k : 1000);
+      if (crc != expected) {
+        free(buf);
+        FAILm("incremental CRC32C differs from reference");
+      }
+    }
+  free(buf);
+  PASS();
+}
+
+TEST test_crc32c_dispatch_uses_supported_kernel(void) {
+  const enum acquire_crc32c_kernel active = acquire_crc32c_active_kernel();
+  ASSERT(acquire_crc32c_kernel_supported(active));
+  ASSERT_EQ_FMT(acquire_crc32c_with_kernel(active, 0, "123456789", 9),
+                acquire_crc32c(0, "123456789", 9), "%08x");
+  ASSERT_EQ_FMT(0x1234U, acquire_crc32c(0x1234U, NULL, 0), "%08x");
+  PASS();
+}
+
+TEST test_crc32c_combine(void) {
+  unsigned char buf[10000];
+  uint32_t whole, a, b;
+  size_t i, split;
+  for (i = 0; i < sizeof(buf); i++)
+    buf[i] = (unsigned char)(i * 31 + 7);
+  whole = acquire_crc32c(0, buf, sizeof(buf));
+  for (split = 0; split <= sizeof(buf); split += 1111) {
+    a = acquire_crc32c(0, buf, split);
+    b = acquire_crc32c(0, buf + split, sizeof(buf) - split);
+    ASSERT_EQ_FMT(whole,
+                  acquire_crc32c_combine(a, b, (uint64_t)(sizeof(buf) - split)),
+                  "%08x");
+  }
+  ASSERT_EQ_FMT(whole, acquire_crc32c_combine(whole, 0, 0), "%08x");
+  PASS();
+}
+
+static const struct test_pattern CRC32C_PARALLEL_PATTERN = {13, 5, 251};
+
+/* Writes a file big enough to be split into several ranges; returns its CRC */
+static uint32_t crc32c_write_parallel_file(off_t *size_out) {
+  const size_t size = 3 * ACQUIRE_CRC32C_PARALLEL_MIN_RANGE + 12345;
+  unsigned char chunk[4096];
+  uint32_t crc = 0;
+  size_t done, n;
+  if (test_write_pattern(CRC32C_PARALLEL_FILE_PATH, size,
+                         &CRC32C_PARALLEL_PATTERN) != 0)
+    return 0;
+  for (done = 0; done < size; done += n) {
+    n = size - done < sizeof(chunk) ? size - done : sizeof(chunk);
+    test_pattern_fill(&CRC32C_PARALLEL_PATTERN, done, chunk, n);
+    crc = acquire_crc32c(crc, chunk, n);
+  }
+  *size_out = (off_t)size;
+  return crc;
+}
+
+TEST test_crc32c_parallel_verify(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  char hex[9];
+  off_t size = 0;
+  enum acquire_status status;
+  const uint32_t crc = crc32c_write_parallel_file(&size);
+  ASSERT(h != NULL);
+  ASSERT(size > 0);
+  snprintf(hex, sizeof(hex), "%08x", crc);
+
+  /* Non-blocking polls while the workers run */
+  acquire_handle_set_verify_threads(h, 4);
+  acquire_handle_set_poll_budget(h, 1, 0);
+  ASSERT_EQ(0, acquire_verify_async_start(h, CRC32C_PARALLEL_FILE_PATH,
+                                          LIBACQUIRE_CRC32C, hex));
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_CRC32C, h->active_backend);
+  do {
+    status = acquire_verify_async_poll(h);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, status, "%d");
+  ASSERT_EQ(size, h->bytes_processed);
+
+  /* One thread per CPU through the blocking API */
+  acquire_handle_set_verify_threads(h, 0);
+  ASSERT_EQ(0, acquire_verify_sync(h, CRC32C_PARALLEL_FILE_PATH,
+                                   LIBACQUIRE_CRC32C, hex));
+
+  hex[0] = hex[0] == '0' ? '1' : '0';
+  acquire_handle_set_verify_threads(h, 3);
+  ASSERT_EQ(-1, acquire_verify_sync(h, CRC32C_PARALLEL_FILE_PATH,
+                                    LIBACQUIRE_CRC32C, hex));
+  ASSERT_EQ(ACQUIRE_ERROR, h->status);
+  ASSERT_EQ(-1, _crc32c_verify_async_start(h, CRC32C_PARALLEL_FILE_PATH,
+                                          LIBACQUIRE_CRC32C, NULL));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(CRC32C_PARALLEL_FILE_PATH);
+  PASS();
+}
+
+TEST test_crc32c_parallel_cancel(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  off_t size = 0;
+  const uint32_t crc = crc32c_write_parallel_file(&size);
+  char hex[9];
+  ASSERT(h != NULL);
+  ASSERT(size > 0);
+  snprintf(hex, sizeof(hex), "%08x", crc);
+
+  acquire_handle_set_verify_threads(h, 2);
+  ASSERT_EQ(0, acquire_verify_async_start(h, CRC32C_PARALLEL_FILE_PATH,
+                                          LIBACQUIRE_CRC32C, hex));
+  acquire_verify_async_cancel(h);
+  ASSERT_EQ(ACQUIRE_ERROR, acquire_verify_async_poll(h));
+  ASSERT_EQ(ACQUIRE_ERROR_CANCELLED, acquire_handle_get_error_code(h));
+  ASSERT(h->backend_handle == NULL);
+
+  acquire_handle_free(h);
+  remove(CRC32C_PARALLEL_FILE_PATH);
+  PASS();
+}
+
+SUITE(crc32c_suite) {
+  static const enum acquire_crc32c_kernel kernels[] = {
+      ACQUIRE_CRC32C_KERNEL_PORTABLE, ACQUIRE_CRC32C_KERNEL_SSE42,
+      ACQUIRE_CRC32C_KERNEL_ARMV8};
+  size_t i;
+  for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    RUN_TEST1(test_crc32c_rfc3720_vectors, kernels[i]);
+    RUN_TEST1(test_crc32c_kernel_matches_reference, kernels[i]);
+  }
+  RUN_TEST(test_crc32c_dispatch_uses_supported_kernel);
+  RUN_TEST(test_crc32c_combine);
+  RUN_TEST(test_crc32c_parallel_verify);
+  RUN_TEST(test_crc32c_parallel_cancel);
+}
+
+#endif /* !TEST_CRC32C_H */
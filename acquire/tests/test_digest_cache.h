@@ -0,0 +1,170 @@
+#ifndef TEST_DIGEST_CACHE_H
+#define TEST_DIGEST_CACHE_H
+
+#include <stdio.h>
+
+#include <greatest.h>
+
+#include "acquire_digest_cache.h"
+#include "acquire_handle.h"
+#include "acquire_net_common.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+#include <sys/types.h>
+#include <time.h>
+#include <utime.h>
+
+static const char *DIGEST_CACHE_INDEX =
+    DOWNLOAD_DIR PATH_SEP "digest_cache_test.idx";
+static const char *DIGEST_CACHE_FILE =
+    DOWNLOAD_DIR PATH_SEP "digest_cache_test.txt";
+
+#define DIGEST_CACHE_ABC_SHA256                                                \
+  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+#define DIGEST_CACHE_ABD_SHA256                                                \
+  "a52d159f262b2c6ddb724a61840befc36eb30c88877a4030b65cbe86298449c9"
+
+/* Write `contents`, dated `age` seconds ago so it is not racily clean */
+static int digest_cache_write(const char *contents, long age) {
+  struct utimbuf times;
+  if (test_write_string(DIGEST_CACHE_FILE, contents) != 0)
+    return -1;
+  times.actime = times.modtime = time(NULL) - age;
+  return utime(DIGEST_CACHE_FILE, &times);
+}
+
+TEST test_digest_cache_hit_after_verify(void) {
+  struct acquire_digest_cache *cache;
+  struct acquire_digest_cache_stats stats;
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  remove(DIGEST_CACHE_INDEX);
+  ASSERT_EQ(0, digest_cache_write("abc", 60));
+  cache = acquire_digest_cache_open(DIGEST_CACHE_INDEX);
+  ASSERT(cache != NULL);
+
+  ASSERT_EQ(-1, acquire_digest_cache_lookup(cache, DIGEST_CACHE_FILE,
+                                            LIBACQUIRE_SHA256,
+                                            DIGEST_CACHE_ABC_SHA256));
+  ASSERT_EQ(0, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                     LIBACQUIRE_SHA256,
+                                     DIGEST_CACHE_ABC_SHA256));
+  ASSERT(acquire_handle_get_progress(h) == 3);
+  /* Answered without reading: the handle's progress is untouched */
+  acquire_handle_set_progress(h, 0);
+  ASSERT_EQ(0, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                     LIBACQUIRE_SHA256,
+                                     DIGEST_CACHE_ABC_SHA256));
+  ASSERT_EQ(0, acquire_handle_get_progress(h));
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+  /* Only a match is taken on trust: a different digest is hashed again */
+  ASSERT_EQ(-1, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                      LIBACQUIRE_SHA256,
+                                      DIGEST_CACHE_ABD_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  ASSERT_EQ(3, acquire_handle_get_progress(h));
+  /* Other algorithms are separate entries */
+  ASSERT_EQ(-1, acquire_digest_cache_lookup(cache, DIGEST_CACHE_FILE,
+                                            LIBACQUIRE_SHA512,
+                                            DIGEST_CACHE_ABC_SHA256));
+
+  acquire_digest_cache_get_stats(cache, &stats);
+  ASSERT_EQ(2, stats.hits);
+  ASSERT_EQ(3, stats.misses);
+  ASSERT_EQ(1, stats.stores);
+  ASSERT_EQ(0, stats.stale);
+  acquire_digest_cache_close(cache);
+
+  /* The index outlives the process */
+  cache = acquire_digest_cache_open(DIGEST_CACHE_INDEX);
+  ASSERT(cache != NULL);
+  ASSERT_EQ(1, acquire_digest_cache_lookup(cache, DIGEST_CACHE_FILE,
+                                           LIBACQUIRE_SHA256,
+                                           DIGEST_CACHE_ABC_SHA256));
+
+  /* `is_downloaded` uses a cache only once given one, and only reads it */
+  ASSERT(acquire_digest_cache_default() == NULL);
+  acquire_digest_cache_set_default(cache);
+  ASSERT(acquire_digest_cache_default() == cache);
+  ASSERT(is_downloaded(DIGEST_CACHE_FILE, LIBACQUIRE_SHA256,
+                       DIGEST_CACHE_ABC_SHA256, NULL));
+  ASSERT(!is_downloaded(DIGEST_CACHE_FILE, LIBACQUIRE_SHA256,
+                        DIGEST_CACHE_ABD_SHA256, NULL));
+  ASSERT(!is_downloaded(DOWNLOAD_DIR, LIBACQUIRE_SHA256,
+                        DIGEST_CACHE_ABC_SHA256, NULL));
+  acquire_digest_cache_get_stats(cache, &stats);
+  ASSERT_EQ(3, stats.hits);
+  ASSERT_EQ(0, stats.stores);
+  acquire_digest_cache_set_default(NULL);
+  acquire_digest_cache_close(cache);
+  acquire_handle_free(h);
+  PASS();
+}
+
+TEST test_digest_cache_invalidates_changed_files(void) {
+  struct acquire_digest_cache *cache;
+  struct acquire_digest_cache_stats stats;
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  remove(DIGEST_CACHE_INDEX);
+  ASSERT_EQ(0, digest_cache_write("abc", 60));
+  cache = acquire_digest_cache_open(DIGEST_CACHE_INDEX);
+  ASSERT(cache != NULL);
+  ASSERT_EQ(0, acquire_digest_cache_store(cache, DIGEST_CACHE_FILE,
+                                          LIBACQUIRE_SHA256,
+                                          DIGEST_CACHE_ABC_SHA256));
+
+  /* Same size, and even the same mtime: the ctime still moves */
+  ASSERT_EQ(0, digest_cache_write("abd", 60));
+  ASSERT_EQ(-1, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                      LIBACQUIRE_SHA256,
+                                      DIGEST_CACHE_ABC_SHA256));
+  ASSERT_EQ(3, acquire_handle_get_progress(h));
+  ASSERT_EQ(0, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                     LIBACQUIRE_SHA256,
+                                     DIGEST_CACHE_ABD_SHA256));
+  acquire_digest_cache_get_stats(cache, &stats);
+  ASSERT(stats.stale >= 1);
+  ASSERT_EQ(0, stats.hits);
+  ASSERT_EQ(2, stats.stores);
+
+  /* A file written just now is hashed every time until it settles */
+  ASSERT_EQ(0, digest_cache_write("abc", 0));
+  ASSERT_EQ(0, acquire_verify_cached(cache, h, DIGEST_CACHE_FILE,
+                                     LIBACQUIRE_SHA256,
+                                     DIGEST_CACHE_ABC_SHA256));
+  ASSERT_EQ(-1, acquire_digest_cache_store(cache, DIGEST_CACHE_FILE,
+                                           LIBACQUIRE_SHA256,
+                                           DIGEST_CACHE_ABC_SHA256));
+  acquire_digest_cache_get_stats(cache, &stats);
+  ASSERT_EQ(2, stats.stores);
+
+  /* Missing files are reported, not cached */
+  ASSERT_EQ(-1, acquire_verify_cached(cache, h, "nonexistent.file",
+                                      LIBACQUIRE_SHA256,
+                                      DIGEST_CACHE_ABC_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+
+  acquire_digest_cache_close(cache);
+  remove(DIGEST_CACHE_INDEX);
+  remove(DIGEST_CACHE_FILE);
+  acquire_handle_free(h);
+  PASS();
+}
+
+SUITE(digest_cache_suite) {
+  RUN_TEST(test_digest_cache_hit_after_verify);
+  RUN_TEST(test_digest_cache_invalidates_changed_files);
+}
+
+#else
+
+SUITE(digest_cache_suite) {}
+
+#endif /* !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&     \
+          !defined(__NT__) */
+
+#endif /* !TEST_DIGEST_CACHE_H */
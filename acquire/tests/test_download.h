@@ -5,13 +5,18 @@
 
 #include <greatest.h>
 
+#include "acquire_blocks.h"
 #include "acquire_checksums.h"
 #include "acquire_common_defs.h"
 #include "acquire_download.h"
+#include "acquire_fileutils.h"
+#include "acquire_multi_digest.h"
 #include "config_for_tests.h"
+#include "test_util.h"
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #else
+#include <poll.h>
 #include <unistd.h>
 #endif
 
@@ -66,6 +71,278 @@ TEST test_async_download(void) {
   PASS();
 }
 
+TEST test_async_download_poll_wait(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  const char local_path[] = DOWNLOAD_DIR PATH_SEP "greatest_waited.h";
+  ASSERT(h != NULL);
+
+  /* Polls sleep on the transfer instead, so no pause is needed here */
+  acquire_handle_set_poll_wait(h, 1000);
+  ASSERT_EQ(0, acquire_download_async_start(h, GREATEST_URL, local_path));
+  while (acquire_download_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h->status, "%d");
+  ASSERT_EQ(0, acquire_verify_sync(h, local_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  /* The blocking form picks its own wait, and leaves the handle's alone */
+  ASSERT_EQ(0, acquire_download_sync(h, GREATEST_URL, local_path));
+  ASSERT_EQ(1000, h->poll_wait_msec);
+
+  acquire_handle_free(h);
+  remove(local_path);
+  PASS();
+}
+
+/* What a download asked its event loop for through the socket hook */
+struct download_events {
+  int socket_calls;
+  int last_events;
+};
+
+static void download_record_socket(struct acquire_handle *handle,
+                                   acquire_socket_t fd, int events,
+                                   void *user_data) {
+  struct download_events *seen = (struct download_events *)user_data;
+  (void)handle;
+  (void)fd;
+  seen->socket_calls++;
+  seen->last_events = events;
+}
+
+TEST test_async_download_event_loop(void) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  SKIPm("Drives the download with poll(2)");
+#else
+  struct acquire_handle *h = acquire_handle_init();
+  const char local_path[] = DOWNLOAD_DIR PATH_SEP "greatest_evented.h";
+  struct acquire_download_fd fds[8];
+  struct pollfd pfds[8];
+  struct download_events seen;
+  enum acquire_status status;
+  long timeout_ms;
+  int n, i, ready;
+  ASSERT(h != NULL);
+  seen.socket_calls = seen.last_events = 0;
+  acquire_handle_set_event_hooks(h, download_record_socket, NULL, &seen);
+
+  ASSERT_EQ(0, acquire_download_async_start(h, GREATEST_URL, local_path));
+  status = h->status;
+  while (status == ACQUIRE_IN_PROGRESS) {
+    n = acquire_download_get_fds(h, fds, 8, &timeout_ms);
+    ASSERT(n >= 0 && n <= 8);
+    /* A running download always has something to wake it */
+    ASSERT(n > 0 || timeout_ms >= 0);
+    for (i = 0; i < n; i++) {
+      pfds[i].fd = fds[i].fd;
+      pfds[i].events = (short)(((fds[i].events & ACQUIRE_EVENT_IN) ? POLLIN
+                                                                   : 0) |
+                               ((fds[i].events & ACQUIRE_EVENT_OUT) ? POLLOUT
+                                                                    : 0));
+      pfds[i].revents = 0;
+    }
+    ready = poll(pfds, (nfds_t)n, (int)timeout_ms);
+    ASSERT(ready >= 0);
+    if (ready == 0)
+      status = acquire_download_socket_action(h, ACQUIRE_SOCKET_TIMEOUT, 0);
+    for (i = 0; i < n && ready > 0 && status == ACQUIRE_IN_PROGRESS; i++)
+      if (pfds[i].revents)
+        status = acquire_download_socket_action(
+            h, pfds[i].fd,
+            ((pfds[i].revents & POLLIN) ? ACQUIRE_EVENT_IN : 0) |
+                ((pfds[i].revents & POLLOUT) ? ACQUIRE_EVENT_OUT : 0) |
+                ((pfds[i].revents & (POLLERR | POLLHUP)) ? ACQUIRE_EVENT_ERR
+                                                         : 0));
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, status, "%d");
+  ASSERT_EQ(0, acquire_verify_sync(h, local_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  /* Nothing is left to watch, and the loop was told so */
+  ASSERT_EQ(0, acquire_download_get_fds(h, fds, 8, &timeout_ms));
+  ASSERT_EQ(-1, timeout_ms);
+  ASSERT(seen.socket_calls == 0 || seen.last_events == 0);
+  ASSERT_EQ(-1, acquire_download_get_fds(h, fds, 8, NULL));
+
+  acquire_handle_free(h);
+  remove(local_path);
+  PASS();
+#endif
+}
+
+TEST test_engine_downloads(void) {
+  struct acquire_engine *engine = acquire_engine_create();
+  struct acquire_handle *h[3];
+  char paths[3][PATH_MAX];
+  int i, left;
+  ASSERT(engine != NULL);
+  for (i = 0; i < 3; i++) {
+    h[i] = acquire_handle_init();
+    ASSERT(h[i] != NULL);
+    acquire_handle_set_engine(h[i], engine);
+    sprintf(paths[i], "%s%sgreatest_engine%d.h", DOWNLOAD_DIR, PATH_SEP, i);
+    ASSERT_EQ(0, acquire_download_async_start(h[i], GREATEST_URL, paths[i]));
+  }
+
+  /* One poll drives every download; the handles only report */
+  while ((left = acquire_engine_poll(engine, 100)) > 0) {
+  }
+  ASSERT_EQ(0, left);
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ_FMT(ACQUIRE_COMPLETE, acquire_download_async_poll(h[i]), "%d");
+    ASSERT_EQ(0, acquire_verify_sync(h[i], paths[i], LIBACQUIRE_SHA256,
+                                     GREATEST_SHA256));
+  }
+
+  /* A blocking download on the engine drives it too */
+  ASSERT_EQ(0, acquire_download_sync(h[0], GREATEST_URL, paths[0]));
+  ASSERT_EQ(0, acquire_engine_poll(engine, 0));
+
+  for (i = 0; i < 3; i++) {
+    acquire_handle_free(h[i]);
+    remove(paths[i]);
+  }
+  acquire_engine_free(engine);
+  PASS();
+}
+
+TEST test_engine_cancellation(void) {
+  struct acquire_engine *engine = acquire_engine_create();
+  struct acquire_handle *kept = acquire_handle_init();
+  struct acquire_handle *dropped = acquire_handle_init();
+  const char kept_path[] = DOWNLOAD_DIR PATH_SEP "greatest_engine_kept.h";
+  const char dropped_path[] = DOWNLOAD_DIR PATH_SEP "greatest_engine_dropped.h";
+  ASSERT(engine != NULL && kept != NULL && dropped != NULL);
+  acquire_handle_set_engine(kept, engine);
+  acquire_handle_set_engine(dropped, engine);
+
+  ASSERT_EQ(0, acquire_download_async_start(kept, GREATEST_URL, kept_path));
+  ASSERT_EQ(0,
+            acquire_download_async_start(dropped, GREATEST_URL, dropped_path));
+  /* Backends that download inside the start call have nothing to cancel */
+  if (dropped->status == ACQUIRE_IN_PROGRESS) {
+    acquire_download_async_cancel(dropped);
+    while (acquire_engine_poll(engine, 100) > 0) {
+    }
+    ASSERT_EQ_FMT(ACQUIRE_ERROR_CANCELLED,
+                  acquire_handle_get_error_code(dropped), "%d");
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, kept->status, "%d");
+
+  /* Freeing a handle takes its download off the engine */
+  ASSERT_EQ(0, acquire_download_async_start(kept, GREATEST_URL, kept_path));
+  ASSERT_EQ(0,
+            acquire_download_async_start(dropped, GREATEST_URL, dropped_path));
+  acquire_handle_free(dropped);
+  dropped = NULL;
+  while (acquire_engine_poll(engine, 100) > 0) {
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, kept->status, "%d");
+
+  /* Freeing the engine stops whatever is still on it */
+  ASSERT_EQ(0, acquire_download_async_start(kept, GREATEST_URL, kept_path));
+  if (kept->status == ACQUIRE_IN_PROGRESS) {
+    acquire_engine_free(engine);
+    ASSERT_EQ_FMT(ACQUIRE_ERROR_CANCELLED, acquire_handle_get_error_code(kept),
+                  "%d");
+  } else {
+    acquire_engine_free(engine);
+  }
+
+  acquire_handle_free(kept);
+  acquire_handle_free(dropped);
+  remove(kept_path);
+  remove(dropped_path);
+  PASS();
+}
+
+TEST test_session_downloads(void) {
+  struct acquire_session *session = acquire_session_create();
+  struct acquire_engine *engine = acquire_engine_create();
+  struct acquire_handle *a = acquire_handle_init();
+  struct acquire_handle *b = acquire_handle_init();
+  const char a_path[] = DOWNLOAD_DIR PATH_SEP "greatest_session_a.h";
+  const char b_path[] = DOWNLOAD_DIR PATH_SEP "greatest_session_b.h";
+  ASSERT(session != NULL && engine != NULL && a != NULL && b != NULL);
+  acquire_handle_set_session(a, session);
+  acquire_handle_set_session(b, session);
+
+  /* One after the other, the second picking up what the first left */
+  ASSERT_EQ(0, acquire_download_sync(a, GREATEST_URL, a_path));
+  ASSERT_EQ(0, acquire_download_sync(a, GREATEST_URL, a_path));
+  ASSERT_EQ(0, acquire_verify_sync(a, a_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  /* Side by side on one engine */
+  acquire_handle_set_engine(a, engine);
+  acquire_handle_set_engine(b, engine);
+  ASSERT_EQ(0, acquire_download_async_start(a, GREATEST_URL, a_path));
+  ASSERT_EQ(0, acquire_download_async_start(b, GREATEST_URL, b_path));
+  while (acquire_engine_poll(engine, 100) > 0) {
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, a->status, "%d");
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, b->status, "%d");
+  ASSERT_EQ(0, acquire_verify_sync(b, b_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  acquire_handle_free(a);
+  acquire_handle_free(b);
+  acquire_engine_free(engine);
+  acquire_session_free(session);
+  remove(a_path);
+  remove(b_path);
+  PASS();
+}
+
+TEST test_download_batch(void) {
+  struct acquire_engine *engine = acquire_engine_create();
+  struct acquire_handle *h[3];
+  struct acquire_download_item items[3];
+  char paths[3][PATH_MAX];
+  int i;
+  ASSERT(engine != NULL);
+  for (i = 0; i < 3; i++) {
+    h[i] = acquire_handle_init();
+    ASSERT(h[i] != NULL);
+    sprintf(paths[i], "%s%sgreatest_batch%d.h", DOWNLOAD_DIR, PATH_SEP, i);
+    items[i].handle = h[i];
+    items[i].url = GREATEST_URL;
+    items[i].dest_path = paths[i];
+  }
+
+  /* On an engine of their own, one of them unable to write */
+  items[2].dest_path = "non" PATH_SEP "existent" PATH_SEP "greatest.h";
+  ASSERT_EQ(1, acquire_download_batch(NULL, items, 3));
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h[0]->status, "%d");
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h[1]->status, "%d");
+  ASSERT_EQ_FMT(ACQUIRE_ERROR_FILE_OPEN_FAILED,
+                acquire_handle_get_error_code(h[2]), "%d");
+  items[2].dest_path = paths[2];
+
+  /* Over one connection to the origin, and off the engine afterwards */
+  ASSERT_EQ(0, acquire_engine_set_origin_limits(engine, 1, 100));
+  ASSERT_EQ(0, acquire_download_batch(engine, items, 3));
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(NULL, h[i]->engine);
+    ASSERT_EQ(0, acquire_verify_sync(h[i], paths[i], LIBACQUIRE_SHA256,
+                                     GREATEST_SHA256));
+  }
+  ASSERT_EQ(0, acquire_download_batch(engine, items, 0));
+
+  ASSERT_EQ(-1, acquire_engine_set_origin_limits(engine, 1, 0));
+  ASSERT_EQ(-1, acquire_engine_set_origin_limits(engine, -1, 100));
+  items[1].handle = NULL;
+  ASSERT_EQ(-1, acquire_download_batch(engine, items, 3));
+  ASSERT_EQ(-1, acquire_download_batch(engine, NULL, 1));
+
+  for (i = 0; i < 3; i++) {
+    acquire_handle_free(h[i]);
+    remove(paths[i]);
+  }
+  acquire_engine_free(engine);
+  PASS();
+}
+
 TEST test_async_download_invalid_args(void) {
   struct acquire_handle *h = acquire_handle_init();
   int result;
@@ -220,9 +497,195 @@ TEST test_download_reusability(void) {
   PASS();
 }
 
+TEST test_verified_download(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  const char local_path[] = DOWNLOAD_DIR PATH_SEP "greatest_verified.h";
+  ASSERT(h != NULL);
+
+  ASSERT_EQ_FMT(0,
+                acquire_download_verified_sync(h, GREATEST_URL, local_path,
+                                               LIBACQUIRE_SHA256,
+                                               GREATEST_SHA256),
+                "%d");
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h->status, "%d");
+  ASSERT_EQ(1, h->digests[0].matched);
+  ASSERT(h->download_digest == NULL);
+
+  /* Same bytes, wrong digest: the transfer itself fails */
+  ASSERT_EQ_FMT(
+      -1,
+      acquire_download_verified_sync(
+          h, GREATEST_URL, local_path, LIBACQUIRE_SHA256,
+          "0000000000000000000000000000000000000000000000000000000000000000"),
+      "%d");
+  ASSERT_EQ_FMT(ACQUIRE_ERROR_CHECKSUM_MISMATCH,
+                acquire_handle_get_error_code(h), "%d");
+  ASSERT_STR_EQ(GREATEST_SHA256, h->digests[0].computed_hash);
+  ASSERT(is_file(local_path));
+
+  /* Rejected before anything is fetched */
+  ASSERT_EQ(-1, acquire_download_verified_sync(h, GREATEST_URL, local_path,
+                                               LIBACQUIRE_SHA256, "abc"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(local_path);
+  PASS();
+}
+
+/* Hash the first `len` bytes of `path` into a checkpoint, as an
+ * interrupted verified download would have */
+static size_t download_checkpoint_of(struct acquire_handle *h,
+                                     const char *path, off_t len,
+                                     void *out, size_t size) {
+  struct acquire_digest_spec spec;
+  struct acquire_digest_stream *stream;
+  unsigned char chunk[4096];
+  size_t taken = 0, n;
+  FILE *f = fopen(path, "rb");
+  spec.algorithm = LIBACQUIRE_SHA256;
+  spec.expected_hash = GREATEST_SHA256;
+  stream = acquire_digest_stream_new(h, &spec, 1);
+  while (f != NULL && stream != NULL && len > 0) {
+    n = len < (off_t)sizeof(chunk) ? (size_t)len : sizeof(chunk);
+    if (fread(chunk, 1, n, f) != n ||
+        acquire_digest_stream_update(stream, chunk, n) != 0)
+      break;
+    len -= (off_t)n;
+  }
+  if (len == 0)
+    taken = acquire_digest_stream_checkpoint(stream, out, size);
+  acquire_digest_stream_free(stream);
+  if (f != NULL)
+    fclose(f);
+  return taken;
+}
+
+TEST test_verified_download_resume(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  const char local_path[] = DOWNLOAD_DIR PATH_SEP "greatest_resumed.h";
+  unsigned char checkpoint[ACQUIRE_CHECKPOINT_MAX_SIZE];
+  size_t size;
+  off_t whole, half;
+  FILE *f;
+  ASSERT(h != NULL);
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  /* A crypto library's SHA-2 state may not be exportable; ours is */
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_SHA2);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+  ASSERT_EQ(0, acquire_download_sync(h, GREATEST_URL, local_path));
+  whole = filesize(local_path);
+  half = whole / 2;
+  ASSERT(half > 0);
+  size = download_checkpoint_of(h, local_path, half, checkpoint,
+                                sizeof(checkpoint));
+  if (size == 0) {
+    acquire_handle_free(h);
+    remove(local_path);
+    SKIPm("A digest context in this build cannot be checkpointed");
+  }
+  ASSERT(size <= sizeof(checkpoint));
+
+  /* Spoil what follows the checkpoint, and run on past the end */
+  f = fopen(local_path, "r+b");
+  ASSERT(f != NULL);
+  ASSERT_EQ(0, fseek(f, (long)half, SEEK_SET));
+  fputs("not the rest of greatest.h", f);
+  ASSERT_EQ(0, fseek(f, 0, SEEK_END));
+  fputs("nor anything after it", f);
+  fclose(f);
+
+  ASSERT_EQ(0, acquire_download_verified_resume_async_start(
+                   h, GREATEST_URL, local_path, LIBACQUIRE_SHA256,
+                   GREATEST_SHA256, checkpoint, size));
+  while (acquire_download_async_poll(h) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h->status, "%d");
+  ASSERT_EQ(1, h->digests[0].matched);
+  ASSERT_EQ(whole, filesize(local_path));
+  ASSERT_EQ(0, acquire_verify_sync(h, local_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  /* The file no longer holds what the checkpoint covers */
+  ASSERT_EQ(0, test_write_string(local_path, ""));
+  ASSERT_EQ(-1, acquire_download_verified_resume_async_start(
+                    h, GREATEST_URL, local_path, LIBACQUIRE_SHA256,
+                    GREATEST_SHA256, checkpoint, size));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_READ_FAILED, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_download_verified_resume_async_start(
+                    h, GREATEST_URL, local_path, LIBACQUIRE_SHA256,
+                    GREATEST_SHA256, NULL, 0));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(local_path);
+  PASS();
+}
+
+TEST test_download_repair_blocks(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  const char local_path[] = DOWNLOAD_DIR PATH_SEP "greatest_repaired.h";
+  struct acquire_block_manifest m;
+  size_t bad[8];
+  const size_t unordered[] = {1, 0};
+  off_t whole;
+  int n;
+  FILE *f;
+  ASSERT(h != NULL);
+
+  ASSERT_EQ(0, acquire_download_sync(h, GREATEST_URL, local_path));
+  whole = filesize(local_path);
+  ASSERT(whole > 3 * 4096);
+  ASSERT_EQ(0, acquire_block_manifest_create(h, &m, local_path,
+                                             LIBACQUIRE_SHA256, 4096));
+
+  /* Spoil two adjacent blocks, and run on past the end */
+  f = fopen(local_path, "r+b");
+  ASSERT(f != NULL);
+  ASSERT_EQ(0, fseek(f, 4096 + 100, SEEK_SET));
+  fputs("not greatest.h", f);
+  ASSERT_EQ(0, fseek(f, 2 * 4096 + 100, SEEK_SET));
+  fputs("nor this", f);
+  ASSERT_EQ(0, fseek(f, 0, SEEK_END));
+  fputs("nor anything after it", f);
+  fclose(f);
+
+  n = acquire_verify_blocks(h, local_path, &m, bad, 8);
+  ASSERT_EQ(3, n);
+  ASSERT_EQ(1, bad[0]);
+  ASSERT_EQ(2, bad[1]);
+  ASSERT_EQ(m.count - 1, bad[2]);
+  ASSERT_EQ(0, acquire_download_repair_blocks(h, GREATEST_URL, local_path, &m,
+                                              bad, (size_t)n));
+  ASSERT_EQ_FMT(ACQUIRE_COMPLETE, h->status, "%d");
+  /* Only the bad blocks came over again */
+  ASSERT(acquire_handle_get_progress(h) < whole);
+  ASSERT_EQ(whole, filesize(local_path));
+  ASSERT_EQ(0, acquire_verify_blocks(h, local_path, &m, NULL, 0));
+  ASSERT_EQ(0, acquire_verify_sync(h, local_path, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+
+  ASSERT_EQ(-1, acquire_download_repair_blocks(h, GREATEST_URL, local_path,
+                                               &m, unordered, 2));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+
+  acquire_block_manifest_free(&m);
+  acquire_handle_free(h);
+  remove(local_path);
+  PASS();
+}
+
 SUITE(downloads_suite) {
   RUN_TEST(test_sync_download);
   RUN_TEST(test_async_download);
+  RUN_TEST(test_async_download_poll_wait);
+  RUN_TEST(test_async_download_event_loop);
+  RUN_TEST(test_engine_downloads);
+  RUN_TEST(test_engine_cancellation);
+  RUN_TEST(test_session_downloads);
+  RUN_TEST(test_download_batch);
   RUN_TEST(test_sync_download_invalid_args);
   RUN_TEST(test_async_download_invalid_args);
   RUN_TEST(test_async_cancellation);
@@ -230,5 +693,8 @@ SUITE(downloads_suite) {
   RUN_TEST(test_download_bad_host);
   RUN_TEST(test_download_to_invalid_path);
   RUN_TEST(test_download_reusability);
+  RUN_TEST(test_verified_download);
+  RUN_TEST(test_verified_download_resume);
+  RUN_TEST(test_download_repair_blocks);
 }
 #endif /* !TEST_DOWNLOAD_H */
@@ -0,0 +1,186 @@
+#ifndef TEST_EXECUTOR_H
+#define TEST_EXECUTOR_H
+
+#include <stdio.h>
+
+#include <greatest.h>
+
+#include "acquire_checksums.h"
+#include "acquire_executor.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+#include <poll.h>
+#endif
+
+static const char *EXECUTOR_FILE_PATH =
+    DOWNLOAD_DIR PATH_SEP "executor_test.bin";
+
+#define EXECUTOR_FILE_LEN (8 * 1048576)
+static const struct test_pattern EXECUTOR_PATTERN = {31, 7, 256};
+
+TEST test_executor_verifies_off_thread(void) {
+  struct acquire_executor *ex = acquire_executor_create(2);
+  struct acquire_handle *h = acquire_handle_init();
+  enum acquire_status status;
+  int fd;
+  ASSERT(ex != NULL);
+  ASSERT(h != NULL);
+  acquire_handle_set_executor(h, ex);
+  fd = acquire_handle_get_completion_fd(h);
+
+  ASSERT_EQ(0, acquire_verify_async_start(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                          GREATEST_SHA256));
+  ASSERT(h->job != NULL);
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+  ASSERT(fd >= 0);
+  {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ASSERT_EQ(1, poll(&pfd, 1, 10000));
+    ASSERT(pfd.revents & POLLIN);
+    /* Still readable until the job is collected */
+    ASSERT_EQ(1, poll(&pfd, 1, 0));
+  }
+#else
+  ASSERT_EQ(-1, fd);
+  acquire_executor_wait(h);
+#endif
+  status = acquire_verify_async_poll(h);
+  ASSERT_EQ(ACQUIRE_COMPLETE, status);
+  ASSERT(h->job == NULL);
+  ASSERT(acquire_handle_get_progress(h) > 0);
+  /* The poll budget is the caller's again */
+  ASSERT_EQ(ACQUIRE_DEFAULT_POLL_BUDGET_BYTES, h->poll_budget_bytes);
+#if !defined(WIN32) && !defined(_WIN32) && !defined(__WIN32__) &&             \
+    !defined(__NT__)
+  {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ASSERT_EQ(0, poll(&pfd, 1, 0));
+  }
+#endif
+
+  /* A mismatch surfaces the same way */
+  ASSERT_EQ(0, acquire_verify_async_start(
+                   h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                   "0000000000000000000000000000000000000000000000000000000000"
+                   "000000"));
+  ASSERT_EQ(ACQUIRE_ERROR, acquire_executor_wait(h));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+
+  /* Argument errors are still reported by `async_start` itself */
+  ASSERT_EQ(-1, acquire_verify_async_start(h, "nonexistent.file",
+                                           LIBACQUIRE_SHA256, GREATEST_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+  ASSERT(h->job == NULL);
+
+  acquire_handle_free(h);
+  acquire_executor_free(ex);
+  PASS();
+}
+
+TEST test_executor_sync_and_many_handles(void) {
+  struct acquire_executor *ex = acquire_executor_create(0);
+  struct acquire_handle *handles[4];
+  size_t i;
+  ASSERT(ex != NULL);
+  for (i = 0; i < 4; i++) {
+    handles[i] = acquire_handle_init();
+    ASSERT(handles[i] != NULL);
+    acquire_handle_set_executor(handles[i], ex);
+  }
+  ASSERT_EQ(0, acquire_verify_sync(handles[0], GREATEST_FILE,
+                                   LIBACQUIRE_SHA256, GREATEST_SHA256));
+  for (i = 0; i < 4; i++)
+    ASSERT_EQ(0, acquire_verify_async_start(handles[i], GREATEST_FILE,
+                                            LIBACQUIRE_SHA256,
+                                            GREATEST_SHA256));
+  /* Busy handles refuse a second verification, which leaves the first be */
+  ASSERT_EQ(-1, acquire_verify_async_start(handles[0], GREATEST_FILE,
+                                           LIBACQUIRE_SHA256, GREATEST_SHA256));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT,
+            acquire_handle_get_error_code(handles[0]));
+  for (i = 0; i < 4; i++) {
+    while (acquire_verify_async_poll(handles[i]) == ACQUIRE_IN_PROGRESS)
+      ;
+    ASSERT_EQ(ACQUIRE_COMPLETE, handles[i]->status);
+    ASSERT_EQ(ACQUIRE_OK, acquire_handle_get_error_code(handles[i]));
+  }
+  for (i = 0; i < 4; i++)
+    acquire_handle_free(handles[i]);
+  acquire_executor_free(ex);
+  PASS();
+}
+
+TEST test_executor_cancel_and_shutdown(void) {
+  struct acquire_executor *ex = acquire_executor_create(1);
+  struct acquire_handle *running = acquire_handle_init();
+  struct acquire_handle *queued = acquire_handle_init();
+  enum acquire_status status;
+  ASSERT(ex != NULL);
+  ASSERT(running != NULL && queued != NULL);
+  ASSERT_EQ(0, test_write_pattern(EXECUTOR_FILE_PATH, EXECUTOR_FILE_LEN,
+                                  &EXECUTOR_PATTERN));
+  acquire_handle_set_executor(running, ex);
+  acquire_handle_set_executor(queued, ex);
+  /* Small blocks so cancellation is noticed promptly */
+  acquire_handle_set_read_buffer_size(running, 4096);
+
+  ASSERT_EQ(0, acquire_verify_async_start(
+                   running, EXECUTOR_FILE_PATH, LIBACQUIRE_SHA256,
+                   "0000000000000000000000000000000000000000000000000000000000"
+                   "000000"));
+  ASSERT_EQ(0, acquire_verify_async_start(
+                   queued, EXECUTOR_FILE_PATH, LIBACQUIRE_SHA256,
+                   "0000000000000000000000000000000000000000000000000000000000"
+                   "000000"));
+  acquire_verify_async_cancel(running);
+  status = acquire_executor_wait(running);
+  ASSERT_EQ(ACQUIRE_ERROR, status);
+  ASSERT(acquire_handle_get_error_code(running) == ACQUIRE_ERROR_CANCELLED ||
+         acquire_handle_get_error_code(running) == ACQUIRE_ERROR_UNKNOWN);
+  ASSERT(acquire_handle_get_progress(running) <= (off_t)EXECUTOR_FILE_LEN);
+
+  /* Shutting down finishes whatever is still queued */
+  acquire_executor_free(ex);
+  ASSERT_EQ(ACQUIRE_ERROR, acquire_verify_async_poll(queued));
+  ASSERT(queued->job == NULL);
+
+  /* Both start over uncancelled, on this thread now */
+  acquire_handle_set_executor(running, NULL);
+  acquire_handle_set_executor(queued, NULL);
+  ASSERT_EQ(-1, acquire_verify_sync(
+                    queued, EXECUTOR_FILE_PATH, LIBACQUIRE_SHA256,
+                    "0000000000000000000000000000000000000000000000000000000000"
+                    "000000"));
+  ASSERT_EQ_FMT(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(queued),
+                "%d");
+  ASSERT_EQ(-1, acquire_verify_sync(
+                    running, EXECUTOR_FILE_PATH, LIBACQUIRE_SHA256,
+                    "0000000000000000000000000000000000000000000000000000000000"
+                    "000000"));
+  ASSERT_EQ_FMT(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(running),
+                "%d");
+
+  acquire_handle_free(running);
+  acquire_handle_free(queued);
+  remove(EXECUTOR_FILE_PATH);
+  PASS();
+}
+
+SUITE(executor_suite) {
+  RUN_TEST(test_executor_verifies_off_thread);
+  RUN_TEST(test_executor_sync_and_many_handles);
+  RUN_TEST(test_executor_cancel_and_shutdown);
+}
+
+#endif /* !TEST_EXECUTOR_H */
@@ -0,0 +1,165 @@
+#ifndef TEST_FILE_READER_H
+#define TEST_FILE_READER_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_checksums.h"
+#include "acquire_file_reader.h"
+#include "acquire_handle.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *FILE_READER_PATH =
+    DOWNLOAD_DIR PATH_SEP "file_reader_test.bin";
+static const char *FILE_READER_EMPTY_PATH =
+    DOWNLOAD_DIR PATH_SEP "file_reader_empty.bin";
+
+/* Not a multiple of any block size used below */
+#define FILE_READER_LEN 100003
+
+static const struct test_pattern FILE_READER_PATTERN = {13, 5, 251};
+
+/* Both paths hand out the same bytes in blocks of at most `block_size` */
+TEST test_file_reader_mapped_and_read(void) {
+  struct acquire_file_reader reader;
+  const unsigned char *data;
+  size_t len, total, i, blocks;
+  int flags, got;
+  ASSERT_EQ(0, test_write_pattern(FILE_READER_PATH, FILE_READER_LEN,
+                                  &FILE_READER_PATTERN));
+  for (flags = 0; flags <= ACQUIRE_FILE_READER_MAP; flags++) {
+    ASSERT_EQ(0, acquire_file_reader_open(&reader, FILE_READER_PATH, 4096,
+                                          flags));
+    ASSERT_EQ((off_t)FILE_READER_LEN, reader.size);
+    ASSERT_EQ(flags ? 0 : 1, reader.map == NULL);
+    total = blocks = 0;
+    while ((got = acquire_file_reader_next(&reader, &data, &len)) == 1) {
+      ASSERT(len > 0 && len <= 4096);
+      for (i = 0; i < len; i++)
+        if (data[i] != test_pattern_byte(&FILE_READER_PATTERN, total + i))
+          FAILm("Block contents differ from the file");
+      total += len;
+      blocks++;
+    }
+    ASSERT_EQ(0, got);
+    ASSERT_EQ((size_t)FILE_READER_LEN, total);
+    ASSERT_EQ((size_t)(FILE_READER_LEN + 4095) / 4096, blocks);
+    acquire_file_reader_close(&reader);
+  }
+  PASS();
+}
+
+TEST test_file_reader_read_at_and_seek(void) {
+  struct acquire_file_reader reader;
+  unsigned char scratch[64];
+  const unsigned char *data;
+  size_t got;
+  int flags;
+  ASSERT_EQ(0, test_write_pattern(FILE_READER_PATH, FILE_READER_LEN,
+                                  &FILE_READER_PATTERN));
+  for (flags = 0; flags <= ACQUIRE_FILE_READER_MAP; flags++) {
+    ASSERT_EQ(0,
+              acquire_file_reader_open(&reader, FILE_READER_PATH, 64, flags));
+    ASSERT_EQ(0, acquire_file_reader_read_at(&reader, 70000, sizeof(scratch),
+                                             scratch, &data, &got));
+    ASSERT_EQ(sizeof(scratch), got);
+    ASSERT_EQ(test_pattern_byte(&FILE_READER_PATTERN, 70000), data[0]);
+    ASSERT_EQ(test_pattern_byte(&FILE_READER_PATTERN, 70063), data[63]);
+
+    /* Short read at the end, then nothing past it */
+    ASSERT_EQ(0, acquire_file_reader_read_at(&reader, FILE_READER_LEN - 3,
+                                             sizeof(scratch), scratch, &data,
+                                             &got));
+    ASSERT_EQ(3, got);
+    ASSERT_EQ(0, acquire_file_reader_read_at(&reader, FILE_READER_LEN,
+                                             sizeof(scratch), scratch, &data,
+                                             &got));
+    ASSERT_EQ(0, got);
+
+    ASSERT_EQ(0, acquire_file_reader_seek(&reader, FILE_READER_LEN - 10));
+    ASSERT_EQ(1, acquire_file_reader_next(&reader, &data, &got));
+    ASSERT_EQ(10, got);
+    ASSERT_EQ(test_pattern_byte(&FILE_READER_PATTERN, FILE_READER_LEN - 10),
+              data[0]);
+    ASSERT_EQ(0, acquire_file_reader_next(&reader, &data, &got));
+    acquire_file_reader_close(&reader);
+  }
+  remove(FILE_READER_PATH);
+  PASS();
+}
+
+TEST test_file_reader_empty_and_missing(void) {
+  struct acquire_file_reader reader;
+  const unsigned char *data;
+  size_t len;
+  char reason[128];
+  ASSERT_EQ(0, test_write_pattern(FILE_READER_EMPTY_PATH, 0,
+                                  &FILE_READER_PATTERN));
+  ASSERT_EQ(0, acquire_file_reader_open(&reader, FILE_READER_EMPTY_PATH, 0, 0));
+  ASSERT_EQ((size_t)ACQUIRE_DEFAULT_READ_BUFFER_SIZE, reader.block_size);
+  ASSERT_EQ(0, acquire_file_reader_next(&reader, &data, &len));
+  acquire_file_reader_close(&reader);
+  /* Closing twice is harmless */
+  acquire_file_reader_close(&reader);
+  remove(FILE_READER_EMPTY_PATH);
+
+  ASSERT_EQ(-1, acquire_file_reader_open(&reader, "nonexistent.file", 0, 0));
+  ASSERT_EQ(ENOENT, reader.error);
+  ASSERT(strlen(acquire_file_reader_strerror(&reader, reason,
+                                             sizeof(reason))) > 0);
+  acquire_file_reader_close(&reader);
+  PASS();
+}
+
+TEST test_file_reader_buffer_size_sets_poll_granularity(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  enum acquire_status status;
+  int polls = 0;
+  ASSERT(h != NULL);
+  acquire_handle_set_read_buffer_size(h, 1024);
+  ASSERT_EQ(1024, h->read_buffer_size);
+  /* One block per poll */
+  acquire_handle_set_poll_budget(h, 1, 0);
+  ASSERT_EQ(0, acquire_verify_async_start(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                          GREATEST_SHA256));
+  do {
+    status = acquire_verify_async_poll(h);
+    polls++;
+    ASSERT(h->bytes_processed <= (off_t)polls * 1024);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  ASSERT_EQ(ACQUIRE_COMPLETE, status);
+  ASSERT(polls > 1);
+  acquire_handle_free(h);
+  PASS();
+}
+
+/* Hashing reads by default and maps only when asked to */
+TEST test_file_reader_handle_map_opt_in(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, h->file_reader_flags);
+  ASSERT_EQ(0, acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+  acquire_handle_set_file_map(h, 1);
+  ASSERT_EQ(ACQUIRE_FILE_READER_MAP, h->file_reader_flags);
+  ASSERT_EQ(0, acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+  acquire_handle_set_file_map(h, 0);
+  ASSERT_EQ(0, h->file_reader_flags);
+  acquire_handle_free(h);
+  PASS();
+}
+
+SUITE(file_reader_suite) {
+  RUN_TEST(test_file_reader_mapped_and_read);
+  RUN_TEST(test_file_reader_read_at_and_seek);
+  RUN_TEST(test_file_reader_empty_and_missing);
+  RUN_TEST(test_file_reader_buffer_size_sets_poll_granularity);
+  RUN_TEST(test_file_reader_handle_map_opt_in);
+}
+
+#endif /* !TEST_FILE_READER_H */
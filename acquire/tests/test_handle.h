@@ -73,12 +73,45 @@ TEST test_handle_set_error_no_fmt(void) {
   PASS();
 }
 
+TEST test_handle_poll_budget(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(ACQUIRE_DEFAULT_POLL_BUDGET_BYTES, h->poll_budget_bytes);
+  ASSERT_EQ(0, h->poll_budget_usec);
+
+  acquire_handle_set_poll_budget(h, 0, 0);
+  ASSERT_EQ(0, acquire_handle_poll_budget_spent(h, 1 << 30,
+                                                acquire_clock_seconds()));
+
+  acquire_handle_set_poll_budget(h, 4096, 0);
+  ASSERT_EQ(0, acquire_handle_poll_budget_spent(h, 4095,
+                                                acquire_clock_seconds()));
+  ASSERT_EQ(1, acquire_handle_poll_budget_spent(h, 4096,
+                                                acquire_clock_seconds()));
+
+  /* A poll that "started" a second ago has blown a 1ms budget */
+  acquire_handle_set_poll_budget(h, 0, 1000);
+  ASSERT_EQ(1, acquire_handle_poll_budget_spent(
+                   h, 0, acquire_clock_seconds() - 1.0));
+
+  acquire_handle_set_poll_budget(NULL, 1, 1); /* No crash is a pass */
+
+  /* Download polls return at once unless told they may wait */
+  ASSERT_EQ(0, h->poll_wait_msec);
+  acquire_handle_set_poll_wait(h, 250);
+  ASSERT_EQ(250, h->poll_wait_msec);
+  acquire_handle_set_poll_wait(NULL, 1);
+  acquire_handle_free(h);
+  PASS();
+}
+
 SUITE(handle_suite) {
   RUN_TEST(test_handle_initialization);
   RUN_TEST(test_handle_set_and_get_error);
   RUN_TEST(test_handle_null_safety);
   RUN_TEST(test_handle_set_error_with_formatting);
   RUN_TEST(test_handle_set_error_no_fmt);
+  RUN_TEST(test_handle_poll_budget);
 }
 
 #endif /* !TEST_HANDLE_H */
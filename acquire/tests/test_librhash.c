@@ -3,6 +3,8 @@
 #include "acquire_config.h"
 #include <greatest.h>
 
+#include "acquire_digest_pool.h"
+
 #include "test_librhash.h"
 
 #ifdef LIBACQUIRE_DOWNLOAD_DIR_IMPL
@@ -22,6 +24,7 @@ int main(int argc, char **argv) {
   (void)argc;
   (void)argv;
 #endif
+  acquire_digest_pool_cleanup();
   GREATEST_MAIN_END();
 }
 #endif /* defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH */
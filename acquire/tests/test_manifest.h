@@ -0,0 +1,183 @@
+#ifndef TEST_MANIFEST_H
+#define TEST_MANIFEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_handle.h"
+#include "acquire_manifest.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *MANIFEST_PATH = DOWNLOAD_DIR PATH_SEP "SHA256SUMS.test";
+static const char *MANIFEST_ABC_PATH = DOWNLOAD_DIR PATH_SEP "manifest_abc.txt";
+static const char *MANIFEST_EMPTY_PATH =
+    DOWNLOAD_DIR PATH_SEP "manifest_empty.txt";
+
+#define MANIFEST_ABC_SHA256                                                    \
+  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+#define MANIFEST_EMPTY_SHA256                                                  \
+  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+TEST test_manifest_parses_both_formats(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_manifest m;
+  const char text[] =
+      "# release 1.0\n"
+      MANIFEST_ABC_SHA256 "  a.txt\n"
+      MANIFEST_ABC_SHA256 " *bin/b.img\r\n"
+      "\n"
+      "SHA256 (dir/c (1).txt) = " MANIFEST_EMPTY_SHA256 "\n"
+      "CRC32C (d.bin) = 364B3FB7\n"
+      "\\" MANIFEST_ABC_SHA256 "  new\\nline\\\\x\n"
+      "not a checksum line\n"
+      "SHA256 (short) = abc\n"
+      "MD5 (e) = d41d8cd98f00b204e9800998ecf8427e\n"
+      "364b3fb7  crc.bin";
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, acquire_manifest_parse(h, &m, text, sizeof(text) - 1,
+                                      LIBACQUIRE_UNSUPPORTED_CHECKSUM));
+  ASSERT_EQ(6, m.count);
+  ASSERT_EQ(3, m.stats.malformed);
+  ASSERT_STR_EQ("a.txt", m.entries[0].path);
+  ASSERT_EQ(LIBACQUIRE_SHA256, m.entries[0].algorithm);
+  ASSERT_STR_EQ("bin/b.img", m.entries[1].path);
+  ASSERT_STR_EQ("dir/c (1).txt", m.entries[2].path);
+  ASSERT_STR_EQ(MANIFEST_EMPTY_SHA256, m.entries[2].expected_hash);
+  ASSERT_STR_EQ("d.bin", m.entries[3].path);
+  ASSERT_EQ(LIBACQUIRE_CRC32C, m.entries[3].algorithm);
+  ASSERT_STR_EQ("new\nline\\x", m.entries[4].path);
+  /* Told from the digest length */
+  ASSERT_EQ(LIBACQUIRE_CRC32C, m.entries[5].algorithm);
+  ASSERT_STR_EQ("crc.bin", m.entries[5].path);
+  acquire_manifest_free(&m);
+
+  /* An explicit algorithm applies to untagged lines only */
+  ASSERT_EQ(0, acquire_manifest_parse(h, &m, text, sizeof(text) - 1,
+                                      LIBACQUIRE_BLAKE3));
+  ASSERT_EQ(5, m.count);
+  ASSERT_EQ(LIBACQUIRE_BLAKE3, m.entries[0].algorithm);
+  ASSERT_EQ(LIBACQUIRE_SHA256, m.entries[2].algorithm);
+  acquire_manifest_free(&m);
+  acquire_handle_free(h);
+  PASS();
+}
+
+/* Enough entries that three workers have to steal from each other */
+TEST test_manifest_verify_reports_each_entry(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_manifest m;
+  char text[8192];
+  size_t i, len = 0;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_string(MANIFEST_ABC_PATH, "abc"));
+  ASSERT_EQ(0, test_write_string(MANIFEST_EMPTY_PATH, ""));
+  for (i = 0; i < 40; i++)
+    len += sprintf(text + len, "%s  %s\n",
+                   i % 2 ? MANIFEST_ABC_SHA256 : MANIFEST_EMPTY_SHA256,
+                   i % 2 ? "manifest_abc.txt" : "manifest_empty.txt");
+  len += sprintf(text + len, "%s  manifest_abc.txt\n", MANIFEST_EMPTY_SHA256);
+  len += sprintf(text + len, "%s  manifest_missing.txt\n",
+                 MANIFEST_EMPTY_SHA256);
+  ASSERT_EQ(0, acquire_manifest_parse(h, &m, text, len, LIBACQUIRE_SHA256));
+  ASSERT_EQ(42, m.count);
+
+  ASSERT_EQ(-1, acquire_manifest_verify(h, &m, DOWNLOAD_DIR, 3));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  ASSERT_EQ(3, m.stats.threads);
+  ASSERT_EQ(40, m.stats.passed);
+  ASSERT_EQ(2, m.stats.failed);
+  for (i = 0; i < 40; i++)
+    ASSERT_EQ(ACQUIRE_OK, m.entries[i].error);
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, m.entries[40].error);
+  ASSERT_EQ(3, m.entries[40].bytes);
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, m.entries[41].error);
+  ASSERT_EQ(0, m.entries[41].bytes);
+  ASSERT_EQ((off_t)(20 * 3 + 3), m.stats.bytes);
+  acquire_manifest_free(&m);
+  acquire_handle_free(h);
+  PASS();
+}
+
+TEST test_manifest_verify_from_file(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_manifest m;
+  char text[1024];
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_string(MANIFEST_ABC_PATH, "abc"));
+  sprintf(text, "%s  %s\nSHA256 (%s) = %s\n", MANIFEST_ABC_SHA256,
+          MANIFEST_ABC_PATH, GREATEST_FILE, GREATEST_SHA256);
+  ASSERT_EQ(0, test_write_string(MANIFEST_PATH, text));
+  /* All cores, though there are only two files to go round */
+  ASSERT_EQ(0, acquire_verify_manifest(h, MANIFEST_PATH, NULL,
+                                       LIBACQUIRE_UNSUPPORTED_CHECKSUM, 0,
+                                       &m));
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+  ASSERT_EQ(2, m.stats.files);
+  ASSERT_EQ(0, m.stats.failed);
+  ASSERT(m.stats.threads >= 1 && m.stats.threads <= 2);
+  ASSERT(m.stats.bytes > 3);
+  acquire_manifest_free(&m);
+
+  ASSERT_EQ(-1, acquire_verify_manifest(h, "nonexistent.sums", NULL,
+                                        LIBACQUIRE_SHA256, 1, &m));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+
+  remove(MANIFEST_PATH);
+  remove(MANIFEST_ABC_PATH);
+  remove(MANIFEST_EMPTY_PATH);
+  acquire_handle_free(h);
+  PASS();
+}
+
+/* Either side of the largest file hashed in a SHA-256 lane, read both ways */
+TEST test_manifest_verify_around_lane_size(void) {
+  static const char *const digests[] = {
+      "dda402a2c028f0cbbdbc5c6ebae965eed9c75f71236e7022b0386d3455d5ae2f",
+      "4b640d85ab3ba30fd02c9fc9db4a8928f416322ad27022ea58a65aaee68a4df2",
+      "237356e18b503616912abb8ffaed3a72591e397d4ac294c4637917d48a3f529d"};
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_manifest m;
+  char text[4096], path[1024];
+  const struct test_pattern pattern = {1, 0, 251};
+  unsigned int depth;
+  size_t i, len = 0;
+  ASSERT(h != NULL);
+  for (i = 0; i < 3; i++) {
+    sprintf(path, "%s%smanifest_lane_%lu.bin", DOWNLOAD_DIR, PATH_SEP,
+            (unsigned long)i);
+    ASSERT_EQ(0, test_write_pattern(path, 65535 + i, &pattern));
+  }
+  for (i = 0; i < 20; i++)
+    len += sprintf(text + len, "%s  manifest_lane_%lu.bin\n", digests[i % 3],
+                   (unsigned long)(i % 3));
+  ASSERT_EQ(0, acquire_manifest_parse(h, &m, text, len, LIBACQUIRE_SHA256));
+
+  for (depth = 1; depth <= 8; depth *= 8) {
+    acquire_handle_set_io_queue_depth(h, depth);
+    ASSERT_EQ(0, acquire_manifest_verify(h, &m, DOWNLOAD_DIR, 2));
+    ASSERT_EQ(20, m.stats.passed);
+    ASSERT_EQ((off_t)(7 * 65535 + 7 * 65536 + 6 * 65537), m.stats.bytes);
+    for (i = 0; i < 20; i++)
+      ASSERT_EQ((off_t)(65535 + i % 3), m.entries[i].bytes);
+  }
+  acquire_manifest_free(&m);
+  for (i = 0; i < 3; i++) {
+    sprintf(path, "%s%smanifest_lane_%lu.bin", DOWNLOAD_DIR, PATH_SEP,
+            (unsigned long)i);
+    remove(path);
+  }
+  acquire_handle_free(h);
+  PASS();
+}
+
+SUITE(manifest_suite) {
+  RUN_TEST(test_manifest_parses_both_formats);
+  RUN_TEST(test_manifest_verify_reports_each_entry);
+  RUN_TEST(test_manifest_verify_from_file);
+  RUN_TEST(test_manifest_verify_around_lane_size);
+}
+
+#endif /* !TEST_MANIFEST_H */
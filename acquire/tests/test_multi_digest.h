@@ -0,0 +1,469 @@
+#ifndef TEST_MULTI_DIGEST_H
+#define TEST_MULTI_DIGEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+#include "acquire_blake3.h"
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "acquire_multi_digest.h"
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+#include "acquire_sha2.h"
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *MULTI_DIGEST_FILE_PATH =
+    DOWNLOAD_DIR PATH_SEP "multi_digest_test.bin";
+
+/* Digests of `MULTI_DIGEST_FILE_LEN` bytes of `MULTI_DIGEST_PATTERN` */
+#define MULTI_DIGEST_FILE_LEN (1048576 + 4099)
+#define MULTI_DIGEST_CRC32C "ec158750"
+#define MULTI_DIGEST_SHA256                                                    \
+  "7a323c1fd0da4234de2c506691e5d6a84f1f04262e18bfb6ddeaa18e26dcb57c"
+#define MULTI_DIGEST_SHA512                                                    \
+  "0b4815de8dd4b66b45ec33123aa78a9a3c2193f3cd1b9d58cca758fcce10a223"           \
+  "703f5d954f9011b97e7eb04e1c2be1f4fe6c31d9e43f70cac8b64e5043a7dda0"
+#define MULTI_DIGEST_BLAKE3                                                    \
+  "1aed7271a5316b6d67fe454d8db9c340ed7316abb9a2cfb219591794b38b2edb"
+#define MULTI_DIGEST_XXH3_64 "8dbced5842d6b2ef"
+#define MULTI_DIGEST_XXH128 "d02aeca414f736cc8dbced5842d6b2ef"
+
+static const struct test_pattern MULTI_DIGEST_PATTERN = {7, 3, 256};
+
+TEST test_multi_digest_all_match(void) {
+  struct acquire_digest_spec specs[ACQUIRE_MAX_DIGESTS];
+  struct acquire_handle *h = acquire_handle_init();
+  size_t count = 0, i;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(MULTI_DIGEST_FILE_PATH, MULTI_DIGEST_FILE_LEN,
+                                  &MULTI_DIGEST_PATTERN));
+
+  specs[count].algorithm = LIBACQUIRE_SHA256;
+  specs[count++].expected_hash = MULTI_DIGEST_SHA256;
+  specs[count].algorithm = LIBACQUIRE_SHA512;
+  specs[count++].expected_hash = MULTI_DIGEST_SHA512;
+#if defined(LIBACQUIRE_USE_LIBRHASH) && LIBACQUIRE_USE_LIBRHASH ||             \
+    defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  specs[count].algorithm = LIBACQUIRE_CRC32C;
+  specs[count++].expected_hash = MULTI_DIGEST_CRC32C;
+#endif
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  specs[count].algorithm = LIBACQUIRE_BLAKE3;
+  specs[count++].expected_hash = MULTI_DIGEST_BLAKE3;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  specs[count].algorithm = LIBACQUIRE_XXH3_64;
+  specs[count++].expected_hash = MULTI_DIGEST_XXH3_64;
+  specs[count].algorithm = LIBACQUIRE_XXH128;
+  specs[count++].expected_hash = MULTI_DIGEST_XXH128;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+
+  ASSERT_EQ(0, acquire_verify_multi_sync(h, MULTI_DIGEST_FILE_PATH, specs,
+                                         count));
+  ASSERT_EQ(ACQUIRE_COMPLETE, h->status);
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_MULTI, h->active_backend);
+  /* One pass over the file, however many digests */
+  ASSERT_EQ((off_t)MULTI_DIGEST_FILE_LEN, h->bytes_processed);
+  ASSERT_EQ(count, h->digest_count);
+  for (i = 0; i < count; i++) {
+    const struct acquire_digest_result *r =
+        acquire_handle_get_digest_result(h, i);
+    ASSERT(r != NULL);
+    ASSERT_EQ(specs[i].algorithm, r->algorithm);
+    ASSERT_EQ(1, r->matched);
+    ASSERT_STR_EQ(specs[i].expected_hash, r->computed_hash);
+  }
+  ASSERT(acquire_handle_get_digest_result(h, count) == NULL);
+
+  acquire_handle_free(h);
+  PASS();
+}
+
+TEST test_multi_digest_reports_each_result(void) {
+  struct acquire_digest_spec specs[2];
+  struct acquire_handle *h = acquire_handle_init();
+  int polls = 0;
+  enum acquire_status status;
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(MULTI_DIGEST_FILE_PATH, MULTI_DIGEST_FILE_LEN,
+                                  &MULTI_DIGEST_PATTERN));
+
+  specs[0].algorithm = LIBACQUIRE_SHA512;
+  specs[0].expected_hash = MULTI_DIGEST_SHA512;
+  specs[1].algorithm = LIBACQUIRE_SHA256;
+  specs[1].expected_hash =
+      "0000000000000000000000000000000000000000000000000000000000000000";
+
+  acquire_handle_set_poll_budget(h, 262144, 0);
+  ASSERT_EQ(0, acquire_verify_multi_async_start(h, MULTI_DIGEST_FILE_PATH,
+                                                specs, 2));
+  do {
+    status = acquire_verify_async_poll(h);
+    polls++;
+  } while (status == ACQUIRE_IN_PROGRESS);
+  ASSERT(polls > 1);
+  ASSERT_EQ(ACQUIRE_ERROR, status);
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  ASSERT_EQ(2, h->digest_count);
+  ASSERT_EQ(1, h->digests[0].matched);
+  ASSERT_EQ(0, h->digests[1].matched);
+  ASSERT_STR_EQ(MULTI_DIGEST_SHA256, h->digests[1].computed_hash);
+
+  acquire_handle_free(h);
+  remove(MULTI_DIGEST_FILE_PATH);
+  PASS();
+}
+
+TEST test_multi_digest_rejects_bad_specs(void) {
+  struct acquire_digest_spec specs[2];
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+
+  specs[0].algorithm = LIBACQUIRE_SHA256;
+  specs[0].expected_hash = MULTI_DIGEST_SHA256;
+  specs[1] = specs[0];
+  ASSERT_EQ(-1, acquire_verify_multi_sync(h, GREATEST_FILE, specs, 2));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  ASSERT_EQ(-1, acquire_verify_multi_sync(h, GREATEST_FILE, specs, 0));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+
+  specs[1].algorithm = LIBACQUIRE_SHA512;
+  ASSERT_EQ(-1, acquire_verify_multi_sync(h, GREATEST_FILE, specs, 2));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+
+  specs[1].expected_hash = MULTI_DIGEST_SHA512;
+  ASSERT_EQ(-1, acquire_verify_multi_sync(h, "nonexistent.file", specs, 2));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED, acquire_handle_get_error_code(h));
+  ASSERT_EQ(0, h->digest_count);
+
+  acquire_handle_free(h);
+  PASS();
+}
+
+/* The file's bytes again, fed in uneven pieces as a network would */
+TEST test_multi_digest_stream(void) {
+  struct acquire_digest_spec specs[2];
+  struct acquire_digest_stream *stream;
+  struct acquire_handle *h = acquire_handle_init();
+  unsigned char piece[1500];
+  size_t fed = 0, n, i;
+  ASSERT(h != NULL);
+
+  specs[0].algorithm = LIBACQUIRE_SHA256;
+  specs[0].expected_hash = MULTI_DIGEST_SHA256;
+  specs[1].algorithm = LIBACQUIRE_SHA512;
+  specs[1].expected_hash = MULTI_DIGEST_SHA512;
+  stream = acquire_digest_stream_new(h, specs, 2);
+  ASSERT(stream != NULL);
+  ASSERT_EQ(2, h->digest_count);
+  ASSERT_EQ(-1, h->digests[0].matched);
+  while (fed < MULTI_DIGEST_FILE_LEN) {
+    n = 1 + fed % sizeof(piece);
+    if (n > MULTI_DIGEST_FILE_LEN - fed)
+      n = MULTI_DIGEST_FILE_LEN - fed;
+    for (i = 0; i < n; i++)
+      piece[i] = (unsigned char)(((fed + i) * 7 + 3) % 256);
+    ASSERT_EQ(0, acquire_digest_stream_update(stream, piece, n));
+    fed += n;
+  }
+  ASSERT_EQ(0, acquire_digest_stream_finish(stream, h));
+  ASSERT_EQ(1, h->digests[0].matched);
+  ASSERT_EQ(1, h->digests[1].matched);
+  ASSERT_STR_EQ(MULTI_DIGEST_SHA512, h->digests[1].computed_hash);
+  acquire_digest_stream_free(stream);
+
+  /* Anything else is a mismatch, reported as such */
+  stream = acquire_digest_stream_new(h, specs, 1);
+  ASSERT(stream != NULL);
+  ASSERT_EQ(0, acquire_digest_stream_update(stream, "abc", 3));
+  ASSERT_EQ(-1, acquire_digest_stream_finish(stream, h));
+  ASSERT_EQ(ACQUIRE_ERROR_CHECKSUM_MISMATCH, acquire_handle_get_error_code(h));
+  ASSERT_EQ(0, h->digests[0].matched);
+  acquire_digest_stream_free(stream);
+
+  specs[0].expected_hash = "abc";
+  ASSERT(acquire_digest_stream_new(h, specs, 1) == NULL);
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  PASS();
+}
+
+/* Stop part way through, then carry on from a checkpoint on a new handle */
+TEST test_multi_digest_checkpoint_resume(void) {
+  struct acquire_digest_spec specs[ACQUIRE_MAX_DIGESTS];
+  unsigned char checkpoint[ACQUIRE_CHECKPOINT_MAX_SIZE];
+  struct acquire_handle *h = acquire_handle_init();
+  struct acquire_handle *resumed = acquire_handle_init();
+  size_t count = 0, size, i;
+  off_t offset;
+  ASSERT(h != NULL && resumed != NULL);
+  ASSERT_EQ(0, test_write_pattern(MULTI_DIGEST_FILE_PATH, MULTI_DIGEST_FILE_LEN,
+                                  &MULTI_DIGEST_PATTERN));
+
+  specs[count].algorithm = LIBACQUIRE_SHA256;
+  specs[count++].expected_hash = MULTI_DIGEST_SHA256;
+  specs[count].algorithm = LIBACQUIRE_SHA512;
+  specs[count++].expected_hash = MULTI_DIGEST_SHA512;
+#if defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C
+  specs[count].algorithm = LIBACQUIRE_CRC32C;
+  specs[count++].expected_hash = MULTI_DIGEST_CRC32C;
+#endif /* defined(LIBACQUIRE_USE_CRC32C) && LIBACQUIRE_USE_CRC32C */
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  specs[count].algorithm = LIBACQUIRE_BLAKE3;
+  specs[count++].expected_hash = MULTI_DIGEST_BLAKE3;
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+#if defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH
+  specs[count].algorithm = LIBACQUIRE_XXH128;
+  specs[count++].expected_hash = MULTI_DIGEST_XXH128;
+#endif /* defined(LIBACQUIRE_USE_XXHASH) && LIBACQUIRE_USE_XXHASH */
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  /* A crypto library's SHA-2 state may not be exportable; ours is */
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_SHA2);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+  acquire_handle_set_poll_budget(h, 65536, 0);
+  ASSERT_EQ(0, acquire_verify_multi_async_start(h, MULTI_DIGEST_FILE_PATH,
+                                                specs, count));
+  ASSERT_EQ(ACQUIRE_IN_PROGRESS, acquire_verify_async_poll(h));
+  size = acquire_checkpoint(h, NULL, 0);
+  if (size > 0)
+    ASSERT_EQ(size, acquire_checkpoint(h, checkpoint, sizeof(checkpoint)));
+  acquire_verify_async_cancel(h);
+  ASSERT_EQ(ACQUIRE_ERROR, acquire_verify_async_poll(h));
+  ASSERT_EQ(0, acquire_checkpoint(h, checkpoint, sizeof(checkpoint)));
+  if (size == 0) {
+    acquire_handle_free(h);
+    acquire_handle_free(resumed);
+    SKIPm("A digest context in this build cannot be checkpointed");
+  }
+  ASSERT(size <= sizeof(checkpoint));
+  offset = acquire_checkpoint_offset(checkpoint, size);
+  ASSERT(offset > 0 && offset < (off_t)MULTI_DIGEST_FILE_LEN);
+  ASSERT_EQ(offset, h->bytes_processed);
+
+  /* Only the rest of the file is read */
+  ASSERT_EQ(0, acquire_verify_multi_resume_async_start(
+                   resumed, MULTI_DIGEST_FILE_PATH, specs, count, checkpoint,
+                   size));
+  ASSERT_EQ(offset, resumed->bytes_processed);
+  while (acquire_verify_async_poll(resumed) == ACQUIRE_IN_PROGRESS) {
+  }
+  ASSERT_EQ(ACQUIRE_COMPLETE, resumed->status);
+  ASSERT_EQ((off_t)MULTI_DIGEST_FILE_LEN, resumed->bytes_processed);
+  for (i = 0; i < count; i++)
+    ASSERT_EQ(1, resumed->digests[i].matched);
+
+  /* Only these digests, from a whole checkpoint, fit it */
+  ASSERT_EQ(-1, acquire_verify_multi_resume_async_start(
+                    resumed, MULTI_DIGEST_FILE_PATH, specs + 1, count - 1,
+                    checkpoint, size));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT,
+            acquire_handle_get_error_code(resumed));
+  ASSERT_EQ(-1, acquire_verify_multi_resume_async_start(
+                    resumed, MULTI_DIGEST_FILE_PATH, specs, count, checkpoint,
+                    size - 1));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT,
+            acquire_handle_get_error_code(resumed));
+  ASSERT_EQ(-1, acquire_checkpoint_offset(checkpoint, size - 1));
+  checkpoint[0] ^= 1;
+  ASSERT_EQ(-1, acquire_checkpoint_offset(checkpoint, size));
+  checkpoint[0] ^= 1;
+  ASSERT_EQ(-1, acquire_verify_multi_resume_async_start(
+                    resumed, "multi_digest_missing.bin", specs, count,
+                    checkpoint, size));
+  ASSERT_EQ(ACQUIRE_ERROR_FILE_OPEN_FAILED,
+            acquire_handle_get_error_code(resumed));
+
+  acquire_handle_free(h);
+  acquire_handle_free(resumed);
+  PASS();
+}
+
+static int multi_digest_feed(struct acquire_digest_stream *stream,
+                             size_t from, size_t to) {
+  unsigned char piece[4096];
+  size_t n;
+  while (from < to) {
+    n = to - from < sizeof(piece) ? to - from : sizeof(piece);
+    test_pattern_fill(&MULTI_DIGEST_PATTERN, from, piece, n);
+    if (acquire_digest_stream_update(stream, piece, n) != 0)
+      return -1;
+    from += n;
+  }
+  return 0;
+}
+
+/* A stream saved half way, as a download would be, finishes the same */
+TEST test_multi_digest_stream_checkpoint(void) {
+  struct acquire_digest_spec spec;
+  struct acquire_digest_stream *stream;
+  unsigned char checkpoint[ACQUIRE_CHECKPOINT_MAX_SIZE];
+  struct acquire_handle *h = acquire_handle_init();
+  const size_t half = MULTI_DIGEST_FILE_LEN / 2 + 13;
+  size_t size;
+  ASSERT(h != NULL);
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_SHA2);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  spec.algorithm = LIBACQUIRE_SHA512;
+  spec.expected_hash = MULTI_DIGEST_SHA512;
+
+  stream = acquire_digest_stream_new(h, &spec, 1);
+  ASSERT(stream != NULL);
+  ASSERT_EQ(0, multi_digest_feed(stream, 0, half));
+  size = acquire_digest_stream_checkpoint(stream, checkpoint,
+                                          sizeof(checkpoint));
+  /* Drop the stream, as a crash would, and pick up from the save */
+  acquire_digest_stream_free(stream);
+  if (size == 0) {
+    acquire_handle_free(h);
+    SKIPm("A digest context in this build cannot be checkpointed");
+  }
+  ASSERT(size <= sizeof(checkpoint));
+  ASSERT_EQ((off_t)half, acquire_checkpoint_offset(checkpoint, size));
+  stream = acquire_digest_stream_resume(h, &spec, 1, checkpoint, size);
+  ASSERT(stream != NULL);
+  ASSERT_EQ(0, multi_digest_feed(stream, half, MULTI_DIGEST_FILE_LEN));
+  ASSERT_EQ(0, acquire_digest_stream_finish(stream, h));
+  ASSERT_EQ(1, h->digests[0].matched);
+  acquire_digest_stream_free(stream);
+
+  /* A checkpoint of one digest does not resume another */
+  spec.algorithm = LIBACQUIRE_SHA256;
+  spec.expected_hash = MULTI_DIGEST_SHA256;
+  ASSERT(acquire_digest_stream_resume(h, &spec, 1, checkpoint, size) ==
+         NULL);
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  acquire_handle_free(h);
+  PASS();
+}
+
+/*
+ * Where a one-digest checkpoint keeps its sum, after the magic, version and
+ * length, and its digest's state, after the rest of the header, the offset,
+ * the count and the digest's algorithm, kind and state length
+ */
+#define MULTI_DIGEST_CHECKPOINT_SUM_AT 16
+#define MULTI_DIGEST_CHECKPOINT_STATE_AT 48
+
+/* Sign `checkpoint` again after changing it, as a forger would */
+static void multi_digest_resum(unsigned char *checkpoint, size_t size) {
+  uint64_t h = UINT64_C(0xCBF29CE484222325);
+  size_t i;
+  for (i = MULTI_DIGEST_CHECKPOINT_SUM_AT + sizeof(h); i < size; i++)
+    h = (h ^ checkpoint[i]) * UINT64_C(0x100000001B3);
+  memcpy(checkpoint + MULTI_DIGEST_CHECKPOINT_SUM_AT, &h, sizeof(h));
+}
+
+/* Whether the one-digest `checkpoint` of `spec` resumes on `h` */
+static int multi_digest_resumes(struct acquire_handle *h,
+                                const struct acquire_digest_spec *spec,
+                                const unsigned char *checkpoint,
+                                size_t size) {
+  struct acquire_digest_stream *stream =
+      acquire_digest_stream_resume(h, spec, 1, checkpoint, size);
+  acquire_digest_stream_free(stream);
+  return stream != NULL;
+}
+
+/* Damaged checkpoints, and states no hasher could be in, are refused */
+TEST test_multi_digest_checkpoint_rejects_forgery(void) {
+  struct acquire_digest_spec spec;
+  struct acquire_digest_stream *stream;
+  unsigned char checkpoint[ACQUIRE_CHECKPOINT_MAX_SIZE];
+  struct acquire_handle *h = acquire_handle_init();
+  size_t size;
+  ASSERT(h != NULL);
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  acquire_handle_set_checksum_backend(h, ACQUIRE_BACKEND_CHECKSUM_SHA2);
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+  spec.algorithm = LIBACQUIRE_SHA512;
+  spec.expected_hash = MULTI_DIGEST_SHA512;
+  stream = acquire_digest_stream_new(h, &spec, 1);
+  ASSERT(stream != NULL);
+  ASSERT_EQ(0, multi_digest_feed(stream, 0, 1000));
+  size = acquire_digest_stream_checkpoint(stream, checkpoint,
+                                          sizeof(checkpoint));
+  acquire_digest_stream_free(stream);
+  if (size == 0 || size > sizeof(checkpoint)) {
+    acquire_handle_free(h);
+    SKIPm("A digest context in this build cannot be checkpointed");
+  }
+  ASSERT_EQ(1, multi_digest_resumes(h, &spec, checkpoint, size));
+
+  /* Any changed byte fails the sum */
+  checkpoint[size - 1] ^= 1;
+  ASSERT_EQ(-1, acquire_checkpoint_offset(checkpoint, size));
+  ASSERT_EQ(0, multi_digest_resumes(h, &spec, checkpoint, size));
+  ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT, acquire_handle_get_error_code(h));
+  checkpoint[size - 1] ^= 1;
+
+#if defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2
+  {
+    /* A correctly summed state whose buffer length runs off its buffer */
+    struct acquire_sha2_hasher forged;
+    ASSERT_EQ(MULTI_DIGEST_CHECKPOINT_STATE_AT + sizeof(forged) + 4, size);
+    memcpy(&forged, checkpoint + MULTI_DIGEST_CHECKPOINT_STATE_AT,
+           sizeof(forged));
+    ASSERT_EQ(1000 % 128, forged.buf_len);
+    forged.buf_len = 4096;
+    memcpy(checkpoint + MULTI_DIGEST_CHECKPOINT_STATE_AT, &forged,
+           sizeof(forged));
+    multi_digest_resum(checkpoint, size);
+    ASSERT_EQ(1000, acquire_checkpoint_offset(checkpoint, size));
+    ASSERT_EQ(0, multi_digest_resumes(h, &spec, checkpoint, size));
+    ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT,
+              acquire_handle_get_error_code(h));
+  }
+#endif /* defined(LIBACQUIRE_USE_SHA2) && LIBACQUIRE_USE_SHA2 */
+
+#if defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3
+  {
+    /* A BLAKE3 state with more subtrees than its stack holds */
+    struct acquire_blake3_hasher forged;
+    spec.algorithm = LIBACQUIRE_BLAKE3;
+    spec.expected_hash = MULTI_DIGEST_BLAKE3;
+    stream = acquire_digest_stream_new(h, &spec, 1);
+    ASSERT(stream != NULL);
+    ASSERT_EQ(0, multi_digest_feed(stream, 0, 5000));
+    size = acquire_digest_stream_checkpoint(stream, checkpoint,
+                                            sizeof(checkpoint));
+    acquire_digest_stream_free(stream);
+    ASSERT_EQ(MULTI_DIGEST_CHECKPOINT_STATE_AT + sizeof(forged) + 4, size);
+    ASSERT_EQ(1, multi_digest_resumes(h, &spec, checkpoint, size));
+    memcpy(&forged, checkpoint + MULTI_DIGEST_CHECKPOINT_STATE_AT,
+           sizeof(forged));
+    forged.cv_stack_len = 200;
+    memcpy(checkpoint + MULTI_DIGEST_CHECKPOINT_STATE_AT, &forged,
+           sizeof(forged));
+    multi_digest_resum(checkpoint, size);
+    ASSERT_EQ(0, multi_digest_resumes(h, &spec, checkpoint, size));
+    ASSERT_EQ(ACQUIRE_ERROR_INVALID_ARGUMENT,
+              acquire_handle_get_error_code(h));
+  }
+#endif /* defined(LIBACQUIRE_USE_BLAKE3) && LIBACQUIRE_USE_BLAKE3 */
+
+  acquire_handle_free(h);
+  PASS();
+}
+
+SUITE(multi_digest_suite) {
+  RUN_TEST(test_multi_digest_all_match);
+  RUN_TEST(test_multi_digest_reports_each_result);
+  RUN_TEST(test_multi_digest_rejects_bad_specs);
+  RUN_TEST(test_multi_digest_stream);
+  RUN_TEST(test_multi_digest_checkpoint_resume);
+  RUN_TEST(test_multi_digest_stream_checkpoint);
+  RUN_TEST(test_multi_digest_checkpoint_rejects_forgery);
+}
+
+#endif /* !TEST_MULTI_DIGEST_H */
@@ -1,6 +1,7 @@
 #include <greatest.h>
 
 #include "acquire_common_defs.h"
+#include "acquire_digest_pool.h"
 
 #if (defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL) ||             \
     (defined(LIBACQUIRE_USE_COMMON_CRYPTO) && LIBACQUIRE_USE_COMMON_CRYPTO) || \
@@ -26,5 +27,6 @@ int main(int argc, char **argv) {
   }
   RUN_SUITE(openssl_backend_suite);
 #endif
+  acquire_digest_pool_cleanup();
   GREATEST_MAIN_END();
 }
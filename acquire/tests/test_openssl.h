@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "acquire_checksums.h"
+#include "acquire_digest_pool.h"
 #include "config_for_tests.h"
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
@@ -72,11 +73,72 @@ TEST test_openssl_backend_cancel_null(void) {
   PASS();
 }
 
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+TEST test_openssl_backend_reuses_contexts(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  EVP_MD_CTX *ctx;
+  int i, pooled;
+  ASSERT(h != NULL);
+
+  /* A context given back half-used hashes from scratch when taken again */
+  ctx = acquire_digest_pool_evp_take(LIBACQUIRE_SHA256);
+  ASSERT(ctx != NULL);
+  ASSERT_EQ(1, EVP_DigestUpdate(ctx, "stale", 5));
+  acquire_digest_pool_evp_give(LIBACQUIRE_SHA256, ctx);
+  ASSERT(acquire_digest_pool_evp_take(LIBACQUIRE_SHA256) == ctx);
+  acquire_digest_pool_evp_give(LIBACQUIRE_SHA256, ctx);
+  ASSERT(acquire_digest_pool_evp_md(LIBACQUIRE_SHA256) != NULL);
+  ASSERT(acquire_digest_pool_evp_md(LIBACQUIRE_CRC32C) == NULL);
+
+  for (pooled = 1; pooled >= 0; pooled--) {
+    acquire_digest_pool_set_enabled(pooled);
+    for (i = 0; i < 8; i++) {
+      h->active_backend = ACQUIRE_BACKEND_CHECKSUM_OPENSSL;
+      if (i % 2) {
+        ASSERT_EQ(-1, acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                          "000000000000000000000000000000000000"
+                                          "0000000000000000000000000000"));
+        ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+      } else {
+        ASSERT_EQ(0, acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                         GREATEST_SHA256));
+      }
+    }
+  }
+  acquire_digest_pool_set_enabled(1);
+  acquire_handle_free(h);
+  PASS();
+}
+
+TEST test_openssl_backend_pool_cleanup(void) {
+  struct acquire_handle *h = acquire_handle_init();
+  EVP_MD_CTX *ctx;
+  ASSERT(h != NULL);
+  ctx = acquire_digest_pool_evp_take(LIBACQUIRE_SHA512);
+  ASSERT(ctx != NULL);
+  acquire_digest_pool_evp_give(LIBACQUIRE_SHA512, ctx);
+  acquire_digest_pool_cleanup();
+  /* Still hashes afterwards, from a new pool; cleaning twice is harmless */
+  ASSERT(acquire_digest_pool_evp_md(LIBACQUIRE_SHA256) != NULL);
+  h->active_backend = ACQUIRE_BACKEND_CHECKSUM_OPENSSL;
+  ASSERT_EQ(0, acquire_verify_sync(h, GREATEST_FILE, LIBACQUIRE_SHA256,
+                                   GREATEST_SHA256));
+  acquire_digest_pool_cleanup();
+  acquire_digest_pool_cleanup();
+  acquire_handle_free(h);
+  PASS();
+}
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
+
 SUITE(openssl_backend_suite) {
   RUN_TEST(test_openssl_backend_unsupported_algo);
   RUN_TEST(test_openssl_backend_poll_on_finished_handle);
   RUN_TEST(test_openssl_backend_poll_on_null_backend);
   RUN_TEST(test_openssl_backend_cancel_null);
+#ifdef ACQUIRE_DIGEST_POOL_EVP
+  RUN_TEST(test_openssl_backend_reuses_contexts);
+  RUN_TEST(test_openssl_backend_pool_cleanup);
+#endif /* ACQUIRE_DIGEST_POOL_EVP */
 }
 
 #endif /* (defined(LIBACQUIRE_USE_OPENSSL) && LIBACQUIRE_USE_OPENSSL) ||       \
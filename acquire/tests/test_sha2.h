@@ -0,0 +1,252 @@
+#ifndef TEST_SHA2_H
+#define TEST_SHA2_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "acquire_sha2.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *SHA2_FILE_PATH = DOWNLOAD_DIR PATH_SEP "sha2_test.bin";
+
+struct sha2_vector {
+  const char *message;
+  const char *sha256;
+  const char *sha512;
+};
+
+/* FIPS 180-4 examples: padding into the same block and into the next one */
+static const struct sha2_vector sha2_vectors[] = {
+    {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+     "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+     "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"},
+    {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+     "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+     "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+     "204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c335"
+     "96fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445"},
+    {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+     "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+     "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+     "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+     "501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"}};
+
+static void sha2_test_hex(const struct acquire_sha2_hasher *hasher,
+                          char hex[129]) {
+  unsigned char digest[ACQUIRE_SHA512_OUT_LEN];
+  const size_t n = hasher->algorithm == LIBACQUIRE_SHA512
+                       ? ACQUIRE_SHA512_OUT_LEN
+                       : ACQUIRE_SHA256_OUT_LEN;
+  size_t i;
+  acquire_sha2_final(hasher, digest);
+  for (i = 0; i < n; i++)
+    sprintf(hex + 2 * i, "%02x", digest[i]);
+}
+
+TEST test_sha2_vectors(enum acquire_sha2_kernel kernel) {
+  struct acquire_sha2_hasher hasher;
+  unsigned char *million;
+  char hex[129];
+  size_t i;
+
+  if (!acquire_sha2_kernel_supported(kernel))
+    SKIPm("SHA-2 kernel not supported on this CPU");
+
+  for (i = 0; i < sizeof(sha2_vectors) / sizeof(sha2_vectors[0]); i++) {
+    const struct sha2_vector *v = &sha2_vectors[i];
+    ASSERT_EQ(0, acquire_sha2_init_with_kernel(&hasher, LIBACQUIRE_SHA256,
+                                               kernel));
+    ASSERT_EQ(kernel, hasher.kernel);
+    acquire_sha2_update(&hasher, v->message, strlen(v->message));
+    sha2_test_hex(&hasher, hex);
+    ASSERT_STR_EQ(v->sha256, hex);
+    ASSERT_EQ(0, acquire_sha2_init_with_kernel(&hasher, LIBACQUIRE_SHA512,
+                                               kernel));
+    acquire_sha2_update(&hasher, v->message, strlen(v->message));
+    sha2_test_hex(&hasher, hex);
+    ASSERT_STR_EQ(v->sha512, hex);
+  }
+
+  /* A million 'a's, fed in pieces that straddle block boundaries */
+  million = (unsigned char *)malloc(1000000);
+  ASSERT(million != NULL);
+  memset(million, 'a', 1000000);
+  acquire_sha2_init_with_kernel(&hasher, LIBACQUIRE_SHA256, kernel);
+  for (i = 0; i < 1000000; i += 997)
+    acquire_sha2_update(&hasher, million + i,
+                        1000000 - i < 997 ? 1000000 - i : 997);
+  sha2_test_hex(&hasher, hex);
+  free(million);
+  ASSERT_STR_EQ(
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", hex);
+
+  ASSERT_EQ(-1, acquire_sha2_init_with_kernel(&hasher, LIBACQUIRE_CRC32C,
+                                              kernel));
+  PASS();
+}
+
+/* Every length around the padding edges, hashed whole and byte by byte */
+TEST test_sha2_kernel_matches_portable(enum acquire_sha2_kernel kernel) {
+  unsigned char data[300];
+  struct acquire_sha2_hasher whole, split, portable;
+  char whole_hex[129], split_hex[129], portable_hex[129];
+  size_t len, i;
+
+  if (!acquire_sha2_kernel_supported(kernel))
+    SKIPm("SHA-2 kernel not supported on this CPU");
+  for (i = 0; i < sizeof(data); i++)
+    data[i] = (unsigned char)(i * 31 + 7);
+  for (len = 0; len <= sizeof(data); len++) {
+    acquire_sha2_init_with_kernel(&whole, LIBACQUIRE_SHA256, kernel);
+    acquire_sha2_init_with_kernel(&split, LIBACQUIRE_SHA256, kernel);
+    acquire_sha2_init_with_kernel(&portable, LIBACQUIRE_SHA256,
+                                  ACQUIRE_SHA2_KERNEL_PORTABLE);
+    acquire_sha2_update(&whole, data, len);
+    for (i = 0; i < len; i++)
+      acquire_sha2_update(&split, data + i, 1);
+    acquire_sha2_update(&portable, data, len);
+    sha2_test_hex(&whole, whole_hex);
+    sha2_test_hex(&split, split_hex);
+    sha2_test_hex(&portable, portable_hex);
+    ASSERT_STR_EQ(portable_hex, whole_hex);
+    ASSERT_STR_EQ(portable_hex, split_hex);
+  }
+  PASS();
+}
+
+/*
+ * Lanes of assorted lengths and partial blocks, some left idle or handed a
+ * SHA-512 or active-kernel hasher, against one hasher at a time
+ */
+TEST test_sha256_update_many(void) {
+  enum { LANES = ACQUIRE_SHA256_MB_LANES + 3 };
+  static unsigned char data[LANES][700];
+  struct acquire_sha2_hasher many[LANES], single[LANES];
+  struct acquire_sha2_hasher *hashers[LANES];
+  unsigned char digests[LANES][ACQUIRE_SHA512_OUT_LEN];
+  unsigned char *outs[LANES];
+  const void *inputs[LANES];
+  size_t lens[LANES], count, round, i, j;
+  char many_hex[129], single_hex[129];
+
+  for (i = 0; i < LANES; i++)
+    for (j = 0; j < sizeof(data[i]); j++)
+      data[i][j] = (unsigned char)(i * 131 + j * 7);
+  for (count = 1; count <= LANES; count++) {
+    for (i = 0; i < count; i++) {
+      const enum Checksum alg = i == 5 ? LIBACQUIRE_SHA512 : LIBACQUIRE_SHA256;
+      const enum acquire_sha2_kernel kernel =
+          i == 6 ? acquire_sha2_active_kernel() : ACQUIRE_SHA2_KERNEL_PORTABLE;
+      ASSERT_EQ(0, acquire_sha2_init_with_kernel(&many[i], alg, kernel));
+      ASSERT_EQ(0, acquire_sha2_init(&single[i], alg));
+      hashers[i] = &many[i];
+      outs[i] = digests[i];
+    }
+    /* A partial block first, then runs that end lanes at different blocks */
+    for (round = 0; round < 3; round++) {
+      for (i = 0; i < count; i++) {
+        lens[i] = round == 0 ? (i * 13 + count) % 64
+                             : (i * 97 + round * 211 + count * 7) % 640;
+        if (i == 3 && round == 1)
+          lens[i] = 0;
+        inputs[i] = data[i] + round * 20;
+        acquire_sha2_update(&single[i], inputs[i], lens[i]);
+      }
+      acquire_sha256_update_many(hashers, inputs, lens, count);
+    }
+    acquire_sha256_final_many(hashers, outs, count);
+    for (i = 0; i < count; i++) {
+      const size_t n = many[i].algorithm == LIBACQUIRE_SHA512
+                           ? ACQUIRE_SHA512_OUT_LEN
+                           : ACQUIRE_SHA256_OUT_LEN;
+      for (j = 0; j < n; j++)
+        sprintf(many_hex + 2 * j, "%02x", digests[i][j]);
+      sha2_test_hex(&single[i], single_hex);
+      ASSERT_STR_EQ(single_hex, many_hex);
+      /* `final_many` leaves the hasher as it was */
+      sha2_test_hex(&many[i], many_hex);
+      ASSERT_STR_EQ(single_hex, many_hex);
+    }
+  }
+  PASS();
+}
+
+static enum acquire_status sha2_test_verify(struct acquire_handle *h,
+                                            enum Checksum algorithm,
+                                            const char *expected) {
+  enum acquire_status status;
+  if (_sha2_verify_async_start(h, SHA2_FILE_PATH, algorithm, expected) != 0)
+    return ACQUIRE_ERROR;
+  do {
+    status = _sha2_verify_async_poll(h);
+  } while (status == ACQUIRE_IN_PROGRESS);
+  return status;
+}
+
+TEST test_sha2_verify(void) {
+  const size_t len = 3 * 1048576 + 11;
+  const struct test_pattern pattern = {1, 0, 251};
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(SHA2_FILE_PATH, len, &pattern));
+
+  /* Called directly, since a crypto library would take these first */
+  ASSERT_EQ(ACQUIRE_COMPLETE,
+            sha2_test_verify(h, LIBACQUIRE_SHA256,
+                             "6AD8A20DF6FDB90553FA0D96FEE4FFA6"
+                             "0AE400D181140E35C0CED9A13EC15AB7"));
+  ASSERT_EQ((off_t)len, h->bytes_processed);
+  ASSERT_EQ(ACQUIRE_COMPLETE,
+            sha2_test_verify(h, LIBACQUIRE_SHA512,
+                             "3a511e16ae0472d116e3530bed21f6a5"
+                             "6f96da28803a7104517cb0250704b7f3"
+                             "c6b98f24081dff6e73dfcc8d9929631d"
+                             "1feea9163abc173b1e0df9cc3fbd5ed9"));
+  ASSERT_EQ(0, acquire_verify_sync(h, SHA2_FILE_PATH, LIBACQUIRE_SHA256,
+                                   "6ad8a20df6fdb90553fa0d96fee4ffa6"
+                                   "0ae400d181140e35c0ced9a13ec15ab7"));
+
+  ASSERT_EQ(ACQUIRE_ERROR,
+            sha2_test_verify(h, LIBACQUIRE_SHA256,
+                             "6ad8a20df6fdb90553fa0d96fee4ffa6"
+                             "0ae400d181140e35c0ced9a13ec15ab6"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  /* A SHA256 digest is not a valid SHA512 one */
+  ASSERT_EQ(ACQUIRE_ERROR,
+            sha2_test_verify(h, LIBACQUIRE_SHA512,
+                             "6ad8a20df6fdb90553fa0d96fee4ffa6"
+                             "0ae400d181140e35c0ced9a13ec15ab7"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+  /* Other algorithms are left to the rest of the chain */
+  h->error.code = ACQUIRE_OK;
+  ASSERT_EQ(-1, _sha2_verify_async_start(h, SHA2_FILE_PATH, LIBACQUIRE_CRC32C,
+                                         "00000000"));
+  ASSERT_EQ(ACQUIRE_OK, acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(SHA2_FILE_PATH);
+  PASS();
+}
+
+SUITE(sha2_suite) {
+  static const enum acquire_sha2_kernel kernels[] = {
+      ACQUIRE_SHA2_KERNEL_PORTABLE, ACQUIRE_SHA2_KERNEL_SHANI,
+      ACQUIRE_SHA2_KERNEL_ARMV8};
+  size_t i;
+  for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    RUN_TEST1(test_sha2_vectors, kernels[i]);
+    RUN_TEST1(test_sha2_kernel_matches_portable, kernels[i]);
+  }
+  RUN_TEST(test_sha256_update_many);
+  RUN_TEST(test_sha2_verify);
+}
+
+#endif /* !TEST_SHA2_H */
@@ -0,0 +1,56 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Byte `i` of a patterned test file is `(i * mul + add) % mod` */
+struct test_pattern {
+  size_t mul;
+  size_t add;
+  size_t mod;
+};
+
+static unsigned char test_pattern_byte(const struct test_pattern *pattern,
+                                       size_t i) {
+  return (unsigned char)((i * pattern->mul + pattern->add) % pattern->mod);
+}
+
+/* Bytes `[from, from + len)` of `pattern` into `out` */
+static void test_pattern_fill(const struct test_pattern *pattern, size_t from,
+                              unsigned char *out, size_t len) {
+  size_t i;
+  for (i = 0; i < len; i++)
+    out[i] = test_pattern_byte(pattern, from + i);
+}
+
+/* Replace `path` with `contents`; `0` on success */
+static int test_write_string(const char *path, const char *contents) {
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return -1;
+  fputs(contents, f);
+  return fclose(f);
+}
+
+/* Replace `path` with the first `len` bytes of `pattern`; `0` on success */
+static int test_write_pattern(const char *path, size_t len,
+                              const struct test_pattern *pattern) {
+  unsigned char chunk[4096];
+  size_t written = 0, n;
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return -1;
+  while (written < len) {
+    n = len - written < sizeof(chunk) ? len - written : sizeof(chunk);
+    test_pattern_fill(pattern, written, chunk, n);
+    if (fwrite(chunk, 1, n, f) != n) {
+      fclose(f);
+      return -1;
+    }
+    written += n;
+  }
+  return fclose(f);
+}
+
+#endif /* !TEST_UTIL_H */
@@ -0,0 +1,121 @@
+#ifndef TEST_XXHASH_H
+#define TEST_XXHASH_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <greatest.h>
+
+#include "acquire_checksums.h"
+#include "acquire_handle.h"
+#include "acquire_net_common.h"
+#include "acquire_xxhash.h"
+#include "config_for_tests.h"
+#include "test_util.h"
+
+static const char *XXHASH_FILE_PATH = DOWNLOAD_DIR PATH_SEP "xxhash_test.bin";
+
+struct xxhash_vector {
+  size_t len;
+  const char *xxh3_64;
+  const char *xxh128;
+};
+
+/*
+ * Byte `i` is `i % 251`. The lengths hit each of XXH3's size classes: empty,
+ * 1-3, 4-8, 9-16, 17-128, 129-240 and the striped long-input loop that the
+ * SIMD kernels implement.
+ */
+static const struct xxhash_vector xxhash_vectors[] = {
+    {0, "2d06800538d394c2", "99aa06d3014798d86001c324468d497f"},
+    {3, "5f4299fc161c9cbb", "e3b55f57945a17cf5f4299fc161c9cbb"},
+    {16, "8355e3a6f61770db", "72950631827607e2842812cc870dcae2"},
+    {128, "85c6174c7ff4c46b", "14792fc3af88dc6c05321a0b64d67b41"},
+    {129, "ec7642b431ba3e5a", "dd5e74ac6b45f54ebc30b63382b09a3b"},
+    {240, "375a384d957fe865", "65b5be86da5540e7c92b68e16f83bbb6"},
+    {241, "02e8cd95421c6d02", "1da1cb61bcb8a2a102e8cd95421c6d02"},
+    {1024, "e5d78bafa45b2aa5", "d0ac1f7b93bf57b9e5d78bafa45b2aa5"},
+    {2048, "25339063db861586", "a5141efedfefc1af25339063db861586"},
+    {100003, "acf33ba3cf61e369", "b02e921ecad88f0facf33ba3cf61e369"}};
+
+TEST test_xxhash_vectors(enum acquire_xxhash_kernel kernel) {
+  const size_t max_len = 100003;
+  unsigned char *buf;
+  char hex[33];
+  size_t i;
+
+  if (!acquire_xxhash_kernel_supported(kernel))
+    SKIPm("xxHash kernel not supported on this CPU");
+
+  buf = (unsigned char *)malloc(max_len);
+  ASSERT(buf != NULL);
+  for (i = 0; i < max_len; i++)
+    buf[i] = (unsigned char)(i % 251);
+  for (i = 0; i < sizeof(xxhash_vectors) / sizeof(xxhash_vectors[0]); i++) {
+    const struct xxhash_vector *v = &xxhash_vectors[i];
+    if (acquire_xxhash_hex(LIBACQUIRE_XXH3_64, kernel, buf, v->len, hex) != 0 ||
+        strcmp(hex, v->xxh3_64) != 0) {
+      free(buf);
+      ASSERT_STR_EQ(v->xxh3_64, hex);
+    }
+    if (acquire_xxhash_hex(LIBACQUIRE_XXH128, kernel, buf, v->len, hex) != 0 ||
+        strcmp(hex, v->xxh128) != 0) {
+      free(buf);
+      ASSERT_STR_EQ(v->xxh128, hex);
+    }
+  }
+  free(buf);
+  ASSERT_EQ(-1, acquire_xxhash_hex(LIBACQUIRE_SHA256, kernel, "", 0, hex));
+  PASS();
+}
+
+TEST test_xxhash_string2checksum(void) {
+  ASSERT_EQ(LIBACQUIRE_XXH3_64, string2checksum("xxh3"));
+  ASSERT_EQ(LIBACQUIRE_XXH3_64, string2checksum("XXH3_64"));
+  ASSERT_EQ(LIBACQUIRE_XXH128, string2checksum("xxh128"));
+  ASSERT(acquire_xxhash_kernel_supported(acquire_xxhash_active_kernel()));
+  PASS();
+}
+
+TEST test_xxhash_verify(void) {
+  const size_t len = 3 * 1048576 + 11;
+  const struct test_pattern pattern = {1, 0, 251};
+  struct acquire_handle *h = acquire_handle_init();
+  ASSERT(h != NULL);
+  ASSERT_EQ(0, test_write_pattern(XXHASH_FILE_PATH, len, &pattern));
+
+  ASSERT_EQ(0, acquire_verify_sync(h, XXHASH_FILE_PATH, LIBACQUIRE_XXH3_64,
+                                   "cf76fd988cdc6a49"));
+  ASSERT_EQ(ACQUIRE_BACKEND_CHECKSUM_XXHASH, h->active_backend);
+  ASSERT_EQ((off_t)len, h->bytes_processed);
+  ASSERT_EQ(0, acquire_verify_sync(h, XXHASH_FILE_PATH, LIBACQUIRE_XXH128,
+                                   "BCE8EA590D528F8ECF76FD988CDC6A49"));
+  ASSERT(is_downloaded(XXHASH_FILE_PATH, LIBACQUIRE_XXH128,
+                       "bce8ea590d528f8ecf76fd988cdc6a49", NULL));
+
+  ASSERT_EQ(-1, acquire_verify_sync(h, XXHASH_FILE_PATH, LIBACQUIRE_XXH3_64,
+                                    "cf76fd988cdc6a48"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNKNOWN, acquire_handle_get_error_code(h));
+  /* A 64-bit digest is not a valid XXH128 one */
+  ASSERT_EQ(-1, acquire_verify_sync(h, XXHASH_FILE_PATH, LIBACQUIRE_XXH128,
+                                    "cf76fd988cdc6a49"));
+  ASSERT_EQ(ACQUIRE_ERROR_UNSUPPORTED_CHECKSUM_FORMAT,
+            acquire_handle_get_error_code(h));
+
+  acquire_handle_free(h);
+  remove(XXHASH_FILE_PATH);
+  PASS();
+}
+
+SUITE(xxhash_suite) {
+  static const enum acquire_xxhash_kernel kernels[] = {
+      ACQUIRE_XXHASH_KERNEL_BASELINE, ACQUIRE_XXHASH_KERNEL_AVX2,
+      ACQUIRE_XXHASH_KERNEL_AVX512};
+  size_t i;
+  for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    RUN_TEST1(test_xxhash_vectors, kernels[i]);
+  RUN_TEST(test_xxhash_string2checksum);
+  RUN_TEST(test_xxhash_verify);
+}
+
+#endif /* !TEST_XXHASH_H */
@@ -18,12 +18,23 @@ function(generate_amalgamation_header)
             "acquire/acquire_common_defs.h"
 
             # Crypto
+            "acquire/acquire_file_reader.h"
+            "acquire/acquire_executor.h"
+            "acquire/acquire_digest_pool.h"
             "acquire/acquire_openssl.h"
             "acquire/acquire_wincrypt.h"
             # "acquire/acquire_winseccng.h"
             "acquire/acquire_openssl.h"
             "acquire/acquire_crc32c.h"
+            "acquire/acquire_blake3.h"
+            "acquire/acquire_sha2.h"
+            "acquire/acquire_af_alg.h"
             "acquire/acquire_librhash.h"
+            "acquire/acquire_multi_digest.h"
+            "acquire/acquire_calibrate.h"
+            "acquire/acquire_batch_reader.h"
+            "acquire/acquire_manifest.h"
+            "acquire/acquire_blocks.h"
 
             # Networking
             "acquire/acquire_download.h"
@@ -32,6 +43,7 @@ function(generate_amalgamation_header)
             "acquire/acquire_wininet.h"
             "acquire/acquire_libfetch.h"
 
+            "acquire/acquire_digest_cache.h"
             "acquire/acquire_net_common.h"
 
             # Archiving